@@ -21,9 +21,7 @@ unix {
 MOC_DIR=.moc
 OBJECTS_DIR=.obj
 
-# Note: we need the script module to parse JSON fragments as part of the
-# fronius solar API.
-QT += core network dbus script xml
+QT += core network dbus xml
 QT -= gui
 
 TARGET = dbus-fronius
@@ -37,10 +35,6 @@ include(src/json/json.pri)
 include(ext/qslog/QsLog.pri)
 include(ext/velib/src/qt/ve_qitems.pri)
 
-# Fronius SolarAPI still uses QHttp, and porting to QT5 is not possible
-# because QNetworkAccessManager is a CPU hog.
-equals(QT_MAJOR_VERSION, 5): include(src/qhttp/qhttp.pri)
-
 VELIB_INC = ext/velib/inc/velib/qt
 VELIB_SRC = ext/velib/src/qt
 
@@ -63,7 +57,12 @@ SOURCES += \
     src/inverter_settings.cpp \
     src/fronius_device_info.cpp \
     src/inverter_mediator.cpp \
+    src/latency_statistics.cpp \
+    src/tcp_socket_options.cpp \
     src/modbus_tcp_client/modbus_tcp_client.cpp \
+    src/modbus_tcp_client/modbus_tcp_frame_buffer.cpp \
+    src/modbus_tcp_client/modbus_tcp_client_pool.cpp \
+    src/modbus_tcp_client/modbus_tcp_transport.cpp \
     src/ve_qitem_consumer.cpp \
     src/ve_qitem_init_monitor.cpp \
     src/ve_service.cpp \
@@ -73,10 +72,21 @@ SOURCES += \
     src/fronius_udp_detector.cpp \
     src/modbus_tcp_client/modbus_reply.cpp \
     src/modbus_tcp_client/modbus_client.cpp \
+    src/modbus_tcp_client/modbus_request.cpp \
+    src/modbus_tcp_client/modbus_batch.cpp \
+    src/modbus_tcp_client/modbus_read_plan.cpp \
+    src/modbus_tcp_client/modbus_register_cache.cpp \
+    src/modbus_tcp_client/modbus_shadow_registers.cpp \
+    src/modbus_tcp_client/modbus_deadline_queue.cpp \
+    src/modbus_tcp_client/crc16.cpp \
     src/sunspec_tools.cpp \
     src/gateway_interface.cpp \
     src/sunspec_updater.cpp \
     src/solar_api_updater.cpp \
+    src/solar_api_system_poller.cpp \
+    src/solar_api_session.cpp \
+    src/http_client.cpp \
+    src/http_response_parser.cpp \
     src/data_processor.cpp \
     src/sma_detector.cpp \
     src/sma_inverter.cpp \
@@ -96,8 +106,14 @@ HEADERS += \
     src/defines.h \
     src/fronius_device_info.h \
     src/inverter_mediator.h \
+    src/latency_statistics.h \
+    src/tcp_socket_options.h \
     src/velib/velib_config_app.h \
     src/modbus_tcp_client/modbus_tcp_client.h \
+    src/modbus_tcp_client/modbus_tcp_frame_buffer.h \
+    src/modbus_tcp_client/modbus_tcp_client_pool.h \
+    src/modbus_tcp_client/modbus_tcp_transport.h \
+    src/modbus_tcp_client/modbus_spsc_queue.h \
     src/ve_qitem_consumer.h \
     src/ve_qitem_init_monitor.h \
     src/ve_service.h \
@@ -106,11 +122,24 @@ HEADERS += \
     src/sunspec_detector.h \
     src/fronius_udp_detector.h \
     src/modbus_tcp_client/modbus_reply.h \
+    src/modbus_tcp_client/modbus_register_view.h \
     src/modbus_tcp_client/modbus_client.h \
+    src/modbus_tcp_client/modbus_request.h \
+    src/modbus_tcp_client/modbus_object_pool.h \
+    src/modbus_tcp_client/modbus_batch.h \
+    src/modbus_tcp_client/modbus_read_plan.h \
+    src/modbus_tcp_client/modbus_register_cache.h \
+    src/modbus_tcp_client/modbus_shadow_registers.h \
+    src/modbus_tcp_client/modbus_deadline_queue.h \
+    src/modbus_tcp_client/crc16.h \
     src/sunspec_tools.h \
     src/gateway_interface.h \
     src/sunspec_updater.h \
     src/solar_api_updater.h \
+    src/solar_api_system_poller.h \
+    src/solar_api_session.h \
+    src/http_client.h \
+    src/http_response_parser.h \
     src/data_processor.h \
     src/sma_detector.h \
     src/sma_inverter.h \
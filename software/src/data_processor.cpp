@@ -11,6 +11,9 @@ DataProcessor::DataProcessor(Inverter *inverter, InverterSettings *settings, QOb
 	mSettings(settings),
 	mPreviousTotalEnergy(-1)
 {
+	mPhaseWeights[0] = 0;
+	mPhaseWeights[1] = 0;
+	mPhaseWeights[2] = 0;
 }
 
 void DataProcessor::process(const CommonInverterData &data)
@@ -66,6 +69,9 @@ void DataProcessor::process(const ThreePhasesInverterData &data)
 	if (totalVi > 0) {
 		powerCorrection = mInverter->meanPowerInfo()->power() / totalVi;
 		energyCorrection = energyDelta / totalVi;
+		mPhaseWeights[0] = vi1 / totalVi;
+		mPhaseWeights[1] = vi2 / totalVi;
+		mPhaseWeights[2] = deviceInfo.phaseCount > 2 ? vi3 / totalVi : 0;
 	}
 
 	PowerInfo *l1 = mInverter->l1PowerInfo();
@@ -91,6 +97,35 @@ void DataProcessor::process(const ThreePhasesInverterData &data)
 	mPreviousTotalEnergy = totalEnergy;
 }
 
+void DataProcessor::process(const InverterSystemValues &data)
+{
+	BasicPowerInfo *pi = mInverter->meanPowerInfo();
+	// Fronius gives us energy in Wh. We need kWh here.
+	pi->setTotalEnergy(data.totalEnergy / 1000);
+	// Phase energy of multi phase inverters is updated along with the voltages and currents in the
+	// 3 phase data.
+	InverterPhase phase = getPhase();
+	if (phase != MultiPhase)
+		mInverter->getPowerInfo(phase)->setTotalEnergy(pi->totalEnergy());
+	processPower(data.acPower);
+}
+
+void DataProcessor::processPower(double acPower)
+{
+	mInverter->meanPowerInfo()->setPower(acPower);
+	InverterPhase phase = getPhase();
+	if (phase != MultiPhase) {
+		mInverter->getPowerInfo(phase)->setPower(acPower);
+		return;
+	}
+	if (mPhaseWeights[0] + mPhaseWeights[1] + mPhaseWeights[2] <= 0)
+		return;
+	mInverter->l1PowerInfo()->setPower(acPower * mPhaseWeights[0]);
+	mInverter->l2PowerInfo()->setPower(acPower * mPhaseWeights[1]);
+	if (mInverter->deviceInfo().phaseCount > 2)
+		mInverter->l3PowerInfo()->setPower(acPower * mPhaseWeights[2]);
+}
+
 void DataProcessor::updateEnergySettings()
 {
 	updateEnergySettings(PhaseL1);
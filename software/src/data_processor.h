@@ -7,6 +7,7 @@
 class Inverter;
 class InverterSettings;
 struct CommonInverterData;
+struct InverterSystemValues;
 struct ThreePhasesInverterData;
 
 /*!
@@ -29,6 +30,19 @@ public:
 
 	void process(const ThreePhasesInverterData &data);
 
+	/*!
+	 * @brief Updates power and total energy from a `Scope=System` request.
+	 * On multi phase inverters the power is distributed over the phases
+	 * using the weights from the last ThreePhasesInverterData.
+	 */
+	void process(const InverterSystemValues &data);
+
+	/*!
+	 * @brief Updates the power only, eg. from the power flow data. Power is
+	 * distributed over the phases like in `process(InverterSystemValues)`.
+	 */
+	void processPower(double acPower);
+
 	void updateEnergySettings();
 
 private:
@@ -44,6 +58,8 @@ private:
 	Inverter *mInverter;
 	InverterSettings *mSettings;
 	double mPreviousTotalEnergy;
+	/// Fraction of the total power on each phase, as computed from the last 3 phase data.
+	double mPhaseWeights[3];
 };
 
 #endif // FRONIUSDATAPROCESSOR_H
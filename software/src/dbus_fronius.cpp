@@ -1,4 +1,5 @@
 #include <QsLog.h>
+#include <QTimer>
 #include "dbus_fronius.h"
 #include "defines.h"
 #include "inverter_gateway.h"
@@ -14,12 +15,17 @@ DBusFronius::DBusFronius(QObject *parent) :
 	mSettings(new Settings(VeQItems::getRoot()->itemGetOrCreate("sub/com.victronenergy.settings/Settings/Fronius", false), this)),
 	mAutoDetect(createItem("AutoDetect")),
 	mScanProgress(createItem("ScanProgress")),
-	mGateway(new InverterGateway(mSettings, this))
+	mGateway(new InverterGateway(mSettings, this)),
+	mLatencyTimer(new QTimer(this))
 {
 	connect(mGateway, SIGNAL(inverterFound(DeviceInfo)), this, SLOT(onInverterFound(DeviceInfo)));
 	connect(mGateway, SIGNAL(autoDetectChanged()), this, SLOT(onAutoDetectChanged()));
 	connect(mGateway, SIGNAL(scanProgressChanged()), this, SLOT(onScanProgressChanged()));
 
+	mLatencyTimer->setInterval(10000);
+	connect(mLatencyTimer, SIGNAL(timeout()), this, SLOT(onLatencyTimer()));
+	mLatencyTimer->start();
+
 	VeQItemInitMonitor::monitor(mSettings->root(), this, SLOT(onSettingsInitialized()));
 	registerService();
 }
@@ -86,3 +92,31 @@ void DBusFronius::onAutoDetectChanged()
 	}
 	produceValue(mAutoDetect, 0, "Idle");
 }
+
+void DBusFronius::onLatencyTimer()
+{
+	static const int Percentiles[] = { 50, 90, 99 };
+	LatencyStatistics &statistics = LatencyStatistics::instance();
+	foreach (const QString &key, statistics.keys()) {
+		const LatencyStatistics::Entry *entry = statistics.entry(key);
+		QString path = "Latency/" + key + "/";
+		for (int s=0; s<LatencyStatistics::StageCount; ++s) {
+			LatencyStatistics::Stage stage = static_cast<LatencyStatistics::Stage>(s);
+			QString stagePath = path + LatencyStatistics::stageName(stage);
+			// Only the transactions since the previous update are published.
+			LatencyHistogram::Snapshot &previous = mLatencySnapshots[stagePath];
+			LatencyHistogram::Snapshot current = entry->histogram(stage).snapshot();
+			LatencyHistogram::Snapshot interval = current - previous;
+			previous = current;
+			if (stage == LatencyStatistics::TotalStage)
+				produceValue(createItem(path + "Count"), interval.count());
+			for (size_t i=0; i<sizeof(Percentiles) / sizeof(Percentiles[0]); ++i) {
+				int p = Percentiles[i];
+				int value = interval.percentile(p);
+				produceValue(createItem(stagePath + "/P" + QString::number(p)),
+							 value < 0 ? QVariant() : QVariant(value),
+							 value < 0 ? QString() : QString("%1ms").arg(value));
+			}
+		}
+	}
+}
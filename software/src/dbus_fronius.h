@@ -1,11 +1,14 @@
 #ifndef DBUS_TEST2_H
 #define DBUS_TEST2_H
 
+#include <QHash>
 #include "gateway_interface.h"
+#include "latency_statistics.h"
 #include "ve_service.h"
 
 class InverterGateway;
 class InverterMediator;
+class QTimer;
 class Settings;
 class VeQItem;
 
@@ -16,6 +19,12 @@ struct DeviceInfo;
  *
  * It acts as a composite GatewayInterface, as a D-Bus publisher of the
  * 'com.victronenergy.fronius` service, and as createor of the `InverterMediator` classes.
+ *
+ * The latency statistics of all Modbus and Solar API transactions (see `LatencyStatistics`) are
+ * published as percentiles (ms) in the /Latency subtree, like
+ * `/Latency/Modbus/192_168_1_10/126/3/Total/P90` and `/Latency/SolarApi/<host>/<request>/...`.
+ * The percentiles and the count cover the transactions completed since the previous update, so a
+ * change in latency shows up right away instead of being averaged out over the uptime.
  */
 class DBusFronius : public VeService, public GatewayInterface
 {
@@ -36,12 +45,17 @@ private slots:
 
 	void onAutoDetectChanged();
 
+	void onLatencyTimer();
+
 private:
 	QList<InverterMediator *> mMediators;
 	Settings *mSettings;
 	VeQItem *mAutoDetect;
 	VeQItem *mScanProgress;
 	InverterGateway *mGateway;
+	QTimer *mLatencyTimer;
+	/// Histograms at the previous latency update, keyed by D-Bus path of the stage.
+	QHash<QString, LatencyHistogram::Snapshot> mLatencySnapshots;
 };
 
 #endif // DBUS_TEST2_H
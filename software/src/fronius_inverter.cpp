@@ -1,5 +1,6 @@
 #include "ve_service.h"
 #include "fronius_inverter.h"
+#include "modbus_register_view.h"
 
 // Fronius inverters send a null payload during certain solar net timeouts. We
 // want to filter for those.
@@ -15,7 +16,7 @@ FroniusInverter::FroniusInverter(VeQItem *root, const DeviceInfo &deviceInfo,
 	produceValue(createItem("FroniusDeviceType"), deviceInfo.deviceType);
 }
 
-bool FroniusInverter::validateSunspecMonitorFrame(QVector<quint16> frame)
+bool FroniusInverter::validateSunspecMonitorFrame(const ModbusRegisterView &frame)
 {
 	// When there are communication timeouts between a Fronius
 	// datamanager and the PV-inverters, we will sometimes receive a
@@ -8,7 +8,7 @@ class FroniusInverter : public Inverter
 	Q_OBJECT
 public:
 	FroniusInverter(VeQItem *root, const DeviceInfo &deviceInfo, int deviceInstance, QObject *parent = 0);
-	virtual bool validateSunspecMonitorFrame(QVector<quint16> frame);
+	virtual bool validateSunspecMonitorFrame(const ModbusRegisterView &frame);
 };
 
 #endif // FRONIUS_INVERTER_H
@@ -1,30 +1,458 @@
 #include <QtGlobal>
 #if QT_VERSION >= QT_VERSION_CHECK(5, 0, 0)
 #include <QUrlQuery>
-#include "qhttp/qhttp.h"
-#else
-#include <QHttp>
 #endif
 
 #include <QUrl>
 #include <QsLog.h>
-#include <QStringList>
-#include <QTimer>
 
 #include "froniussolar_api.h"
-#include "json/json.h"
+#include "json/json_reader.h"
+#include "solar_api_session.h"
+
+namespace {
+
+// All paths tables start with the reply status, which is handled by processReply.
+enum StatusPath
+{
+	StatusCodePath,
+	StatusReasonPath,
+	FirstDataPath
+};
+
+#define STATUS_PATHS "Head/Status/Code", "Head/Status/Reason"
+#define PATH_COUNT(p) static_cast<int>(sizeof(p) / sizeof(p[0]))
+
+/// Picks the status from the reply, and passes all other values to the data handler.
+class StatusHandler : public JsonHandler
+{
+public:
+	StatusHandler(JsonHandler &dataHandler):
+		hasCode(false),
+		code(0),
+		mDataHandler(dataHandler)
+	{
+	}
+
+	virtual void onValue(int path, const QByteArray &key, const JsonValue &value)
+	{
+		switch (path) {
+		case StatusCodePath:
+			hasCode = true;
+			code = value.toInt();
+			break;
+		case StatusReasonPath:
+			reason = value.toString();
+			break;
+		default:
+			mDataHandler.onValue(path, key, value);
+			break;
+		}
+	}
+
+	bool hasCode;
+	int code;
+	QString reason;
+
+private:
+	JsonHandler &mDataHandler;
+};
+
+class ConverterInfoHandler : public JsonHandler
+{
+public:
+	enum Path
+	{
+		DeviceTypePath = FirstDataPath,
+		UniqueIdPath,
+		CustomNamePath,
+		ErrorCodePath,
+		InverterStatusPath
+	};
+
+	static const JsonPaths &paths()
+	{
+		static const char *const p[] = {
+			STATUS_PATHS,
+			"Body/Data/*/DT",
+			"Body/Data/*/UniqueID",
+			"Body/Data/*/CustomName",
+			"Body/Data/*/ErrorCode",
+			"Body/Data/*/StatusCode"
+		};
+		static const JsonPaths paths(p, PATH_COUNT(p));
+		return paths;
+	}
+
+	virtual void onValue(int path, const QByteArray &key, const JsonValue &value)
+	{
+		InverterInfo &ii = inverter(key.toInt());
+		switch (path) {
+		case DeviceTypePath:
+			ii.deviceType = value.toInt();
+			break;
+		case UniqueIdPath:
+			ii.uniqueId = value.toString();
+			break;
+		case CustomNamePath:
+			ii.customName = value.toString();
+			break;
+		case ErrorCodePath:
+			ii.errorCode = value.toInt();
+			break;
+		case InverterStatusPath:
+			ii.statusCode = value.toInt();
+			break;
+		}
+	}
+
+	QMap<int, InverterInfo> inverters;
+
+private:
+	InverterInfo &inverter(int id)
+	{
+		QMap<int, InverterInfo>::Iterator it = inverters.find(id);
+		if (it == inverters.end()) {
+			InverterInfo ii;
+			ii.id = id;
+			ii.deviceType = 0;
+			ii.errorCode = 0;
+			ii.statusCode = 0;
+			it = inverters.insert(id, ii);
+		}
+		return it.value();
+	}
+};
+
+class CommonDataHandler : public JsonHandler
+{
+public:
+	enum Path
+	{
+		DeviceIdPath = FirstDataPath,
+		AcPowerPath,
+		AcCurrentPath,
+		AcVoltagePath,
+		AcFrequencyPath,
+		DcCurrentPath,
+		DcVoltagePath,
+		DayEnergyPath,
+		YearEnergyPath,
+		TotalEnergyPath,
+		DeviceStatusPath,
+		DeviceErrorPath
+	};
+
+	static const JsonPaths &paths()
+	{
+		static const char *const p[] = {
+			STATUS_PATHS,
+			"Head/RequestArguments/DeviceId",
+			"Body/Data/PAC/Value",
+			"Body/Data/IAC/Value",
+			"Body/Data/UAC/Value",
+			"Body/Data/FAC/Value",
+			"Body/Data/IDC/Value",
+			"Body/Data/UDC/Value",
+			"Body/Data/DAY_ENERGY/Value",
+			"Body/Data/YEAR_ENERGY/Value",
+			"Body/Data/TOTAL_ENERGY/Value",
+			"Body/Data/DeviceStatus/StatusCode",
+			"Body/Data/DeviceStatus/ErrorCode"
+		};
+		static const JsonPaths paths(p, PATH_COUNT(p));
+		return paths;
+	}
+
+	CommonDataHandler(CommonInverterData &data):
+		mData(data)
+	{
+		mData.acPower = 0;
+		mData.acCurrent = 0;
+		mData.acVoltage = 0;
+		mData.acFrequency = 0;
+		mData.dcCurrent = 0;
+		mData.dcVoltage = 0;
+		mData.dayEnergy = 0;
+		mData.yearEnergy = 0;
+		mData.totalEnergy = 0;
+		mData.statusCode = 0;
+		mData.errorCode = 0;
+	}
+
+	virtual void onValue(int path, const QByteArray &key, const JsonValue &value)
+	{
+		Q_UNUSED(key)
+		switch (path) {
+		case DeviceIdPath:
+			mData.deviceId = value.toString();
+			break;
+		case AcPowerPath:
+			mData.acPower = value.toDouble();
+			break;
+		case AcCurrentPath:
+			mData.acCurrent = value.toDouble();
+			break;
+		case AcVoltagePath:
+			mData.acVoltage = value.toDouble();
+			break;
+		case AcFrequencyPath:
+			mData.acFrequency = value.toDouble();
+			break;
+		case DcCurrentPath:
+			mData.dcCurrent = value.toDouble();
+			break;
+		case DcVoltagePath:
+			mData.dcVoltage = value.toDouble();
+			break;
+		case DayEnergyPath:
+			mData.dayEnergy = value.toDouble();
+			break;
+		case YearEnergyPath:
+			mData.yearEnergy = value.toDouble();
+			break;
+		case TotalEnergyPath:
+			mData.totalEnergy = value.toDouble();
+			break;
+		case DeviceStatusPath:
+			mData.statusCode = value.toInt();
+			break;
+		case DeviceErrorPath:
+			mData.errorCode = value.toInt();
+			break;
+		}
+	}
+
+private:
+	CommonInverterData &mData;
+};
+
+class ThreePhasesDataHandler : public JsonHandler
+{
+public:
+	enum Path
+	{
+		DeviceIdPath = FirstDataPath,
+		AcCurrentPhase1Path,
+		AcVoltagePhase1Path,
+		AcCurrentPhase2Path,
+		AcVoltagePhase2Path,
+		AcCurrentPhase3Path,
+		AcVoltagePhase3Path
+	};
+
+	static const JsonPaths &paths()
+	{
+		static const char *const p[] = {
+			STATUS_PATHS,
+			"Head/RequestArguments/DeviceId",
+			"Body/Data/IAC_L1/Value",
+			"Body/Data/UAC_L1/Value",
+			"Body/Data/IAC_L2/Value",
+			"Body/Data/UAC_L2/Value",
+			"Body/Data/IAC_L3/Value",
+			"Body/Data/UAC_L3/Value"
+		};
+		static const JsonPaths paths(p, PATH_COUNT(p));
+		return paths;
+	}
+
+	ThreePhasesDataHandler(ThreePhasesInverterData &data):
+		mData(data)
+	{
+		mData.acCurrentPhase1 = 0;
+		mData.acVoltagePhase1 = 0;
+		mData.acCurrentPhase2 = 0;
+		mData.acVoltagePhase2 = 0;
+		mData.acCurrentPhase3 = 0;
+		mData.acVoltagePhase3 = 0;
+	}
+
+	virtual void onValue(int path, const QByteArray &key, const JsonValue &value)
+	{
+		Q_UNUSED(key)
+		switch (path) {
+		case DeviceIdPath:
+			mData.deviceId = value.toString();
+			break;
+		case AcCurrentPhase1Path:
+			mData.acCurrentPhase1 = value.toDouble();
+			break;
+		case AcVoltagePhase1Path:
+			mData.acVoltagePhase1 = value.toDouble();
+			break;
+		case AcCurrentPhase2Path:
+			mData.acCurrentPhase2 = value.toDouble();
+			break;
+		case AcVoltagePhase2Path:
+			mData.acVoltagePhase2 = value.toDouble();
+			break;
+		case AcCurrentPhase3Path:
+			mData.acCurrentPhase3 = value.toDouble();
+			break;
+		case AcVoltagePhase3Path:
+			mData.acVoltagePhase3 = value.toDouble();
+			break;
+		}
+	}
+
+private:
+	ThreePhasesInverterData &mData;
+};
+
+class DeviceInfoHandler : public JsonHandler
+{
+public:
+	enum Path
+	{
+		SerialPath = FirstDataPath
+	};
+
+	static const JsonPaths &paths()
+	{
+		static const char *const p[] = {
+			STATUS_PATHS,
+			"Body/Data/*/Serial"
+		};
+		static const JsonPaths paths(p, PATH_COUNT(p));
+		return paths;
+	}
+
+	DeviceInfoHandler(DeviceInfoData &data):
+		mData(data)
+	{
+	}
+
+	virtual void onValue(int path, const QByteArray &key, const JsonValue &value)
+	{
+		if (path == SerialPath)
+			mData.serialInfo[key.toInt()] = value.toString();
+	}
+
+private:
+	DeviceInfoData &mData;
+};
+
+class SystemDataHandler : public JsonHandler
+{
+public:
+	enum Path
+	{
+		AcPowerPath = FirstDataPath,
+		DayEnergyPath,
+		YearEnergyPath,
+		TotalEnergyPath
+	};
+
+	static const JsonPaths &paths()
+	{
+		static const char *const p[] = {
+			STATUS_PATHS,
+			"Body/Data/PAC/Values/*",
+			"Body/Data/DAY_ENERGY/Values/*",
+			"Body/Data/YEAR_ENERGY/Values/*",
+			"Body/Data/TOTAL_ENERGY/Values/*"
+		};
+		static const JsonPaths paths(p, PATH_COUNT(p));
+		return paths;
+	}
+
+	SystemDataHandler(SystemInverterData &data):
+		mData(data)
+	{
+	}
+
+	virtual void onValue(int path, const QByteArray &key, const JsonValue &value)
+	{
+		InverterSystemValues &v = values(key.toInt());
+		switch (path) {
+		case AcPowerPath:
+			v.acPower = value.toDouble();
+			break;
+		case DayEnergyPath:
+			v.dayEnergy = value.toDouble();
+			break;
+		case YearEnergyPath:
+			v.yearEnergy = value.toDouble();
+			break;
+		case TotalEnergyPath:
+			v.totalEnergy = value.toDouble();
+			break;
+		}
+	}
+
+private:
+	InverterSystemValues &values(int id)
+	{
+		QMap<int, InverterSystemValues>::Iterator it = mData.inverters.find(id);
+		if (it == mData.inverters.end()) {
+			InverterSystemValues v;
+			v.acPower = 0;
+			v.dayEnergy = 0;
+			v.yearEnergy = 0;
+			v.totalEnergy = 0;
+			it = mData.inverters.insert(id, v);
+		}
+		return it.value();
+	}
+
+	SystemInverterData &mData;
+};
+
+class PowerFlowDataHandler : public JsonHandler
+{
+public:
+	enum Path
+	{
+		InverterPowerPath = FirstDataPath
+	};
+
+	static const JsonPaths &paths()
+	{
+		static const char *const p[] = {
+			STATUS_PATHS,
+			"Body/Data/Inverters/*/P"
+		};
+		static const JsonPaths paths(p, PATH_COUNT(p));
+		return paths;
+	}
+
+	PowerFlowDataHandler(PowerFlowData &data):
+		mData(data)
+	{
+	}
+
+	virtual void onValue(int path, const QByteArray &key, const JsonValue &value)
+	{
+		// The power is null when the inverter is not producing (eg. at night), which gives 0.
+		if (path == InverterPowerPath)
+			mData.inverterPower.insert(key.toInt(), value.toDouble());
+	}
+
+private:
+	PowerFlowData &mData;
+};
+
+}
 
 FroniusSolarApi::FroniusSolarApi(const QString &hostName, int port, int timeout,
 								 QObject *parent) :
 	QObject(parent),
-	mHttp(0),
+	mSession(0),
 	mHostName(hostName),
 	mPort(port),
-	mTimeoutTimer(new QTimer(this))
+	mTimeout(timeout),
+	mReplyId(0)
+{
+	mClock.start();
+	updateSession();
+}
+
+FroniusSolarApi::~FroniusSolarApi()
 {
-	mTimeoutTimer->setInterval(timeout);
-	connect(mTimeoutTimer, SIGNAL(timeout()), this, SLOT(onTimeout()));
-	updateHttpClient();
+	cancel();
+	disconnect(mSession, 0, this, 0);
+	SolarApiSession::release(mSession);
 }
 
 QString FroniusSolarApi::hostName() const
@@ -37,7 +465,7 @@ void FroniusSolarApi::setHostName(const QString &h)
 	if (mHostName == h)
 		return;
 	mHostName = h;
-	updateHttpClient();
+	updateSession();
 }
 
 int FroniusSolarApi::port() const
@@ -57,16 +485,16 @@ void FroniusSolarApi::setPort(int port)
 	if (mPort == port)
 		return;
 	mPort = port;
-	updateHttpClient();
+	updateSession();
 }
 
-void FroniusSolarApi::getConverterInfoAsync()
+SolarApiRequest FroniusSolarApi::getConverterInfoAsync(int timeout)
 {
 	QUrl url = baseUrl("/solar_api/v1/GetInverterInfo.cgi");
-	sendGetRequest(url, "getInverterInfo");
+	return sendGetRequest(url, SolarApiRequest::ConverterInfo, timeout);
 }
 
-void FroniusSolarApi::getCommonDataAsync(int deviceId)
+SolarApiRequest FroniusSolarApi::getCommonDataAsync(int deviceId, int timeout)
 {
 	QUrl url = baseUrl("/solar_api/v1/GetInverterRealtimeData.cgi");
 
@@ -81,10 +509,10 @@ void FroniusSolarApi::getCommonDataAsync(int deviceId)
 	url.addQueryItem("DeviceId", QString::number(deviceId));
 	url.addQueryItem("DataCollection", "CommonInverterData");
 	#endif
-	sendGetRequest(url, "getCommonData");
+	return sendGetRequest(url, SolarApiRequest::CommonData, timeout);
 }
 
-void FroniusSolarApi::getThreePhasesInverterDataAsync(int deviceId)
+SolarApiRequest FroniusSolarApi::getThreePhasesInverterDataAsync(int deviceId, int timeout)
 {
 	QUrl url = baseUrl("/solar_api/v1/GetInverterRealtimeData.cgi");
 	#if QT_VERSION >= QT_VERSION_CHECK(5, 0, 0)
@@ -98,10 +526,10 @@ void FroniusSolarApi::getThreePhasesInverterDataAsync(int deviceId)
 	url.addQueryItem("DeviceId", QString::number(deviceId));
 	url.addQueryItem("DataCollection", "3PInverterData");
 	#endif
-	sendGetRequest(url, "getThreePhasesInverterData");
+	return sendGetRequest(url, SolarApiRequest::ThreePhasesData, timeout);
 }
 
-void FroniusSolarApi::getDeviceInfoAsync()
+SolarApiRequest FroniusSolarApi::getDeviceInfoAsync(int timeout)
 {
 	QUrl url = baseUrl("/solar_api/v1/GetActiveDeviceInfo.cgi");
 	#if QT_VERSION >= QT_VERSION_CHECK(5, 0, 0)
@@ -111,137 +539,189 @@ void FroniusSolarApi::getDeviceInfoAsync()
 	#else
 	url.addQueryItem("DeviceClass", "Inverter");
 	#endif
-	sendGetRequest(url, "getDeviceInfo");
+	return sendGetRequest(url, SolarApiRequest::DeviceInfo, timeout);
+}
+
+SolarApiRequest FroniusSolarApi::getSystemDataAsync(int timeout)
+{
+	QUrl url = baseUrl("/solar_api/v1/GetInverterRealtimeData.cgi");
+	#if QT_VERSION >= QT_VERSION_CHECK(5, 0, 0)
+	QUrlQuery query;
+	query.addQueryItem("Scope", "System");
+	url.setQuery(query);
+	#else
+	url.addQueryItem("Scope", "System");
+	#endif
+	return sendGetRequest(url, SolarApiRequest::SystemData, timeout);
+}
+
+SolarApiRequest FroniusSolarApi::getPowerFlowDataAsync(int timeout)
+{
+	QUrl url = baseUrl("/solar_api/v1/GetPowerFlowRealtimeData.fcgi");
+	return sendGetRequest(url, SolarApiRequest::PowerFlow, timeout);
+}
+
+void FroniusSolarApi::cancel(const SolarApiRequest &request)
+{
+	if (mRequests.remove(request.id()) > 0)
+		mSession->cancel(request.id());
+}
+
+void FroniusSolarApi::cancel()
+{
+	foreach (int id, mRequests.keys())
+		mSession->cancel(id);
+	mRequests.clear();
+}
+
+int FroniusSolarApi::pendingRequestCount() const
+{
+	return mRequests.size();
 }
 
-void FroniusSolarApi::onDone(bool error)
+void FroniusSolarApi::onRequestStarted(int id)
 {
-	processRequest(error ? mHttp->errorString() : QString());
+	QHash<int, PendingRequest>::Iterator it = mRequests.find(id);
+	if (it != mRequests.end() && it->timestamps.written < 0)
+		it->timestamps.written = mClock.elapsed();
 }
 
-void FroniusSolarApi::onTimeout()
+void FroniusSolarApi::onFirstByteReceived(int id)
 {
-	// During call to abort onRequestFinished will be called.
-	mHttp->abort();
+	QHash<int, PendingRequest>::Iterator it = mRequests.find(id);
+	if (it != mRequests.end() && it->timestamps.firstByte < 0)
+		it->timestamps.firstByte = mClock.elapsed();
+}
+
+void FroniusSolarApi::onRequestFinished(int id, const QString &error, const QByteArray &body)
+{
+	// The session is shared with other FroniusSolarApi objects on the same host.
+	QHash<int, PendingRequest>::Iterator it = mRequests.find(id);
+	if (it == mRequests.end())
+		return;
+	mReply = it.value();
+	mReply.timestamps.completed = mClock.elapsed();
+	mRequests.erase(it);
+	mReplyId = id;
+	mReplyBody = body;
+	processRequest(mReply.type, error);
+	mReplyId = 0;
+	mReplyBody.clear();
 }
 
 void FroniusSolarApi::processConverterInfo(const QString &networkError)
 {
 	InverterListData data;
-	QVariantMap map;
-	processReply(networkError, data, map);
-	QVariantMap devices = getByPath(map, "Body/Data").toMap();
-	for (QVariantMap::Iterator it = devices.begin();
-		 it != devices.end();
-		 ++it) {
-		InverterInfo ii;
-		ii.id = it.key().toInt();
-		QVariantMap di = it.value().toMap();
-		ii.deviceType = di["DT"].toInt();
-		ii.uniqueId = di["UniqueID"].toString();
-		ii.customName = di["CustomName"].toString();
-		ii.errorCode = di["ErrorCode"].toInt();
-		ii.statusCode = di["StatusCode"].toInt();
-		data.inverters.push_back(ii);
-	}
+	ConverterInfoHandler handler;
+	processReply(networkError, data, ConverterInfoHandler::paths(), handler);
+	data.inverters = handler.inverters.values();
 	emit converterInfoFound(data);
 }
 
 void FroniusSolarApi::processCommonData(const QString &networkError)
 {
 	CommonInverterData data;
-	QVariantMap map;
-	processReply(networkError, data, map);
-	data.deviceId = getByPath(map, "Head/RequestArguments/DeviceId").toString();
-	QVariant d = getByPath(map, "Body/Data");
-	data.acPower = getByPath(d, "PAC/Value").toDouble();
-	data.acCurrent = getByPath(d, "IAC/Value").toDouble();
-	data.acVoltage = getByPath(d, "UAC/Value").toDouble();
-	data.acFrequency = getByPath(d, "FAC/Value").toDouble();
-	data.dcCurrent = getByPath(d, "IDC/Value").toDouble();
-	data.dcVoltage = getByPath(d, "UDC/Value").toDouble();
-	data.dayEnergy = getByPath(d, "DAY_ENERGY/Value").toDouble();
-	data.yearEnergy = getByPath(d, "YEAR_ENERGY/Value").toDouble();
-	data.totalEnergy = getByPath(d, "TOTAL_ENERGY/Value").toDouble();
-	data.statusCode = getByPath(d, "DeviceStatus/StatusCode").toInt();
-	data.errorCode = getByPath(d, "DeviceStatus/ErrorCode").toInt();
+	CommonDataHandler handler(data);
+	processReply(networkError, data, CommonDataHandler::paths(), handler);
 	emit commonDataFound(data);
 }
 
 void FroniusSolarApi::processThreePhasesData(const QString &networkError)
 {
 	ThreePhasesInverterData data;
-	QVariantMap map;
-	processReply(networkError, data, map);
-	data.deviceId = getByPath(map, "Head/RequestArguments/DeviceId").toString();
-	QVariant d = getByPath(map, "Body/Data");
-	data.acCurrentPhase1 = getByPath(d, "IAC_L1/Value").toDouble();
-	data.acVoltagePhase1 = getByPath(d, "UAC_L1/Value").toDouble();
-	data.acCurrentPhase2 = getByPath(d, "IAC_L2/Value").toDouble();
-	data.acVoltagePhase2 = getByPath(d, "UAC_L2/Value").toDouble();
-	data.acCurrentPhase3 = getByPath(d, "IAC_L3/Value").toDouble();
-	data.acVoltagePhase3 = getByPath(d, "UAC_L3/Value").toDouble();
+	ThreePhasesDataHandler handler(data);
+	processReply(networkError, data, ThreePhasesDataHandler::paths(), handler);
 	emit threePhasesDataFound(data);
 }
 
 void FroniusSolarApi::processDeviceInfo(const QString &networkError)
 {
-	QVariantMap map;
 	DeviceInfoData data;
-	processReply(networkError, data, map);
-	QVariantMap devices = getByPath(map, "Body/Data").toMap();
-	for (QVariantMap::Iterator it = devices.begin(); it != devices.end(); ++it) {
-		QVariantMap di = it.value().toMap();
-		data.serialInfo[it.key().toInt()] = di["Serial"].toString();
-	}
+	DeviceInfoHandler handler(data);
+	processReply(networkError, data, DeviceInfoHandler::paths(), handler);
 	emit deviceInfoFound(data);
 }
 
-void FroniusSolarApi::sendGetRequest(const QUrl &request, const QString &id)
+void FroniusSolarApi::processSystemData(const QString &networkError)
+{
+	SystemInverterData data;
+	SystemDataHandler handler(data);
+	processReply(networkError, data, SystemDataHandler::paths(), handler);
+	emit systemDataFound(data);
+}
+
+void FroniusSolarApi::processPowerFlowData(const QString &networkError)
 {
-	Q_ASSERT(mRequestType.isEmpty());
-	mHttp->get(request.toString());
-	mRequestType = id;
-	mTimeoutTimer->start();
+	PowerFlowData data;
+	PowerFlowDataHandler handler(data);
+	processReply(networkError, data, PowerFlowDataHandler::paths(), handler);
+	emit powerFlowDataFound(data);
 }
 
-void FroniusSolarApi::processRequest(const QString &networkError)
+SolarApiRequest FroniusSolarApi::sendGetRequest(const QUrl &request,
+												SolarApiRequest::Type type, int timeout)
 {
-	if (mRequestType == "getInverterInfo") {
+	PendingRequest pending;
+	pending.type = type;
+	pending.timestamps.enqueued = mClock.elapsed();
+	int id = mSession->get(request.toString(), timeout < 0 ? mTimeout : timeout);
+	mRequests.insert(id, pending);
+	return SolarApiRequest(type, id);
+}
+
+void FroniusSolarApi::processRequest(SolarApiRequest::Type type, const QString &networkError)
+{
+	switch (type) {
+	case SolarApiRequest::ConverterInfo:
 		processConverterInfo(networkError);
-	} else if (mRequestType == "getCommonData") {
+		break;
+	case SolarApiRequest::CommonData:
 		processCommonData(networkError);
-	} else if (mRequestType == "getThreePhasesInverterData") {
+		break;
+	case SolarApiRequest::ThreePhasesData:
 		processThreePhasesData(networkError);
-	} else if (mRequestType == "getDeviceInfo") {
+		break;
+	case SolarApiRequest::DeviceInfo:
 		processDeviceInfo(networkError);
+		break;
+	case SolarApiRequest::SystemData:
+		processSystemData(networkError);
+		break;
+	case SolarApiRequest::PowerFlow:
+		processPowerFlowData(networkError);
+		break;
+	case SolarApiRequest::InvalidRequest:
+		break;
 	}
 }
 
 void FroniusSolarApi::processReply(const QString &networkError,
 								   SolarApiReply &apiReply,
-								   QVariantMap &map)
+								   const JsonPaths &paths,
+								   JsonHandler &handler)
 {
-	mRequestType.clear();
-	mTimeoutTimer->stop();
+	apiReply.requestId = mReplyId;
 	// Some error will be logged with QLOG_DEBUG because they occur often during
 	// a device scan and would fill the log with a lot of useless information.
 	if (!networkError.isEmpty()) {
 		apiReply.error = SolarApiReply::NetworkError;
-		apiReply.errorMessage = mHttp->errorString();
+		apiReply.errorMessage = networkError;
 		QLOG_DEBUG() << "Network error:" << apiReply.errorMessage << mHostName;
 		return;
 	}
-	QByteArray bytes = mHttp->readAll();
-	QString result(QString::fromLocal8Bit(bytes));
-	// CCGX does not receive reply from subsequent requests if we don't do this.
-	mHttp->close();
-	QLOG_TRACE() << result;
-	if (!result.isEmpty()) {
-		map = JSON::instance().parse(result).toMap();
+	const QByteArray &bytes = mReplyBody;
+	QLOG_TRACE() << QString::fromUtf8(bytes);
+	StatusHandler status(handler);
+	bool valid = false;
+	if (!bytes.isEmpty()) {
+		JsonReader reader(paths);
+		valid = reader.read(bytes, status);
+		if (!valid) {
+			QLOG_DEBUG() << "Invalid JSON:" << reader.errorString() << "at offset"
+						 << reader.errorOffset() << mHostName;
+		}
 	}
-	QVariantMap status = getByPath(map, "Head/Status").toMap();
-	if (!status.contains("Code")) {
+	if (!valid || !status.hasCode) {
 		apiReply.error = SolarApiReply::NetworkError;
 		apiReply.errorMessage = "Reply message has no status "
 								"(we're probably talking to a device "
@@ -249,33 +729,60 @@ void FroniusSolarApi::processReply(const QString &networkError,
 		QLOG_DEBUG() << "Network error:" << apiReply.errorMessage << mHostName;
 		return;
 	}
-	int errorCode = status["Code"].toInt();
-	if (errorCode != 0)
+	if (status.code != 0)
 	{
 		apiReply.error = SolarApiReply::ApiError;
-		apiReply.errorMessage = status["Reason"].toString();
+		apiReply.errorMessage = status.reason;
 		QLOG_DEBUG() << "Fronius solar API error:" << apiReply.errorMessage;
 		return;
 	}
 	apiReply.error = SolarApiReply::NoError;
+	// Only successful requests are recorded, otherwise a device scan would add statistics for
+	// every host on the network.
+	recordLatency();
+}
+
+void FroniusSolarApi::updateSession()
+{
+	cancel();
+	if (mSession != 0) {
+		disconnect(mSession, 0, this, 0);
+		SolarApiSession::release(mSession);
+	}
+	mSession = SolarApiSession::acquire(mHostName, mPort);
+	connect(mSession, SIGNAL(requestStarted(int)),
+			this, SLOT(onRequestStarted(int)));
+	connect(mSession, SIGNAL(firstByteReceived(int)),
+			this, SLOT(onFirstByteReceived(int)));
+	connect(mSession, SIGNAL(requestFinished(int, QString, QByteArray)),
+			this, SLOT(onRequestFinished(int, QString, QByteArray)));
 }
 
-void FroniusSolarApi::updateHttpClient()
+void FroniusSolarApi::recordLatency()
 {
-	delete mHttp;
-	mHttp = new QHttp(mHostName, QHttp::ConnectionModeHttp, mPort, this);
-	connect(mHttp, SIGNAL(done(bool)),
-			this, SLOT(onDone(bool)));
+	QString key = QString("SolarApi/%1/%2").
+		arg(LatencyStatistics::toPathElement(mHostName)).
+		arg(requestName(mReply.type));
+	LatencyStatistics::instance().entry(key)->record(mReply.timestamps);
 }
 
-QVariant FroniusSolarApi::getByPath(const QVariant &variant,
-									const QString &path)
+const char *FroniusSolarApi::requestName(SolarApiRequest::Type type)
 {
-	QVariant m = variant;
-	QStringList spl = path.split('/');
-	for (QStringList::Iterator it = spl.begin(); it != spl.end(); ++it)
-	{
-		m = m.toMap()[*it];
+	switch (type) {
+	case SolarApiRequest::ConverterInfo:
+		return "getInverterInfo";
+	case SolarApiRequest::CommonData:
+		return "getCommonData";
+	case SolarApiRequest::ThreePhasesData:
+		return "getThreePhasesInverterData";
+	case SolarApiRequest::DeviceInfo:
+		return "getDeviceInfo";
+	case SolarApiRequest::SystemData:
+		return "getSystemData";
+	case SolarApiRequest::PowerFlow:
+		return "getPowerFlowData";
+	case SolarApiRequest::InvalidRequest:
+		break;
 	}
-	return m;
+	return "invalid";
 }
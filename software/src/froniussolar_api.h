@@ -1,14 +1,18 @@
 #ifndef FRONIUSSOLAR_API_H
 #define FRONIUSSOLAR_API_H
 
+#include <QElapsedTimer>
+#include <QHash>
 #include <QObject>
 #include <QList>
+#include <QMap>
 #include <QString>
 #include <QUrl>
-#include <QVariantMap>
+#include "latency_statistics.h"
 
-class QHttp;
-class QTimer;
+class JsonHandler;
+class JsonPaths;
+class SolarApiSession;
 
 /*!
  * @brief Base class for all data packages returned by FroniusSolarApi.
@@ -24,6 +28,8 @@ struct SolarApiReply
 
 	Error error;
 	QString errorMessage;
+	/// Id of the SolarApiRequest this is the reply to.
+	int requestId;
 };
 
 struct InverterInfo
@@ -111,17 +117,103 @@ struct ThreePhasesInverterData : public SolarApiReply
 	double acVoltagePhase3;
 };
 
+/*!
+ * @brief Values of a single inverter, as reported by a `Scope=System` request.
+ */
+struct InverterSystemValues
+{
+	double acPower;
+	double dayEnergy;
+	double yearEnergy;
+	double totalEnergy;
+};
+
+struct SystemInverterData : public SolarApiReply
+{
+	/*!
+	 * @brief Values of all inverters on the data manager, by device id (the
+	 * `id` field in InverterInfo).
+	 */
+	QMap<int, InverterSystemValues> inverters;
+};
+
+struct PowerFlowData : public SolarApiReply
+{
+	/*!
+	 * @brief AC power (W) of all inverters on the data manager, by device id
+	 * (the `id` field in InverterInfo).
+	 */
+	QMap<int, double> inverterPower;
+};
+
 struct DeviceInfoData : public SolarApiReply
 {
 	QMap<int, QString> serialInfo;
 };
 
+/*!
+ * @brief Handle of a request issued by FroniusSolarApi.
+ * The handle may be used to cancel the request, and to match the reply (see
+ * SolarApiReply::requestId).
+ */
+class SolarApiRequest
+{
+public:
+	enum Type
+	{
+		InvalidRequest,
+		ConverterInfo,
+		CommonData,
+		ThreePhasesData,
+		DeviceInfo,
+		SystemData,
+		PowerFlow
+	};
+
+	SolarApiRequest():
+		mType(InvalidRequest),
+		mId(0)
+	{
+	}
+
+	Type type() const
+	{
+		return mType;
+	}
+
+	int id() const
+	{
+		return mId;
+	}
+
+	bool isValid() const
+	{
+		return mId != 0;
+	}
+
+private:
+	friend class FroniusSolarApi;
+
+	SolarApiRequest(Type type, int id):
+		mType(type),
+		mId(id)
+	{
+	}
+
+	Type mType;
+	int mId;
+};
+
 /*!
  * @brief Implements the Fronius solar API.
  * This is the API running on the data manager extension cards which may be
  * installed in Fronius converters.
  * A single data manager card can report information from multiple inverters,
  * if they are chained using the DATCOM interface.
+ *
+ * Any number of requests may be issued at the same time. They are sent in
+ * parallel over the connections of the SolarApiSession of the host. Each
+ * request has its own timeout, starting when the request is sent.
  */
 class FroniusSolarApi : public QObject
 {
@@ -129,6 +221,8 @@ class FroniusSolarApi : public QObject
 public:
 	FroniusSolarApi(const QString &hostName, int port, int timeout, QObject *parent = 0);
 
+	virtual ~FroniusSolarApi();
+
 	QString hostName() const;
 
 	void setHostName(const QString &h);
@@ -143,8 +237,10 @@ public:
 	 * This function is asynchronous and will return immediatlye.
 	 * The converterInfoFound signal will be emitted when the API call has been
 	 * handled, even if an error has occured.
+	 * @param timeout Timeout in milliseconds. If negative, the timeout passed
+	 * to the constructor is used. The same applies to the other requests.
 	 */
-	void getConverterInfoAsync();
+	SolarApiRequest getConverterInfoAsync(int timeout = -1);
 
 	/*!
 	 * @brief retrieves common data from the specified inverter. Common data
@@ -155,7 +251,7 @@ public:
 	 * The commonDataFound signal will be emitted when the API call has been
 	 * handled, even if an error has occured.
 	 */
-	void getCommonDataAsync(int deviceId);
+	SolarApiRequest getCommonDataAsync(int deviceId, int timeout = -1);
 
 	/*!
 	 * @brief retrieves values from 3 phase inverters.
@@ -165,9 +261,41 @@ public:
 	 * The threePhasesDataFound signal will be emitted when the API call has
 	 * been handled, even if an error has occured.
 	 */
-	void getThreePhasesInverterDataAsync(int deviceId);
+	SolarApiRequest getThreePhasesInverterDataAsync(int deviceId, int timeout = -1);
 
-	void getDeviceInfoAsync();
+	SolarApiRequest getDeviceInfoAsync(int timeout = -1);
+
+	/*!
+	 * @brief retrieves power and energy values of all inverters on the data
+	 * manager with a single request.
+	 * The systemDataFound signal will be emitted when the API call has been
+	 * handled, even if an error has occured.
+	 */
+	SolarApiRequest getSystemDataAsync(int timeout = -1);
+
+	/*!
+	 * @brief retrieves the AC power of all inverters on the data manager
+	 * from the power flow data. This is the lightest request giving the
+	 * power, so it is suitable for polling at a high rate.
+	 * The powerFlowDataFound signal will be emitted when the API call has
+	 * been handled, even if an error has occured.
+	 */
+	SolarApiRequest getPowerFlowDataAsync(int timeout = -1);
+
+	/*!
+	 * @brief Cancels a request. No signal will be emitted for it. Does
+	 * nothing if the request has already been completed.
+	 */
+	void cancel(const SolarApiRequest &request);
+
+	/*!
+	 * @brief Cancels all requests in progress (if any). No signals will be
+	 * emitted for them.
+	 */
+	void cancel();
+
+	/// Returns the number of requests which have not been completed yet.
+	int pendingRequestCount() const;
 
 signals:
 	/*!
@@ -191,17 +319,30 @@ signals:
 
 	void deviceInfoFound(const DeviceInfoData &data);
 
+	void systemDataFound(const SystemInverterData &data);
+
+	void powerFlowDataFound(const PowerFlowData &data);
+
 private slots:
-	void onDone(bool error);
+	void onRequestStarted(int id);
+
+	void onFirstByteReceived(int id);
 
-	void onTimeout();
+	void onRequestFinished(int id, const QString &error, const QByteArray &body);
 
 private:
+	struct PendingRequest
+	{
+		SolarApiRequest::Type type;
+		LatencyStatistics::Timestamps timestamps;
+	};
+
 	const QUrl baseUrl(const QString &path);
 
-	void sendGetRequest(const QUrl &request, const QString &id);
+	SolarApiRequest sendGetRequest(const QUrl &request, SolarApiRequest::Type type,
+								   int timeout);
 
-	void processRequest(const QString &networkError);
+	void processRequest(SolarApiRequest::Type type, const QString &networkError);
 
 	void processConverterInfo(const QString &networkError);
 
@@ -211,25 +352,40 @@ private:
 
 	void processDeviceInfo(const QString &networkError);
 
-	void processReply(const QString &networkError, SolarApiReply &apiReply,
-					  QVariantMap &map);
+	void processSystemData(const QString &networkError);
 
-	void updateHttpClient();
+	void processPowerFlowData(const QString &networkError);
 
 	/*!
-	 * @brief Retrieves a nested value from the specified map.
-	 * @param map
-	 * @param path A list of id's separated by slashes ('/').
-	 * @return The nested value or an empty variant of the value could not be
-	 * found.
+	 * @brief Checks the network error and the status in the reply, and passes
+	 * the values found at `paths` to `handler`.
+	 * The first two paths must be `Head/Status/Code` and `Head/Status/Reason`.
+	 * Those values are consumed by this function.
 	 */
-	static QVariant getByPath(const QVariant &map, const QString &path);
+	void processReply(const QString &networkError, SolarApiReply &apiReply,
+					  const JsonPaths &paths, JsonHandler &handler);
+
+	/// Switches to the session of the current host and port.
+	void updateSession();
+
+	/// Adds the timestamps of the reply being processed to the latency statistics.
+	void recordLatency();
+
+	static const char *requestName(SolarApiRequest::Type type);
 
-	QHttp *mHttp;
+	SolarApiSession *mSession;
 	QString mHostName;
 	int mPort;
-	QString mRequestType;
-	QTimer *mTimeoutTimer;
+	int mTimeout;
+	/// Requests in progress, by session id.
+	QHash<int, PendingRequest> mRequests;
+	/// Session id of the reply being processed
+	int mReplyId;
+	/// Body of the reply being processed
+	QByteArray mReplyBody;
+	/// The request whose reply is being processed
+	PendingRequest mReply;
+	QElapsedTimer mClock;
 };
 
 #endif // FRONIUSSOLAR_API_H
@@ -0,0 +1,182 @@
+#include <QTcpSocket>
+#include <QTimer>
+#include "http_client.h"
+#include "tcp_socket_options.h"
+
+HttpClient::HttpClient(const QString &hostName, quint16 port, QObject *parent):
+	QObject(parent),
+	mSocket(new QTcpSocket(this)),
+	mTimer(new QTimer(this)),
+	mHostName(hostName),
+	mPort(port),
+	mBusy(false),
+	mKeepAlive(true),
+	mFirstByteReceived(false)
+{
+	mTimer->setSingleShot(true);
+	connect(mTimer, SIGNAL(timeout()), this, SLOT(onTimeout()));
+	connect(mSocket, SIGNAL(readyRead()), this, SLOT(onReadyRead()));
+	connect(mSocket, SIGNAL(connected()), this, SLOT(onConnected()));
+	connect(mSocket, SIGNAL(disconnected()), this, SLOT(onDisconnected()));
+	connect(mSocket, SIGNAL(error(QAbstractSocket::SocketError)),
+			this, SLOT(onError(QAbstractSocket::SocketError)));
+}
+
+QString HttpClient::hostName() const
+{
+	return mHostName;
+}
+
+quint16 HttpClient::port() const
+{
+	return mPort;
+}
+
+bool HttpClient::keepAlive() const
+{
+	return mKeepAlive;
+}
+
+void HttpClient::setKeepAlive(bool keepAlive)
+{
+	mKeepAlive = keepAlive;
+}
+
+bool HttpClient::isConnected() const
+{
+	return !mBusy && mSocket->state() == QAbstractSocket::ConnectedState;
+}
+
+bool HttpClient::isBusy() const
+{
+	return mBusy;
+}
+
+void HttpClient::get(const QString &path, int timeout)
+{
+	Q_ASSERT(!mBusy);
+	mRequest.clear();
+	mRequest.append("GET ");
+	mRequest.append(path.toUtf8());
+	mRequest.append(" HTTP/1.1\r\nHost: ");
+	mRequest.append(mHostName.toUtf8());
+	if (mPort != 80) {
+		mRequest.append(':');
+		mRequest.append(QByteArray::number(mPort));
+	}
+	mRequest.append(mKeepAlive ?
+		"\r\nConnection: keep-alive\r\n\r\n" :
+		"\r\nConnection: close\r\n\r\n");
+	mParser.reset();
+	mBusy = true;
+	mFirstByteReceived = false;
+	mTimer->start(timeout);
+	switch (mSocket->state()) {
+	case QAbstractSocket::ConnectedState:
+		writeRequest();
+		break;
+	case QAbstractSocket::UnconnectedState:
+		mSocket->connectToHost(mHostName, mPort);
+		break;
+	default:
+		// Still connecting (which should not happen, because the connection is closed when a
+		// request is aborted), or closing.
+		mSocket->abort();
+		mSocket->connectToHost(mHostName, mPort);
+		break;
+	}
+}
+
+void HttpClient::abort()
+{
+	mTimer->stop();
+	mBusy = false;
+	mSocket->abort();
+}
+
+int HttpClient::statusCode() const
+{
+	return mParser.statusCode();
+}
+
+void HttpClient::onConnected()
+{
+	TcpSocketOptions::global().apply(mSocket);
+	emit connected();
+	if (mBusy)
+		writeRequest();
+}
+
+void HttpClient::onDisconnected()
+{
+	if (!mBusy)
+		return;
+	if (mParser.setEndOfStream())
+		finish(QString(), mParser.takeBody(), false);
+	else
+		fail(mParser.errorString());
+}
+
+void HttpClient::onError(QAbstractSocket::SocketError error)
+{
+	// A closed connection is handled in onDisconnected, because it may mark the end of the body.
+	if (!mBusy || error == QAbstractSocket::RemoteHostClosedError)
+		return;
+	fail(mSocket->errorString());
+}
+
+void HttpClient::onReadyRead()
+{
+	for (;;) {
+		qint64 count = mSocket->read(mBuffer, ReceiveBufferSize);
+		if (count <= 0)
+			return;
+		if (!mBusy) {
+			// Data on an idle connection: we cannot tell where the next reply would start.
+			mSocket->abort();
+			return;
+		}
+		if (!mFirstByteReceived) {
+			mFirstByteReceived = true;
+			emit firstByteReceived();
+		}
+		int consumed = mParser.parse(mBuffer, static_cast<int>(count));
+		if (mParser.hasError()) {
+			fail(mParser.errorString());
+			return;
+		}
+		if (mParser.isComplete()) {
+			// Anything following the reply is dropped along with the connection.
+			bool close = !mKeepAlive || !mParser.keepAlive() || consumed < count ||
+				mSocket->bytesAvailable() > 0;
+			finish(QString(), mParser.takeBody(), close);
+			return;
+		}
+	}
+}
+
+void HttpClient::onTimeout()
+{
+	fail("Request timed out");
+}
+
+void HttpClient::writeRequest()
+{
+	mSocket->write(mRequest);
+	emit requestSent();
+}
+
+void HttpClient::fail(const QString &error)
+{
+	finish(error, QByteArray(), true);
+}
+
+void HttpClient::finish(const QString &error, const QByteArray &body, bool close)
+{
+	mTimer->stop();
+	// Reset before closing, because closing the socket emits `disconnected` right away.
+	mBusy = false;
+	if (close)
+		mSocket->abort();
+	emit finished(error, body);
+}
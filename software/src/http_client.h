@@ -0,0 +1,125 @@
+#ifndef HTTP_CLIENT_H
+#define HTTP_CLIENT_H
+
+#include <QAbstractSocket>
+#include <QByteArray>
+#include <QObject>
+#include <QString>
+#include "http_response_parser.h"
+
+class QTimer;
+
+/*!
+ * @brief Minimal asynchronous HTTP/1.1 client, which sends GET requests to a
+ * single host.
+ *
+ * Only what the Fronius Solar API needs is supported: plain GET requests over
+ * a persistent connection. There is no support for authentication, proxies,
+ * SSL, redirects or request bodies. One request is handled at a time.
+ *
+ * Incoming data is read through a fixed size buffer, and parsed on the fly
+ * by HttpResponseParser. Each request has a deadline covering connecting,
+ * sending the request and receiving the reply.
+ *
+ * After an error or a timeout the connection is closed, so the next request
+ * always starts on a new connection.
+ */
+class HttpClient : public QObject
+{
+	Q_OBJECT
+public:
+	/// Size of the buffer used to read from the socket.
+	static const int ReceiveBufferSize = 2048;
+
+	HttpClient(const QString &hostName, quint16 port, QObject *parent = 0);
+
+	QString hostName() const;
+
+	quint16 port() const;
+
+	/// Returns false if the connection is closed after each request.
+	bool keepAlive() const;
+
+	/*!
+	 * @brief Enables persistent connections (the default). If disabled,
+	 * `Connection: close` is sent with each request.
+	 */
+	void setKeepAlive(bool keepAlive);
+
+	/// True if the next request will be sent over an open connection.
+	bool isConnected() const;
+
+	/// True if a request is in progress.
+	bool isBusy() const;
+
+	/*!
+	 * @brief Sends a GET request. There should be no request in progress.
+	 * @param path The path and query of the request.
+	 * @param timeout Time in milliseconds after which the request fails,
+	 * unless the reply has been received.
+	 */
+	void get(const QString &path, int timeout);
+
+	/*!
+	 * @brief Aborts the request in progress (if any) and closes the
+	 * connection. No signals will be emitted for the request.
+	 */
+	void abort();
+
+	/// Status code of the last reply.
+	int statusCode() const;
+
+signals:
+	/// Emitted when a new connection has been established.
+	void connected();
+
+	void requestSent();
+
+	/*!
+	 * @brief Emitted when the first data of the reply has been read, before
+	 * it is parsed. Together with `requestSent`, this gives the time the
+	 * server took to answer.
+	 */
+	void firstByteReceived();
+
+	/*!
+	 * @brief Emitted when a request has been completed.
+	 * @param error Description of the error, or an empty string on success.
+	 * The status code of the reply does not count as an error.
+	 * @param body The body of the reply. Empty if an error has occurred.
+	 */
+	void finished(const QString &error, const QByteArray &body);
+
+private slots:
+	void onConnected();
+
+	void onDisconnected();
+
+	void onError(QAbstractSocket::SocketError error);
+
+	void onReadyRead();
+
+	void onTimeout();
+
+private:
+	void writeRequest();
+
+	void fail(const QString &error);
+
+	/// Ends the current request, and emits `finished`.
+	void finish(const QString &error, const QByteArray &body, bool close);
+
+	QAbstractSocket *mSocket;
+	QTimer *mTimer;
+	QString mHostName;
+	quint16 mPort;
+	QByteArray mRequest;
+	HttpResponseParser mParser;
+	bool mBusy;
+	bool mKeepAlive;
+	/// Set when data has been read for the current request.
+	bool mFirstByteReceived;
+	char mBuffer[ReceiveBufferSize];
+};
+
+#endif // HTTP_CLIENT_H
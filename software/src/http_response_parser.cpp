@@ -0,0 +1,269 @@
+#include <string.h>
+#include "http_response_parser.h"
+
+HttpResponseParser::HttpResponseParser()
+{
+	mLine.reserve(256);
+	reset();
+}
+
+void HttpResponseParser::reset()
+{
+	mState = StatusLine;
+	mLine.clear();
+	mBody.clear();
+	mError.clear();
+	mStatusCode = 0;
+	mContentLength = -1;
+	mRemaining = 0;
+	mChunked = false;
+	mKeepAlive = false;
+	mHeaderComplete = false;
+}
+
+int HttpResponseParser::parse(const char *data, int size)
+{
+	const char *pos = data;
+	const char *end = data + size;
+	while (pos < end && mState != Complete && mState != Failed) {
+		switch (mState) {
+		case FixedBody:
+		case ChunkData:
+		{
+			int count = static_cast<int>(qMin<qint64>(end - pos, mRemaining));
+			mBody.append(pos, count);
+			pos += count;
+			mRemaining -= count;
+			if (mRemaining == 0)
+				mState = mState == FixedBody ? Complete : ChunkDataEnd;
+			break;
+		}
+		case BodyUntilClose:
+			if (appendBody(pos, static_cast<int>(end - pos)))
+				pos = end;
+			break;
+		default:
+			if (readLine(pos, end)) {
+				processLine();
+				mLine.clear();
+			}
+			break;
+		}
+	}
+	return static_cast<int>(pos - data);
+}
+
+bool HttpResponseParser::setEndOfStream()
+{
+	if (mState == BodyUntilClose)
+		mState = Complete;
+	else if (mState != Complete && mState != Failed)
+		fail("Connection closed before the reply was complete");
+	return mState == Complete;
+}
+
+bool HttpResponseParser::headerComplete() const
+{
+	return mHeaderComplete;
+}
+
+bool HttpResponseParser::isComplete() const
+{
+	return mState == Complete;
+}
+
+bool HttpResponseParser::hasError() const
+{
+	return mState == Failed;
+}
+
+QString HttpResponseParser::errorString() const
+{
+	return mError;
+}
+
+int HttpResponseParser::statusCode() const
+{
+	return mStatusCode;
+}
+
+bool HttpResponseParser::keepAlive() const
+{
+	return mKeepAlive;
+}
+
+const QByteArray &HttpResponseParser::body() const
+{
+	return mBody;
+}
+
+QByteArray HttpResponseParser::takeBody()
+{
+	QByteArray body = mBody;
+	mBody = QByteArray();
+	return body;
+}
+
+bool HttpResponseParser::readLine(const char *&pos, const char *end)
+{
+	const char *nl = static_cast<const char *>(memchr(pos, '\n', static_cast<size_t>(end - pos)));
+	const char *lineEnd = nl == 0 ? end : nl;
+	if (mLine.size() + (lineEnd - pos) > MaxLineLength) {
+		fail("Header line too long");
+		return false;
+	}
+	mLine.append(pos, static_cast<int>(lineEnd - pos));
+	if (nl == 0) {
+		pos = end;
+		return false;
+	}
+	pos = nl + 1;
+	if (mLine.endsWith('\r'))
+		mLine.chop(1);
+	return true;
+}
+
+void HttpResponseParser::processLine()
+{
+	switch (mState) {
+	case StatusLine:
+		processStatusLine();
+		break;
+	case HeaderLine:
+		if (mLine.isEmpty())
+			processHeaderEnd();
+		else
+			processHeaderLine();
+		break;
+	case ChunkSize:
+		processChunkSize();
+		break;
+	case ChunkDataEnd:
+		if (mLine.isEmpty())
+			mState = ChunkSize;
+		else
+			fail("Missing line break after chunk");
+		break;
+	case Trailer:
+		// Trailer fields are ignored.
+		if (mLine.isEmpty())
+			mState = Complete;
+		break;
+	default:
+		break;
+	}
+}
+
+void HttpResponseParser::processStatusLine()
+{
+	// Some servers send an extra line break after a body.
+	if (mLine.isEmpty())
+		return;
+	// HTTP/1.1 200 OK
+	if (mLine.size() < 12 || !mLine.startsWith("HTTP/1.") || mLine[8] != ' ') {
+		fail("Invalid HTTP status line");
+		return;
+	}
+	bool ok = false;
+	mStatusCode = mLine.mid(9, 3).toInt(&ok);
+	if (!ok || mStatusCode < 100) {
+		fail("Invalid HTTP status code");
+		return;
+	}
+	// HTTP/1.1 connections are persistent unless the server says otherwise, HTTP/1.0
+	// connections only if the server says so.
+	mKeepAlive = mLine[7] != '0';
+	mContentLength = -1;
+	mChunked = false;
+	mState = HeaderLine;
+}
+
+void HttpResponseParser::processHeaderLine()
+{
+	int colon = mLine.indexOf(':');
+	if (colon <= 0) {
+		fail("Invalid HTTP header");
+		return;
+	}
+	QByteArray name = mLine.left(colon).trimmed().toLower();
+	QByteArray value = mLine.mid(colon + 1).trimmed().toLower();
+	if (name == "content-length") {
+		bool ok = false;
+		mContentLength = value.toLongLong(&ok);
+		if (!ok || mContentLength < 0)
+			fail("Invalid Content-Length");
+	} else if (name == "transfer-encoding") {
+		mChunked = value.contains("chunked");
+	} else if (name == "connection") {
+		if (value.contains("close"))
+			mKeepAlive = false;
+		else if (value.contains("keep-alive"))
+			mKeepAlive = true;
+	}
+}
+
+void HttpResponseParser::processHeaderEnd()
+{
+	if (mStatusCode < 200) {
+		// Interim response (eg. 100 Continue). The final response follows.
+		mState = StatusLine;
+		return;
+	}
+	mHeaderComplete = true;
+	if (mStatusCode == 204 || mStatusCode == 304) {
+		mState = Complete;
+	} else if (mChunked) {
+		mState = ChunkSize;
+	} else if (mContentLength >= 0) {
+		if (mContentLength > MaxBodySize) {
+			fail("Reply too large");
+			return;
+		}
+		mBody.reserve(static_cast<int>(mContentLength));
+		mRemaining = mContentLength;
+		mState = mRemaining == 0 ? Complete : FixedBody;
+	} else {
+		// The end of the body is marked by the end of the connection.
+		mKeepAlive = false;
+		mState = BodyUntilClose;
+	}
+}
+
+void HttpResponseParser::processChunkSize()
+{
+	// Chunk extensions are ignored.
+	int semicolon = mLine.indexOf(';');
+	QByteArray size = (semicolon < 0 ? mLine : mLine.left(semicolon)).trimmed();
+	bool ok = false;
+	qint64 chunkSize = size.toLongLong(&ok, 16);
+	if (!ok || chunkSize < 0) {
+		fail("Invalid chunk size");
+		return;
+	}
+	if (chunkSize == 0) {
+		mState = Trailer;
+		return;
+	}
+	if (mBody.size() + chunkSize > MaxBodySize) {
+		fail("Reply too large");
+		return;
+	}
+	mRemaining = chunkSize;
+	mState = ChunkData;
+}
+
+bool HttpResponseParser::appendBody(const char *data, int size)
+{
+	if (mBody.size() + size > MaxBodySize) {
+		fail("Reply too large");
+		return false;
+	}
+	mBody.append(data, size);
+	return true;
+}
+
+void HttpResponseParser::fail(const char *message)
+{
+	mState = Failed;
+	mError = QString::fromLatin1(message);
+}
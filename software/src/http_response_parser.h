@@ -0,0 +1,116 @@
+#ifndef HTTP_RESPONSE_PARSER_H
+#define HTTP_RESPONSE_PARSER_H
+
+#include <QByteArray>
+#include <QString>
+
+/*!
+ * @brief Incremental parser for HTTP/1.x responses, as used by HttpClient.
+ * Data is fed in arbitrary pieces as it arrives from the socket. The status
+ * line and headers are parsed line by line, without keeping the complete
+ * header. Only the headers needed to find the end of the body
+ * (`Content-Length` and `Transfer-Encoding: chunked`) and to decide whether
+ * the connection may be reused (`Connection`) are interpreted. Interim (1xx)
+ * responses are skipped.
+ */
+class HttpResponseParser
+{
+public:
+	/// Maximum length of the status line, a header line or a chunk size line.
+	static const int MaxLineLength = 4096;
+
+	/// Maximum size of the body. Solar API replies are a few kB at most.
+	static const int MaxBodySize = 1024 * 1024;
+
+	HttpResponseParser();
+
+	/// Prepares the parser for the next response.
+	void reset();
+
+	/*!
+	 * @brief Parses the next piece of the response.
+	 * @return The number of bytes consumed. All bytes are consumed unless
+	 * the response is complete or an error has been found.
+	 */
+	int parse(const char *data, int size);
+
+	/*!
+	 * @brief Must be called when the peer has closed the connection. This
+	 * completes a response whose body is delimited by the end of the
+	 * connection, and is an error otherwise.
+	 * @return true if the response is complete.
+	 */
+	bool setEndOfStream();
+
+	/// True if the status line and all headers of the final response have been parsed.
+	bool headerComplete() const;
+
+	bool isComplete() const;
+
+	bool hasError() const;
+
+	QString errorString() const;
+
+	int statusCode() const;
+
+	/*!
+	 * @brief True if the server allows the connection to be used for the
+	 * next request. Only valid when the response is complete.
+	 */
+	bool keepAlive() const;
+
+	const QByteArray &body() const;
+
+	/// Returns the body, and clears the copy held by the parser.
+	QByteArray takeBody();
+
+private:
+	enum State
+	{
+		StatusLine,
+		HeaderLine,
+		FixedBody,
+		ChunkSize,
+		ChunkData,
+		ChunkDataEnd,
+		Trailer,
+		BodyUntilClose,
+		Complete,
+		Failed
+	};
+
+	/*!
+	 * @brief Appends data to `mLine` up to and including the next newline.
+	 * @return true if a complete line is available (without the line
+	 * terminator).
+	 */
+	bool readLine(const char *&pos, const char *end);
+
+	void processLine();
+
+	void processStatusLine();
+
+	void processHeaderLine();
+
+	void processHeaderEnd();
+
+	void processChunkSize();
+
+	bool appendBody(const char *data, int size);
+
+	void fail(const char *message);
+
+	State mState;
+	QByteArray mLine;
+	QByteArray mBody;
+	QString mError;
+	int mStatusCode;
+	qint64 mContentLength;
+	/// Bytes left in the body or in the current chunk.
+	qint64 mRemaining;
+	bool mChunked;
+	bool mKeepAlive;
+	bool mHeaderComplete;
+};
+
+#endif // HTTP_RESPONSE_PARSER_H
@@ -253,7 +253,7 @@ void Inverter::updateConnectionItem()
         arg(apistr));
 }
 
-bool Inverter::validateSunspecMonitorFrame(QVector<quint16> frame)
+bool Inverter::validateSunspecMonitorFrame(const ModbusRegisterView &frame)
 {
 	Q_UNUSED(frame);
 	return true;
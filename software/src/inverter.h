@@ -4,8 +4,9 @@
 #include "defines.h"
 #include "ve_service.h"
 
-class PowerInfo;
 class BasicPowerInfo;
+class ModbusRegisterView;
+class PowerInfo;
 
 class Inverter : public VeService
 {
@@ -77,7 +78,7 @@ public:
 	QString location() const;
 
 	// A hook where inverters can filter bad sunspec data
-	virtual bool validateSunspecMonitorFrame(QVector<quint16> frame);
+	virtual bool validateSunspecMonitorFrame(const ModbusRegisterView &frame);
 
 signals:
 	void customNameChanged();
@@ -6,6 +6,7 @@
 #include "sma_inverter.h"
 #include "gateway_interface.h"
 #include "inverter_mediator.h"
+#include "modbus_register_cache.h"
 #include "sunspec_updater.h"
 #include "inverter_settings.h"
 #include "solar_api_updater.h"
@@ -132,6 +133,8 @@ void InverterMediator::onConnectionLost()
 void InverterMediator::onInverterModelChanged()
 {
 	QLOG_WARN() << "Config change in: " << mInverter->location();
+	// Make sure the detector does not use the model chain from before the change.
+	ModbusRegisterCache::instance()->invalidate(mDeviceInfo.hostName, mDeviceInfo.networkId);
 	// Start device scan, which will force a config reread.
 	mGateway->startDetection();
 	// Do not delete the inverter here because right now a function within The updater is emitting
@@ -167,7 +170,8 @@ void InverterMediator::startAcquisition()
 	Q_ASSERT(mInverter != 0);
 	mInverter->setPosition(mInverterSettings->position());
 	if (mDeviceInfo.retrievalMode == ProtocolFroniusSolarApi) {
-		SolarApiUpdater *updater = new SolarApiUpdater(mInverter, mInverterSettings, mInverter);
+		SolarApiUpdater *updater = new SolarApiUpdater(mInverter, mInverterSettings, mSettings,
+													 mInverter);
 		connect(updater, SIGNAL(connectionLost()), this, SLOT(onConnectionLost()));
     } else if(mDeviceInfo.retrievalMode == ProtocolSMA) {
         SMAUpdater *updater = new SMAUpdater((SMAInverter *)mInverter, mInverterSettings, mInverter);
@@ -1,6 +1,5 @@
 INCLUDEPATH += $$PWD
 
-HEADERS += $$PWD/json.h
-
-SOURCES += $$PWD/json.cpp
+HEADERS += $$PWD/json_reader.h
 
+SOURCES += $$PWD/json_reader.cpp
@@ -0,0 +1,553 @@
+#include <math.h>
+#include <string.h>
+#include <QVarLengthArray>
+#include "json_reader.h"
+
+namespace {
+
+const int MaxDepth = 64;
+
+// Mantissas up to 2^53 and powers of ten up to 1e22 are exact in a double, so in that range a
+// single multiplication or division gives the correctly rounded result.
+const quint64 MaxExactMantissa = Q_UINT64_C(1) << 53;
+const int MaxExactPower = 22;
+const double ExactPowers[MaxExactPower + 1] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+bool isDigit(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+bool isWildcard(const QByteArray &name)
+{
+	return name.size() == 1 && name.at(0) == '*';
+}
+
+int hexValue(char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
+void appendUtf8(QByteArray *out, uint code)
+{
+	if (code < 0x80) {
+		out->append(static_cast<char>(code));
+	} else if (code < 0x800) {
+		out->append(static_cast<char>(0xC0 | (code >> 6)));
+		out->append(static_cast<char>(0x80 | (code & 0x3F)));
+	} else if (code < 0x10000) {
+		out->append(static_cast<char>(0xE0 | (code >> 12)));
+		out->append(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+		out->append(static_cast<char>(0x80 | (code & 0x3F)));
+	} else {
+		out->append(static_cast<char>(0xF0 | (code >> 18)));
+		out->append(static_cast<char>(0x80 | ((code >> 12) & 0x3F)));
+		out->append(static_cast<char>(0x80 | ((code >> 6) & 0x3F)));
+		out->append(static_cast<char>(0x80 | (code & 0x3F)));
+	}
+}
+
+}
+
+JsonValue::JsonValue():
+	mType(Null),
+	mNumber(0)
+{
+}
+
+JsonValue::Type JsonValue::type() const
+{
+	return mType;
+}
+
+bool JsonValue::isNull() const
+{
+	return mType == Null;
+}
+
+bool JsonValue::toBool() const
+{
+	switch (mType) {
+	case Bool:
+	case Number:
+		return mNumber != 0;
+	case String:
+		return !mString.isEmpty() && mString != "0" && mString != "false";
+	default:
+		return false;
+	}
+}
+
+double JsonValue::toDouble() const
+{
+	switch (mType) {
+	case Bool:
+	case Number:
+		return mNumber;
+	case String:
+		return mString.toDouble();
+	default:
+		return 0;
+	}
+}
+
+int JsonValue::toInt() const
+{
+	switch (mType) {
+	case Bool:
+	case Number:
+		return qRound(mNumber);
+	case String:
+		return mString.toInt();
+	default:
+		return 0;
+	}
+}
+
+QString JsonValue::toString() const
+{
+	switch (mType) {
+	case Bool:
+		return mNumber != 0 ? "true" : "false";
+	case Number:
+		if (mNumber == floor(mNumber) && fabs(mNumber) < 1e15)
+			return QString::number(static_cast<qint64>(mNumber));
+		return QString::number(mNumber, 'g', 15);
+	case String:
+		return mString;
+	default:
+		return QString();
+	}
+}
+
+JsonPaths::JsonPaths(const char *const *paths, int count)
+{
+	mPaths.reserve(count);
+	for (int i=0; i<count; ++i)
+		mPaths.append(QByteArray(paths[i]).split('/'));
+}
+
+int JsonPaths::count() const
+{
+	return mPaths.size();
+}
+
+JsonReader::JsonReader(const JsonPaths &paths):
+	mPaths(paths),
+	mBegin(0),
+	mPos(0),
+	mEnd(0),
+	mHandler(0),
+	mErrorOffset(0)
+{
+	// Reserving capacity keeps the buffer from being released when it is cleared.
+	mBuffer.reserve(64);
+}
+
+bool JsonReader::read(const QByteArray &data, JsonHandler &handler)
+{
+	return read(data.constData(), data.size(), handler);
+}
+
+bool JsonReader::read(const char *data, int size, JsonHandler &handler)
+{
+	mBegin = data;
+	mPos = data;
+	mEnd = data + size;
+	mHandler = &handler;
+	mKey.clear();
+	mError.clear();
+	mErrorOffset = 0;
+	QVarLengthArray<int, 16> candidates(mPaths.count());
+	for (int i=0; i<candidates.size(); ++i)
+		candidates[i] = i;
+	skipWhitespace();
+	bool ok = parseValue(0, candidates.constData(), candidates.size());
+	if (ok) {
+		skipWhitespace();
+		if (mPos != mEnd)
+			ok = fail("Unexpected data after document");
+	}
+	mHandler = 0;
+	return ok;
+}
+
+QString JsonReader::errorString() const
+{
+	return mError;
+}
+
+int JsonReader::errorOffset() const
+{
+	return mErrorOffset;
+}
+
+bool JsonReader::parseValue(int depth, const int *candidates, int count)
+{
+	if (mPos == mEnd)
+		return fail("Unexpected end of data");
+	if (count == 0)
+		return skipValue(depth);
+	if (*mPos == '{')
+		return parseObject(depth, candidates, count);
+	if (*mPos == '[')
+		return skipContainer(depth);
+	bool leaf = false;
+	for (int i=0; i<count && !leaf; ++i)
+		leaf = mPaths.mPaths[candidates[i]].size() == depth;
+	if (!leaf)
+		return parseScalar(0);
+	JsonValue value;
+	if (!parseScalar(&value))
+		return false;
+	for (int i=0; i<count; ++i) {
+		if (mPaths.mPaths[candidates[i]].size() == depth)
+			mHandler->onValue(candidates[i], mKey, value);
+	}
+	return true;
+}
+
+bool JsonReader::parseObject(int depth, const int *candidates, int count)
+{
+	if (depth >= MaxDepth)
+		return fail("Maximum nesting depth exceeded");
+	++mPos;
+	skipWhitespace();
+	if (mPos < mEnd && *mPos == '}') {
+		++mPos;
+		return true;
+	}
+	for (;;) {
+		if (!parseName(&mBuffer))
+			return false;
+		QVarLengthArray<int, 16> matches;
+		bool wildcard = false;
+		for (int i=0; i<count; ++i) {
+			const QList<QByteArray> &path = mPaths.mPaths[candidates[i]];
+			if (path.size() <= depth)
+				continue;
+			const QByteArray &name = path.at(depth);
+			if (isWildcard(name)) {
+				matches.append(candidates[i]);
+				wildcard = true;
+			} else if (name == mBuffer) {
+				matches.append(candidates[i]);
+			}
+		}
+		bool ok = false;
+		if (wildcard) {
+			QByteArray outerKey = mKey;
+			// Deep copy, so mBuffer keeps its capacity
+			mKey = QByteArray(mBuffer.constData(), mBuffer.size());
+			ok = parseValue(depth + 1, matches.constData(), matches.size());
+			mKey = outerKey;
+		} else {
+			ok = parseValue(depth + 1, matches.constData(), matches.size());
+		}
+		if (!ok)
+			return false;
+		skipWhitespace();
+		if (mPos == mEnd)
+			return fail("Unexpected end of data");
+		if (*mPos == '}') {
+			++mPos;
+			return true;
+		}
+		if (*mPos != ',')
+			return fail("Expected ',' or '}'");
+		++mPos;
+		skipWhitespace();
+	}
+}
+
+bool JsonReader::skipValue(int depth)
+{
+	if (mPos == mEnd)
+		return fail("Unexpected end of data");
+	if (*mPos == '{' || *mPos == '[')
+		return skipContainer(depth);
+	return parseScalar(0);
+}
+
+bool JsonReader::skipContainer(int depth)
+{
+	if (depth >= MaxDepth)
+		return fail("Maximum nesting depth exceeded");
+	bool object = *mPos == '{';
+	char close = object ? '}' : ']';
+	++mPos;
+	skipWhitespace();
+	if (mPos < mEnd && *mPos == close) {
+		++mPos;
+		return true;
+	}
+	for (;;) {
+		if (object && !parseName(0))
+			return false;
+		if (!skipValue(depth + 1))
+			return false;
+		skipWhitespace();
+		if (mPos == mEnd)
+			return fail("Unexpected end of data");
+		if (*mPos == close) {
+			++mPos;
+			return true;
+		}
+		if (*mPos != ',')
+			return fail(object ? "Expected ',' or '}'" : "Expected ',' or ']'");
+		++mPos;
+		skipWhitespace();
+	}
+}
+
+bool JsonReader::parseName(QByteArray *name)
+{
+	if (mPos == mEnd || *mPos != '"')
+		return fail("Expected member name");
+	if (name != 0)
+		name->resize(0);
+	if (!parseString(name))
+		return false;
+	skipWhitespace();
+	if (mPos == mEnd || *mPos != ':')
+		return fail("Expected ':'");
+	++mPos;
+	skipWhitespace();
+	return true;
+}
+
+bool JsonReader::parseString(QByteArray *out)
+{
+	++mPos; // opening quote
+	const char *start = mPos;
+	for (;;) {
+		const char *p = start;
+		while (p < mEnd && *p != '"' && *p != '\\' && static_cast<uchar>(*p) >= 0x20)
+			++p;
+		if (out != 0)
+			out->append(start, static_cast<int>(p - start));
+		mPos = p;
+		if (p == mEnd)
+			return fail("Unterminated string");
+		if (*p == '"') {
+			++mPos;
+			return true;
+		}
+		if (*p != '\\')
+			return fail("Control character in string");
+		if (p + 1 == mEnd)
+			return fail("Unterminated string");
+		char c = p[1];
+		mPos = p + 2;
+		switch (c) {
+		case '"':
+		case '\\':
+		case '/':
+			break;
+		case 'b':
+			c = '\b';
+			break;
+		case 'f':
+			c = '\f';
+			break;
+		case 'n':
+			c = '\n';
+			break;
+		case 'r':
+			c = '\r';
+			break;
+		case 't':
+			c = '\t';
+			break;
+		case 'u':
+		{
+			uint code = 0;
+			if (!parseUnicodeEscape(code))
+				return false;
+			if (code >= 0xD800 && code < 0xDC00) {
+				// A high surrogate must be followed by an escaped low surrogate
+				uint low = 0;
+				if (mEnd - mPos < 2 || mPos[0] != '\\' || mPos[1] != 'u')
+					return fail("Invalid surrogate pair");
+				mPos += 2;
+				if (!parseUnicodeEscape(low))
+					return false;
+				if (low < 0xDC00 || low >= 0xE000)
+					return fail("Invalid surrogate pair");
+				code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+			} else if (code >= 0xDC00 && code < 0xE000) {
+				return fail("Invalid surrogate pair");
+			}
+			if (out != 0)
+				appendUtf8(out, code);
+			start = mPos;
+			continue;
+		}
+		default:
+			return fail("Invalid escape sequence");
+		}
+		if (out != 0)
+			out->append(c);
+		start = mPos;
+	}
+}
+
+bool JsonReader::parseUnicodeEscape(uint &code)
+{
+	if (mEnd - mPos < 4)
+		return fail("Invalid unicode escape");
+	code = 0;
+	for (int i=0; i<4; ++i) {
+		int v = hexValue(mPos[i]);
+		if (v < 0)
+			return fail("Invalid unicode escape");
+		code = (code << 4) | static_cast<uint>(v);
+	}
+	mPos += 4;
+	return true;
+}
+
+bool JsonReader::parseScalar(JsonValue *value)
+{
+	switch (*mPos) {
+	case '"':
+		if (value == 0)
+			return parseString(0);
+		mBuffer.resize(0);
+		if (!parseString(&mBuffer))
+			return false;
+		value->mType = JsonValue::String;
+		value->mString = QString::fromUtf8(mBuffer.constData(), mBuffer.size());
+		return true;
+	case 't':
+		if (!parseLiteral("true", 4))
+			return false;
+		if (value != 0) {
+			value->mType = JsonValue::Bool;
+			value->mNumber = 1;
+		}
+		return true;
+	case 'f':
+		if (!parseLiteral("false", 5))
+			return false;
+		if (value != 0) {
+			value->mType = JsonValue::Bool;
+			value->mNumber = 0;
+		}
+		return true;
+	case 'n':
+		if (!parseLiteral("null", 4))
+			return false;
+		if (value != 0)
+			value->mType = JsonValue::Null;
+		return true;
+	default:
+		return parseNumber(value);
+	}
+}
+
+bool JsonReader::parseNumber(JsonValue *value)
+{
+	const char *p = mPos;
+	bool negative = false;
+	if (p < mEnd && *p == '-') {
+		negative = true;
+		++p;
+	}
+	if (p == mEnd || !isDigit(*p))
+		return fail("Invalid value");
+	quint64 mantissa = 0;
+	int exponent = 0;
+	bool exact = true;
+	if (*p == '0') {
+		++p;
+	} else {
+		for (; p < mEnd && isDigit(*p); ++p) {
+			uint d = static_cast<uint>(*p - '0');
+			if (mantissa <= (MaxExactMantissa - d) / 10)
+				mantissa = mantissa * 10 + d;
+			else
+				exact = false;
+		}
+	}
+	if (p < mEnd && *p == '.') {
+		++p;
+		if (p == mEnd || !isDigit(*p))
+			return fail("Invalid number");
+		for (; p < mEnd && isDigit(*p); ++p) {
+			uint d = static_cast<uint>(*p - '0');
+			if (mantissa <= (MaxExactMantissa - d) / 10) {
+				mantissa = mantissa * 10 + d;
+				--exponent;
+			} else if (d != 0) {
+				exact = false;
+			}
+		}
+	}
+	if (p < mEnd && (*p == 'e' || *p == 'E')) {
+		++p;
+		bool negativeExponent = false;
+		if (p < mEnd && (*p == '+' || *p == '-')) {
+			negativeExponent = *p == '-';
+			++p;
+		}
+		if (p == mEnd || !isDigit(*p))
+			return fail("Invalid number");
+		int e = 0;
+		for (; p < mEnd && isDigit(*p); ++p) {
+			if (e < 10000)
+				e = e * 10 + (*p - '0');
+		}
+		exponent += negativeExponent ? -e : e;
+	}
+	const char *start = mPos;
+	mPos = p;
+	if (value == 0)
+		return true;
+	double d = 0;
+	if (exact && exponent >= -MaxExactPower && exponent <= MaxExactPower) {
+		d = static_cast<double>(mantissa);
+		if (exponent < 0)
+			d /= ExactPowers[-exponent];
+		else
+			d *= ExactPowers[exponent];
+		if (negative)
+			d = -d;
+	} else {
+		// Slow path for numbers we do not see in practice. QByteArray uses the C locale.
+		d = QByteArray(start, static_cast<int>(p - start)).toDouble();
+	}
+	value->mType = JsonValue::Number;
+	value->mNumber = d;
+	return true;
+}
+
+bool JsonReader::parseLiteral(const char *literal, int length)
+{
+	if (mEnd - mPos < length || memcmp(mPos, literal, static_cast<size_t>(length)) != 0)
+		return fail("Invalid value");
+	mPos += length;
+	return true;
+}
+
+void JsonReader::skipWhitespace()
+{
+	while (mPos < mEnd && (*mPos == ' ' || *mPos == '\t' || *mPos == '\n' || *mPos == '\r'))
+		++mPos;
+}
+
+bool JsonReader::fail(const char *message)
+{
+	mError = QString::fromLatin1(message);
+	mErrorOffset = static_cast<int>(mPos - mBegin);
+	return false;
+}
@@ -0,0 +1,146 @@
+#ifndef JSON_READER_H
+#define JSON_READER_H
+
+#include <QByteArray>
+#include <QList>
+#include <QString>
+#include <QVector>
+
+/*!
+ * @brief Scalar value (string, number, boolean or null) found by JsonReader.
+ */
+class JsonValue
+{
+public:
+	enum Type
+	{
+		Null,
+		Bool,
+		Number,
+		String
+	};
+
+	JsonValue();
+
+	Type type() const;
+
+	bool isNull() const;
+
+	bool toBool() const;
+
+	double toDouble() const;
+
+	int toInt() const;
+
+	/*!
+	 * @brief Returns strings as is. Integral numbers are formatted without
+	 * decimals, so `"476"` and `476` give the same result.
+	 */
+	QString toString() const;
+
+private:
+	friend class JsonReader;
+
+	Type mType;
+	double mNumber;
+	QString mString;
+};
+
+/*!
+ * @brief Precompiled set of paths to the values extracted by JsonReader.
+ * A path lists the names of nested object members separated by slashes, eg.
+ * `Body/Data/PAC/Value`. A `*` matches any member name at that level. Array
+ * elements cannot be addressed.
+ * The index of a path in the list passed to the constructor identifies the
+ * path in JsonHandler::onValue.
+ */
+class JsonPaths
+{
+public:
+	JsonPaths(const char *const *paths, int count);
+
+	int count() const;
+
+private:
+	friend class JsonReader;
+
+	QVector<QList<QByteArray> > mPaths;
+};
+
+class JsonHandler
+{
+public:
+	virtual ~JsonHandler() {}
+
+	/*!
+	 * @brief Called for each scalar value whose location matches one of the
+	 * paths.
+	 * @param path The index of the matching path.
+	 * @param key The member name matched by the innermost `*` on the way to
+	 * the value. Empty if the path has no wildcard.
+	 * @param value The value. Only valid during the call.
+	 */
+	virtual void onValue(int path, const QByteArray &key, const JsonValue &value) = 0;
+};
+
+/*!
+ * @brief Streaming JSON reader which extracts values at known locations.
+ * The document is parsed in a single pass, without building an intermediate
+ * tree. Values which do not match any path are validated but not decoded.
+ * Handler callbacks are made while parsing, so a document which turns out to
+ * be invalid may already have reported some values.
+ */
+class JsonReader
+{
+public:
+	explicit JsonReader(const JsonPaths &paths);
+
+	bool read(const QByteArray &data, JsonHandler &handler);
+
+	bool read(const char *data, int size, JsonHandler &handler);
+
+	/// Description of the last error, empty if the last document was valid.
+	QString errorString() const;
+
+	/// Offset in the document where the last error was found.
+	int errorOffset() const;
+
+private:
+	bool parseValue(int depth, const int *candidates, int count);
+
+	bool parseObject(int depth, const int *candidates, int count);
+
+	bool skipValue(int depth);
+
+	bool skipContainer(int depth);
+
+	bool parseName(QByteArray *name);
+
+	bool parseString(QByteArray *out);
+
+	bool parseUnicodeEscape(uint &code);
+
+	bool parseScalar(JsonValue *value);
+
+	bool parseNumber(JsonValue *value);
+
+	bool parseLiteral(const char *literal, int length);
+
+	void skipWhitespace();
+
+	bool fail(const char *message);
+
+	const JsonPaths &mPaths;
+	const char *mBegin;
+	const char *mPos;
+	const char *mEnd;
+	JsonHandler *mHandler;
+	/// Member name matched by the innermost wildcard
+	QByteArray mKey;
+	/// Decoding buffer for strings
+	QByteArray mBuffer;
+	QString mError;
+	int mErrorOffset;
+};
+
+#endif // JSON_READER_H
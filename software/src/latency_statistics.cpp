@@ -0,0 +1,174 @@
+#include <QMutexLocker>
+#include "latency_statistics.h"
+
+static int loadRelaxed(const QAtomicInt &v)
+{
+#if QT_VERSION >= QT_VERSION_CHECK(5, 0, 0)
+	return v.load();
+#else
+	return v;
+#endif
+}
+
+LatencyHistogram::Snapshot::Snapshot()
+{
+	for (int i=0; i<BucketCount; ++i)
+		buckets[i] = 0;
+}
+
+int LatencyHistogram::Snapshot::count() const
+{
+	int result = 0;
+	for (int i=0; i<BucketCount; ++i)
+		result += buckets[i];
+	return result;
+}
+
+int LatencyHistogram::Snapshot::percentile(int p) const
+{
+	qint64 total = count();
+	if (total == 0)
+		return -1;
+	qint64 rank = qMax(Q_INT64_C(1), (total * qBound(0, p, 100) + 99) / 100);
+	qint64 sum = 0;
+	for (int i=0; i<BucketCount - 1; ++i) {
+		sum += buckets[i];
+		if (sum >= rank)
+			return upperBound(i);
+	}
+	return upperBound(BucketCount - 2);
+}
+
+LatencyHistogram::Snapshot LatencyHistogram::Snapshot::operator-(const Snapshot &other) const
+{
+	Snapshot result;
+	for (int i=0; i<BucketCount; ++i)
+		result.buckets[i] = buckets[i] - other.buckets[i];
+	return result;
+}
+
+LatencyHistogram::LatencyHistogram()
+{
+}
+
+void LatencyHistogram::add(qint64 ms)
+{
+	mBuckets[bucketIndex(ms)].fetchAndAddRelaxed(1);
+}
+
+int LatencyHistogram::count() const
+{
+	int result = 0;
+	for (int i=0; i<BucketCount; ++i)
+		result += loadRelaxed(mBuckets[i]);
+	return result;
+}
+
+int LatencyHistogram::bucketCount(int bucket) const
+{
+	Q_ASSERT(bucket >= 0 && bucket < BucketCount);
+	return loadRelaxed(mBuckets[bucket]);
+}
+
+int LatencyHistogram::percentile(int p) const
+{
+	// Take a snapshot first, so the buckets are consistent with the total count.
+	return snapshot().percentile(p);
+}
+
+LatencyHistogram::Snapshot LatencyHistogram::snapshot() const
+{
+	Snapshot result;
+	for (int i=0; i<BucketCount; ++i)
+		result.buckets[i] = loadRelaxed(mBuckets[i]);
+	return result;
+}
+
+int LatencyHistogram::bucketIndex(qint64 ms)
+{
+	int bucket = 0;
+	while (ms > 0 && bucket < BucketCount - 1) {
+		ms >>= 1;
+		++bucket;
+	}
+	return bucket;
+}
+
+int LatencyHistogram::upperBound(int bucket)
+{
+	Q_ASSERT(bucket >= 0 && bucket < BucketCount - 1);
+	return 1 << bucket;
+}
+
+LatencyStatistics::Entry::Entry()
+{
+}
+
+void LatencyStatistics::Entry::record(const Timestamps &t)
+{
+	if (t.enqueued >= 0 && t.written >= t.enqueued)
+		mHistograms[QueueStage].add(t.written - t.enqueued);
+	if (t.written >= 0 && t.firstByte >= t.written)
+		mHistograms[WaitStage].add(t.firstByte - t.written);
+	if (t.firstByte >= 0 && t.completed >= t.firstByte)
+		mHistograms[ReceiveStage].add(t.completed - t.firstByte);
+	if (t.enqueued >= 0 && t.completed >= t.enqueued)
+		mHistograms[TotalStage].add(t.completed - t.enqueued);
+}
+
+LatencyStatistics::LatencyStatistics()
+{
+}
+
+LatencyStatistics::~LatencyStatistics()
+{
+	qDeleteAll(mEntries);
+}
+
+LatencyStatistics &LatencyStatistics::instance()
+{
+	static LatencyStatistics statistics;
+	return statistics;
+}
+
+LatencyStatistics::Entry *LatencyStatistics::entry(const QString &key)
+{
+	QMutexLocker locker(&mMutex);
+	QMap<QString, Entry *>::Iterator it = mEntries.find(key);
+	if (it == mEntries.end())
+		it = mEntries.insert(key, new Entry());
+	return it.value();
+}
+
+QStringList LatencyStatistics::keys() const
+{
+	QMutexLocker locker(&mMutex);
+	return mEntries.keys();
+}
+
+QString LatencyStatistics::stageName(Stage stage)
+{
+	switch (stage) {
+	case QueueStage:
+		return "Queue";
+	case WaitStage:
+		return "Wait";
+	case ReceiveStage:
+		return "Receive";
+	case TotalStage:
+		return "Total";
+	default:
+		return QString();
+	}
+}
+
+QString LatencyStatistics::toPathElement(const QString &s)
+{
+	QString result = s;
+	for (int i=0; i<result.size(); ++i) {
+		QChar c = result.at(i);
+		if (!(c.isLetterOrNumber() && c.unicode() < 128) && c != '_')
+			result[i] = '_';
+	}
+	return result;
+}
@@ -0,0 +1,155 @@
+#ifndef LATENCY_STATISTICS_H
+#define LATENCY_STATISTICS_H
+
+#include <QAtomicInt>
+#include <QMap>
+#include <QMutex>
+#include <QString>
+#include <QStringList>
+
+/*!
+ * Histogram of latencies (in ms) with fixed, exponentially growing buckets.
+ *
+ * Bucket 0 holds values below 1ms, bucket i (0 < i < BucketCount - 1) holds values in
+ * [2^(i-1), 2^i), and the last bucket holds everything above. Adding a value is a single atomic
+ * increment, so the histogram may be filled from any thread without locking.
+ */
+class LatencyHistogram
+{
+public:
+	static const int BucketCount = 18;
+
+	/*!
+	 * Bucket counts of a histogram at a given time. The difference of two snapshots holds the
+	 * values added in between.
+	 */
+	struct Snapshot
+	{
+		Snapshot();
+
+		int count() const;
+
+		/// See `LatencyHistogram::percentile`.
+		int percentile(int p) const;
+
+		Snapshot operator-(const Snapshot &other) const;
+
+		int buckets[BucketCount];
+	};
+
+	LatencyHistogram();
+
+	void add(qint64 ms);
+
+	int count() const;
+
+	int bucketCount(int bucket) const;
+
+	/*!
+	 * Returns the upper bound (ms) of the bucket containing the given percentile (0-100), or -1 if
+	 * the histogram is empty. For values in the last bucket the lower bound is returned.
+	 */
+	int percentile(int p) const;
+
+	Snapshot snapshot() const;
+
+	static int bucketIndex(qint64 ms);
+
+	static int upperBound(int bucket);
+
+private:
+	Q_DISABLE_COPY(LatencyHistogram)
+
+	QAtomicInt mBuckets[BucketCount];
+};
+
+/*!
+ * Collects latency histograms of network transactions, keyed by a path like
+ * `Modbus/<host>/<unit>/<function>`.
+ *
+ * Each transaction goes through 4 stages: enqueued (requested by the application), written (sent
+ * to the socket), first byte of the response received, and completed. The histograms of an entry
+ * keep the time spent between those stages separately, so we can tell whether a slow transaction
+ * was waiting in our own queue, for the device, or for the rest of the response.
+ *
+ * Entries are never removed, so pointers returned by `entry` remain valid and may be cached.
+ * Creating an entry takes a lock, recording does not.
+ */
+class LatencyStatistics
+{
+public:
+	enum Stage
+	{
+		/// Enqueued until written
+		QueueStage,
+		/// Written until first byte of response
+		WaitStage,
+		/// First byte until complete
+		ReceiveStage,
+		/// Enqueued until complete
+		TotalStage,
+		StageCount
+	};
+
+	/// Timestamps (ms, from a monotonic clock) of a single transaction. -1 if unknown.
+	struct Timestamps
+	{
+		Timestamps():
+			enqueued(-1),
+			written(-1),
+			firstByte(-1),
+			completed(-1)
+		{
+		}
+
+		qint64 enqueued;
+		qint64 written;
+		qint64 firstByte;
+		qint64 completed;
+	};
+
+	class Entry
+	{
+	public:
+		Entry();
+
+		/// Adds the durations of all stages for which both timestamps are known.
+		void record(const Timestamps &t);
+
+		const LatencyHistogram &histogram(Stage stage) const
+		{
+			return mHistograms[stage];
+		}
+
+	private:
+		Q_DISABLE_COPY(Entry)
+
+		LatencyHistogram mHistograms[StageCount];
+	};
+
+	~LatencyStatistics();
+
+	static LatencyStatistics &instance();
+
+	/// Returns the entry with the given key. The entry is created if it does not exist.
+	Entry *entry(const QString &key);
+
+	QStringList keys() const;
+
+	/// Returns the name of a stage, as used on the D-Bus.
+	static QString stageName(Stage stage);
+
+	/*!
+	 * Replaces all characters that are not allowed in a D-Bus path element (like the dots in an
+	 * IP address) with underscores.
+	 */
+	static QString toPathElement(const QString &s);
+
+private:
+	LatencyStatistics();
+
+	mutable QMutex mMutex;
+	QMap<QString, Entry *> mEntries;
+};
+
+#endif // LATENCY_STATISTICS_H
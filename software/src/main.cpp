@@ -1,4 +1,5 @@
 #include <QCoreApplication>
+#include <QDateTime>
 #include <QsLog.h>
 #include <QStringList>
 #include <unistd.h>
@@ -6,6 +7,8 @@
 #include <velib/qt/ve_qitems_dbus.hpp>
 #include <velib/qt/ve_qitem_dbus_publisher.hpp>
 #include "dbus_fronius.h"
+#include "modbus_tcp_transport.h"
+#include "tcp_socket_options.h"
 #include "ve_service.h"
 
 void initDBus()
@@ -50,6 +53,8 @@ int main(int argc, char *argv[])
 
 	bool expectVerbosity = false;
 	bool expectDBusAddress = false;
+	bool expectUserTimeout = false;
+	TcpSocketOptions socketOptions;
 	QString dbusAddress = "system";
 	foreach (QString arg, a.arguments()) {
 		if (expectVerbosity) {
@@ -64,6 +69,9 @@ int main(int argc, char *argv[])
 		} else if (expectDBusAddress) {
 			dbusAddress = arg;
 			expectDBusAddress = false;
+		} else if (expectUserTimeout) {
+			socketOptions.userTimeout = qMax(0, arg.toInt());
+			expectUserTimeout = false;
 		}
 		if (arg == "-h" || arg == "--help") {
 			qDebug() << a.arguments().first();
@@ -75,6 +83,10 @@ int main(int argc, char *argv[])
 			qDebug() << "\t Set log level";
 			qDebug() << "\t-b, --dbus";
 			qDebug() << "\t dbus address or 'session' or 'system'";
+			qDebug() << "\t--modbus-thread";
+			qDebug() << "\t Handle Modbus TCP traffic in a separate thread";
+			qDebug() << "\t--tcp-user-timeout ms";
+			qDebug() << "\t Close connections with data unacknowledged for this long (0: system default)";
 			return 0;
 		}
 		if (arg == "-V" || arg == "--version") {
@@ -87,8 +99,13 @@ int main(int argc, char *argv[])
 			logger.setIncludeTimestamp(true);
 		} else if (arg == "-b" || arg == "--dbus") {
 			expectDBusAddress = true;
+		} else if (arg == "--modbus-thread") {
+			ModbusTcpTransport::setIoThreadEnabled(true);
+		} else if (arg == "--tcp-user-timeout") {
+			expectUserTimeout = true;
 		}
 	}
+	TcpSocketOptions::setGlobal(socketOptions);
 
 	VeQItemDbusProducer producer(VeQItems::getRoot(), "sub", true, false);
 	producer.setListenIndividually(true);
@@ -100,6 +117,9 @@ int main(int argc, char *argv[])
 
 	initDBus();
 
+	// Used for the jitter in reconnect delays, which should differ between restarts.
+	qsrand(static_cast<uint>(QDateTime::currentMSecsSinceEpoch()) ^ static_cast<uint>(getpid()));
+
 	DBusFronius test(&a);
 
 	return a.exec();
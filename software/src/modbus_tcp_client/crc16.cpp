@@ -1,7 +1,7 @@
 #include "crc16.h"
 
 /* Table of CRC values for high–order byte */
-static uint8_t CrcHi[] = {
+static const uint8_t CrcHi[] = {
 	0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0, 0x80, 0x41, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81,
 	0x40, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x00, 0xC1, 0x81, 0x40, 0x01, 0xC0,
 	0x80, 0x41, 0x01, 0xC0, 0x80, 0x41, 0x00, 0xC1, 0x81, 0x40, 0x00, 0xC1, 0x81, 0x40, 0x01,
@@ -23,7 +23,7 @@ static uint8_t CrcHi[] = {
 };
 
 /* Table of CRC values for low–order byte */
-static uint8_t CrcLo[] =
+static const uint8_t CrcLo[] =
 {
 	0x00, 0xC0, 0xC1, 0x01, 0xC3, 0x03, 0x02, 0xC2, 0xC6, 0x06, 0x07, 0xC7, 0x05, 0xC5, 0xC4,
 	0x04, 0xCC, 0x0C, 0x0D, 0xCD, 0x0F, 0xCF, 0xCE, 0x0E, 0x0A, 0xCA, 0xCB, 0x0B, 0xC9, 0x09,
@@ -59,13 +59,33 @@ void Crc16::add(uint8_t byte)
 
 void Crc16::add(const QByteArray &bytes)
 {
-	foreach (uint8_t b, bytes)
-		add(b);
+	add(bytes.constData(), bytes.size());
+}
+
+void Crc16::add(const char *data, int size)
+{
+	// Work on local copies, so the compiler can keep the state in registers.
+	uint8_t hi = mCrcHi;
+	uint8_t lo = mCrcLo;
+	const uint8_t *p = reinterpret_cast<const uint8_t *>(data);
+	const uint8_t *end = p + size;
+	for (; p < end; ++p) {
+		int index = hi ^ *p;
+		hi = lo ^ CrcHi[index];
+		lo = CrcLo[index];
+	}
+	mCrcHi = hi;
+	mCrcLo = lo;
 }
 
 uint16_t Crc16::getValue(const QByteArray &bytes)
+{
+	return getValue(bytes.constData(), bytes.size());
+}
+
+uint16_t Crc16::getValue(const char *data, int size)
 {
 	Crc16 crc;
-	crc.add(bytes);
+	crc.add(data, size);
 	return crc.getValue();
 }
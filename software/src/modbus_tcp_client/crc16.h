@@ -46,6 +46,8 @@ public:
 
 	void add(const QByteArray &bytes);
 
+	void add(const char *data, int size);
+
 	void reset()
 	{
 		mCrcLo = 0xFF;
@@ -59,6 +61,8 @@ public:
 	 */
 	static uint16_t getValue(const QByteArray &bytes);
 
+	static uint16_t getValue(const char *data, int size);
+
 private:
 	uint8_t mCrcLo;
 	uint8_t mCrcHi;
@@ -0,0 +1,68 @@
+#include "modbus_batch.h"
+#include "modbus_client.h"
+
+ModbusBatch::ModbusBatch(ModbusClient *client, quint8 unitId, QObject *parent):
+	QObject(parent),
+	mClient(client),
+	mUnitId(unitId),
+	mPendingCount(0),
+	mTimeout(0)
+{
+	Q_ASSERT(client != 0);
+}
+
+ModbusBatch::~ModbusBatch()
+{
+	// Requests still in progress are no longer needed.
+	foreach (ModbusReply *reply, mReplies)
+		mClient->cancel(reply);
+}
+
+int ModbusBatch::readHoldingRegisters(quint16 startReg, quint16 count)
+{
+	ModbusRequest request = ModbusRequest::readHoldingRegisters(mUnitId, startReg, count);
+	request.timeout = mTimeout;
+	return add(mClient->sendRequest(request));
+}
+
+int ModbusBatch::readInputRegisters(quint16 startReg, quint16 count)
+{
+	ModbusRequest request = ModbusRequest::readInputRegisters(mUnitId, startReg, count);
+	request.timeout = mTimeout;
+	return add(mClient->sendRequest(request));
+}
+
+void ModbusBatch::setTimeout(int t)
+{
+	mTimeout = qMax(0, t);
+}
+
+bool ModbusBatch::isFinished() const
+{
+	return mPendingCount == 0;
+}
+
+ModbusReply::ExceptionCode ModbusBatch::error() const
+{
+	foreach (ModbusReply *reply, mReplies) {
+		if (reply->error() != ModbusReply::NoException)
+			return reply->error();
+	}
+	return ModbusReply::NoException;
+}
+
+void ModbusBatch::onReplyFinished()
+{
+	Q_ASSERT(mPendingCount > 0);
+	--mPendingCount;
+	if (mPendingCount == 0)
+		emit finished();
+}
+
+int ModbusBatch::add(ModbusReply *reply)
+{
+	mReplies.append(reply);
+	++mPendingCount;
+	connect(reply, SIGNAL(finished()), this, SLOT(onReplyFinished()));
+	return mReplies.size() - 1;
+}
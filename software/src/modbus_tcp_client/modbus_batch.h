@@ -0,0 +1,79 @@
+#ifndef MODBUS_BATCH_H
+#define MODBUS_BATCH_H
+
+#include <QList>
+#include <QObject>
+#include "modbus_reply.h"
+
+class ModbusClient;
+
+/*!
+ * Groups a set of modbus requests, so they can be handled as a whole.
+ *
+ * All requests are handed to the client immediately. If the client supports more than one
+ * transaction in flight (see `ModbusTcpClient::setMaxPendingRequests`), they are sent to the
+ * device back-to-back instead of waiting for each reply in turn. The `finished` signal is emitted
+ * once, after all replies have been received (or have failed).
+ *
+ * The batch owns the replies it creates and will delete them when it is destroyed. Requests which
+ * have not been finished by then are cancelled.
+ */
+class ModbusBatch : public QObject
+{
+	Q_OBJECT
+public:
+	ModbusBatch(ModbusClient *client, quint8 unitId, QObject *parent = 0);
+
+	~ModbusBatch();
+
+	/*!
+	 * Adds a read request to the batch.
+	 * @return The index of the request, which can be passed to `reply`.
+	 */
+	int readHoldingRegisters(quint16 startReg, quint16 count);
+
+	int readInputRegisters(quint16 startReg, quint16 count);
+
+	/// Returns the timeout (ms) of the requests added from now on. 0 means the client timeout.
+	int timeout() const
+	{
+		return mTimeout;
+	}
+
+	void setTimeout(int t);
+
+	int count() const
+	{
+		return mReplies.size();
+	}
+
+	ModbusReply *reply(int index) const
+	{
+		return mReplies.at(index);
+	}
+
+	bool isFinished() const;
+
+	/*!
+	 * Returns the error of the first failed request in the batch, or `NoException` if all
+	 * requests succeeded.
+	 */
+	ModbusReply::ExceptionCode error() const;
+
+signals:
+	void finished();
+
+private slots:
+	void onReplyFinished();
+
+private:
+	int add(ModbusReply *reply);
+
+	ModbusClient *mClient;
+	QList<ModbusReply *> mReplies;
+	quint8 mUnitId;
+	int mPendingCount;
+	int mTimeout;
+};
+
+#endif // MODBUS_BATCH_H
@@ -1,7 +1,133 @@
 #include "modbus_client.h"
+#include "modbus_reply.h"
 
 ModbusClient::ModbusClient(QObject *parent):
-	QObject(parent)
+	QObject(parent),
+	mLastRequestId(0)
 {
 
 }
+
+ModbusReply *ModbusClient::sendRequest(const ModbusRequest &request)
+{
+	switch (request.function) {
+	case ModbusRequest::ReadHoldingRegisters:
+		return readHoldingRegisters(request.unitId, request.startReg, request.count);
+	case ModbusRequest::ReadInputRegisters:
+		return readInputRegisters(request.unitId, request.startReg, request.count);
+	case ModbusRequest::WriteSingleRegister:
+		return writeSingleHoldingRegister(request.unitId, request.startReg,
+										  request.values.value(0));
+	case ModbusRequest::WriteMultipleRegisters:
+		return writeMultipleHoldingRegisters(request.unitId, request.startReg, request.values);
+	case ModbusRequest::ReadWriteMultipleRegisters:
+		return readWriteMultipleRegisters(request.unitId, request.startReg, request.count,
+										  request.writeStartReg, request.values);
+	}
+	Q_ASSERT(false);
+	return 0;
+}
+
+quint32 ModbusClient::submit(const ModbusRequest &request, const ModbusCallback &callback)
+{
+	ModbusReply *reply = sendRequest(request);
+	Q_ASSERT(reply != 0);
+	SubmittedReply sr;
+	sr.requestId = nextRequestId();
+	sr.callback = callback;
+	mSubmittedReplies.insert(reply, sr);
+	connect(reply, SIGNAL(finished()), this, SLOT(onSubmittedReplyFinished()));
+	return sr.requestId;
+}
+
+void ModbusClient::cancelRequest(quint32 requestId)
+{
+	for (QHash<ModbusReply *, SubmittedReply>::Iterator it = mSubmittedReplies.begin();
+		 it != mSubmittedReplies.end(); ++it) {
+		if (it->requestId == requestId) {
+			ModbusReply *reply = it.key();
+			mSubmittedReplies.erase(it);
+			cancel(reply);
+			return;
+		}
+	}
+}
+
+void ModbusClient::cancel(ModbusReply *reply)
+{
+	if (reply == 0)
+		return;
+	if (!reply->isFinished()) {
+		disconnect(reply, SIGNAL(finished()), 0, 0);
+		// Replies may also come from elsewhere, eg. ModbusRegisterCache.
+		if (reply->parent() == this)
+			cancelTransaction(reply);
+	}
+	reply->deleteLater();
+}
+
+void ModbusClient::cancelAll(QObject *owner)
+{
+	cancelRequests(owner, false);
+	cancelReplies(owner, false);
+}
+
+void ModbusClient::cancelAll()
+{
+	cancelRequests(0, true);
+	cancelReplies(0, true);
+}
+
+void ModbusClient::cancelRequests(const void *object, bool all)
+{
+	QList<ModbusReply *> replies;
+	for (QHash<ModbusReply *, SubmittedReply>::Iterator it = mSubmittedReplies.begin();
+		 it != mSubmittedReplies.end();) {
+		if (all || it->callback.object() == object) {
+			replies.append(it.key());
+			it = mSubmittedReplies.erase(it);
+		} else {
+			++it;
+		}
+	}
+	foreach (ModbusReply *reply, replies)
+		cancel(reply);
+}
+
+quint32 ModbusClient::nextRequestId()
+{
+	++mLastRequestId;
+	if (mLastRequestId == 0)
+		++mLastRequestId;
+	return mLastRequestId;
+}
+
+void ModbusClient::onSubmittedReplyFinished()
+{
+	ModbusReply *reply = static_cast<ModbusReply *>(sender());
+	reply->deleteLater();
+	QHash<ModbusReply *, SubmittedReply>::Iterator it = mSubmittedReplies.find(reply);
+	if (it == mSubmittedReplies.end())
+		return;
+	SubmittedReply sr = it.value();
+	mSubmittedReplies.erase(it);
+	ModbusResult result;
+	result.requestId = sr.requestId;
+	result.error = reply->error();
+	result.registers = reply->registerView();
+	sr.callback(result);
+}
+
+void ModbusClient::cancelReplies(QObject *owner, bool all)
+{
+	QList<ModbusReply *> replies = findChildren<ModbusReply *>();
+	// Cancelling a transaction which is waiting for a response may cause the next queued request
+	// to be sent. The newest requests are cancelled first, so we will not send requests which are
+	// about to be cancelled.
+	for (int i=replies.size() - 1; i>=0; --i) {
+		ModbusReply *reply = replies[i];
+		if (reply->isFinished() || (!all && reply->owner() != owner))
+			continue;
+		cancel(reply);
+	}
+}
@@ -1,7 +1,9 @@
 #ifndef MODBUS_CLIENT_H
 #define MODBUS_CLIENT_H
 
+#include <QHash>
 #include <QObject>
+#include "modbus_request.h"
 
 class ModbusReply;
 
@@ -20,9 +22,97 @@ public:
 	virtual ModbusReply *writeMultipleHoldingRegisters(quint8 unitId, quint16 startReg,
 													   const QVector<quint16> &values) = 0;
 
+	/*!
+	 * Writes holding registers and reads holding registers in a single transaction (function
+	 * code 23). The device performs the write before the read. Devices which do not support this
+	 * function will answer with `ModbusReply::IllegalFunction`.
+	 * @return The registers read.
+	 */
+	virtual ModbusReply *readWriteMultipleRegisters(quint8 unitId, quint16 readStartReg,
+													quint16 readCount, quint16 writeStartReg,
+													const QVector<quint16> &values) = 0;
+
+	/*!
+	 * Sends the given request, and returns its reply. Same as calling the function above that
+	 * matches `request.function`, except that clients which support it (see `ModbusTcpClient`)
+	 * use `request.timeout` instead of the timeout of the client.
+	 */
+	virtual ModbusReply *sendRequest(const ModbusRequest &request);
+
 	virtual int timeout() const = 0;
 
 	virtual void setTimeout(int t) = 0;
+
+	/*!
+	 * Sends a request, and calls `callback` when the request has been handled, also if an error
+	 * occurred or the request timed out. The callback is never called from within `submit`.
+	 *
+	 * This is an alternative to the functions returning a `ModbusReply`, for users who send a lot
+	 * of requests: clients which support it (see `ModbusTcpClient`) keep the request in a
+	 * preallocated record, so no QObject, signal connection or deferred delete is involved. The
+	 * default implementation sends the request using the functions above.
+	 * @return An id, which may be passed to `cancelRequest`. Never 0.
+	 */
+	virtual quint32 submit(const ModbusRequest &request, const ModbusCallback &callback);
+
+	/*!
+	 * Cancels a request sent with `submit`. The callback will not be called. Does nothing if the
+	 * request has been handled already.
+	 */
+	virtual void cancelRequest(quint32 requestId);
+
+	/*!
+	 * Cancels the request of the given reply. An unfinished reply is removed from the send queue
+	 * (or the list of transactions waiting for a response) right away, and will never emit
+	 * `finished`. A response arriving later is ignored.
+	 * The reply is deleted later, so it is safe to cancel a reply from one of its slots. Finished
+	 * replies are simply deleted later.
+	 */
+	void cancel(ModbusReply *reply);
+
+	/*!
+	 * Cancels all requests of this client whose reply has been marked with the given owner (see
+	 * `ModbusReply::setOwner`), and all requests sent with `submit` whose callback is invoked on
+	 * the owner. Use this when the owner is being destroyed: a client may be shared by several
+	 * users, so other requests must not be affected.
+	 */
+	void cancelAll(QObject *owner);
+
+	/// Cancels all requests of this client.
+	void cancelAll();
+
+protected:
+	/*!
+	 * Called when an unfinished reply created by this client is cancelled. Implementations should
+	 * forget about the reply, and ignore responses to the request.
+	 */
+	virtual void cancelTransaction(ModbusReply *reply) = 0;
+
+	/*!
+	 * Cancels the requests sent with `submit` whose callback is invoked on `object`, or all of
+	 * them if `all` is set.
+	 */
+	virtual void cancelRequests(const void *object, bool all);
+
+	/// Returns the id for a new request sent with `submit`.
+	quint32 nextRequestId();
+
+private slots:
+	void onSubmittedReplyFinished();
+
+private:
+	/// A request sent with `submit`, using the reply based API.
+	struct SubmittedReply
+	{
+		quint32 requestId;
+		ModbusCallback callback;
+	};
+
+	/// Cancels the (unfinished) replies created by this client, newest first.
+	void cancelReplies(QObject *owner, bool all);
+
+	QHash<ModbusReply *, SubmittedReply> mSubmittedReplies;
+	quint32 mLastRequestId;
 };
 
 #endif // MODBUS_CLIENT_H
@@ -0,0 +1,93 @@
+#include "modbus_deadline_queue.h"
+
+void ModbusDeadlineQueue::push(qint64 deadline, quint16 transactionId, const void *tag)
+{
+	Entry e;
+	e.deadline = deadline;
+	e.transactionId = transactionId;
+	e.tag = tag;
+	QHash<const void *, int>::ConstIterator it = mPositions.constFind(tag);
+	if (it != mPositions.constEnd()) {
+		int index = it.value();
+		place(index, e);
+		restore(index);
+		return;
+	}
+	mEntries.append(e);
+	mPositions.insert(tag, mEntries.size() - 1);
+	siftUp(mEntries.size() - 1);
+}
+
+bool ModbusDeadlineQueue::remove(const void *tag)
+{
+	QHash<const void *, int>::ConstIterator it = mPositions.constFind(tag);
+	if (it == mPositions.constEnd())
+		return false;
+	removeAt(it.value());
+	return true;
+}
+
+bool ModbusDeadlineQueue::popExpired(qint64 now, Entry &entry)
+{
+	if (mEntries.isEmpty() || mEntries.first().deadline > now)
+		return false;
+	entry = mEntries.first();
+	removeAt(0);
+	return true;
+}
+
+void ModbusDeadlineQueue::removeAt(int index)
+{
+	mPositions.remove(mEntries[index].tag);
+	Entry last = mEntries.last();
+	mEntries.removeLast();
+	if (index == mEntries.size())
+		return;
+	place(index, last);
+	restore(index);
+}
+
+void ModbusDeadlineQueue::restore(int index)
+{
+	if (index > 0 && mEntries[index].deadline < mEntries[(index - 1) / 2].deadline)
+		siftUp(index);
+	else
+		siftDown(index);
+}
+
+void ModbusDeadlineQueue::siftUp(int index)
+{
+	Entry e = mEntries[index];
+	while (index > 0) {
+		int parent = (index - 1) / 2;
+		if (mEntries[parent].deadline <= e.deadline)
+			break;
+		place(index, mEntries[parent]);
+		index = parent;
+	}
+	place(index, e);
+}
+
+void ModbusDeadlineQueue::siftDown(int index)
+{
+	Entry e = mEntries[index];
+	int size = mEntries.size();
+	for (;;) {
+		int child = 2 * index + 1;
+		if (child >= size)
+			break;
+		if (child + 1 < size && mEntries[child + 1].deadline < mEntries[child].deadline)
+			++child;
+		if (e.deadline <= mEntries[child].deadline)
+			break;
+		place(index, mEntries[child]);
+		index = child;
+	}
+	place(index, e);
+}
+
+void ModbusDeadlineQueue::place(int index, const Entry &e)
+{
+	mEntries[index] = e;
+	mPositions[e.tag] = index;
+}
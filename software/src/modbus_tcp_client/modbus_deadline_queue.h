@@ -0,0 +1,82 @@
+#ifndef MODBUS_DEADLINE_QUEUE_H
+#define MODBUS_DEADLINE_QUEUE_H
+
+#include <QHash>
+#include <QVector>
+
+/*!
+ * Min-heap of transaction deadlines.
+ *
+ * Used by the modbus clients to track the timeouts of all outstanding transactions with a single
+ * timer, instead of registering a timer for each transaction. Each entry is identified by its
+ * tag (the object waiting for the transaction), and should be removed when the transaction
+ * completes, so the timer is only programmed for deadlines that may still expire. The heap keeps
+ * the position of each entry, so removal takes O(log n).
+ */
+class ModbusDeadlineQueue
+{
+public:
+	struct Entry
+	{
+		qint64 deadline;
+		quint16 transactionId;
+		/// Identifies the entry. Should not be dereferenced.
+		const void *tag;
+	};
+
+	/// Adds an entry. An entry with the same tag is replaced.
+	void push(qint64 deadline, quint16 transactionId, const void *tag);
+
+	/*!
+	 * Removes the entry with the given tag.
+	 * @return false if there is no such entry.
+	 */
+	bool remove(const void *tag);
+
+	bool isEmpty() const
+	{
+		return mEntries.isEmpty();
+	}
+
+	int size() const
+	{
+		return mEntries.size();
+	}
+
+	/// Returns the earliest deadline. The queue should not be empty.
+	qint64 nextDeadline() const
+	{
+		Q_ASSERT(!mEntries.isEmpty());
+		return mEntries.first().deadline;
+	}
+
+	/*!
+	 * Removes the entry with the earliest deadline, if it is not after `now`.
+	 * @return false if there is no expired entry.
+	 */
+	bool popExpired(qint64 now, Entry &entry);
+
+	void clear()
+	{
+		mEntries.clear();
+		mPositions.clear();
+	}
+
+private:
+	void removeAt(int index);
+
+	/// Moves the entry at `index` up or down until the heap is valid again.
+	void restore(int index);
+
+	void siftUp(int index);
+
+	void siftDown(int index);
+
+	void place(int index, const Entry &e);
+
+	QVector<Entry> mEntries;
+	/// Position of each entry in `mEntries`, per tag.
+	QHash<const void *, int> mPositions;
+};
+
+#endif // MODBUS_DEADLINE_QUEUE_H
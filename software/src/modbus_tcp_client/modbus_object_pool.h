@@ -0,0 +1,64 @@
+#ifndef MODBUS_OBJECT_POOL_H
+#define MODBUS_OBJECT_POOL_H
+
+#include <QtAlgorithms>
+#include <QVector>
+
+/*!
+ * Free list of objects which are reused instead of being allocated for each transaction.
+ *
+ * Objects are created when the pool is empty, and are only deleted when the pool is destroyed.
+ * Objects returned by `take` keep the state they had when they were released, so the user should
+ * initialize all members it relies on.
+ */
+template<typename T>
+class ModbusObjectPool
+{
+public:
+	ModbusObjectPool()
+	{
+	}
+
+	~ModbusObjectPool()
+	{
+		qDeleteAll(mObjects);
+	}
+
+	T *take()
+	{
+		if (mFree.isEmpty()) {
+			T *object = new T();
+			mObjects.append(object);
+			return object;
+		}
+		T *object = mFree.last();
+		mFree.removeLast();
+		return object;
+	}
+
+	void release(T *object)
+	{
+		Q_ASSERT(object != 0);
+		mFree.append(object);
+	}
+
+	/// Number of objects created by the pool.
+	int size() const
+	{
+		return mObjects.size();
+	}
+
+	/// Number of objects available for reuse.
+	int available() const
+	{
+		return mFree.size();
+	}
+
+private:
+	Q_DISABLE_COPY(ModbusObjectPool)
+
+	QVector<T *> mObjects;
+	QVector<T *> mFree;
+};
+
+#endif // MODBUS_OBJECT_POOL_H
@@ -0,0 +1,163 @@
+#include <algorithm>
+#include "modbus_batch.h"
+#include "modbus_client.h"
+#include "modbus_read_plan.h"
+
+static bool startsBefore(const ModbusRegisterRange &r0, const ModbusRegisterRange &r1)
+{
+	return r0.startReg < r1.startReg;
+}
+
+ModbusReadPlan::ModbusReadPlan(ModbusClient *client, quint8 unitId, QObject *parent):
+	QObject(parent),
+	mClient(client),
+	mBatch(0),
+	mUnitId(unitId),
+	mGapTolerance(0),
+	mTimeout(0)
+{
+	Q_ASSERT(client != 0);
+}
+
+void ModbusReadPlan::setGapTolerance(int t)
+{
+	mGapTolerance = qMax(0, t);
+}
+
+void ModbusReadPlan::setTimeout(int t)
+{
+	mTimeout = qMax(0, t);
+}
+
+void ModbusReadPlan::addRange(quint16 startReg, quint16 count)
+{
+	Q_ASSERT(mBatch == 0);
+	if (count > 0)
+		mRanges.append(ModbusRegisterRange(startReg, count));
+}
+
+void ModbusReadPlan::start()
+{
+	Q_ASSERT(mBatch == 0);
+	mRequests = plan(mRanges, mGapTolerance);
+	mBatch = new ModbusBatch(mClient, mUnitId, this);
+	mBatch->setTimeout(mTimeout);
+	foreach (const ModbusRegisterRange &r, mRequests)
+		mBatch->readHoldingRegisters(r.startReg, r.count);
+	connect(mBatch, SIGNAL(finished()), this, SLOT(onBatchFinished()));
+	if (mRequests.isEmpty())
+		QMetaObject::invokeMethod(this, "onBatchFinished", Qt::QueuedConnection);
+}
+
+int ModbusReadPlan::blockCount() const
+{
+	if (mBatch != 0)
+		return mRequests.size();
+	return plan(mRanges, mGapTolerance).size();
+}
+
+bool ModbusReadPlan::isFinished() const
+{
+	return mBatch != 0 && mBatch->isFinished();
+}
+
+ModbusReply::ExceptionCode ModbusReadPlan::error() const
+{
+	if (mBatch == 0)
+		return ModbusReply::NoException;
+	return mBatch->error();
+}
+
+bool ModbusReadPlan::contains(quint16 startReg, quint16 count) const
+{
+	return findRequest(startReg, count) >= 0;
+}
+
+ModbusRegisterView ModbusReadPlan::registers(quint16 startReg, quint16 count) const
+{
+	int i = findRequest(startReg, count);
+	if (i < 0)
+		return ModbusRegisterView();
+	if (startReg + count > mRequests[i].endReg())
+		return stitch(i, startReg, count);
+	return mValues[i].mid(startReg - mRequests[i].startReg, count);
+}
+
+QList<ModbusRegisterRange> ModbusReadPlan::plan(QList<ModbusRegisterRange> ranges,
+												int gapTolerance, int maxCount)
+{
+	Q_ASSERT(maxCount > 0);
+	std::sort(ranges.begin(), ranges.end(), startsBefore);
+	QList<ModbusRegisterRange> result;
+	foreach (const ModbusRegisterRange &r, ranges) {
+		if (!result.isEmpty()) {
+			ModbusRegisterRange &last = result.last();
+			int end = qMax(r.endReg(), last.endReg());
+			if (r.startReg <= last.endReg() + gapTolerance && end - last.startReg <= maxCount) {
+				last.count = static_cast<quint16>(end - last.startReg);
+				continue;
+			}
+		}
+		// Ranges are not split unless they do not fit in a single request, so each of them can
+		// be retrieved from a single reply.
+		for (int start = r.startReg; start < r.endReg(); start += maxCount) {
+			int count = qMin(r.endReg() - start, maxCount);
+			result.append(ModbusRegisterRange(static_cast<quint16>(start),
+											  static_cast<quint16>(count)));
+		}
+	}
+	return result;
+}
+
+void ModbusReadPlan::onBatchFinished()
+{
+	mValues.clear();
+	mStitched.clear();
+	for (int i=0; i<mBatch->count(); ++i) {
+		// The replies are owned by the batch, so the views remain valid.
+		ModbusRegisterView values = mBatch->reply(i)->registerView();
+		// Do not allow short replies to be mistaken for valid data.
+		if (values.size() != mRequests[i].count)
+			values = ModbusRegisterView();
+		mValues.append(values);
+	}
+	emit finished();
+}
+
+int ModbusReadPlan::findRequest(quint16 startReg, quint16 count) const
+{
+	int end = startReg + count;
+	for (int i=0; i<mRequests.size() && i<mValues.size(); ++i) {
+		const ModbusRegisterRange &r = mRequests[i];
+		if (r.startReg > startReg || startReg >= r.endReg())
+			continue;
+		// The requests are sorted by register, so a range that was split continues in the next
+		// requests.
+		for (int j=i; j<mRequests.size() && j<mValues.size(); ++j) {
+			if (mValues[j].isEmpty())
+				return -1;
+			if (j > i && mRequests[j].startReg != mRequests[j - 1].endReg())
+				return -1;
+			if (end <= mRequests[j].endReg())
+				return i;
+		}
+		return -1;
+	}
+	return -1;
+}
+
+ModbusRegisterView ModbusReadPlan::stitch(int first, quint16 startReg, quint16 count) const
+{
+	QVector<quint16> values;
+	values.reserve(count);
+	int end = startReg + count;
+	for (int i=first; values.size() < count; ++i) {
+		const ModbusRegisterRange &r = mRequests[i];
+		int offset = qMax(static_cast<int>(startReg), static_cast<int>(r.startReg)) - r.startReg;
+		int last = qMin(end, r.endReg()) - r.startReg;
+		for (int j=offset; j<last; ++j)
+			values.append(mValues[i][j]);
+	}
+	mStitched.append(values);
+	return ModbusRegisterView(mStitched.last());
+}
@@ -0,0 +1,147 @@
+#ifndef MODBUS_READ_PLAN_H
+#define MODBUS_READ_PLAN_H
+
+#include <QList>
+#include <QObject>
+#include <QVector>
+#include "modbus_reply.h"
+
+class ModbusBatch;
+class ModbusClient;
+
+struct ModbusRegisterRange
+{
+	ModbusRegisterRange():
+		startReg(0),
+		count(0)
+	{}
+
+	ModbusRegisterRange(quint16 startReg, quint16 count):
+		startReg(startReg),
+		count(count)
+	{}
+
+	/// Returns the first register after the range. Uses int to avoid overflow at 0xFFFF.
+	int endReg() const
+	{
+		return startReg + count;
+	}
+
+	bool operator==(const ModbusRegisterRange &other) const
+	{
+		return startReg == other.startReg && count == other.count;
+	}
+
+	quint16 startReg;
+	quint16 count;
+};
+
+/*!
+ * Reads a set of holding register ranges using as few requests as possible.
+ *
+ * Add all ranges needed (in any order), then call `start`. Ranges which overlap, are adjacent, or
+ * are separated by no more than `gapTolerance` registers are merged into a single request, as long
+ * as the request does not exceed `MaxRegistersPerRead`. The requests are sent as a `ModbusBatch`,
+ * so they are pipelined if the client allows it.
+ *
+ * After the `finished` signal, the register values are retrieved by register number, regardless
+ * of the request they were part of. A range which was split over several requests (because it
+ * exceeds `MaxRegistersPerRead`) is copied into a single buffer when it is retrieved; all other
+ * ranges refer to the values of the reply directly.
+ *
+ * Note that the gap registers are read as well. Some devices refuse requests which include
+ * unsupported registers, so the gap tolerance should only be raised for devices known to accept
+ * this.
+ */
+class ModbusReadPlan : public QObject
+{
+	Q_OBJECT
+public:
+	/// Maximum number of registers in a single read request, as defined by the Modbus spec.
+	static const int MaxRegistersPerRead = 125;
+
+	ModbusReadPlan(ModbusClient *client, quint8 unitId, QObject *parent = 0);
+
+	int gapTolerance() const
+	{
+		return mGapTolerance;
+	}
+
+	void setGapTolerance(int t);
+
+	/// Returns the timeout (ms) of the read requests. 0 (the default) means the client timeout.
+	int timeout() const
+	{
+		return mTimeout;
+	}
+
+	void setTimeout(int t);
+
+	void addRange(quint16 startReg, quint16 count);
+
+	/// Sends the read requests. Ranges should not be added afterwards.
+	void start();
+
+	/// Returns the number of requests needed to read all ranges added so far.
+	int blockCount() const;
+
+	/// Returns the requests which are sent by `start`.
+	QList<ModbusRegisterRange> requests() const
+	{
+		return mRequests;
+	}
+
+	bool isFinished() const;
+
+	/*!
+	 * Returns the error of the first failed request, or `NoException` if all requests succeeded.
+	 */
+	ModbusReply::ExceptionCode error() const;
+
+	/// Returns true if the values of all registers in the given range are available.
+	bool contains(quint16 startReg, quint16 count = 1) const;
+
+	/*!
+	 * Returns the values of the given registers, or an empty view if they are not (all)
+	 * available. The view is valid until the plan is deleted.
+	 */
+	ModbusRegisterView registers(quint16 startReg, quint16 count) const;
+
+	/*!
+	 * Merges `ranges` into the smallest number of ranges, where ranges separated by no more than
+	 * `gapTolerance` registers are joined, provided the result does not exceed `maxCount`
+	 * registers. Ranges larger than `maxCount` are split.
+	 */
+	static QList<ModbusRegisterRange> plan(QList<ModbusRegisterRange> ranges, int gapTolerance,
+										   int maxCount = MaxRegistersPerRead);
+
+signals:
+	void finished();
+
+private slots:
+	void onBatchFinished();
+
+private:
+	/*!
+	 * Returns the index of the first of the consecutive requests containing the given range, or -1
+	 * if some of the registers have not been read.
+	 */
+	int findRequest(quint16 startReg, quint16 count) const;
+
+	/// Copies the given range from the consecutive requests starting at `first`.
+	ModbusRegisterView stitch(int first, quint16 startReg, quint16 count) const;
+
+	ModbusClient *mClient;
+	ModbusBatch *mBatch;
+	QList<ModbusRegisterRange> mRanges;
+	QList<ModbusRegisterRange> mRequests;
+	/// Values of each request, or empty views for requests that failed.
+	QList<ModbusRegisterView> mValues;
+	/// Ranges spanning several requests, copied by `stitch`.
+	mutable QList<QVector<quint16> > mStitched;
+	quint8 mUnitId;
+	int mGapTolerance;
+	int mTimeout;
+};
+
+#endif // MODBUS_READ_PLAN_H
@@ -0,0 +1,157 @@
+#include <QCoreApplication>
+#include <QTimer>
+#include "modbus_client.h"
+#include "modbus_register_cache.h"
+
+ModbusRegisterCache::ModbusRegisterCache(QObject *parent):
+	QObject(parent),
+	mGeneration(0)
+{
+	mClock.start();
+}
+
+ModbusRegisterCache *ModbusRegisterCache::instance()
+{
+	static ModbusRegisterCache *cache = new ModbusRegisterCache(QCoreApplication::instance());
+	return cache;
+}
+
+ModbusReply *ModbusRegisterCache::readHoldingRegisters(ModbusClient *client,
+													   const QString &hostName, quint8 unitId,
+													   quint16 startReg, quint16 count, int ttl,
+													   int timeout)
+{
+	quint64 key = createKey(unitId, startReg, count);
+	QHash<QString, QHash<quint64, Entry> >::Iterator hit = mEntries.find(hostName);
+	if (hit != mEntries.end()) {
+		QHash<quint64, Entry>::Iterator it = hit->find(key);
+		if (it != hit->end()) {
+			if (it->expires > mClock.elapsed()) {
+				CachedReply *reply = new CachedReply(this);
+				reply->registers = it->registers;
+				if (mCachedReplies.isEmpty())
+					QTimer::singleShot(0, this, SLOT(onFinishCachedReplies()));
+				mCachedReplies.append(reply);
+				return reply;
+			}
+			hit->erase(it);
+		}
+	}
+	ModbusRequest read = ModbusRequest::readHoldingRegisters(unitId, startReg, count);
+	read.timeout = timeout;
+	ModbusReply *reply = client->sendRequest(read);
+	Request request;
+	request.hostName = hostName;
+	request.key = key;
+	request.ttl = ttl;
+	request.generation = mGeneration;
+	mRequests.insert(reply, request);
+	connect(reply, SIGNAL(finished()), this, SLOT(onReadFinished()));
+	connect(reply, SIGNAL(destroyed()), this, SLOT(onReadDestroyed()));
+	return reply;
+}
+
+void ModbusRegisterCache::invalidate(const QString &hostName, quint8 unitId)
+{
+	++mGeneration;
+	QHash<QString, QHash<quint64, Entry> >::Iterator hit = mEntries.find(hostName);
+	if (hit == mEntries.end())
+		return;
+	for (QHash<quint64, Entry>::Iterator it = hit->begin(); it != hit->end();) {
+		if (static_cast<quint8>(it.key() >> 32) == unitId)
+			it = hit->erase(it);
+		else
+			++it;
+	}
+	if (hit->isEmpty())
+		mEntries.erase(hit);
+}
+
+void ModbusRegisterCache::invalidate(const QString &hostName)
+{
+	++mGeneration;
+	mEntries.remove(hostName);
+}
+
+int ModbusRegisterCache::count() const
+{
+	int result = 0;
+	foreach (const QHash<quint64, Entry> &entries, mEntries)
+		result += entries.size();
+	return result;
+}
+
+void ModbusRegisterCache::onReadFinished()
+{
+	ModbusReply *reply = static_cast<ModbusReply *>(sender());
+	QHash<ModbusReply *, Request>::Iterator it = mRequests.find(reply);
+	if (it == mRequests.end())
+		return;
+	Request request = it.value();
+	mRequests.erase(it);
+	disconnect(reply, 0, this, 0);
+	if (reply->error() != ModbusReply::NoException || request.generation != mGeneration)
+		return;
+	removeExpired();
+	Entry e;
+	e.registers = reply->registers();
+	e.expires = mClock.elapsed() + request.ttl;
+	mEntries[request.hostName].insert(request.key, e);
+}
+
+void ModbusRegisterCache::onReadDestroyed()
+{
+	mRequests.remove(static_cast<ModbusReply *>(sender()));
+}
+
+void ModbusRegisterCache::onFinishCachedReplies()
+{
+	// Replies created while handling the results will be finished in the next round.
+	QList<QPointer<CachedReply> > replies = mCachedReplies;
+	mCachedReplies.clear();
+	foreach (const QPointer<CachedReply> &reply, replies) {
+		// The reply may have been deleted by its owner.
+		if (!reply.isNull())
+			reply->setResult(reply->registers);
+	}
+}
+
+quint64 ModbusRegisterCache::createKey(quint8 unitId, quint16 startReg, quint16 count)
+{
+	return (static_cast<quint64>(unitId) << 32) | (static_cast<quint64>(startReg) << 16) | count;
+}
+
+void ModbusRegisterCache::removeExpired()
+{
+	qint64 now = mClock.elapsed();
+	QHash<QString, QHash<quint64, Entry> >::Iterator hit = mEntries.begin();
+	while (hit != mEntries.end()) {
+		for (QHash<quint64, Entry>::Iterator it = hit->begin(); it != hit->end();) {
+			if (it->expires <= now)
+				it = hit->erase(it);
+			else
+				++it;
+		}
+		if (hit->isEmpty())
+			hit = mEntries.erase(hit);
+		else
+			++hit;
+	}
+}
+
+ModbusRegisterCache::CachedReply::CachedReply(QObject *parent):
+	ModbusReply(parent),
+	mFinished(false)
+{
+}
+
+bool ModbusRegisterCache::CachedReply::isFinished() const
+{
+	return mFinished;
+}
+
+void ModbusRegisterCache::CachedReply::onFinished()
+{
+	Q_ASSERT(!mFinished);
+	mFinished = true;
+}
@@ -0,0 +1,113 @@
+#ifndef MODBUS_REGISTER_CACHE_H
+#define MODBUS_REGISTER_CACHE_H
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QPointer>
+#include <QString>
+#include <QVector>
+#include "modbus_reply.h"
+
+class ModbusClient;
+
+/*!
+ * Caches the results of register reads which rarely change, such as SunSpec model 1 (common),
+ * model 120 (nameplate) and the layout of the model chain.
+ *
+ * Entries are keyed by host, unit id and register range. The caller specifies how long (`ttl`)
+ * the result of each read may be used, so different ranges may have a different lifetime.
+ * Entries are invalidated explicitly when the device configuration is known to have changed.
+ * Expired entries are removed when a new entry is added, so entries of devices which are no longer
+ * queried do not pile up.
+ *
+ * Only successful reads are cached. Replies served from the cache are finished from the event
+ * loop, so callers can connect to `finished` after the read call, just like they would when the
+ * request is sent to the device.
+ */
+class ModbusRegisterCache : public QObject
+{
+	Q_OBJECT
+public:
+	/// Creates a private cache. Most users should use the shared cache returned by `instance`.
+	explicit ModbusRegisterCache(QObject *parent = 0);
+
+	static ModbusRegisterCache *instance();
+
+	/*!
+	 * Returns a reply holding the requested holding registers. If the range is not cached (or the
+	 * entry has expired) the registers are read using `client`, and the result is cached for
+	 * `ttl` milliseconds.
+	 * @param timeout Timeout (ms) of the read, or 0 to use the timeout of the client.
+	 */
+	ModbusReply *readHoldingRegisters(ModbusClient *client, const QString &hostName,
+									  quint8 unitId, quint16 startReg, quint16 count, int ttl,
+									  int timeout = 0);
+
+	/// Removes all entries of the given unit.
+	void invalidate(const QString &hostName, quint8 unitId);
+
+	/// Removes all entries of the given host.
+	void invalidate(const QString &hostName);
+
+	/*!
+	 * Returns the number of entries. Expired entries are included until the next entry is
+	 * added.
+	 */
+	int count() const;
+
+private slots:
+	void onReadFinished();
+
+	void onReadDestroyed();
+
+	void onFinishCachedReplies();
+
+private:
+	class CachedReply : public ModbusReply
+	{
+	public:
+		CachedReply(QObject *parent = 0);
+
+		using ModbusReply::setResult;
+
+		virtual bool isFinished() const;
+
+		QVector<quint16> registers;
+
+	private:
+		virtual void onFinished();
+
+		bool mFinished;
+	};
+
+	struct Entry {
+		QVector<quint16> registers;
+		/// Time (`mClock`) after which the entry may no longer be used.
+		qint64 expires;
+	};
+
+	/// A read sent to the device, whose result will be cached.
+	struct Request {
+		QString hostName;
+		quint64 key;
+		qint64 ttl;
+		/// Value of `mGeneration` when the request was sent.
+		int generation;
+	};
+
+	static quint64 createKey(quint8 unitId, quint16 startReg, quint16 count);
+
+	/// Removes all entries which have expired, and hosts without entries.
+	void removeExpired();
+
+	QHash<QString, QHash<quint64, Entry> > mEntries;
+	QHash<ModbusReply *, Request> mRequests;
+	QList<QPointer<CachedReply> > mCachedReplies;
+	QElapsedTimer mClock;
+	/// Incremented on each invalidation, so results of reads sent before are not cached.
+	int mGeneration;
+};
+
+#endif // MODBUS_REGISTER_CACHE_H
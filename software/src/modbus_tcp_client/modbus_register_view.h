@@ -0,0 +1,98 @@
+#ifndef MODBUS_REGISTER_VIEW_H
+#define MODBUS_REGISTER_VIEW_H
+
+#include <QtGlobal>
+#include <QVector>
+
+/*!
+ * Read-only view on a sequence of register values, without owning them.
+ *
+ * Used to pass register values around without copying them. A view is only valid as long as the
+ * storage it refers to. The register view of a ModbusReply is valid until the reply is deleted.
+ */
+class ModbusRegisterView
+{
+public:
+	ModbusRegisterView():
+		mData(0),
+		mSize(0)
+	{}
+
+	ModbusRegisterView(const quint16 *data, int size):
+		mData(data),
+		mSize(size)
+	{}
+
+	/// Implicit, so functions taking a view also accept vectors.
+	ModbusRegisterView(const QVector<quint16> &values):
+		mData(values.constData()),
+		mSize(values.size())
+	{}
+
+	const quint16 *data() const
+	{
+		return mData;
+	}
+
+	int size() const
+	{
+		return mSize;
+	}
+
+	bool isEmpty() const
+	{
+		return mSize == 0;
+	}
+
+	quint16 at(int i) const
+	{
+		Q_ASSERT(i >= 0 && i < mSize);
+		return mData[i];
+	}
+
+	quint16 operator[](int i) const
+	{
+		return at(i);
+	}
+
+	/*!
+	 * Returns the view on `count` registers starting at `offset`. The result is clipped to the
+	 * registers available.
+	 */
+	ModbusRegisterView mid(int offset, int count) const
+	{
+		if (offset < 0 || offset >= mSize)
+			return ModbusRegisterView();
+		return ModbusRegisterView(mData + offset, qMin(count, mSize - offset));
+	}
+
+	QVector<quint16> toVector() const
+	{
+		QVector<quint16> result(mSize);
+		for (int i=0; i<mSize; ++i)
+			result[i] = mData[i];
+		return result;
+	}
+
+	bool operator==(const ModbusRegisterView &other) const
+	{
+		if (mSize != other.mSize)
+			return false;
+		for (int i=0; i<mSize; ++i) {
+			if (mData[i] != other.mData[i])
+				return false;
+		}
+		return true;
+	}
+
+	bool operator!=(const ModbusRegisterView &other) const
+	{
+		return !(*this == other);
+	}
+
+private:
+	const quint16 *mData;
+	int mSize;
+};
+
+#endif // MODBUS_REGISTER_VIEW_H
@@ -3,7 +3,9 @@
 
 ModbusReply::ModbusReply(QObject *parent) :
 	QObject(parent),
-	mError(NoException)
+	mRegisterCount(0),
+	mError(NoException),
+	mOwner(0)
 {
 }
 
@@ -16,17 +18,17 @@ QString ModbusReply::toString() const
 		QMetaEnum metaEnum = mo.enumerator(index);
 		s += QString("Error: %2\t").arg(metaEnum.valueToKey(mError));
 	}
-	if (mRegisters.isEmpty())
+	ModbusRegisterView registers = registerView();
+	if (registers.isEmpty())
 		return s;
 	s += "Registers: [";
-	int i = 0;
-	foreach (quint16 v, mRegisters) {
+	for (int i=0; i<registers.size(); ++i) {
+		quint16 v = registers[i];
 		s += QString::number(i);
 		s += ':';
 		s += "0x";
 		s += QString::number(v, 16).toUpper();
 		s += ", ";
-		++i;
 	}
 	s.remove(s.size() - 2, 2);
 	s += ']';
@@ -37,8 +39,24 @@ void ModbusReply::setResult(const QVector<quint16> &registers)
 {
 	if (isFinished())
 		return;
-	Q_ASSERT(mRegisters.isEmpty());
-	mRegisters = registers;
+	Q_ASSERT(mRegisterCount == 0);
+	quint16 *r = allocRegisters(registers.size());
+	for (int i=0; i<registers.size(); ++i)
+		r[i] = registers[i];
+	mError = NoException;
+	onFinished();
+	Q_ASSERT(isFinished());
+	emit finished();
+}
+
+void ModbusReply::setResult(const quint8 *data, int count)
+{
+	if (isFinished())
+		return;
+	Q_ASSERT(mRegisterCount == 0);
+	quint16 *r = allocRegisters(count);
+	for (int i=0; i<count; ++i, data += 2)
+		r[i] = static_cast<quint16>((data[0] << 8) | data[1]);
 	mError = NoException;
 	onFinished();
 	Q_ASSERT(isFinished());
@@ -54,3 +72,12 @@ void ModbusReply::setResult(ModbusReply::ExceptionCode error)
 	Q_ASSERT(isFinished());
 	emit finished();
 }
+
+quint16 *ModbusReply::allocRegisters(int count)
+{
+	mRegisterCount = count;
+	if (count <= InlineRegisterCount)
+		return mInlineRegisters;
+	mHeapRegisters.resize(count);
+	return mHeapRegisters.data();
+}
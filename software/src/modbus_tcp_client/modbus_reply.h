@@ -5,6 +5,7 @@
 #include <QVector>
 #include <QDebug>
 #include <QTextStream>
+#include "modbus_register_view.h"
 
 class ModbusReply : public QObject
 {
@@ -31,9 +32,30 @@ public:
 
 	Q_ENUMS(ExceptionCode)
 
+	/*!
+	 * Maximum number of register values stored inside the reply. Larger results are stored on the
+	 * heap. A single read request cannot return more than 125 registers, so this only happens
+	 * with results set from a vector.
+	 */
+	static const int InlineRegisterCount = 125;
+
+	/*!
+	 * Returns a copy of the register values. Use `registerView` to avoid the copy.
+	 */
 	QVector<quint16> registers() const
 	{
-		return mRegisters;
+		return registerView().toVector();
+	}
+
+	/*!
+	 * Returns the register values without copying them. The view is valid until the reply is
+	 * deleted.
+	 */
+	ModbusRegisterView registerView() const
+	{
+		return ModbusRegisterView(
+			mRegisterCount > InlineRegisterCount ? mHeapRegisters.constData() : mInlineRegisters,
+			mRegisterCount);
 	}
 
 	ExceptionCode error() const
@@ -43,6 +65,24 @@ public:
 
 	virtual bool isFinished() const = 0;
 
+	/*!
+	 * Returns the object handling the reply, as set with `setOwner`. Used by
+	 * `ModbusClient::cancelAll` to find the requests of a single user of a (shared) client.
+	 */
+	QObject *owner() const
+	{
+		return mOwner;
+	}
+
+	/*!
+	 * Sets the object handling the reply. The pointer is only used for comparison, so the owner
+	 * may be destroyed before the reply.
+	 */
+	void setOwner(QObject *owner)
+	{
+		mOwner = owner;
+	}
+
 	virtual QString toString() const;
 
 signals:
@@ -55,11 +95,24 @@ protected:
 
 	void setResult(const QVector<quint16> &registers);
 
+	/*!
+	 * Sets the result from raw register data as it appears on the wire.
+	 * @param data `2 * count` bytes holding the register values in network byte order.
+	 * @param count The number of registers.
+	 */
+	void setResult(const quint8 *data, int count);
+
 	void setResult(ExceptionCode error);
 
 private:
-	QVector<quint16> mRegisters;
+	/// Returns storage for `count` register values, and sets the register count.
+	quint16 *allocRegisters(int count);
+
+	quint16 mInlineRegisters[InlineRegisterCount];
+	QVector<quint16> mHeapRegisters;
+	int mRegisterCount;
 	ExceptionCode mError;
+	QObject *mOwner;
 };
 
 inline QDebug &operator<<(QDebug &str, const ModbusReply &reply)
@@ -0,0 +1,63 @@
+#include "modbus_request.h"
+
+ModbusRequest::ModbusRequest():
+	function(ReadHoldingRegisters),
+	unitId(0),
+	startReg(0),
+	count(0),
+	writeStartReg(0),
+	timeout(0)
+{
+}
+
+ModbusRequest ModbusRequest::readHoldingRegisters(quint8 unitId, quint16 startReg, quint16 count)
+{
+	ModbusRequest request;
+	request.function = ReadHoldingRegisters;
+	request.unitId = unitId;
+	request.startReg = startReg;
+	request.count = count;
+	return request;
+}
+
+ModbusRequest ModbusRequest::readInputRegisters(quint8 unitId, quint16 startReg, quint16 count)
+{
+	ModbusRequest request = readHoldingRegisters(unitId, startReg, count);
+	request.function = ReadInputRegisters;
+	return request;
+}
+
+ModbusRequest ModbusRequest::writeSingleHoldingRegister(quint8 unitId, quint16 reg, quint16 value)
+{
+	ModbusRequest request;
+	request.function = WriteSingleRegister;
+	request.unitId = unitId;
+	request.startReg = reg;
+	request.values.append(value);
+	return request;
+}
+
+ModbusRequest ModbusRequest::writeMultipleHoldingRegisters(quint8 unitId, quint16 startReg,
+														   const QVector<quint16> &values)
+{
+	ModbusRequest request;
+	request.function = WriteMultipleRegisters;
+	request.unitId = unitId;
+	request.startReg = startReg;
+	request.values = values;
+	return request;
+}
+
+ModbusRequest ModbusRequest::readWriteMultipleRegisters(quint8 unitId, quint16 readStartReg,
+														quint16 readCount, quint16 writeStartReg,
+														const QVector<quint16> &values)
+{
+	ModbusRequest request;
+	request.function = ReadWriteMultipleRegisters;
+	request.unitId = unitId;
+	request.startReg = readStartReg;
+	request.count = readCount;
+	request.writeStartReg = writeStartReg;
+	request.values = values;
+	return request;
+}
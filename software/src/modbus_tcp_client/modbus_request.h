@@ -0,0 +1,123 @@
+#ifndef MODBUS_REQUEST_H
+#define MODBUS_REQUEST_H
+
+#include <QVector>
+#include "modbus_register_view.h"
+#include "modbus_reply.h"
+
+/*!
+ * Describes a request sent with `ModbusClient::submit`. Use the static functions to create one.
+ */
+struct ModbusRequest
+{
+	enum Function
+	{
+		ReadHoldingRegisters		= 3,
+		ReadInputRegisters			= 4,
+		WriteSingleRegister			= 6,
+		WriteMultipleRegisters		= 16,
+		ReadWriteMultipleRegisters	= 23
+	};
+
+	ModbusRequest();
+
+	static ModbusRequest readHoldingRegisters(quint8 unitId, quint16 startReg, quint16 count);
+
+	static ModbusRequest readInputRegisters(quint8 unitId, quint16 startReg, quint16 count);
+
+	static ModbusRequest writeSingleHoldingRegister(quint8 unitId, quint16 reg, quint16 value);
+
+	static ModbusRequest writeMultipleHoldingRegisters(quint8 unitId, quint16 startReg,
+													   const QVector<quint16> &values);
+
+	static ModbusRequest readWriteMultipleRegisters(quint8 unitId, quint16 readStartReg,
+													quint16 readCount, quint16 writeStartReg,
+													const QVector<quint16> &values);
+
+	Function function;
+	quint8 unitId;
+	/// First register to read, or to write if nothing is read.
+	quint16 startReg;
+	/// Number of registers to read.
+	quint16 count;
+	/// First register to write (ReadWriteMultipleRegisters only).
+	quint16 writeStartReg;
+	/// Values to write.
+	QVector<quint16> values;
+	/*!
+	 * Time (ms) after which the request fails, or 0 to use the timeout of the client. Clients may
+	 * be shared by several users (see `ModbusTcpClientPool`), so users which need a specific
+	 * timeout should set it here instead of changing the timeout of the client.
+	 */
+	int timeout;
+};
+
+/*!
+ * Result passed to the callback of a request. The register view is only valid during the
+ * callback.
+ */
+struct ModbusResult
+{
+	/// The value returned by `ModbusClient::submit`.
+	quint32 requestId;
+	ModbusReply::ExceptionCode error;
+	/// Registers read, or the echoed value of WriteSingleRegister.
+	ModbusRegisterView registers;
+};
+
+/*!
+ * Completion callback for requests sent with `ModbusClient::submit`.
+ *
+ * Holds an object pointer and a member function, which is bound at compile time. Creating and
+ * calling the callback does not allocate memory or involve the meta object system:
+ *
+ *     client->submit(request, ModbusCallback::create<MyClass, &MyClass::onResult>(this));
+ */
+class ModbusCallback
+{
+public:
+	ModbusCallback():
+		mObject(0),
+		mStub(0)
+	{
+	}
+
+	template<class T, void (T::*Method)(const ModbusResult &)>
+	static ModbusCallback create(T *object)
+	{
+		ModbusCallback callback;
+		callback.mObject = object;
+		callback.mStub = &methodStub<T, Method>;
+		return callback;
+	}
+
+	bool isNull() const
+	{
+		return mStub == 0;
+	}
+
+	/// The object the callback will be invoked on. Used to cancel all requests of an object.
+	const void *object() const
+	{
+		return mObject;
+	}
+
+	void operator()(const ModbusResult &result) const
+	{
+		mStub(mObject, result);
+	}
+
+private:
+	typedef void (*Stub)(void *object, const ModbusResult &result);
+
+	template<class T, void (T::*Method)(const ModbusResult &)>
+	static void methodStub(void *object, const ModbusResult &result)
+	{
+		(static_cast<T *>(object)->*Method)(result);
+	}
+
+	void *mObject;
+	Stub mStub;
+};
+
+#endif // MODBUS_REQUEST_H
@@ -9,8 +9,16 @@ ModbusRtuClient::ModbusRtuClient(const QString &portName, int baudrate, QObject
 	ModbusClient(parent),
 	mSerialPort(veSerialAllocate(portName.toLatin1().data())),
 	mTimer(new QTimer(this)),
-	mActiveReply(0)
+	mGapTimer(new QTimer(this)),
+	mActiveReply(0),
+	mBusy(false),
+	mActiveUnit(0),
+	mResponseSize(0),
+	mRequestEndTime(0),
+	mBusIdleTime(0),
+	mTimeout(1000)
 {
+	mClock.start();
 	veSerialSetBaud(mSerialPort, static_cast<un32>(baudrate));
 	veSerialSetKind(mSerialPort, 0); // Requires external event pump
 	veSerialOpen(mSerialPort, 0);
@@ -23,123 +31,133 @@ ModbusRtuClient::ModbusRtuClient(const QString &portName, int baudrate, QObject
 		new QSocketNotifier(mSerialPort->fh, QSocketNotifier::Exception, this);
 	connect(errorNotifier, SIGNAL(activated(int)), this, SLOT(onError()));
 
-	mData.reserve(16);
-
-	resetStateEngine(true);
-	mTimer->setInterval(1000);
 	mTimer->setSingleShot(true);
 	connect(mTimer, SIGNAL(timeout()), this, SLOT(onTimeout()));
+	mGapTimer->setSingleShot(true);
+	connect(mGapTimer, SIGNAL(timeout()), this, SLOT(sendNext()));
 }
 
 ModbusRtuClient::~ModbusRtuClient()
 {
+	// The replies are deleted along with the client, and should not call back.
+	foreach (const Slave &slave, mSlaves) {
+		foreach (ModbusRtuReply *reply, slave.queue)
+			reply->detach();
+	}
+	if (mActiveReply != 0)
+		mActiveReply->detach();
 	veSerialClose(mSerialPort);
 	VeSerialPortFree(mSerialPort);
 }
 
 ModbusReply *ModbusRtuClient::readHoldingRegisters(quint8 unitId, quint16 startReg, quint16 count)
 {
-	return readRegisters(ReadHoldingRegisters, unitId, startReg, count);
+	return readRegisters(ModbusRtuReply::ReadHoldingRegisters, unitId, startReg, count);
 }
 
 ModbusReply *ModbusRtuClient::readInputRegisters(quint8 unitId, quint16 startReg, quint16 count)
 {
-	return readRegisters(ReadInputRegisters, unitId, startReg, count);
+	return readRegisters(ModbusRtuReply::ReadInputRegisters, unitId, startReg, count);
 }
 
 ModbusReply *ModbusRtuClient::writeSingleHoldingRegister(quint8 unitId, quint16 reg, quint16 value)
 {
-	Reply *cmd = new Reply(this);
-	cmd->function = WriteSingleRegister;
+	ModbusRtuReply *cmd = new ModbusRtuReply(this);
+	cmd->function = ModbusRtuReply::WriteSingleRegister;
 	cmd->slaveAddress = unitId;
 	cmd->reg = reg;
 	QVector<quint16> values;
 	values.append(value);
 	cmd->values = values;
-	send(cmd);
-	return cmd;
+	return send(cmd);
 }
 
 ModbusReply *ModbusRtuClient::writeMultipleHoldingRegisters(quint8 unitId, quint16 startReg,
 															const QVector<quint16> &values)
 {
-	Reply *cmd = new Reply(this);
-	cmd->function = WriteMultipleRegisters;
+	ModbusRtuReply *cmd = new ModbusRtuReply(this);
+	cmd->function = ModbusRtuReply::WriteMultipleRegisters;
 	cmd->slaveAddress = unitId;
 	cmd->reg = startReg;
 	cmd->values = values;
-	send(cmd);
-	return cmd;
+	return send(cmd);
+}
+
+ModbusReply *ModbusRtuClient::readWriteMultipleRegisters(quint8 unitId, quint16 readStartReg,
+														quint16 readCount, quint16 writeStartReg,
+														const QVector<quint16> &values)
+{
+	ModbusRtuReply *cmd = new ModbusRtuReply(this);
+	cmd->function = ModbusRtuReply::ReadWriteMultipleRegisters;
+	cmd->slaveAddress = unitId;
+	cmd->reg = readStartReg;
+	cmd->count = readCount;
+	cmd->writeReg = writeStartReg;
+	cmd->values = values;
+	return send(cmd);
 }
 
 int ModbusRtuClient::timeout() const
 {
-	return mTimer->interval();
+	return mTimeout;
 }
 
 void ModbusRtuClient::setTimeout(int t)
 {
-	mTimer->setInterval(t);
+	mTimeout = t;
 }
 
-void ModbusRtuClient::onTimeout()
+int ModbusRtuClient::responseTimeout(quint8 unitId, int requestSize, int responseSize) const
 {
-	if (mState == Idle || mActiveReply == 0)
-		return;
-	mActiveReply->setResult(ModbusReply::Timeout);
-	resetStateEngine(true);
-	processPending();
+	QHash<quint8, Slave>::const_iterator it = mSlaves.find(unitId);
+	if (it == mSlaves.end())
+		return mTimeout;
+	if (it->srtt < 0)
+		return it->backoff > 0 ? qMin(it->backoff, mTimeout) : mTimeout;
+	int baudrate = static_cast<int>(mSerialPort->baudrate);
+	qint64 frameTime = transmitTime(baudrate, requestSize) + transmitTime(baudrate, responseSize);
+	qint64 t = frameTime + it->srtt + 4 * it->rttvar;
+	int minimum = qMax(MinimumTimeout,
+					   static_cast<int>((MinimumFrameTimeFactor * frameTime + 999) / 1000));
+	int timeout = qMax(static_cast<int>((t + 999) / 1000), it->backoff);
+	return qBound(qMin(minimum, mTimeout), timeout, mTimeout);
 }
 
-bool ModbusRtuClient::processPacket()
+int ModbusRtuClient::silentInterval(int baudrate)
 {
-	if (mActiveReply == 0)
-		return true;
-	if (mCrc != mCrcBuilder.getValue()) {
-		// mActiveReply->setResult(ModbusReply::CrcError);
-		return false;
-	}
-	if (mUnitId != mActiveReply->slaveAddress)
-		return false;
-	if ((mFunction & 0x7F) != mActiveReply->function)
-		return false;
-	if ((mFunction & 0x80) != 0) {
-		quint8 errorCode = static_cast<quint8>(mData[0]);
-		mActiveReply->setResult(static_cast<ModbusReply::ExceptionCode>(errorCode));
-		return true;
-	}
-	switch (mFunction) {
-	case ReadHoldingRegisters:
-	case ReadInputRegisters:
-	{
-		QVector<quint16> registers;
-		for (int i=0; i<mData.length(); i+=2) {
-			registers.append(toUInt16(mData, i));
-		}
-		mActiveReply->setResult(registers);
-		break;
-	}
-	case WriteSingleRegister:
-	{
-		QVector<quint16> registers;
-		registers.append(toUInt16(mData, 0));
-		mActiveReply->setResult(registers);
-		break;
-	}
-	case WriteMultipleRegisters:
-	{
-		mActiveReply->setResult(ModbusReply::NoException);
-		break;
-	}
-	default:
-		return false;
+	if (baudrate > 19200)
+		return 1750;
+	// 3.5 characters of 11 bits (start bit, 8 data bits, parity and stop bit).
+	return (35 * 11 * 100000) / baudrate;
+}
+
+int ModbusRtuClient::transmitTime(int baudrate, int size)
+{
+	return static_cast<int>((static_cast<qint64>(size) * 11 * 1000000) / baudrate);
+}
+
+void ModbusRtuClient::onTimeout()
+{
+	if (!mBusy)
+		return;
+	Slave &slave = mSlaves[mActiveUnit];
+	if (slave.srtt < 0) {
+		// The slave never responded, so it is probably not there.
+		slave.backoff = MissedSlaveTimeout;
+	} else {
+		// The estimate is kept, but the slave gets more time until it responds again (like the
+		// retransmission timeout of TCP).
+		slave.backoff = qMin(2 * mTimer->interval(), mTimeout);
 	}
-	return true;
+	ModbusRtuReply *reply = mActiveReply;
+	endTransaction();
+	if (reply != 0)
+		reply->setResult(ModbusReply::Timeout);
 }
 
 void ModbusRtuClient::onReadyRead()
 {
-	quint8 buf[64];
+	quint8 buf[256];
 	bool first = true;
 	for (;;) {
 		ssize_t len = read(mSerialPort->fh, buf, sizeof(buf));
@@ -151,8 +169,8 @@ void ModbusRtuClient::onReadyRead()
 			emit serialEvent("Ready for reading but read 0 bytes. Device removed?");
 			return;
 		}
-		for (ssize_t i = 0; i<len; ++i)
-			handleByteRead(buf[i]);
+		mBusIdleTime = now();
+		handleData(buf, static_cast<int>(len));
 		if (len < static_cast<int>(sizeof(buf)))
 			break;
 		first = false;
@@ -164,199 +182,141 @@ void ModbusRtuClient::onError()
 	emit serialEvent("Serial error");
 }
 
-void ModbusRtuClient::handleByteRead(quint8 b)
+void ModbusRtuClient::cancelTransaction(ModbusReply *reply)
 {
-	if (mAddToCrc)
-		mCrcBuilder.add(b);
-	switch (mState) {
-	case Idle:
-		// We received data when we were not expecting any. Ignore the data.
-		break;
-	case Address:
-		mState = Function;
-		mUnitId = b;
-		break;
-	case Function:
-		mFunction = static_cast<FunctionCode>(b);
-		if ((mFunction & 0x80) != 0) {
-			// Exception
-			mCount = 1;
-			mState = Data;
-		} else {
-			switch (mFunction) {
-			case ReadHoldingRegisters:
-			case ReadInputRegisters:
-				mState = ByteCount;
-				break;
-			case WriteSingleRegister:
-				mState = StartAddressMsb;
-				break;
-			case WriteMultipleRegisters:
-				mState = StartAddressMsb;
-				break;
-			default:
-				resetStateEngine(false);
-				break;
-			}
-		}
-		break;
-	case ByteCount:
-		mCount = b;
-		if (mCount == 0) {
-			mState = CrcMsb;
-			mAddToCrc = false;
-		} else {
-			mState = Data;
-		}
-		break;
-	case StartAddressMsb:
-		mStartAddress = static_cast<quint16>(b << 8);
-		mState = StartAddressLsb;
-		break;
-	case StartAddressLsb:
-		Q_ASSERT(mFunction == WriteSingleRegister || mFunction == WriteMultipleRegisters);
-		mStartAddress |= b;
-		mCount = 2;
-		mState = Data;
-		break;
-	case Data:
-		if (mCount > 0) {
-			mData.append(static_cast<char>(b));
-			--mCount;
-		}
-		if (mCount == 0) {
-			mState = CrcMsb;
-			mAddToCrc = false;
-		}
-		break;
-	case CrcMsb:
-		mCrc = static_cast<quint16>(b << 8);
-		mState = CrcLsb;
-		break;
-	case CrcLsb:
-		mCrc |= b;
-		if (processPacket()) {
-			resetStateEngine(true);
-			processPending();
-		} else {
-			resetStateEngine(false);
-		}
-		break;
-	}
+	ModbusRtuReply *rtuReply = static_cast<ModbusRtuReply *>(reply);
+	rtuReply->detach();
+	removeReply(rtuReply);
 }
 
-void ModbusRtuClient::resetStateEngine(bool toIdle)
+void ModbusRtuClient::removeReply(const ModbusRtuReply *reply)
 {
-	mState = toIdle ? Idle : Address;
-	mCrcBuilder.reset();
-	mAddToCrc = true;
-	mData.clear();
-	if (toIdle)
-		mTimer->stop();
+	if (reply == mActiveReply) {
+		// Keep waiting for the response (or timeout), so it is not mistaken for the response
+		// to the next request.
+		mActiveReply = 0;
+		return;
+	}
+	QHash<quint8, Slave>::iterator it = mSlaves.find(reply->slaveAddress);
+	if (it == mSlaves.end())
+		return;
+	it->queue.removeOne(const_cast<ModbusRtuReply *>(reply));
+	if (it->queue.isEmpty())
+		mUnitOrder.removeOne(reply->slaveAddress);
 }
 
-void ModbusRtuClient::processPending()
+void ModbusRtuClient::sendNext()
 {
-	if (mPendingCommands.isEmpty()) {
-		mActiveReply = 0;
+	if (mBusy || mUnitOrder.isEmpty())
+		return;
+	int baudrate = static_cast<int>(mSerialPort->baudrate);
+	qint64 wait = mBusIdleTime + silentInterval(baudrate) - now();
+	if (wait > 0) {
+		mGapTimer->start(static_cast<int>((wait + 999) / 1000));
 		return;
 	}
-	Reply *cmd = mPendingCommands.first();
-	mPendingCommands.removeFirst();
-	send(cmd);
+	quint8 unitId = mUnitOrder.takeFirst();
+	Slave &slave = mSlaves[unitId];
+	ModbusRtuReply *reply = slave.queue.takeFirst();
+	// Move the slave to the end of the line.
+	if (!slave.queue.isEmpty())
+		mUnitOrder.append(unitId);
+
+	QByteArray frame = reply->createFrame();
+	mActiveReply = reply;
+	mActiveUnit = unitId;
+	mBusy = true;
+	mResponseSize = ModbusRtuDecoder::responseSize(reply);
+	mDecoder.reset();
+	veSerialPutBuf(mSerialPort, reinterpret_cast<un8 *>(frame.data()),
+				   static_cast<un32>(frame.size()));
+	// The frame is transmitted by the UART while we wait for the response.
+	mRequestEndTime = now() + transmitTime(baudrate, frame.size());
+	mBusIdleTime = mRequestEndTime;
+	mTimer->start(responseTimeout(unitId, frame.size(), mResponseSize));
 }
 
-ModbusReply *ModbusRtuClient::readRegisters(FunctionCode function, quint8 slaveAddress,
-											quint16 startReg, quint16 count)
+void ModbusRtuClient::handleData(const quint8 *data, int size)
 {
-	Reply *cmd = new Reply(this);
-	cmd->function = function;
-	cmd->slaveAddress = slaveAddress;
-	cmd->reg = startReg;
-	cmd->count = count;
-	send(cmd);
-	return cmd;
+	while (size > 0) {
+		// We received data when we were not expecting any. Ignore the data.
+		if (!mBusy)
+			return;
+		int consumed = 0;
+		ModbusRtuDecoder::Result result = mDecoder.add(data, size, consumed);
+		data += consumed;
+		size -= consumed;
+		switch (result) {
+		case ModbusRtuDecoder::Incomplete:
+			break;
+		case ModbusRtuDecoder::Complete:
+		{
+			if (mActiveReply != 0 && !mDecoder.setResult(mActiveReply)) {
+				// Not the response we are waiting for.
+				mDecoder.reset();
+				break;
+			}
+			// Time between the end of the request and the start of the response
+			int baudrate = static_cast<int>(mSerialPort->baudrate);
+			qint64 responseTime = now() - mRequestEndTime - transmitTime(baudrate, mResponseSize);
+			addResponseTime(mSlaves[mActiveUnit], static_cast<int>(qMax(Q_INT64_C(0), responseTime)));
+			// Requests created while handling the result have been queued.
+			endTransaction();
+			break;
+		}
+		case ModbusRtuDecoder::Invalid:
+			mDecoder.reset();
+			break;
+		}
+	}
 }
 
-void ModbusRtuClient::send(ModbusRtuClient::Reply *reply)
+void ModbusRtuClient::endTransaction()
 {
-	if (mState != Idle) {
-		Q_ASSERT(mActiveReply == 0);
-		mPendingCommands.append(reply);
-		return;
-	}
-	QByteArray frame;
-	frame.reserve(10);
-	frame.append(static_cast<char>(reply->slaveAddress));
-	frame.append(static_cast<char>(reply->function));
-	switch (reply->function) {
-	case ReadHoldingRegisters:
-	case ReadInputRegisters:
-		frame.append(static_cast<char>(msb(reply->reg)));
-		frame.append(static_cast<char>(lsb(reply->reg)));
-		frame.append(static_cast<char>(msb(reply->count)));
-		frame.append(static_cast<char>(lsb(reply->count)));
-		break;
-	case WriteSingleRegister:
-		Q_ASSERT(reply->values.count() == 1);
-		frame.append(static_cast<char>(msb(reply->reg)));
-		frame.append(static_cast<char>(lsb(reply->reg)));
-		frame.append(static_cast<char>(msb(reply->values.first())));
-		frame.append(static_cast<char>(lsb(reply->values.first())));
-		break;
-	case WriteMultipleRegisters:
-	{
-		Q_ASSERT(!reply->values.isEmpty());
-		int count = reply->values.count();
-		frame.append(static_cast<char>(msb(reply->reg)));
-		frame.append(static_cast<char>(lsb(reply->reg)));
-		frame.append(static_cast<char>(msb(count)));
-		frame.append(static_cast<char>(lsb(count)));
-		frame.append(static_cast<char>(msb(2 * count)));
-		frame.append(static_cast<char>(lsb(2 * count)));
-		break;
-	}
-	default:
-		qFatal("Unsupported function");
-		mTimer->start();
+	if (mActiveReply != 0)
+		mActiveReply->detach();
+	mActiveReply = 0;
+	mBusy = false;
+	mTimer->stop();
+	mBusIdleTime = qMax(mBusIdleTime, now());
+	sendNext();
+}
+
+void ModbusRtuClient::addResponseTime(Slave &slave, int responseTime)
+{
+	slave.backoff = 0;
+	if (slave.srtt < 0) {
+		slave.srtt = responseTime;
+		slave.rttvar = responseTime / 2;
 		return;
 	}
-	mActiveReply = reply;
-	quint16 crc = Crc16::getValue(frame);
-	frame.append(static_cast<char>(msb(crc)));
-	frame.append(static_cast<char>(lsb(crc)));
-	// Modbus requires a pause between sending of 3.5 times the interval needed
-	// to send a character. We use 4 characters here, just in case...
-	// We also assume 10 bits per caracter (8 data bits, 1 stop bit and 1 parity
-	// bit). Keep in mind that overestimating the character time does not hurt
-	// (a lot), but underestimating does.
-	// Then number of bits devided by the the baudrate (unit: bits/second) gives
-	// us the time in seconds. usleep wants time in microseconds, so we have to
-	// multiply by 1 million.
-	usleep((4 * 10 * 1000 * 1000) / mSerialPort->baudrate);
-	veSerialPutBuf(mSerialPort, reinterpret_cast<un8 *>(frame.data()),
-				   static_cast<un32>(frame.size()));
-	mTimer->start();
-	mState = Address;
+	slave.rttvar = (3 * slave.rttvar + qAbs(slave.srtt - responseTime)) / 4;
+	slave.srtt = (7 * slave.srtt + responseTime) / 8;
 }
 
-ModbusRtuClient::Reply::Reply(QObject *parent):
-	ModbusReply(parent),
-	function(ReadHoldingRegisters),
-	slaveAddress(0),
-	reg(0),
-	count(0),
-	finished(false)
+qint64 ModbusRtuClient::now() const
 {
+	return mClock.nsecsElapsed() / 1000;
 }
 
-bool ModbusRtuClient::Reply::isFinished() const
+ModbusReply *ModbusRtuClient::readRegisters(ModbusRtuReply::FunctionCode function,
+											quint8 slaveAddress, quint16 startReg, quint16 count)
 {
-	return finished;
+	ModbusRtuReply *cmd = new ModbusRtuReply(this);
+	cmd->function = function;
+	cmd->slaveAddress = slaveAddress;
+	cmd->reg = startReg;
+	cmd->count = count;
+	return send(cmd);
 }
 
-void ModbusRtuClient::Reply::onFinished()
+ModbusReply *ModbusRtuClient::send(ModbusRtuReply *reply)
 {
-	Q_ASSERT(!finished);
-	finished = true;
+	reply->attach(this);
+	Slave &slave = mSlaves[reply->slaveAddress];
+	if (slave.queue.isEmpty())
+		mUnitOrder.append(reply->slaveAddress);
+	slave.queue.append(reply);
+	sendNext();
+	return reply;
 }
@@ -2,6 +2,8 @@
 #define MODBUS_RTU_H
 
 #include <QByteArray>
+#include <QElapsedTimer>
+#include <QHash>
 #include <QList>
 #include <QMetaType>
 #include <QMutex>
@@ -9,9 +11,8 @@
 extern "C" {
 	#include <velib/platform/serial.h>
 }
-#include "crc16.h"
 #include "modbus_client.h"
-#include "modbus_reply.h"
+#include "modbus_rtu_frame.h"
 
 class QTimer;
 
@@ -21,13 +22,24 @@ Q_DECLARE_METATYPE(QList<quint16>)
  * Partial implementation of the Modbus RTU protocol.
  *
  * Supported functions: `ReadHoldingRegisters`, `ReadInputRegisters`,
- * and `WriteSingleRegister`.
+ * `WriteSingleRegister`, `WriteMultipleRegisters`, and `ReadWriteMultipleRegisters`.
  *
  * Communication is implemented asynchronously. It is allowed to add multiple
  * request at once. They will be queued and sent to the device whenever it is
  * ready (ie. all previous requests have been handled).
+ *
+ * Requests are queued per slave, and the slaves with pending requests are served round robin,
+ * so a slave with many requests cannot starve the others. Between frames the bus is kept silent
+ * for the interval required by the Modbus spec (see `silentInterval`), without blocking the event
+ * loop. The response timeout of each slave is derived from its measured response times, so a
+ * missing slave on a multi-drop bus does not stall the other slaves for the full `timeout`.
+ * When a slave misses a response, its estimate is kept but the timeout is doubled (up to
+ * `timeout`) until it responds again. A slave which never responded gets `MissedSlaveTimeout`
+ * after its first miss, instead of the full `timeout` for each request.
+ *
+ * The framing (see `ModbusRtuReply` and `ModbusRtuDecoder`) is shared with `ModbusRtuTcpClient`.
  */
-class ModbusRtuClient : public ModbusClient
+class ModbusRtuClient : public ModbusClient, private ModbusRtuReplyTracker
 {
 	Q_OBJECT
 public:
@@ -44,97 +56,125 @@ public:
 	virtual ModbusReply *writeMultipleHoldingRegisters(quint8 unitId, quint16 startReg,
 													   const QVector<quint16> &values);
 
+	virtual ModbusReply *readWriteMultipleRegisters(quint8 unitId, quint16 readStartReg,
+													quint16 readCount, quint16 writeStartReg,
+													const QVector<quint16> &values);
+
 	virtual int timeout() const;
 
 	virtual void setTimeout(int t);
 
+	/*!
+	 * Returns the current response timeout (ms) of the given slave for a request with the given
+	 * request and response sizes (bytes). This is `timeout()` until the response time of the slave
+	 * has been measured, or the slave has missed a response.
+	 */
+	int responseTimeout(quint8 unitId, int requestSize, int responseSize) const;
+
+	/*!
+	 * Returns the minimum silent interval between frames in microseconds: 3.5 character times, or
+	 * 1750us for baudrates above 19200 (as prescribed by the Modbus serial line spec).
+	 */
+	static int silentInterval(int baudrate);
+
+	/// Returns the time (us) needed to transmit `size` characters of 11 bits.
+	static int transmitTime(int baudrate, int size);
+
+	/*!
+	 * Lower limit (ms) of the adaptive response timeout. Leaves room for jitter in the response
+	 * time, eg. caused by USB serial adapters.
+	 */
+	static const int MinimumTimeout = 200;
+
+	/*!
+	 * The adaptive response timeout is at least this multiple of the time needed to transmit the
+	 * request and the response, so large frames at low baud rates are not cut short.
+	 */
+	static const int MinimumFrameTimeFactor = 3;
+
+	/*!
+	 * Response timeout (ms) of a slave which missed its first response, and has never responded.
+	 * Such a slave is probably not present, and it should not stall the bus for the full
+	 * `timeout` each time it is polled.
+	 */
+	static const int MissedSlaveTimeout = 400;
+
 signals:
 	void serialEvent(const char *message);
 
+protected:
+	/*!
+	 * Removes a queued request. If the request has been sent already, the client keeps waiting
+	 * for the response (or timeout), because the bus cannot be used before the slave is done.
+	 */
+	virtual void cancelTransaction(ModbusReply *reply);
+
 private slots:
 	void onTimeout();
 
-	bool processPacket();
-
 	void onReadyRead();
 
 	void onError();
 
-private:
-	enum FunctionCode
-	{
-		ReadCoils						= 1,
-		ReadDiscreteInputs				= 2,
-		ReadHoldingRegisters			= 3,
-		ReadInputRegisters				= 4,
-		WriteSingleCoil					= 5,
-		WriteSingleRegister				= 6,
-		WriteMultipleCoils				= 15,
-		WriteMultipleRegisters			= 16,
-		ReadFileRecord					= 20,
-		WriteFileRecord					= 21,
-		MaskWriteRegister				= 22,
-		ReadWriteMultipleRegisters		= 23,
-		ReadFIFOQueue					= 24,
-		EncapsulatedInterfaceTransport	= 43,
-	};
-
-	class Reply : public ModbusReply {
-	public:
-		Reply(QObject *parent = 0);
-
-		using ModbusReply::setResult;
-
-		virtual bool isFinished() const;
+	void sendNext();
 
-		QVector<quint16> values;
-		FunctionCode function;
-		quint8 slaveAddress;
-		quint16 reg;
-		quint16 count;
-		bool finished;
+private:
+	/// Removes a reply which is no longer needed (destroyed or cancelled).
+	virtual void removeReply(const ModbusRtuReply *reply);
 
-	private:
-		virtual void onFinished();
+	struct Slave
+	{
+		Slave():
+			srtt(-1),
+			rttvar(0),
+			backoff(0)
+		{}
+
+		QList<ModbusRtuReply *> queue;
+		/// Smoothed response time (us), -1 if not measured yet.
+		int srtt;
+		/// Response time variation (us).
+		int rttvar;
+		/// Minimum response timeout (ms) after a missed response, 0 if the last one arrived.
+		int backoff;
 	};
 
-	void handleByteRead(quint8 b);
+	void handleData(const quint8 *data, int size);
 
-	void resetStateEngine(bool toIdle);
+	/// Ends the current transaction and schedules the next request.
+	void endTransaction();
 
-	void processPending();
+	/// Updates the response time estimate of the slave (Jacobson/Karels, as used by TCP).
+	static void addResponseTime(Slave &slave, int responseTime);
 
-	ModbusReply *readRegisters(FunctionCode function, quint8 slaveAddress, quint16 startReg, quint16 count);
+	qint64 now() const;
 
-	void send(Reply *reply);
+	ModbusReply *readRegisters(ModbusRtuReply::FunctionCode function, quint8 slaveAddress,
+							   quint16 startReg, quint16 count);
 
-	enum ReadState {
-		Idle,
-		Address,
-		Function,
-		ByteCount,
-		StartAddressMsb,
-		StartAddressLsb,
-		Data,
-		CrcMsb,
-		CrcLsb
-	};
+	ModbusReply *send(ModbusRtuReply *reply);
 
 	VeSerialPort *mSerialPort;
 	QTimer *mTimer;
-	QList<Reply *> mPendingCommands;
-	Reply *mActiveReply;
-
-	// State engine
-	ReadState mState;
-	FunctionCode mFunction;
-	quint8 mCount;
-	quint16 mUnitId;
-	quint16 mStartAddress;
-	quint16 mCrc;
-	Crc16 mCrcBuilder;
-	bool mAddToCrc;
-	QByteArray mData;
+	QTimer *mGapTimer;
+	QElapsedTimer mClock;
+	QHash<quint8, Slave> mSlaves;
+	/// Slaves with pending requests, in the order in which they will be served.
+	QList<quint8> mUnitOrder;
+	/// The reply waiting for a response. May be 0 if the reply was deleted while waiting.
+	ModbusRtuReply *mActiveReply;
+	/// True while waiting for a response (or timeout).
+	bool mBusy;
+	/// Unit id of the slave we are waiting for.
+	quint8 mActiveUnit;
+	/// Expected size of the active response.
+	int mResponseSize;
+	/// Time (us, see `now`) at which the request has been transmitted completely.
+	qint64 mRequestEndTime;
+	/// Time (us) of the last activity on the bus.
+	qint64 mBusIdleTime;
+	int mTimeout;
+	ModbusRtuDecoder mDecoder;
 };
 
 #endif // MODBUS_RTU_H
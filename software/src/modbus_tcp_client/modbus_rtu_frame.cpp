@@ -0,0 +1,219 @@
+#include <string.h>
+#include "modbus_rtu_frame.h"
+
+ModbusRtuReply::ModbusRtuReply(QObject *parent):
+	ModbusReply(parent),
+	function(ReadHoldingRegisters),
+	slaveAddress(0),
+	reg(0),
+	count(0),
+	writeReg(0),
+	finished(false),
+	mTracker(0)
+{
+}
+
+ModbusRtuReply::~ModbusRtuReply()
+{
+	// Done here rather than in a slot connected to `destroyed`, which is emitted when the members
+	// of the reply (eg. `slaveAddress`) are gone.
+	if (mTracker != 0)
+		mTracker->removeReply(this);
+}
+
+bool ModbusRtuReply::isFinished() const
+{
+	return finished;
+}
+
+QByteArray ModbusRtuReply::createFrame() const
+{
+	QByteArray frame;
+	frame.reserve(10);
+	frame.append(static_cast<char>(slaveAddress));
+	frame.append(static_cast<char>(function));
+	switch (function) {
+	case ReadHoldingRegisters:
+	case ReadInputRegisters:
+		frame.append(static_cast<char>(msb(reg)));
+		frame.append(static_cast<char>(lsb(reg)));
+		frame.append(static_cast<char>(msb(count)));
+		frame.append(static_cast<char>(lsb(count)));
+		break;
+	case WriteSingleRegister:
+		Q_ASSERT(values.count() == 1);
+		frame.append(static_cast<char>(msb(reg)));
+		frame.append(static_cast<char>(lsb(reg)));
+		frame.append(static_cast<char>(msb(values.first())));
+		frame.append(static_cast<char>(lsb(values.first())));
+		break;
+	case WriteMultipleRegisters:
+	{
+		Q_ASSERT(!values.isEmpty());
+		int valueCount = values.count();
+		frame.append(static_cast<char>(msb(reg)));
+		frame.append(static_cast<char>(lsb(reg)));
+		frame.append(static_cast<char>(msb(valueCount)));
+		frame.append(static_cast<char>(lsb(valueCount)));
+		appendValues(frame, values);
+		break;
+	}
+	case ReadWriteMultipleRegisters:
+	{
+		Q_ASSERT(!values.isEmpty());
+		int valueCount = values.count();
+		frame.append(static_cast<char>(msb(reg)));
+		frame.append(static_cast<char>(lsb(reg)));
+		frame.append(static_cast<char>(msb(count)));
+		frame.append(static_cast<char>(lsb(count)));
+		frame.append(static_cast<char>(msb(writeReg)));
+		frame.append(static_cast<char>(lsb(writeReg)));
+		frame.append(static_cast<char>(msb(valueCount)));
+		frame.append(static_cast<char>(lsb(valueCount)));
+		appendValues(frame, values);
+		break;
+	}
+	default:
+		qFatal("Unsupported function");
+		break;
+	}
+	quint16 crc = Crc16::getValue(frame);
+	frame.append(static_cast<char>(msb(crc)));
+	frame.append(static_cast<char>(lsb(crc)));
+	return frame;
+}
+
+void ModbusRtuReply::onFinished()
+{
+	Q_ASSERT(!finished);
+	finished = true;
+}
+
+void ModbusRtuReply::appendValues(QByteArray &frame, const QVector<quint16> &values)
+{
+	frame.append(static_cast<char>(2 * values.count()));
+	foreach (quint16 value, values) {
+		frame.append(static_cast<char>(msb(value)));
+		frame.append(static_cast<char>(lsb(value)));
+	}
+}
+
+ModbusRtuDecoder::ModbusRtuDecoder()
+{
+	reset();
+}
+
+void ModbusRtuDecoder::reset()
+{
+	mSize = 0;
+	mFrameSize = 0;
+	mDataOffset = 0;
+	mDataSize = 0;
+}
+
+ModbusRtuDecoder::Result ModbusRtuDecoder::add(const quint8 *data, int size, int &consumed)
+{
+	consumed = 0;
+	while (consumed < size) {
+		// Until the header is complete we do not know how much data we need.
+		int needed = mFrameSize > 0 ? mFrameSize - mSize : (mSize < 2 ? 2 - mSize : 3 - mSize);
+		int count = qMin(needed, size - consumed);
+		memcpy(mFrame + mSize, data + consumed, static_cast<size_t>(count));
+		mSize += count;
+		consumed += count;
+		if (mFrameSize == 0 && mSize >= 2 && !parseHeader())
+			return Invalid;
+		if (mFrameSize > 0 && mSize == mFrameSize) {
+			const char *frame = reinterpret_cast<const char *>(mFrame);
+			quint16 crc = toUInt16(mFrame[mSize - 2], mFrame[mSize - 1]);
+			return crc == Crc16::getValue(frame, mSize - 2) ? Complete : Invalid;
+		}
+	}
+	return Incomplete;
+}
+
+bool ModbusRtuDecoder::parseHeader()
+{
+	quint8 function = mFrame[1];
+	if ((function & 0x80) != 0) {
+		// Exception: address, function, exception code, CRC
+		mDataOffset = 2;
+		mDataSize = 1;
+	} else {
+		switch (function) {
+		case ModbusRtuReply::ReadHoldingRegisters:
+		case ModbusRtuReply::ReadInputRegisters:
+		case ModbusRtuReply::ReadWriteMultipleRegisters:
+			// We need the byte count.
+			if (mSize < 3)
+				return true;
+			mDataOffset = 3;
+			mDataSize = mFrame[2];
+			break;
+		case ModbusRtuReply::WriteSingleRegister:
+		case ModbusRtuReply::WriteMultipleRegisters:
+			// Address, function, start address (2), value or count (2), CRC
+			mDataOffset = 4;
+			mDataSize = 2;
+			break;
+		default:
+			return false;
+		}
+	}
+	mFrameSize = mDataOffset + mDataSize + 2;
+	return true;
+}
+
+bool ModbusRtuDecoder::setResult(ModbusRtuReply *reply) const
+{
+	quint8 function = functionCode();
+	if (unitId() != reply->slaveAddress)
+		return false;
+	if ((function & 0x7F) != reply->function)
+		return false;
+	if ((function & 0x80) != 0) {
+		reply->setResult(static_cast<ModbusReply::ExceptionCode>(data()[0]));
+		return true;
+	}
+	// A response with the right address and function may still belong to an earlier request
+	// (which timed out), so the byte count or the echoed request is checked as well.
+	switch (function) {
+	case ModbusRtuReply::ReadHoldingRegisters:
+	case ModbusRtuReply::ReadInputRegisters:
+	case ModbusRtuReply::ReadWriteMultipleRegisters:
+		if (dataSize() != 2 * reply->count)
+			return false;
+		reply->setResult(data(), dataSize() / 2);
+		break;
+	case ModbusRtuReply::WriteSingleRegister:
+		if (toUInt16(mFrame[2], mFrame[3]) != reply->reg ||
+			toUInt16(data()[0], data()[1]) != reply->values.value(0))
+			return false;
+		reply->setResult(data(), 1);
+		break;
+	case ModbusRtuReply::WriteMultipleRegisters:
+		if (toUInt16(mFrame[2], mFrame[3]) != reply->reg ||
+			toUInt16(data()[0], data()[1]) != reply->values.count())
+			return false;
+		reply->setResult(ModbusReply::NoException);
+		break;
+	default:
+		return false;
+	}
+	return true;
+}
+
+int ModbusRtuDecoder::responseSize(const ModbusRtuReply *request)
+{
+	switch (request->function) {
+	case ModbusRtuReply::ReadHoldingRegisters:
+	case ModbusRtuReply::ReadInputRegisters:
+	case ModbusRtuReply::ReadWriteMultipleRegisters:
+		return 5 + 2 * request->count;
+	case ModbusRtuReply::WriteSingleRegister:
+	case ModbusRtuReply::WriteMultipleRegisters:
+		return 8;
+	default:
+		return 0;
+	}
+}
@@ -0,0 +1,191 @@
+#ifndef MODBUS_RTU_FRAME_H
+#define MODBUS_RTU_FRAME_H
+
+#include <QByteArray>
+#include <QVector>
+#include "crc16.h"
+#include "modbus_reply.h"
+
+class ModbusRtuReply;
+
+/*!
+ * Implemented by the clients using `ModbusRtuReply`, which keep track of the replies they have
+ * queued or sent.
+ */
+class ModbusRtuReplyTracker
+{
+public:
+	/// Called by a reply which is destroyed while it is still being tracked (see `attach`).
+	virtual void removeReply(const ModbusRtuReply *reply) = 0;
+
+protected:
+	~ModbusRtuReplyTracker() {}
+};
+
+/*!
+ * Reply of a Modbus RTU transaction. Holds the request parameters, which are needed to create the
+ * request frame and to check whether a response belongs to the request.
+ *
+ * Shared by all clients using RTU framing (`ModbusRtuClient` and `ModbusRtuTcpClient`).
+ */
+class ModbusRtuReply : public ModbusReply
+{
+public:
+	enum FunctionCode
+	{
+		ReadCoils						= 1,
+		ReadDiscreteInputs				= 2,
+		ReadHoldingRegisters			= 3,
+		ReadInputRegisters				= 4,
+		WriteSingleCoil					= 5,
+		WriteSingleRegister				= 6,
+		WriteMultipleCoils				= 15,
+		WriteMultipleRegisters			= 16,
+		ReadFileRecord					= 20,
+		WriteFileRecord					= 21,
+		MaskWriteRegister				= 22,
+		ReadWriteMultipleRegisters		= 23,
+		ReadFIFOQueue					= 24,
+		EncapsulatedInterfaceTransport	= 43,
+	};
+
+	ModbusRtuReply(QObject *parent = 0);
+
+	/// Removes the reply from its tracker, if any.
+	virtual ~ModbusRtuReply();
+
+	/*!
+	 * Sets the client keeping track of the reply. The reply removes itself from the tracker when
+	 * it is destroyed, while its request parameters are still valid.
+	 */
+	void attach(ModbusRtuReplyTracker *tracker)
+	{
+		mTracker = tracker;
+	}
+
+	/// Called when the tracker no longer keeps track of the reply.
+	void detach()
+	{
+		mTracker = 0;
+	}
+
+	using ModbusReply::setResult;
+
+	virtual bool isFinished() const;
+
+	/// Returns the request frame, including the CRC.
+	QByteArray createFrame() const;
+
+	QVector<quint16> values;
+	FunctionCode function;
+	quint8 slaveAddress;
+	quint16 reg;
+	quint16 count;
+	/// Start register of the write part of ReadWriteMultipleRegisters.
+	quint16 writeReg;
+	bool finished;
+
+private:
+	virtual void onFinished();
+
+	/// Appends the byte count and the register values of a write request.
+	static void appendValues(QByteArray &frame, const QVector<quint16> &values);
+
+	ModbusRtuReplyTracker *mTracker;
+};
+
+/*!
+ * Decodes Modbus RTU response frames from a byte stream.
+ *
+ * RTU frames do not contain a length field. The length is derived from the function code and
+ * (for reads) the byte count, so only responses to the supported functions can be decoded.
+ * Received data is copied into the frame buffer in blocks, and the CRC is computed over the
+ * complete frame at once.
+ */
+class ModbusRtuDecoder
+{
+public:
+	/// Address (1) + function (1) + byte count (1) + 255 data bytes + CRC (2)
+	static const int MaxFrameSize = 260;
+
+	enum Result
+	{
+		/// More data is needed
+		Incomplete,
+		/// A frame with a valid CRC has been received
+		Complete,
+		/// Unsupported function code or CRC error
+		Invalid
+	};
+
+	ModbusRtuDecoder();
+
+	/// Starts decoding a new frame.
+	void reset();
+
+	/*!
+	 * Adds received bytes. Bytes following the end of the frame are not used. After `Complete` or
+	 * `Invalid` has been returned, `reset` should be called before the next frame is decoded.
+	 * @param consumed Set to the number of bytes used.
+	 */
+	Result add(const quint8 *data, int size, int &consumed);
+
+	Result add(quint8 b)
+	{
+		int consumed = 0;
+		return add(&b, 1, consumed);
+	}
+
+	quint8 unitId() const
+	{
+		return mFrame[0];
+	}
+
+	/// The function code of the response. The high bit is set for exception responses.
+	quint8 functionCode() const
+	{
+		return mFrame[1];
+	}
+
+	/*!
+	 * The payload of the frame: the register values for reads, the register value for
+	 * WriteSingleRegister, the register count for WriteMultipleRegisters and the exception code
+	 * for exception responses.
+	 */
+	const quint8 *data() const
+	{
+		return mFrame + mDataOffset;
+	}
+
+	int dataSize() const
+	{
+		return mDataSize;
+	}
+
+	/*!
+	 * Finishes the reply with the decoded response. Besides the address and function code, the
+	 * byte count of reads and the echoed register and value (or count) of writes must match the
+	 * request.
+	 * @return false if the response does not belong to the request.
+	 */
+	bool setResult(ModbusRtuReply *reply) const;
+
+	/// Returns the size of the response to the given request, or 0 if it is unknown.
+	static int responseSize(const ModbusRtuReply *request);
+
+private:
+	/*!
+	 * Computes the size of the frame (and the location of the payload) from the header.
+	 * @return false if the header is not valid.
+	 */
+	bool parseHeader();
+
+	quint8 mFrame[MaxFrameSize];
+	int mSize;
+	/// Size of the complete frame, or 0 if not known yet.
+	int mFrameSize;
+	int mDataOffset;
+	int mDataSize;
+};
+
+#endif // MODBUS_RTU_FRAME_H
@@ -0,0 +1,306 @@
+#include <QTcpSocket>
+#include <QTimer>
+#include <QsLog.h>
+#include "modbus_rtu_tcp_client.h"
+#include "tcp_socket_options.h"
+
+ModbusRtuTcpClient::ModbusRtuTcpClient(QObject *parent):
+	ModbusClient(parent),
+	mSocket(new QTcpSocket(this)),
+	mTimeoutTimer(new QTimer(this)),
+	mGapTimer(new QTimer(this)),
+	mActiveReply(0),
+	mBusy(false),
+	mLastFrameTime(0),
+	mInterFrameGap(DefaultInterFrameGap),
+	mTcpPort(0),
+	mConnectionOpen(false)
+{
+	mClock.start();
+	mTimeoutTimer->setInterval(1000);
+	mTimeoutTimer->setSingleShot(true);
+	connect(mTimeoutTimer, SIGNAL(timeout()), this, SLOT(onTimeout()));
+	mGapTimer->setSingleShot(true);
+	connect(mGapTimer, SIGNAL(timeout()), this, SLOT(sendNext()));
+	connect(mSocket, SIGNAL(readyRead()), this, SLOT(onReadyRead()));
+	connect(mSocket, SIGNAL(connected()), this, SLOT(onConnected()));
+	connect(mSocket, SIGNAL(disconnected()), this, SLOT(onDisconnected()));
+	connect(mSocket, SIGNAL(error(QAbstractSocket::SocketError)),
+			this, SLOT(onSocketErrorReceived(QAbstractSocket::SocketError)));
+}
+
+ModbusRtuTcpClient::~ModbusRtuTcpClient()
+{
+	// The replies are deleted along with the client, and should not call back.
+	foreach (ModbusRtuReply *reply, mQueue)
+		reply->detach();
+	if (mActiveReply != 0)
+		mActiveReply->detach();
+}
+
+void ModbusRtuTcpClient::connectToServer(const QString &hostName, quint16 tcpPort)
+{
+	mHostName = hostName;
+	mTcpPort = tcpPort;
+	startConnect();
+}
+
+bool ModbusRtuTcpClient::isConnected() const
+{
+	return mSocket->state() == QAbstractSocket::ConnectedState;
+}
+
+QString ModbusRtuTcpClient::hostName() const
+{
+	return mHostName;
+}
+
+quint16 ModbusRtuTcpClient::port() const
+{
+	return mTcpPort;
+}
+
+int ModbusRtuTcpClient::interFrameGap() const
+{
+	return mInterFrameGap;
+}
+
+void ModbusRtuTcpClient::setInterFrameGap(int gap)
+{
+	mInterFrameGap = qMax(0, gap);
+}
+
+ModbusReply *ModbusRtuTcpClient::readHoldingRegisters(quint8 unitId, quint16 startReg,
+													  quint16 count)
+{
+	return readRegisters(ModbusRtuReply::ReadHoldingRegisters, unitId, startReg, count);
+}
+
+ModbusReply *ModbusRtuTcpClient::readInputRegisters(quint8 unitId, quint16 startReg,
+													quint16 count)
+{
+	return readRegisters(ModbusRtuReply::ReadInputRegisters, unitId, startReg, count);
+}
+
+ModbusReply *ModbusRtuTcpClient::writeSingleHoldingRegister(quint8 unitId, quint16 reg,
+															quint16 value)
+{
+	ModbusRtuReply *reply = new ModbusRtuReply(this);
+	reply->function = ModbusRtuReply::WriteSingleRegister;
+	reply->slaveAddress = unitId;
+	reply->reg = reg;
+	reply->values.append(value);
+	return send(reply);
+}
+
+ModbusReply *ModbusRtuTcpClient::writeMultipleHoldingRegisters(quint8 unitId, quint16 startReg,
+															   const QVector<quint16> &values)
+{
+	ModbusRtuReply *reply = new ModbusRtuReply(this);
+	reply->function = ModbusRtuReply::WriteMultipleRegisters;
+	reply->slaveAddress = unitId;
+	reply->reg = startReg;
+	reply->values = values;
+	return send(reply);
+}
+
+ModbusReply *ModbusRtuTcpClient::readWriteMultipleRegisters(quint8 unitId, quint16 readStartReg,
+															quint16 readCount,
+															quint16 writeStartReg,
+															const QVector<quint16> &values)
+{
+	ModbusRtuReply *reply = new ModbusRtuReply(this);
+	reply->function = ModbusRtuReply::ReadWriteMultipleRegisters;
+	reply->slaveAddress = unitId;
+	reply->reg = readStartReg;
+	reply->count = readCount;
+	reply->writeReg = writeStartReg;
+	reply->values = values;
+	return send(reply);
+}
+
+int ModbusRtuTcpClient::timeout() const
+{
+	return mTimeoutTimer->interval();
+}
+
+void ModbusRtuTcpClient::setTimeout(int t)
+{
+	mTimeoutTimer->setInterval(t);
+}
+
+void ModbusRtuTcpClient::onConnected()
+{
+	mTimeoutTimer->stop();
+	TcpSocketOptions::global().apply(mSocket);
+	mDecoder.reset();
+	emit connected();
+	sendNext();
+}
+
+void ModbusRtuTcpClient::onDisconnected()
+{
+	closeConnection();
+}
+
+void ModbusRtuTcpClient::onSocketErrorReceived(QAbstractSocket::SocketError error)
+{
+	Q_UNUSED(error)
+	// A broken connection is reported with both an error and `disconnected` by the socket.
+	closeConnection();
+}
+
+void ModbusRtuTcpClient::onReadyRead()
+{
+	char buffer[256];
+	for (;;) {
+		qint64 count = mSocket->read(buffer, sizeof(buffer));
+		if (count <= 0)
+			return;
+		const quint8 *data = reinterpret_cast<const quint8 *>(buffer);
+		int size = static_cast<int>(count);
+		while (size > 0) {
+			// We received data when we were not expecting any. Ignore the data.
+			if (!mBusy)
+				break;
+			int consumed = 0;
+			ModbusRtuDecoder::Result result = mDecoder.add(data, size, consumed);
+			data += consumed;
+			size -= consumed;
+			switch (result) {
+			case ModbusRtuDecoder::Incomplete:
+				break;
+			case ModbusRtuDecoder::Complete:
+				if (mActiveReply != 0 && !mDecoder.setResult(mActiveReply)) {
+					// Not the response we are waiting for.
+					mDecoder.reset();
+					break;
+				}
+				endTransaction();
+				break;
+			case ModbusRtuDecoder::Invalid:
+				mDecoder.reset();
+				break;
+			}
+		}
+	}
+}
+
+void ModbusRtuTcpClient::onTimeout()
+{
+	if (mSocket->state() == QAbstractSocket::HostLookupState ||
+		mSocket->state() == QAbstractSocket::ConnectingState) {
+		// Does not emit `disconnected`, because the socket was not connected.
+		mSocket->abort();
+		closeConnection();
+		return;
+	}
+	if (!mBusy)
+		return;
+	ModbusRtuReply *reply = mActiveReply;
+	endTransaction();
+	if (reply != 0)
+		reply->setResult(ModbusReply::Timeout);
+}
+
+void ModbusRtuTcpClient::cancelTransaction(ModbusReply *reply)
+{
+	ModbusRtuReply *rtuReply = static_cast<ModbusRtuReply *>(reply);
+	rtuReply->detach();
+	removeReply(rtuReply);
+}
+
+void ModbusRtuTcpClient::removeReply(const ModbusRtuReply *reply)
+{
+	if (reply == mActiveReply) {
+		// Keep waiting for the response (or timeout), so it is not mistaken for the response
+		// to the next request.
+		mActiveReply = 0;
+		return;
+	}
+	mQueue.removeOne(const_cast<ModbusRtuReply *>(reply));
+}
+
+void ModbusRtuTcpClient::startConnect()
+{
+	// Closes the current connection (if any) first, which fails the requests sent on it.
+	mSocket->abort();
+	mConnectionOpen = true;
+	mSocket->connectToHost(mHostName, mTcpPort);
+	// Also used as connect timeout, because no request is sent before the connection is up.
+	mTimeoutTimer->start();
+}
+
+void ModbusRtuTcpClient::closeConnection()
+{
+	if (!mConnectionOpen)
+		return;
+	mConnectionOpen = false;
+	failAll(ModbusReply::TcpError);
+	emit disconnected();
+}
+
+void ModbusRtuTcpClient::sendNext()
+{
+	if (mBusy || mQueue.isEmpty() || !isConnected())
+		return;
+	qint64 wait = mLastFrameTime + mInterFrameGap - mClock.elapsed();
+	if (wait > 0) {
+		mGapTimer->start(static_cast<int>(wait));
+		return;
+	}
+	mActiveReply = mQueue.takeFirst();
+	mBusy = true;
+	mDecoder.reset();
+	mSocket->write(mActiveReply->createFrame());
+	mTimeoutTimer->start();
+}
+
+ModbusReply *ModbusRtuTcpClient::readRegisters(ModbusRtuReply::FunctionCode function,
+											   quint8 unitId, quint16 startReg, quint16 count)
+{
+	ModbusRtuReply *reply = new ModbusRtuReply(this);
+	reply->function = function;
+	reply->slaveAddress = unitId;
+	reply->reg = startReg;
+	reply->count = count;
+	return send(reply);
+}
+
+ModbusReply *ModbusRtuTcpClient::send(ModbusRtuReply *reply)
+{
+	reply->attach(this);
+	mQueue.append(reply);
+	// Requests are not kept waiting for a connection which has been lost.
+	if (!mConnectionOpen && !mHostName.isEmpty())
+		startConnect();
+	sendNext();
+	return reply;
+}
+
+void ModbusRtuTcpClient::endTransaction()
+{
+	if (mActiveReply != 0)
+		mActiveReply->detach();
+	mActiveReply = 0;
+	mBusy = false;
+	mTimeoutTimer->stop();
+	mLastFrameTime = mClock.elapsed();
+	sendNext();
+}
+
+void ModbusRtuTcpClient::failAll(ModbusReply::ExceptionCode error)
+{
+	QList<ModbusRtuReply *> replies = mQueue;
+	if (mActiveReply != 0)
+		replies.prepend(mActiveReply);
+	mQueue.clear();
+	mActiveReply = 0;
+	mBusy = false;
+	mTimeoutTimer->stop();
+	mGapTimer->stop();
+	foreach (ModbusRtuReply *reply, replies)
+		reply->detach();
+	foreach (ModbusRtuReply *reply, replies)
+		reply->setResult(error);
+}
@@ -0,0 +1,135 @@
+#ifndef MODBUS_RTU_TCP_CLIENT_H
+#define MODBUS_RTU_TCP_CLIENT_H
+
+#include <QAbstractSocket>
+#include <QElapsedTimer>
+#include <QList>
+#include "modbus_client.h"
+#include "modbus_rtu_frame.h"
+
+class QTimer;
+
+/*!
+ * Modbus RTU over TCP client.
+ *
+ * Sends raw RTU frames (including CRC, without MBAP header) over a TCP connection, as expected by
+ * most RS485-to-Ethernet bridges in transparent mode. RTU frames do not have a transaction id,
+ * so there is only one request on the bus at a time. Queued requests are sent back-to-back, with
+ * a minimum gap (`interFrameGap`) between the end of a response and the next request, which gives
+ * the bridge time to detect the end of the previous frame on the serial bus.
+ *
+ * When the connection is lost (or cannot be established), all queued requests fail with
+ * `TcpError`. A request sent afterwards starts a new connection attempt to the same server. A
+ * connection attempt which takes longer than `timeout` fails as well.
+ *
+ * The framing is shared with `ModbusRtuClient` (see `ModbusRtuReply` and `ModbusRtuDecoder`).
+ */
+class ModbusRtuTcpClient : public ModbusClient, private ModbusRtuReplyTracker
+{
+	Q_OBJECT
+public:
+	/// Default gap (ms) between a response and the next request.
+	static const int DefaultInterFrameGap = 5;
+
+	ModbusRtuTcpClient(QObject *parent = 0);
+
+	virtual ~ModbusRtuTcpClient();
+
+	void connectToServer(const QString &hostName, quint16 tcpPort);
+
+	bool isConnected() const;
+
+	QString hostName() const;
+
+	quint16 port() const;
+
+	int interFrameGap() const;
+
+	void setInterFrameGap(int gap);
+
+	virtual ModbusReply *readHoldingRegisters(quint8 unitId, quint16 startReg, quint16 count);
+
+	virtual ModbusReply *readInputRegisters(quint8 unitId, quint16 startReg, quint16 count);
+
+	virtual ModbusReply *writeSingleHoldingRegister(quint8 unitId, quint16 reg, quint16 value);
+
+	virtual ModbusReply *writeMultipleHoldingRegisters(quint8 unitId, quint16 startReg,
+													   const QVector<quint16> &values);
+
+	virtual ModbusReply *readWriteMultipleRegisters(quint8 unitId, quint16 readStartReg,
+													quint16 readCount, quint16 writeStartReg,
+													const QVector<quint16> &values);
+
+	virtual int timeout() const;
+
+	virtual void setTimeout(int t);
+
+signals:
+	void connected();
+
+	/// Emitted once when the connection is lost, or when a connection attempt fails.
+	void disconnected();
+
+protected:
+	/*!
+	 * Removes a queued request. If the request has been sent already, the client keeps waiting
+	 * for the response (or timeout), so the response is not mistaken for the response to the
+	 * next request.
+	 */
+	virtual void cancelTransaction(ModbusReply *reply);
+
+private slots:
+	void onConnected();
+
+	void onDisconnected();
+
+	void onSocketErrorReceived(QAbstractSocket::SocketError error);
+
+	void onReadyRead();
+
+	void onTimeout();
+
+	void sendNext();
+
+private:
+	/// Removes a reply which is no longer needed (destroyed or cancelled).
+	virtual void removeReply(const ModbusRtuReply *reply);
+
+	void startConnect();
+
+	/*!
+	 * Fails all requests and emits `disconnected`, unless this has been done already for the
+	 * current connection (attempt).
+	 */
+	void closeConnection();
+
+	ModbusReply *readRegisters(ModbusRtuReply::FunctionCode function, quint8 unitId,
+							   quint16 startReg, quint16 count);
+
+	ModbusReply *send(ModbusRtuReply *reply);
+
+	/// Ends the current transaction and schedules the next request.
+	void endTransaction();
+
+	void failAll(ModbusReply::ExceptionCode error);
+
+	QAbstractSocket *mSocket;
+	QTimer *mTimeoutTimer;
+	QTimer *mGapTimer;
+	QElapsedTimer mClock;
+	QList<ModbusRtuReply *> mQueue;
+	/// The reply waiting for a response. May be 0 if the reply was deleted while waiting.
+	ModbusRtuReply *mActiveReply;
+	/// True while waiting for a response (or timeout).
+	bool mBusy;
+	/// Time (`mClock`) at which the last transaction ended.
+	qint64 mLastFrameTime;
+	int mInterFrameGap;
+	ModbusRtuDecoder mDecoder;
+	QString mHostName;
+	quint16 mTcpPort;
+	/// Set from the start of a connection attempt until the connection is closed.
+	bool mConnectionOpen;
+};
+
+#endif // MODBUS_RTU_TCP_CLIENT_H
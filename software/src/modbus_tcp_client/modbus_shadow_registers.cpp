@@ -0,0 +1,112 @@
+#include "modbus_shadow_registers.h"
+
+ModbusShadowRegisters::ModbusShadowRegisters()
+{
+	mClock.start();
+}
+
+void ModbusShadowRegisters::write(quint16 startReg, const ModbusRegisterView &values)
+{
+	if (values.isEmpty())
+		return;
+	qint64 now = mClock.elapsed();
+	Block block;
+	block.startReg = startReg;
+	int endReg = startReg + values.size();
+	// Merge with the blocks overlapping or adjacent to the new values, so the new block covers all
+	// of them without gaps.
+	QList<Block> merged;
+	for (QList<Block>::Iterator it = mBlocks.begin(); it != mBlocks.end();) {
+		if (it->startReg <= endReg && it->endReg() >= startReg) {
+			block.startReg = qMin(block.startReg, it->startReg);
+			endReg = qMax(endReg, it->endReg());
+			merged.append(*it);
+			it = mBlocks.erase(it);
+		} else {
+			++it;
+		}
+	}
+	int size = endReg - block.startReg;
+	block.values.resize(size);
+	block.timestamps.resize(size);
+	foreach (const Block &b, merged) {
+		int offset = b.startReg - block.startReg;
+		for (int i=0; i<b.values.size(); ++i) {
+			block.values[offset + i] = b.values[i];
+			block.timestamps[offset + i] = b.timestamps[i];
+		}
+	}
+	int offset = startReg - block.startReg;
+	for (int i=0; i<values.size(); ++i) {
+		block.values[offset + i] = values[i];
+		block.timestamps[offset + i] = now;
+	}
+	mBlocks.append(block);
+}
+
+bool ModbusShadowRegisters::isFresh(quint16 startReg, int count, int maxAge) const
+{
+	const Block *block = findBlock(startReg, count);
+	if (block == 0)
+		return false;
+	qint64 oldest = mClock.elapsed() - maxAge;
+	int offset = startReg - block->startReg;
+	for (int i=0; i<count; ++i) {
+		if (block->timestamps[offset + i] <= oldest)
+			return false;
+	}
+	return true;
+}
+
+ModbusRegisterView ModbusShadowRegisters::values(quint16 startReg, int count) const
+{
+	const Block *block = findBlock(startReg, count);
+	if (block == 0)
+		return ModbusRegisterView();
+	return ModbusRegisterView(block->values).mid(startReg - block->startReg, count);
+}
+
+void ModbusShadowRegisters::invalidate(quint16 startReg, int count)
+{
+	int endReg = startReg + count;
+	QList<Block> remaining;
+	foreach (const Block &b, mBlocks) {
+		if (b.startReg >= endReg || b.endReg() <= startReg) {
+			remaining.append(b);
+			continue;
+		}
+		// Keep the parts of the block before and after the range.
+		if (b.startReg < startReg) {
+			Block before;
+			before.startReg = b.startReg;
+			before.values = b.values.mid(0, startReg - b.startReg);
+			before.timestamps = b.timestamps.mid(0, startReg - b.startReg);
+			remaining.append(before);
+		}
+		if (b.endReg() > endReg) {
+			Block after;
+			after.startReg = endReg;
+			after.values = b.values.mid(endReg - b.startReg);
+			after.timestamps = b.timestamps.mid(endReg - b.startReg);
+			remaining.append(after);
+		}
+	}
+	mBlocks = remaining;
+}
+
+void ModbusShadowRegisters::invalidate()
+{
+	mBlocks.clear();
+}
+
+const ModbusShadowRegisters::Block *ModbusShadowRegisters::findBlock(quint16 startReg,
+																	   int count) const
+{
+	if (count <= 0)
+		return 0;
+	for (QList<Block>::ConstIterator it = mBlocks.begin(); it != mBlocks.end(); ++it) {
+		if (it->startReg <= startReg && startReg + count <= it->endReg())
+			return &*it;
+	}
+	return 0;
+}
@@ -0,0 +1,67 @@
+#ifndef MODBUS_SHADOW_REGISTERS_H
+#define MODBUS_SHADOW_REGISTERS_H
+
+#include <QElapsedTimer>
+#include <QList>
+#include <QVector>
+#include "modbus_register_view.h"
+
+/*!
+ * Copy of holding registers of a device as we last wrote them, together with the time the write
+ * was acknowledged by the device.
+ *
+ * Used for control registers (like power limits) which only change when we write them. As long as
+ * the shadow is fresh, the registers do not have to be read back from the device. Values read from
+ * the device are not stored: only a write tells us what the device is supposed to contain, and a
+ * periodic read must not keep the shadow fresh forever. Freshness is decided by the caller (see
+ * `isFresh`), because it depends on the register: a power limit which is reverted by the device
+ * after a timeout should be read again well before the timeout expires.
+ */
+class ModbusShadowRegisters
+{
+public:
+	ModbusShadowRegisters();
+
+	/// Stores register values written to the device and acknowledged.
+	void write(quint16 startReg, const ModbusRegisterView &values);
+
+	/*!
+	 * Returns true if all registers in the range are known, and have been written less than
+	 * `maxAge` milliseconds ago.
+	 */
+	bool isFresh(quint16 startReg, int count, int maxAge) const;
+
+	/*!
+	 * Returns the values of the registers in the range, or an empty view if some are unknown.
+	 * The view is valid until the shadow registers are changed.
+	 */
+	ModbusRegisterView values(quint16 startReg, int count) const;
+
+	/// Forgets the registers in the range, so they will be read from the device again.
+	void invalidate(quint16 startReg, int count);
+
+	/// Forgets all registers, for example after the connection to the device was lost.
+	void invalidate();
+
+private:
+	/// Consecutive registers, so a range of registers can be returned as a view.
+	struct Block {
+		int startReg;
+		QVector<quint16> values;
+		/// Time (`mClock`) at which each value was written.
+		QVector<qint64> timestamps;
+
+		int endReg() const
+		{
+			return startReg + values.size();
+		}
+	};
+
+	/// Returns the block containing all registers in the range, or 0 if there is none.
+	const Block *findBlock(quint16 startReg, int count) const;
+
+	QList<Block> mBlocks;
+	QElapsedTimer mClock;
+};
+
+#endif // MODBUS_SHADOW_REGISTERS_H
@@ -0,0 +1,73 @@
+#ifndef MODBUS_SPSC_QUEUE_H
+#define MODBUS_SPSC_QUEUE_H
+
+#include <QAtomicInt>
+
+/*!
+ * Bounded lock-free queue for a single producer thread and a single consumer thread.
+ *
+ * Items are stored in place and are never allocated or freed: the producer fills the slot
+ * returned by `back` and publishes it with `push`, the consumer reads the slot returned by
+ * `front` and hands it back with `pop`.
+ *
+ * Indices run from 0 to 2 * Capacity - 1, so a full queue can be told apart from an empty one
+ * without wasting a slot.
+ */
+template<typename T, int Capacity>
+class ModbusSpscQueue
+{
+public:
+	ModbusSpscQueue():
+		mHead(0),
+		mTail(0)
+	{
+	}
+
+	/// Producer: returns the slot to fill next, or 0 if the queue is full.
+	T *back()
+	{
+		int tail = mTail.fetchAndAddRelaxed(0);
+		int head = mHead.fetchAndAddAcquire(0);
+		if ((tail - head + 2 * Capacity) % (2 * Capacity) == Capacity)
+			return 0;
+		return &mItems[tail % Capacity];
+	}
+
+	/// Producer: makes the slot returned by `back` available to the consumer.
+	void push()
+	{
+		int tail = mTail.fetchAndAddRelaxed(0);
+		mTail.fetchAndStoreRelease(next(tail));
+	}
+
+	/// Consumer: returns the oldest item, or 0 if the queue is empty.
+	T *front()
+	{
+		int head = mHead.fetchAndAddRelaxed(0);
+		int tail = mTail.fetchAndAddAcquire(0);
+		if (head == tail)
+			return 0;
+		return &mItems[head % Capacity];
+	}
+
+	/// Consumer: releases the item returned by `front`.
+	void pop()
+	{
+		int head = mHead.fetchAndAddRelaxed(0);
+		mHead.fetchAndStoreRelease(next(head));
+	}
+
+private:
+	Q_DISABLE_COPY(ModbusSpscQueue)
+
+	static int next(int index)
+	{
+		return (index + 1) % (2 * Capacity);
+	}
+
+	T mItems[Capacity];
+	QAtomicInt mHead;
+	QAtomicInt mTail;
+};
+
+#endif // MODBUS_SPSC_QUEUE_H
@@ -1,74 +1,230 @@
-#include <QHostAddress>
-#include <QTcpSocket>
 #include <QTimer>
 #include "crc16.h"
 #include "modbus_tcp_client.h"
+#include "modbus_tcp_transport.h"
 #include "modbus_reply.h"
 
 #include <QsLog.h>
 
 ModbusTcpClient::ModbusTcpClient(QObject *parent):
 	ModbusClient(parent),
-	mSocket(new QTcpSocket(this)),
+	mTransport(ModbusTcpTransport::create()),
+	mState(QAbstractSocket::UnconnectedState),
+	mSession(0),
 	mTimeout(1000),
-	mConnectTimerId(0),
+	mConnectTimeout(1000),
+	mMaxPendingRequests(DefaultMaxPendingRequests),
+	mWindow(DefaultMaxPendingRequests),
+	mTimer(new QTimer(this)),
+	mTimerDeadline(-1),
+	mConnectDeadline(-1),
+	mReconnectDeadline(-1),
+	mNextAttemptTime(0),
+	mFailureCount(0),
+	mCircuitState(CircuitClosed),
 	mTransactionId(0)
 {
-	mSocket->socketOption(QAbstractSocket::LowDelayOption);
-	connect(mSocket, SIGNAL(readyRead()), this, SLOT(onReadyRead()));
-	connect(mSocket, SIGNAL(connected()), this, SLOT(onConnected()));
-	connect(mSocket, SIGNAL(disconnected()), this, SIGNAL(disconnected()));
-	connect(mSocket, SIGNAL(error(QAbstractSocket::SocketError)),
-			this, SLOT(onSocketErrorReceived(QAbstractSocket::SocketError)));
+	mClock.start();
+	mTimer->setSingleShot(true);
+	connect(mTimer, SIGNAL(timeout()), this, SLOT(onTimer()));
+	connect(mTransport, SIGNAL(framesAvailable()), this, SLOT(onFramesAvailable()));
+	connect(mTransport, SIGNAL(connected(int)), this, SLOT(onConnected(int)));
+	connect(mTransport, SIGNAL(disconnected(int)), this, SLOT(onDisconnected(int)));
+	connect(mTransport, SIGNAL(error(int, QAbstractSocket::SocketError)),
+			this, SLOT(onSocketErrorReceived(int, QAbstractSocket::SocketError)));
+	connect(mTransport, SIGNAL(streamError(int)), this, SLOT(onStreamError(int)));
 }
 
-void ModbusTcpClient::connectToServer(const QString &hostName, quint16 tcpPort)
+ModbusTcpClient::~ModbusTcpClient()
 {
+	// The replies are deleted along with the client, and should not call back.
+	foreach (Reply *reply, outstandingReplies())
+		reply->detach();
+	mTransport->destroy();
+}
+
+void ModbusTcpClient::connectToServer(const QString &hostName, quint16 tcpPort, int timeout)
+{
+	bool sameServer = hostName == mHostName && tcpPort == mTcpPort;
+	if (sameServer &&
+		(mState != QAbstractSocket::UnconnectedState || mReconnectDeadline >= 0)) {
+		// The client may be shared (see ModbusTcpClientPool), so other users may have started
+		// the connection already.
+		return;
+	}
+	if (!sameServer) {
+		mFailureCount = 0;
+		mNextAttemptTime = 0;
+		setCircuitState(CircuitClosed);
+		mLatencyEntries.clear();
+		mUnsupportedFunctions.clear();
+	}
 	mHostName = hostName;
 	mTcpPort = tcpPort;
-	mConnectTimerId = startTimer(mTimeout);
-	mSocket->connectToHost(hostName, tcpPort);
+	mConnectTimeout = timeout > 0 ? timeout : mTimeout;
+	if (mClock.elapsed() < mNextAttemptTime) {
+		mReconnectDeadline = mNextAttemptTime;
+		scheduleTimer();
+		return;
+	}
+	startConnect();
 }
 
 bool ModbusTcpClient::isConnected() const
 {
-	return mSocket->state() == QTcpSocket::ConnectedState;
+	return mState == QAbstractSocket::ConnectedState;
+}
+
+ModbusTcpClient::CircuitState ModbusTcpClient::circuitState() const
+{
+	return mCircuitState;
+}
+
+int ModbusTcpClient::reconnectDelay() const
+{
+	return static_cast<int>(qMax(Q_INT64_C(0), mNextAttemptTime - mClock.elapsed()));
 }
 
 ModbusReply *ModbusTcpClient::readInputRegisters(quint8 unitId, quint16 startReg, quint16 count)
 {
-	return readRegisters(ReadInputRegisters, unitId, startReg, count);
+	return readRegisters(ReadInputRegisters, unitId, startReg, count, mTimeout);
 }
 
 ModbusReply *ModbusTcpClient::readHoldingRegisters(quint8 unitId, quint16 startReg, quint16 count)
 {
-	return readRegisters(ReadHoldingRegisters, unitId, startReg, count);
+	return readRegisters(ReadHoldingRegisters, unitId, startReg, count, mTimeout);
 }
 
 ModbusReply *ModbusTcpClient::writeSingleHoldingRegister(quint8 unitId, quint16 reg, quint16 value)
 {
-	QByteArray frame = createFrame(WriteSingleRegister, unitId, 4);
-	frame.append(static_cast<char>(msb(reg)));
-	frame.append(static_cast<char>(lsb(reg)));
-	frame.append(static_cast<char>(msb(value)));
-	frame.append(static_cast<char>(lsb(value)));
-	return sendFrame(frame);
+	return sendRequest(ModbusRequest::writeSingleHoldingRegister(unitId, reg, value));
 }
 
 ModbusReply *ModbusTcpClient::writeMultipleHoldingRegisters(quint8 unitId, quint16 startReg,
 															const QVector<quint16> &values)
 {
-	QByteArray frame = createFrame(WriteMultipleRegisters, unitId, 5 + 2 * values.size());
-	frame.append(static_cast<char>(msb(startReg)));
-	frame.append(static_cast<char>(lsb(startReg)));
-	frame.append(static_cast<char>(msb(values.size())));
-	frame.append(static_cast<char>(lsb(values.size())));
-	frame.append(static_cast<char>(values.size() * 2));
-	foreach (quint16 value, values) {
-		frame.append(static_cast<char>(msb(value)));
-		frame.append(static_cast<char>(lsb(value)));
+	return sendRequest(ModbusRequest::writeMultipleHoldingRegisters(unitId, startReg, values));
+}
+
+ModbusReply *ModbusTcpClient::readWriteMultipleRegisters(quint8 unitId, quint16 readStartReg,
+														quint16 readCount, quint16 writeStartReg,
+														const QVector<quint16> &values)
+{
+	return sendRequest(ModbusRequest::readWriteMultipleRegisters(unitId, readStartReg, readCount,
+																 writeStartReg, values));
+}
+
+ModbusReply *ModbusTcpClient::sendRequest(const ModbusRequest &request)
+{
+	int timeout = request.timeout > 0 ? request.timeout : mTimeout;
+	switch (request.function) {
+	case ModbusRequest::ReadHoldingRegisters:
+		return readRegisters(ReadHoldingRegisters, request.unitId, request.startReg,
+							 request.count, timeout);
+	case ModbusRequest::ReadInputRegisters:
+		return readRegisters(ReadInputRegisters, request.unitId, request.startReg, request.count,
+							 timeout);
+	default:
+		break;
 	}
-	return sendFrame(frame);
+	QByteArray frame;
+	encodeRequest(request, frame);
+	return sendFrame(frame, timeout);
+}
+
+quint32 ModbusTcpClient::submit(const ModbusRequest &request, const ModbusCallback &callback)
+{
+	Request *r = mRequestPool.take();
+	r->id = nextRequestId();
+	r->callback = callback;
+	Transaction t;
+	t.reply = 0;
+	t.request = r;
+	encodeRequest(request, t.frame);
+	r->transactionId = mTransactionId;
+	r->timestamps = LatencyStatistics::Timestamps();
+	r->timestamps.enqueued = mClock.elapsed();
+	int timeout = request.timeout > 0 ? request.timeout : mTimeout;
+	mDeadlines.push(mClock.elapsed() + timeout, r->transactionId, r);
+	scheduleTimer();
+	if (request.function == ModbusRequest::ReadHoldingRegisters ||
+		request.function == ModbusRequest::ReadInputRegisters) {
+		addSharedRead(r->transactionId, request.function, request.unitId, request.startReg,
+					  request.count);
+	} else {
+		closeSharedReads(request.unitId);
+	}
+	enqueue(request.unitId, t);
+	sendQueued();
+	return r->id;
+}
+
+void ModbusTcpClient::cancelRequest(quint32 requestId)
+{
+	for (QHash<quint16, Request *>::Iterator it = mPendingRequests.begin();
+		 it != mPendingRequests.end(); ++it) {
+		Request *r = it.value();
+		if (r->id == requestId) {
+			// Reads waiting for the result keep the transaction alive. Otherwise, a response
+			// arriving later will not find the transaction, and will be ignored.
+			if (!transferTransaction(it.key())) {
+				mPendingRequests.erase(it);
+				sendQueued();
+			}
+			releaseRequest(r);
+			return;
+		}
+	}
+	for (QHash<quint8, QList<Transaction> >::Iterator it = mQueuedTransactions.begin();
+		 it != mQueuedTransactions.end(); ++it) {
+		foreach (const Transaction &t, it.value()) {
+			if (t.request != 0 && t.request->id == requestId) {
+				Request *r = t.request;
+				quint16 transactionId = t.transactionId();
+				if (!transferTransaction(transactionId)) {
+					Transaction removed;
+					removeQueued(r, transactionId, removed);
+				}
+				releaseRequest(r);
+				return;
+			}
+		}
+	}
+}
+
+void ModbusTcpClient::cancelRequests(const void *object, bool all)
+{
+	// Queued requests are removed first, so they will not be sent when a transaction waiting for
+	// a response is cancelled.
+	QList<Transaction> cancelled;
+	foreach (const QList<Transaction> &queue, mQueuedTransactions) {
+		foreach (const Transaction &t, queue) {
+			if (t.request != 0 && (all || t.request->callback.object() == object))
+				cancelled.append(t);
+		}
+	}
+	foreach (const Transaction &t, cancelled) {
+		if (!transferTransaction(t.transactionId())) {
+			Transaction removed;
+			removeQueued(t.tag(), t.transactionId(), removed);
+		}
+		releaseRequest(t.request);
+	}
+	QList<quint16> pending;
+	for (QHash<quint16, Request *>::ConstIterator it = mPendingRequests.constBegin();
+		 it != mPendingRequests.constEnd(); ++it) {
+		if (all || it.value()->callback.object() == object)
+			pending.append(it.key());
+	}
+	foreach (quint16 transactionId, pending) {
+		Request *r = mPendingRequests.value(transactionId);
+		if (!transferTransaction(transactionId))
+			mPendingRequests.remove(transactionId);
+		releaseRequest(r);
+	}
+	if (!pending.isEmpty())
+		sendQueued();
+	ModbusClient::cancelRequests(object, all);
 }
 
 QString ModbusTcpClient::hostName() const
@@ -81,6 +237,11 @@ quint16 ModbusTcpClient::portName() const
 	return mTcpPort;
 }
 
+bool ModbusTcpClient::isFunctionSupported(quint8 unitId, ModbusRequest::Function function) const
+{
+	return !mUnsupportedFunctions.contains(static_cast<quint16>((unitId << 8) | function));
+}
+
 int ModbusTcpClient::timeout() const
 {
 	return mTimeout;
@@ -91,115 +252,448 @@ void ModbusTcpClient::setTimeout(int t)
 	mTimeout = t;
 }
 
-void ModbusTcpClient::timerEvent(QTimerEvent *event)
+int ModbusTcpClient::maxPendingRequests() const
+{
+	return mMaxPendingRequests;
+}
+
+void ModbusTcpClient::setMaxPendingRequests(int n)
+{
+	mMaxPendingRequests = qMax(1, n);
+	updateWindow();
+}
+
+void ModbusTcpClient::setMaxPendingRequests(const QObject *user, int n)
+{
+	if (n > 0)
+		mUserWindows.insert(user, n);
+	else
+		mUserWindows.remove(user);
+	updateWindow();
+}
+
+int ModbusTcpClient::window() const
+{
+	return mWindow;
+}
+
+void ModbusTcpClient::updateWindow()
 {
-	Q_UNUSED(event)
-	Q_ASSERT(mConnectTimerId > 0);
-	if (mConnectTimerId == 0)
+	mWindow = mMaxPendingRequests;
+	foreach (int n, mUserWindows)
+		mWindow = qMax(mWindow, n);
+	sendQueued();
+}
+
+void ModbusTcpClient::onConnected(int session)
+{
+	if (session != mSession || mState != QAbstractSocket::ConnectingState)
 		return;
-	killTimer(mConnectTimerId);
-	mConnectTimerId = 0;
-	mSocket->disconnectFromHost();
-	emit disconnected();
+	mState = QAbstractSocket::ConnectedState;
+	// No need to stop the timer. It will simply find nothing to do.
+	mConnectDeadline = -1;
+	mFailureCount = 0;
+	mNextAttemptTime = 0;
+	setCircuitState(CircuitClosed);
+	emit connected();
 }
 
-void ModbusTcpClient::onConnected()
+void ModbusTcpClient::onTimer()
 {
-	if (mConnectTimerId > 0) {
-		killTimer(mConnectTimerId);
-		mConnectTimerId = 0;
+	mTimerDeadline = -1;
+	qint64 now = mClock.elapsed();
+	ModbusDeadlineQueue::Entry entry;
+	while (mDeadlines.popExpired(now, entry))
+		expire(entry.transactionId, entry.tag);
+	if (mConnectDeadline >= 0 && mConnectDeadline <= now) {
+		mConnectDeadline = -1;
+		registerFailure();
+		mState = QAbstractSocket::UnconnectedState;
+		mTransport->disconnectFromHost();
+		emit disconnected();
 	}
-	emit connected();
+	if (mReconnectDeadline >= 0 && mReconnectDeadline <= now) {
+		mReconnectDeadline = -1;
+		startConnect();
+	}
+	scheduleTimer();
 }
 
-void ModbusTcpClient::onReadyRead()
+void ModbusTcpClient::expire(quint16 transactionId, const void *tag)
 {
-	mBuffer.append(mSocket->read(mSocket->bytesAvailable()));
-	for (;;) {
-		if (mBuffer.size() < 6)
+	Reply *reply = 0;
+	Request *request = 0;
+	if (mPendingReplies.value(transactionId) == tag) {
+		reply = popReply(transactionId);
+	} else if (mPendingRequests.value(transactionId) == tag) {
+		request = mPendingRequests.take(transactionId);
+	} else {
+		Transaction t;
+		if (!removeQueued(tag, transactionId, t)) {
+			// A reply waiting for the result of a shared read times out on its own. If the reply
+			// is not found, it has been finished or destroyed already.
+			QHash<quint16, SharedRead>::Iterator it = mSharedReads.find(transactionId);
+			if (it == mSharedReads.end())
+				return;
+			int index = it->followers.indexOf(static_cast<Reply *>(const_cast<void *>(tag)));
+			if (index < 0)
+				return;
+			reply = it->followers.takeAt(index);
+			reply->detach();
+			reply->setResult(ModbusReply::Timeout);
 			return;
-		int length = toUInt16(mBuffer, 4) + 6;
-		if (mBuffer.size() < length)
-			return;
-		quint16 transactionId = toUInt16(mBuffer, 0);
-		Q_ASSERT(toUInt16(mBuffer, 2) == 0);
-		// quint8 unitId = static_cast<quint8>(mBuffer[6]);
-		quint8 functionCode = static_cast<quint8>(mBuffer[7]);
-		if ((functionCode & 0x80) == 0) {
-			switch (functionCode) {
-			case ReadHoldingRegisters:
-			case ReadInputRegisters:
-				if (mBuffer.size() > 8) {
-					quint8 payloadSize = static_cast<quint8>(mBuffer[8]);
-					int i0 = 9;
-					int i1 = i0 + payloadSize;
-					if (i1 == length) {
-						QVector<quint16> values;
-						for (; i0 < i1; i0 += 2)
-							values.append(toUInt16(mBuffer, i0));
-						setFinished(transactionId, values);
-						break;
-					}
-				}
-				setFinished(transactionId, ModbusReply::ParseError);
-				break;
-			case WriteSingleRegister:
-				if (mBuffer.size() > 11) {
-					// quint16 startReg = toUInt16(mBuffer, 8);
-					quint16 value = toUInt16(mBuffer, 10);
-					QVector<quint16> values;
-					values.append(value);
-					setFinished(transactionId, values);
-					break;
-				}
-				setFinished(transactionId, ModbusReply::ParseError);
-				break;
-			case WriteMultipleRegisters:
-				if (mBuffer.size() == 12) {
-					// quint16 startReg = toUInt16(mBuffer, 8);
-					// quint16 regCount = toUInt16(mBuffer, 10);
-					setFinished(transactionId, QVector<quint16>());
+		}
+		reply = t.reply;
+		request = t.request;
+		if (reply != 0)
+			reply->detach();
+	}
+	QList<Reply *> followers = takeFollowers(transactionId);
+	sendQueued();
+	if (request != 0)
+		finishRequest(request, ModbusReply::Timeout);
+	else
+		reply->setResult(ModbusReply::Timeout);
+	foreach (Reply *follower, followers)
+		follower->setResult(ModbusReply::Timeout);
+}
+
+void ModbusTcpClient::scheduleTimer()
+{
+	qint64 deadline = mConnectDeadline;
+	if (mReconnectDeadline >= 0 && (deadline < 0 || mReconnectDeadline < deadline))
+		deadline = mReconnectDeadline;
+	if (!mDeadlines.isEmpty() && (deadline < 0 || mDeadlines.nextDeadline() < deadline))
+		deadline = mDeadlines.nextDeadline();
+	if (deadline == mTimerDeadline)
+		return;
+	mTimerDeadline = deadline;
+	if (deadline < 0) {
+		mTimer->stop();
+		return;
+	}
+	mTimer->start(static_cast<int>(qMax(Q_INT64_C(0), deadline - mClock.elapsed())));
+}
+
+void ModbusTcpClient::removeDeadline(const void *tag)
+{
+	// While the timer is being handled, it is programmed afterwards.
+	if (mDeadlines.remove(tag) && mTimerDeadline >= 0)
+		scheduleTimer();
+}
+
+void ModbusTcpClient::onDisconnected(int session)
+{
+	if (session != mSession || mState == QAbstractSocket::UnconnectedState)
+		return;
+	mState = QAbstractSocket::UnconnectedState;
+	emit disconnected();
+}
+
+void ModbusTcpClient::onFramesAvailable()
+{
+	// Converts timestamps from the transport to `mClock`.
+	qint64 offset = mClock.msecsSinceReference();
+	const ModbusTcpTransport::Frame *f = 0;
+	while ((f = mTransport->nextFrame()) != 0) {
+		// Received on an earlier connection, which the client no longer expects responses from.
+		if (f->session != mSession) {
+			mTransport->popFrame();
+			continue;
+		}
+		ModbusTcpFrame frame;
+		frame.transactionId = f->transactionId;
+		frame.protocolId = 0;
+		frame.unitId = f->unitId;
+		frame.functionCode = f->functionCode;
+		frame.data = f->data;
+		frame.size = f->size;
+		recordLatency(frame, f->firstByteTime - offset, f->receivedTime - offset);
+		handleFrame(frame);
+		mTransport->popFrame();
+	}
+}
+
+void ModbusTcpClient::onStreamError(int session)
+{
+	if (session != mSession)
+		return;
+	failPending(ModbusReply::ParseError);
+}
+
+void ModbusTcpClient::handleFrame(const ModbusTcpFrame &frame)
+{
+	quint16 transactionId = frame.transactionId;
+	Q_ASSERT(frame.protocolId == 0);
+	if ((frame.functionCode & 0x80) == 0) {
+		switch (frame.functionCode) {
+		case ReadHoldingRegisters:
+		case ReadInputRegisters:
+		case ReadWriteMultipleRegisters:
+			if (frame.size > 0) {
+				int payloadSize = frame.byteAt(0);
+				if (frame.size == payloadSize + 1 && (payloadSize & 1) == 0) {
+					setFinished(transactionId, frame.data + 1, payloadSize / 2);
 					break;
 				}
-				setFinished(transactionId, ModbusReply::ParseError);
+			}
+			setFinished(transactionId, ModbusReply::ParseError);
+			break;
+		case WriteSingleRegister:
+			if (frame.size >= 4) {
+				// quint16 startReg = frame.uint16At(0);
+				// The echoed value is passed as result.
+				setFinished(transactionId, frame.data + 2, 1);
 				break;
 			}
-		} else {
-			if (mBuffer.size() > 8) {
-				quint8 error = static_cast<quint8>(mBuffer[8]);
-				setFinished(transactionId, error);
-			} else {
-				setFinished(transactionId, ModbusReply::ParseError);
+			setFinished(transactionId, ModbusReply::ParseError);
+			break;
+		case WriteMultipleRegisters:
+			if (frame.size == 4) {
+				// quint16 startReg = frame.uint16At(0);
+				// quint16 regCount = frame.uint16At(2);
+				setFinished(transactionId, frame.data, 0);
+				break;
 			}
+			setFinished(transactionId, ModbusReply::ParseError);
+			break;
+		}
+	} else if (frame.size > 0) {
+		if (frame.byteAt(0) == ModbusReply::IllegalFunction) {
+			mUnsupportedFunctions.insert(
+				static_cast<quint16>((frame.unitId << 8) | (frame.functionCode & 0x7F)));
 		}
-		mBuffer.remove(0, length);
+		setFinished(transactionId, frame.byteAt(0));
+	} else {
+		setFinished(transactionId, ModbusReply::ParseError);
+	}
+}
+
+void ModbusTcpClient::recordLatency(const ModbusTcpFrame &frame, qint64 firstByteTime,
+									qint64 receivedTime)
+{
+	// Exception replies are left out: they do not say much about the round trip time, and the
+	// detectors scan many unit ids, which would leave an entry for each of them.
+	if ((frame.functionCode & 0x80) != 0)
+		return;
+	LatencyStatistics::Timestamps t;
+	Reply *reply = mPendingReplies.value(frame.transactionId);
+	if (reply != 0) {
+		t = reply->timestamps();
+	} else {
+		Request *request = mPendingRequests.value(frame.transactionId);
+		if (request == 0)
+			return;
+		t = request->timestamps;
+	}
+	quint8 functionCode = frame.functionCode;
+	quint16 key = static_cast<quint16>((frame.unitId << 8) | functionCode);
+	LatencyStatistics::Entry *&entry = mLatencyEntries[key];
+	if (entry == 0) {
+		entry = LatencyStatistics::instance().entry(
+			QString("Modbus/%1/%2/%3").
+				arg(LatencyStatistics::toPathElement(mHostName)).
+				arg(frame.unitId).
+				arg(functionCode));
 	}
+	t.firstByte = firstByteTime;
+	t.completed = receivedTime;
+	entry->record(t);
 }
 
-void ModbusTcpClient::onReplyDestroyed()
+
+void ModbusTcpClient::cancelTransaction(ModbusReply *reply)
 {
-	Reply *reply = static_cast<Reply *>(sender());
-	mPendingReplies.remove(reply->transactionId());
+	// A response arriving later will not find the transaction, and will be ignored.
+	removeReply(static_cast<Reply *>(reply));
 }
 
-void ModbusTcpClient::onSocketErrorReceived(QAbstractSocket::SocketError error)
+void ModbusTcpClient::onSocketErrorReceived(int session, QAbstractSocket::SocketError error)
 {
 	Q_UNUSED(error)
-	foreach (Reply *reply, mPendingReplies)
-		reply->setResult(ModbusReply::TcpError);
-	mPendingReplies.clear();
+	// Ignore errors caused by closing the connection after a connect timeout.
+	if (session != mSession || mState == QAbstractSocket::UnconnectedState)
+		return;
+	mState = QAbstractSocket::UnconnectedState;
+	// The connection attempt (if any) has ended.
+	mConnectDeadline = -1;
+	registerFailure();
+	failPending(ModbusReply::TcpError);
 	emit disconnected();
 }
 
-ModbusReply *ModbusTcpClient::sendFrame(const QByteArray &frame)
+void ModbusTcpClient::startConnect()
+{
+	if (mCircuitState == CircuitOpen)
+		setCircuitState(CircuitHalfOpen);
+	++mSession;
+	mState = QAbstractSocket::ConnectingState;
+	mConnectDeadline = mClock.elapsed() + mConnectTimeout;
+	scheduleTimer();
+	mTransport->connectToHost(mHostName, mTcpPort, mSession);
+}
+
+void ModbusTcpClient::registerFailure()
+{
+	++mFailureCount;
+	int delay = InitialReconnectDelay << qMin(mFailureCount - 1, 16);
+	delay = qMin(delay, MaxReconnectDelay);
+	// Wait somewhere between half and the full delay, so clients which lost their connection at
+	// the same moment will not reconnect at the same moment.
+	delay = delay / 2 + qrand() % (delay / 2 + 1);
+	mNextAttemptTime = mClock.elapsed() + delay;
+	if (mFailureCount >= CircuitFailureThreshold)
+		setCircuitState(CircuitOpen);
+}
+
+void ModbusTcpClient::setCircuitState(CircuitState state)
+{
+	if (mCircuitState == state)
+		return;
+	mCircuitState = state;
+	switch (state) {
+	case CircuitOpen:
+		QLOG_WARN() << "Modbus connection to" << mHostName << "failed" << mFailureCount
+					<< "times, next attempt in" << reconnectDelay() << "ms";
+		break;
+	case CircuitClosed:
+		QLOG_INFO() << "Modbus connection to" << mHostName << "restored";
+		break;
+	default:
+		break;
+	}
+	emit circuitStateChanged(state);
+}
+
+void ModbusTcpClient::failPending(ModbusReply::ExceptionCode error)
+{
+	QList<Reply *> replies = outstandingReplies();
+	QList<Request *> requests = mPendingRequests.values();
+	foreach (const QList<Transaction> &queue, mQueuedTransactions) {
+		foreach (const Transaction &t, queue) {
+			if (t.request != 0)
+				requests.append(t.request);
+		}
+	}
+	mPendingRequests.clear();
+	mSharedReads.clear();
+	mPendingReplies.clear();
+	mQueuedTransactions.clear();
+	mUnitOrder.clear();
+	mDeadlines.clear();
+	scheduleTimer();
+	foreach (Reply *reply, replies)
+		reply->detach();
+	foreach (Reply *reply, replies)
+		reply->setResult(error);
+	foreach (Request *request, requests)
+		finishRequest(request, error);
+}
+
+ModbusTcpClient::Reply *ModbusTcpClient::sendFrame(const QByteArray &frame, int timeout)
 {
-	Reply *reply = new Reply(mTransactionId, mTimeout, this);
-	mPendingReplies[mTransactionId] = reply;
-	mSocket->write(frame);
-	connect(reply, SIGNAL(destroyed()), this, SLOT(onReplyDestroyed()));
+	Reply *reply = new Reply(this, mTransactionId);
+	reply->timestamps().enqueued = mClock.elapsed();
+	// The timeout includes the time spent in the send queue, just like it did when each reply
+	// had its own timer.
+	mDeadlines.push(mClock.elapsed() + timeout, mTransactionId, reply);
+	scheduleTimer();
+	quint8 unitId = static_cast<quint8>(frame.at(6));
+	quint8 function = static_cast<quint8>(frame.at(7));
+	if (function != ReadHoldingRegisters && function != ReadInputRegisters)
+		closeSharedReads(unitId);
+	Transaction t;
+	t.reply = reply;
+	t.request = 0;
+	t.frame = frame;
+	enqueue(unitId, t);
+	sendQueued();
 	return reply;
 }
 
+void ModbusTcpClient::sendQueued()
+{
+	Transaction t;
+	while (pendingCount() < mWindow && takeQueued(t)) {
+		if (t.reply != 0) {
+			mPendingReplies[t.reply->transactionId()] = t.reply;
+			t.reply->timestamps().written = mClock.elapsed();
+		} else {
+			mPendingRequests[t.request->transactionId] = t.request;
+			t.request->timestamps.written = mClock.elapsed();
+		}
+		mTransport->write(t.frame, mSession);
+	}
+}
+
+int ModbusTcpClient::pendingCount() const
+{
+	return mPendingReplies.size() + mPendingRequests.size();
+}
+
+void ModbusTcpClient::enqueue(quint8 unitId, const Transaction &t)
+{
+	QList<Transaction> &queue = mQueuedTransactions[unitId];
+	if (queue.isEmpty())
+		mUnitOrder.append(unitId);
+	queue.append(t);
+}
+
+bool ModbusTcpClient::takeQueued(Transaction &t)
+{
+	if (mUnitOrder.isEmpty())
+		return false;
+	quint8 unitId = mUnitOrder.takeFirst();
+	QHash<quint8, QList<Transaction> >::Iterator it = mQueuedTransactions.find(unitId);
+	Q_ASSERT(it != mQueuedTransactions.end() && !it->isEmpty());
+	t = it->takeFirst();
+	if (it->isEmpty())
+		mQueuedTransactions.erase(it);
+	else
+		mUnitOrder.append(unitId);
+	return true;
+}
+
+bool ModbusTcpClient::removeQueued(const void *tag, quint16 transactionId, Transaction &t)
+{
+	for (QHash<quint8, QList<Transaction> >::Iterator it = mQueuedTransactions.begin();
+		 it != mQueuedTransactions.end(); ++it) {
+		QList<Transaction> &queue = it.value();
+		for (int i=0; i<queue.size(); ++i) {
+			// Request records are reused, so the tag alone does not identify the transaction.
+			if (queue[i].tag() != tag || queue[i].transactionId() != transactionId)
+				continue;
+			t = queue[i];
+			queue.removeAt(i);
+			if (queue.isEmpty()) {
+				mUnitOrder.removeOne(it.key());
+				mQueuedTransactions.erase(it);
+			}
+			return true;
+		}
+	}
+	return false;
+}
+
+void ModbusTcpClient::removeReply(Reply *reply)
+{
+	reply->detach();
+	quint16 transactionId = reply->transactionId();
+	QHash<quint16, SharedRead>::Iterator it = mSharedReads.find(transactionId);
+	if (it != mSharedReads.end() && it->followers.removeOne(reply))
+		return;
+	// Reads waiting for the same transaction keep it alive.
+	if (transferTransaction(transactionId))
+		return;
+	if (mPendingReplies.value(transactionId) == reply) {
+		mPendingReplies.remove(transactionId);
+		sendQueued();
+		return;
+	}
+	Transaction t;
+	removeQueued(reply, transactionId, t);
+}
+
 ModbusTcpClient::Reply *ModbusTcpClient::popReply(quint16 transactionId)
 {
 	QHash<quint16, Reply *>::Iterator it = mPendingReplies.find(transactionId);
@@ -207,73 +701,289 @@ ModbusTcpClient::Reply *ModbusTcpClient::popReply(quint16 transactionId)
 		return 0;
 	Reply *reply = it.value();
 	mPendingReplies.erase(it);
-	disconnect(reply);
+	reply->detach();
 	return reply;
 }
 
+void ModbusTcpClient::addSharedRead(quint16 transactionId, quint8 function, quint8 unitId,
+									quint16 startReg, quint16 count)
+{
+	SharedRead &read = mSharedReads[transactionId];
+	read.function = function;
+	read.unitId = unitId;
+	read.startReg = startReg;
+	read.count = count;
+	read.joinable = true;
+	read.followers.clear();
+}
+
+bool ModbusTcpClient::findSharedRead(quint8 function, quint8 unitId, quint16 startReg,
+									 quint16 count, quint16 &transactionId) const
+{
+	if (count == 0)
+		return false;
+	int endReg = startReg + count;
+	for (QHash<quint16, SharedRead>::ConstIterator it = mSharedReads.constBegin();
+		 it != mSharedReads.constEnd(); ++it) {
+		const SharedRead &read = it.value();
+		if (read.joinable && read.function == function && read.unitId == unitId &&
+			read.startReg <= startReg && endReg <= read.startReg + read.count) {
+			transactionId = it.key();
+			return true;
+		}
+	}
+	return false;
+}
+
+QList<ModbusTcpClient::Reply *> ModbusTcpClient::takeFollowers(quint16 transactionId)
+{
+	QHash<quint16, SharedRead>::Iterator it = mSharedReads.find(transactionId);
+	if (it == mSharedReads.end())
+		return QList<Reply *>();
+	QList<Reply *> followers = it->followers;
+	mSharedReads.erase(it);
+	foreach (Reply *follower, followers)
+		follower->detach();
+	return followers;
+}
+
+bool ModbusTcpClient::transferTransaction(quint16 transactionId)
+{
+	QHash<quint16, SharedRead>::Iterator it = mSharedReads.find(transactionId);
+	if (it == mSharedReads.end())
+		return false;
+	if (it->followers.isEmpty()) {
+		mSharedReads.erase(it);
+		return false;
+	}
+	// The new owner has a deadline of its own, which was set when it joined the transaction.
+	Reply *owner = it->followers.takeFirst();
+	if (mPendingReplies.contains(transactionId) || mPendingRequests.contains(transactionId)) {
+		mPendingRequests.remove(transactionId);
+		mPendingReplies.insert(transactionId, owner);
+		return true;
+	}
+	for (QHash<quint8, QList<Transaction> >::Iterator qit = mQueuedTransactions.begin();
+		 qit != mQueuedTransactions.end(); ++qit) {
+		for (int i=0; i<qit->size(); ++i) {
+			Transaction &t = (*qit)[i];
+			if (t.transactionId() == transactionId) {
+				t.reply = owner;
+				t.request = 0;
+				return true;
+			}
+		}
+	}
+	// Not reached: a shared read only exists while its transaction is queued or in flight.
+	Q_ASSERT(false);
+	it->followers.prepend(owner);
+	return false;
+}
+
+void ModbusTcpClient::closeSharedReads(quint8 unitId)
+{
+	for (QHash<quint16, SharedRead>::Iterator it = mSharedReads.begin();
+		 it != mSharedReads.end(); ++it) {
+		if (it->unitId == unitId)
+			it->joinable = false;
+	}
+}
+
+QList<ModbusTcpClient::Reply *> ModbusTcpClient::outstandingReplies() const
+{
+	QList<Reply *> replies = mPendingReplies.values();
+	foreach (const QList<Transaction> &queue, mQueuedTransactions) {
+		foreach (const Transaction &t, queue) {
+			if (t.reply != 0)
+				replies.append(t.reply);
+		}
+	}
+	foreach (const SharedRead &read, mSharedReads)
+		replies.append(read.followers);
+	return replies;
+}
+
 ModbusReply *ModbusTcpClient::readRegisters(FunctionCode function, quint8 unitId, quint16 startReg,
-											quint16 count)
+											quint16 count, int timeout)
 {
-	QByteArray frame = createFrame(function, unitId, 4);
-	frame.append(static_cast<char>(msb(startReg)));
-	frame.append(static_cast<char>(lsb(startReg)));
-	frame.append(static_cast<char>(msb(count)));
-	frame.append(static_cast<char>(lsb(count)));
-	return sendFrame(frame);
+	quint16 transactionId = 0;
+	if (findSharedRead(function, unitId, startReg, count, transactionId)) {
+		// The registers are being read already. Wait for the result of that transaction.
+		SharedRead &read = mSharedReads[transactionId];
+		Reply *reply = new Reply(this, transactionId);
+		reply->setReadRange(static_cast<quint16>(startReg - read.startReg), count);
+		reply->timestamps().enqueued = mClock.elapsed();
+		// Also used when the reply takes over the transaction, because its owner is gone.
+		mDeadlines.push(mClock.elapsed() + timeout, transactionId, reply);
+		scheduleTimer();
+		read.followers.append(reply);
+		return reply;
+	}
+	QByteArray frame;
+	if (function == ReadInputRegisters)
+		encodeRequest(ModbusRequest::readInputRegisters(unitId, startReg, count), frame);
+	else
+		encodeRequest(ModbusRequest::readHoldingRegisters(unitId, startReg, count), frame);
+	Reply *reply = sendFrame(frame, timeout);
+	reply->setReadRange(0, count);
+	addSharedRead(reply->transactionId(), function, unitId, startReg, count);
+	return reply;
 }
 
-QByteArray ModbusTcpClient::createFrame(ModbusTcpClient::FunctionCode function, quint8 unitId,
-										quint8 count)
+void ModbusTcpClient::encodeRequest(const ModbusRequest &request, QByteArray &frame)
 {
 	++mTransactionId;
-	QByteArray frame;
+	int valueCount = request.values.size();
+	// Size of the PDU following the function code
+	int size = 4;
+	if (request.function == ModbusRequest::WriteMultipleRegisters)
+		size = 5 + 2 * valueCount;
+	else if (request.function == ModbusRequest::ReadWriteMultipleRegisters)
+		size = 9 + 2 * valueCount;
+	frame.resize(0);
 	frame.append(static_cast<char>(msb(mTransactionId)));
 	frame.append(static_cast<char>(lsb(mTransactionId)));
 	frame.append(static_cast<char>(0));
 	frame.append(static_cast<char>(0));
 	frame.append(static_cast<char>(0));
-	frame.append(static_cast<char>(count + 2));
-	frame.append(static_cast<char>(unitId));
-	frame.append(static_cast<char>(function));
-	return frame;
+	frame.append(static_cast<char>(size + 2));
+	frame.append(static_cast<char>(request.unitId));
+	frame.append(static_cast<char>(request.function));
+	frame.append(static_cast<char>(msb(request.startReg)));
+	frame.append(static_cast<char>(lsb(request.startReg)));
+	switch (request.function) {
+	case ModbusRequest::ReadHoldingRegisters:
+	case ModbusRequest::ReadInputRegisters:
+		frame.append(static_cast<char>(msb(request.count)));
+		frame.append(static_cast<char>(lsb(request.count)));
+		return;
+	case ModbusRequest::WriteSingleRegister:
+		frame.append(static_cast<char>(msb(request.values.value(0))));
+		frame.append(static_cast<char>(lsb(request.values.value(0))));
+		return;
+	case ModbusRequest::ReadWriteMultipleRegisters:
+		frame.append(static_cast<char>(msb(request.count)));
+		frame.append(static_cast<char>(lsb(request.count)));
+		frame.append(static_cast<char>(msb(request.writeStartReg)));
+		frame.append(static_cast<char>(lsb(request.writeStartReg)));
+		break;
+	case ModbusRequest::WriteMultipleRegisters:
+		break;
+	}
+	frame.append(static_cast<char>(msb(valueCount)));
+	frame.append(static_cast<char>(lsb(valueCount)));
+	frame.append(static_cast<char>(valueCount * 2));
+	foreach (quint16 value, request.values) {
+		frame.append(static_cast<char>(msb(value)));
+		frame.append(static_cast<char>(lsb(value)));
+	}
 }
 
-void ModbusTcpClient::setFinished(quint16 transactionId, const QVector<quint16> &values)
+void ModbusTcpClient::finishRequest(Request *request, ModbusReply::ExceptionCode error,
+									const quint8 *registers, int count)
 {
-	Reply *reply = popReply(transactionId);
-	if (reply != 0)
-		reply->setResult(values);
+	// Decoded on the stack: a single response cannot hold more registers.
+	quint16 values[ModbusReply::InlineRegisterCount];
+	count = qMin(count, static_cast<int>(ModbusReply::InlineRegisterCount));
+	for (int i=0; i<count; ++i)
+		values[i] = static_cast<quint16>((registers[2 * i] << 8) | registers[2 * i + 1]);
+	ModbusResult result;
+	result.requestId = request->id;
+	result.error = error;
+	result.registers = ModbusRegisterView(values, count);
+	ModbusCallback callback = request->callback;
+	// Released before the callback, which may send new requests.
+	releaseRequest(request);
+	callback(result);
+}
+
+void ModbusTcpClient::releaseRequest(Request *request)
+{
+	removeDeadline(request);
+	mRequestPool.release(request);
+}
+
+void ModbusTcpClient::setFinished(quint16 transactionId, const quint8 *registers, int count)
+{
+	Request *request = mPendingRequests.take(transactionId);
+	Reply *reply = request == 0 ? popReply(transactionId) : 0;
+	if (request == 0 && reply == 0)
+		return;
+	QList<Reply *> followers = takeFollowers(transactionId);
+	// Fill the window before handling the result, so the next request is on its way while the
+	// result is being processed.
+	sendQueued();
+	if (request != 0)
+		finishRequest(request, ModbusReply::NoException, registers, count);
+	else
+		reply->setTransactionResult(registers, count);
+	foreach (Reply *follower, followers)
+		follower->setTransactionResult(registers, count);
 }
 
 void ModbusTcpClient::setFinished(quint16 transactionId, int error)
 {
-	Reply *reply = popReply(transactionId);
-	if (reply != 0)
-		reply->setResult(static_cast<ModbusReply::ExceptionCode>(error));
+	ModbusReply::ExceptionCode code = static_cast<ModbusReply::ExceptionCode>(error);
+	Request *request = mPendingRequests.take(transactionId);
+	Reply *reply = request == 0 ? popReply(transactionId) : 0;
+	if (request == 0 && reply == 0)
+		return;
+	QList<Reply *> followers = takeFollowers(transactionId);
+	sendQueued();
+	if (request != 0)
+		finishRequest(request, code);
+	else
+		reply->setResult(code);
+	foreach (Reply *follower, followers)
+		follower->setResult(code);
 }
 
-ModbusTcpClient::Reply::Reply(quint16 transactionId, int timeout, QObject *parent):
-	ModbusReply(parent),
-	mTimerId(startTimer(timeout)),
-	mTransactionId(transactionId)
+ModbusTcpClient::Reply::Reply(ModbusTcpClient *client, quint16 transactionId):
+	ModbusReply(client),
+	mClient(client),
+	mTransactionId(transactionId),
+	mReadOffset(0),
+	mReadCount(0),
+	mFinished(false)
 {
 }
 
-bool ModbusTcpClient::Reply::isFinished() const
+void ModbusTcpClient::Reply::detach()
 {
-	return mTimerId == 0;
+	if (mClient == 0)
+		return;
+	mClient->removeDeadline(this);
+	mClient = 0;
 }
 
-void ModbusTcpClient::Reply::onFinished()
+ModbusTcpClient::Reply::~Reply()
 {
-	Q_ASSERT(mTimerId > 0);
-	killTimer(mTimerId);
-	mTimerId = 0;
+	// Done here rather than in a slot connected to `destroyed`, which is emitted when the reply
+	// is already gone.
+	if (mClient != 0)
+		mClient->removeReply(this);
 }
 
-void ModbusTcpClient::Reply::timerEvent(QTimerEvent *event)
+void ModbusTcpClient::Reply::setTransactionResult(const quint8 *registers, int count)
+{
+	if (mReadCount == 0 || (mReadOffset == 0 && count <= mReadCount)) {
+		// The reply covers the whole result. A short response is passed on as is, like it is for
+		// reads which are not shared.
+		setResult(registers, count);
+	} else if (mReadOffset + mReadCount <= count) {
+		setResult(registers + 2 * mReadOffset, mReadCount);
+	} else {
+		setResult(ModbusReply::ParseError);
+	}
+}
+
+bool ModbusTcpClient::Reply::isFinished() const
+{
+	return mFinished;
+}
+
+void ModbusTcpClient::Reply::onFinished()
 {
-	Q_UNUSED(event)
-	Q_ASSERT(mTimerId > 0);
-	setResult(Timeout);
+	Q_ASSERT(!mFinished);
+	mFinished = true;
 }
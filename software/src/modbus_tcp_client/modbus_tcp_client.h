@@ -2,24 +2,102 @@
 #define MODBUSTCPCLIENT_H
 
 #include <QAbstractSocket>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
 #include <QObject>
+#include <QSet>
+#include "latency_statistics.h"
 #include "modbus_client.h"
+#include "modbus_deadline_queue.h"
+#include "modbus_object_pool.h"
 #include "modbus_reply.h"
+#include "modbus_tcp_frame_buffer.h"
 
+class ModbusTcpTransport;
 class QTimer;
 
+/*!
+ * Modbus TCP client.
+ *
+ * Failed connection attempts (including connections that break down) are retried with an
+ * exponential backoff and random jitter, so clients for different hosts do not reconnect all at
+ * the same time after a network problem. After `CircuitFailureThreshold` consecutive failures, the
+ * circuit breaker opens: connection attempts are postponed until the backoff delay has elapsed.
+ * Then a single trial connection is made (half open). The circuit is closed again once a
+ * connection has been established.
+ *
+ * Socket I/O and frame decoding are done by a `ModbusTcpTransport`, which may run in a separate
+ * I/O thread. All other work (including handling of replies) is done in the thread of the client.
+ *
+ * Register reads are shared: a read of registers which lie within the range of a read of the same
+ * unit id and function that is still queued or waiting for a response is not sent. Instead, the
+ * new reply waits for the transaction already in flight, and gets its own part of the result.
+ * This way a detector scanning a host which is being polled (eg. reading a model header which is
+ * part of the block read by the updater) does not always add a request of its own. Only reads
+ * which overlap in time are shared: results are not kept after the transaction has finished (see
+ * `ModbusRegisterCache` for that). Each reply keeps its own timeout.
+ *
+ * Requests sent with `submit` are kept in records taken from a pool, and finished by calling
+ * their callback directly. They take part in the send queue, the transaction window and the
+ * timeouts just like requests returning a reply. Reads sent with `submit` are always sent, but
+ * may be joined by reads returning a reply.
+ *
+ * Because the client may be shared, its settings should not be changed by a single user. Users
+ * which need a specific timeout pass it with the request (see `ModbusRequest::timeout` and
+ * `sendRequest`), and users which want more transactions in flight use the per-user version of
+ * `setMaxPendingRequests`.
+ */
 class ModbusTcpClient: public ModbusClient
 {
 	Q_OBJECT
+	Q_ENUMS(CircuitState)
 public:
 	static const quint16 DefaultTcpPort = 502;
 
+	static const int DefaultMaxPendingRequests = 1;
+
+	/// Number of consecutive connection failures which will open the circuit breaker.
+	static const int CircuitFailureThreshold = 3;
+
+	/// Reconnect delay (ms) after the first failure. The delay doubles with each failure.
+	static const int InitialReconnectDelay = 1000;
+
+	static const int MaxReconnectDelay = 60000;
+
+	enum CircuitState
+	{
+		/// Normal operation
+		CircuitClosed,
+		/// Too many failures: connection attempts are postponed until the backoff delay elapsed.
+		CircuitOpen,
+		/// A trial connection is in progress.
+		CircuitHalfOpen
+	};
+
 	ModbusTcpClient(QObject *parent = 0);
 
-	void connectToServer(const QString &hostName, quint16 tcpPort = DefaultTcpPort);
+	virtual ~ModbusTcpClient();
+
+	/*!
+	 * Connects to the given server. Does nothing if the client is already connected or connecting
+	 * to the same server. If the previous attempt failed less than `reconnectDelay` ago, the
+	 * connection attempt is postponed.
+	 * @param timeout Timeout (ms) of the connection attempt, or 0 to use `timeout()`.
+	 */
+	void connectToServer(const QString &hostName, quint16 tcpPort = DefaultTcpPort,
+						 int timeout = 0);
 
 	bool isConnected() const;
 
+	CircuitState circuitState() const;
+
+	/*!
+	 * Returns the time (ms) until a new connection attempt will be made. Returns 0 if there are no
+	 * recent connection failures.
+	 */
+	int reconnectDelay() const;
+
 	virtual ModbusReply *readHoldingRegisters(quint8 unitId, quint16 startReg, quint16 count);
 
 	virtual ModbusReply *readInputRegisters(quint8 unitId, quint16 startReg, quint16 count);
@@ -29,30 +107,84 @@ public:
 	virtual ModbusReply *writeMultipleHoldingRegisters(quint8 unitId, quint16 startReg,
 													   const QVector<quint16> &values);
 
+	virtual ModbusReply *readWriteMultipleRegisters(quint8 unitId, quint16 readStartReg,
+													quint16 readCount, quint16 writeStartReg,
+													const QVector<quint16> &values);
+
+	virtual ModbusReply *sendRequest(const ModbusRequest &request);
+
+	virtual quint32 submit(const ModbusRequest &request, const ModbusCallback &callback);
+
+	virtual void cancelRequest(quint32 requestId);
+
 	QString hostName() const;
 
 	quint16 portName() const;
 
+	/*!
+	 * Returns false if the given unit answered a request with the given function with
+	 * `ModbusReply::IllegalFunction`. This is remembered as long as the client talks to the same
+	 * server, so users sharing the client (or taking it over, see `ModbusTcpClientPool`) do not
+	 * have to probe the device again.
+	 */
+	bool isFunctionSupported(quint8 unitId, ModbusRequest::Function function) const;
+
 	virtual int timeout() const;
 
 	virtual void setTimeout(int t);
 
+	/*!
+	 * Returns the maximum number of transactions which may be in flight on the
+	 * connection. Requests beyond this limit are queued and sent as soon as
+	 * a reply for an earlier transaction arrives. Queued requests for different
+	 * unit ids are sent in turns.
+	 */
+	int maxPendingRequests() const;
+
+	/*!
+	 * Sets the maximum number of transactions in flight. Replies are matched
+	 * by transaction id, so they may arrive in any order. The default (1)
+	 * sends a request only after the previous one has been handled, which is
+	 * what devices that cannot handle pipelined requests need.
+	 */
+	void setMaxPendingRequests(int n);
+
+	/*!
+	 * Allows up to `n` transactions in flight while `user` is using the client. The client uses
+	 * the largest window requested by its users (and at least `maxPendingRequests`), so a user
+	 * that knows the device accepts pipelined requests can raise the window without changing the
+	 * setting for good. All users of a client talk to the same device, so they share the window.
+	 * Pass 0 to withdraw the request, which should be done before the client is released.
+	 */
+	void setMaxPendingRequests(const QObject *user, int n);
+
+	/// Returns the number of transactions that may currently be in flight.
+	int window() const;
+
 signals:
 	void connected();
 
 	void disconnected();
 
+	void circuitStateChanged(ModbusTcpClient::CircuitState state);
+
 protected:
-	virtual void timerEvent(QTimerEvent *event);
+	virtual void cancelTransaction(ModbusReply *reply);
+
+	virtual void cancelRequests(const void *object, bool all);
 
 private slots:
-	void onConnected();
+	void onConnected(int session);
 
-	void onReadyRead();
+	void onDisconnected(int session);
 
-	void onReplyDestroyed();
+	void onTimer();
 
-	void onSocketErrorReceived(QAbstractSocket::SocketError error);
+	void onFramesAvailable();
+
+	void onStreamError(int session);
+
+	void onSocketErrorReceived(int session, QAbstractSocket::SocketError error);
 
 private:
 	enum FunctionCode
@@ -75,44 +207,262 @@ private:
 
 	class Reply : public ModbusReply {
 	public:
-		Reply(quint16 transactionId, int timeout, QObject *parent = 0);
+		Reply(ModbusTcpClient *client, quint16 transactionId);
+
+		/// Removes the reply from the client, if the client still keeps track of it.
+		virtual ~Reply();
 
 		quint16 transactionId() const
 		{
 			return mTransactionId;
 		}
 
+		/// Called when the client no longer keeps track of the reply. Removes its deadline.
+		void detach();
+
+		/*!
+		 * Marks the reply as a read taking part in a shared read. The reply takes `count`
+		 * registers from the result of the transaction, starting at `offset`.
+		 */
+		void setReadRange(quint16 offset, quint16 count)
+		{
+			mReadOffset = offset;
+			mReadCount = count;
+		}
+
 		using ModbusReply::setResult;
 
+		/*!
+		 * Sets the result of the transaction of the reply. A reply taking part in a shared read
+		 * takes its own range from the result, or fails with `ParseError` if the result does not
+		 * contain it.
+		 */
+		void setTransactionResult(const quint8 *registers, int count);
+
 		virtual bool isFinished() const;
 
-		virtual void timerEvent(QTimerEvent *event);
+		LatencyStatistics::Timestamps &timestamps()
+		{
+			return mTimestamps;
+		}
 
 	private:
 		virtual void onFinished();
 
-		int mTimerId;
+		ModbusTcpClient *mClient;
 		quint16 mTransactionId;
+		quint16 mReadOffset;
+		/// 0 if the reply does not take part in a shared read.
+		quint16 mReadCount;
+		bool mFinished;
+		LatencyStatistics::Timestamps mTimestamps;
 	};
 
 	ModbusReply *readRegisters(FunctionCode function, quint8 unitId, quint16 startReg,
-							   quint16 count);
+							   quint16 count, int timeout);
+
+	/// A request sent with `submit`.
+	struct Request {
+		quint32 id;
+		quint16 transactionId;
+		ModbusCallback callback;
+		LatencyStatistics::Timestamps timestamps;
+	};
 
-	ModbusReply *sendFrame(const QByteArray &payload);
+	/// A queued transaction. Either `reply` or `request` is set.
+	struct Transaction {
+		Reply *reply;
+		Request *request;
+		QByteArray frame;
 
-	Reply *popReply(quint16 transactionId);
+		quint16 transactionId() const
+		{
+			return reply != 0 ? reply->transactionId() : request->transactionId;
+		}
+
+		/// The tag used in `mDeadlines`.
+		const void *tag() const
+		{
+			return reply != 0 ? static_cast<const void *>(reply) : request;
+		}
+	};
+
+	/// A read transaction which is queued or waiting for a response, and the replies sharing it.
+	struct SharedRead {
+		quint8 function;
+		quint8 unitId;
+		quint16 startReg;
+		quint16 count;
+		/// Cleared when a write to the unit is sent, because the result may not reflect the write.
+		bool joinable;
+		/// Replies waiting for the result, other than the one owning the transaction.
+		QList<Reply *> followers;
+	};
+
+	Reply *sendFrame(const QByteArray &payload, int timeout);
+
+	void sendQueued();
+
+	/// Recomputes `mWindow` after one of the window settings has changed.
+	void updateWindow();
 
-	QByteArray createFrame(FunctionCode function, quint8 unitId, quint8 count);
+	void enqueue(quint8 unitId, const Transaction &t);
+
+	/*!
+	 * Takes the next transaction from the send queue. Unit ids take turns, so a unit with a lot
+	 * of queued requests cannot delay the other units on the same connection.
+	 */
+	bool takeQueued(Transaction &t);
+
+	/*!
+	 * Removes the transaction with the given tag (see `Transaction::tag`) and transaction id from
+	 * the send queue.
+	 * @return false if the transaction is not queued.
+	 */
+	bool removeQueued(const void *tag, quint16 transactionId, Transaction &t);
+
+	/// Number of transactions waiting for a response.
+	int pendingCount() const;
+
+	/*!
+	 * Removes a reply which is no longer needed (destroyed or cancelled) from the shared reads,
+	 * the send queue and the transactions waiting for a response. The transaction of the reply is
+	 * kept if other replies are waiting for its result.
+	 */
+	void removeReply(Reply *reply);
+
+	Reply *popReply(quint16 transactionId);
 
-	void setFinished(quint16 transactionId, const QVector<quint16> &values);
+	void addSharedRead(quint16 transactionId, quint8 function, quint8 unitId, quint16 startReg,
+					   quint16 count);
+
+	/*!
+	 * Looks for a joinable read transaction whose range contains the given range.
+	 * @return false if there is none.
+	 */
+	bool findSharedRead(quint8 function, quint8 unitId, quint16 startReg, quint16 count,
+						quint16 &transactionId) const;
+
+	/*!
+	 * Returns the replies waiting for the result of the given transaction (besides its owner), so
+	 * they can be finished with the same result. The shared read is removed.
+	 */
+	QList<Reply *> takeFollowers(quint16 transactionId);
+
+	/*!
+	 * Hands the given transaction over to the first reply waiting for its result, because its
+	 * owner is no longer interested in it.
+	 * @return false if no other reply is waiting for the result. The shared read (if any) is
+	 * removed in that case.
+	 */
+	bool transferTransaction(quint16 transactionId);
+
+	/*!
+	 * Prevents reads sent from now on from joining the transactions already queued or in flight
+	 * for the given unit. Used when a write is sent, because the result of those transactions may
+	 * not reflect the write.
+	 */
+	void closeSharedReads(quint8 unitId);
+
+	/// Returns all replies which are queued, waiting for a response or for a shared read.
+	QList<Reply *> outstandingReplies() const;
+
+	/// Builds the frame of the request, using a new transaction id.
+	void encodeRequest(const ModbusRequest &request, QByteArray &frame);
+
+	/*!
+	 * Returns the record of a request sent with `submit` to the pool, and calls its callback.
+	 * @param registers Register values in network byte order (big endian)
+	 * @param count The number of registers
+	 */
+	void finishRequest(Request *request, ModbusReply::ExceptionCode error,
+					   const quint8 *registers = 0, int count = 0);
+
+	/// Removes the deadline of a request sent with `submit`, and returns its record to the pool.
+	void releaseRequest(Request *request);
+
+	void handleFrame(const ModbusTcpFrame &frame);
+
+	/*!
+	 * Adds the timestamps of the transaction the frame belongs to (if it is still pending) to the
+	 * latency statistics of the unit id and function code. Exception replies are not recorded.
+	 */
+	void recordLatency(const ModbusTcpFrame &frame, qint64 firstByteTime, qint64 receivedTime);
+
+	void failPending(ModbusReply::ExceptionCode error);
+
+	/*!
+	 * Finishes the transaction with a timeout error, if the reply is still waiting for a response
+	 * or in the send queue.
+	 */
+	void expire(quint16 transactionId, const void *tag);
+
+	/*!
+	 * Programs the timer for the next deadline (transaction or connect timeout), or stops it if
+	 * there is none.
+	 */
+	void scheduleTimer();
+
+	/// Removes the deadline of a transaction which has completed or been cancelled.
+	void removeDeadline(const void *tag);
+
+	void startConnect();
+
+	/// Updates the backoff delay and circuit state after a connection failure.
+	void registerFailure();
+
+	void setCircuitState(CircuitState state);
+
+	/*!
+	 * Finishes the transaction with the given ID.
+	 * @param registers Register values in network byte order (big endian)
+	 * @param count The number of registers
+	 */
+	void setFinished(quint16 transactionId, const quint8 *registers, int count);
 
 	void setFinished(quint16 transactionId, int error);
 
 	QHash<quint16, Reply *> mPendingReplies;
-	QAbstractSocket *mSocket;
+	/// Requests sent with `submit` which are waiting for a response.
+	QHash<quint16, Request *> mPendingRequests;
+	ModbusObjectPool<Request> mRequestPool;
+	/// Transactions waiting to be sent, per unit id.
+	QHash<quint8, QList<Transaction> > mQueuedTransactions;
+	/// Unit ids with queued transactions, in the order in which they will be served.
+	QList<quint8> mUnitOrder;
+	/// Read transactions which are queued or waiting for a response, per transaction id.
+	QHash<quint16, SharedRead> mSharedReads;
+	ModbusTcpTransport *mTransport;
+	/// Connection state as far as the client knows. The transport may be in another thread.
+	QAbstractSocket::SocketState mState;
+	/// Number of the current connection attempt, used to ignore events from earlier attempts.
+	int mSession;
 	int mTimeout;
-	int mConnectTimerId;
-	QByteArray mBuffer;
+	/// Timeout of the current (or next) connection attempt.
+	int mConnectTimeout;
+	int mMaxPendingRequests;
+	/// Windows requested with `setMaxPendingRequests(user, n)`.
+	QHash<const QObject *, int> mUserWindows;
+	/// Number of transactions that may be in flight.
+	int mWindow;
+	/// Timeouts of all outstanding transactions, all handled by `mTimer`.
+	ModbusDeadlineQueue mDeadlines;
+	QTimer *mTimer;
+	QElapsedTimer mClock;
+	/// The deadline `mTimer` is programmed for, or -1 if the timer is not running.
+	qint64 mTimerDeadline;
+	/// Deadline of the connection attempt, or -1 if there is no connection attempt in progress.
+	qint64 mConnectDeadline;
+	/// Time of a postponed connection attempt, or -1 if there is none.
+	qint64 mReconnectDeadline;
+	/// Earliest time at which a new connection attempt is allowed.
+	qint64 mNextAttemptTime;
+	int mFailureCount;
+	CircuitState mCircuitState;
+	/// Functions answered with IllegalFunction, per unit id (high byte) and function (low byte).
+	QSet<quint16> mUnsupportedFunctions;
+	/// Latency statistics per unit id (high byte) and function code (low byte).
+	QHash<quint16, LatencyStatistics::Entry *> mLatencyEntries;
 	QString mHostName;
 	quint16 mTcpPort;
 	quint16 mTransactionId;
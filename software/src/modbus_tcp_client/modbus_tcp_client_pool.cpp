@@ -0,0 +1,99 @@
+#include <QCoreApplication>
+#include <QTimer>
+#include <QsLog.h>
+#include "modbus_tcp_client_pool.h"
+
+ModbusTcpClientPool::ModbusTcpClientPool(QObject *parent):
+	QObject(parent),
+	mLingerTimer(new QTimer(this)),
+	mLingerTime(DefaultLingerTime)
+{
+	mClock.start();
+	mLingerTimer->setSingleShot(true);
+	connect(mLingerTimer, SIGNAL(timeout()), this, SLOT(onLingerTimer()));
+}
+
+ModbusTcpClientPool *ModbusTcpClientPool::instance()
+{
+	// Parented to the application, so the sockets are closed before the event loop is gone.
+	static ModbusTcpClientPool *pool = new ModbusTcpClientPool(QCoreApplication::instance());
+	return pool;
+}
+
+ModbusTcpClient *ModbusTcpClientPool::acquire(const QString &hostName, quint16 tcpPort)
+{
+	QString key = createKey(hostName, tcpPort);
+	QHash<QString, Entry>::Iterator it = mEntries.find(key);
+	if (it == mEntries.end()) {
+		Entry e;
+		e.client = new ModbusTcpClient(this);
+		e.refCount = 0;
+		e.idleSince = 0;
+		it = mEntries.insert(key, e);
+		QLOG_DEBUG() << "[ModbusPool] New connection to" << key;
+	} else if (it->refCount == 0) {
+		QLOG_DEBUG() << "[ModbusPool] Reusing idle connection to" << key;
+	}
+	++it->refCount;
+	return it->client;
+}
+
+void ModbusTcpClientPool::release(ModbusTcpClient *client)
+{
+	for (QHash<QString, Entry>::Iterator it = mEntries.begin(); it != mEntries.end(); ++it) {
+		if (it->client != client)
+			continue;
+		Q_ASSERT(it->refCount > 0);
+		if (--it->refCount == 0) {
+			it->idleSince = mClock.elapsed();
+			scheduleLingerTimer();
+		}
+		return;
+	}
+	Q_ASSERT(false);
+}
+
+int ModbusTcpClientPool::lingerTime() const
+{
+	return mLingerTime;
+}
+
+void ModbusTcpClientPool::setLingerTime(int t)
+{
+	mLingerTime = t;
+	scheduleLingerTimer();
+}
+
+void ModbusTcpClientPool::onLingerTimer()
+{
+	qint64 now = mClock.elapsed();
+	for (QHash<QString, Entry>::Iterator it = mEntries.begin(); it != mEntries.end();) {
+		if (it->refCount == 0 && it->idleSince + mLingerTime <= now) {
+			QLOG_DEBUG() << "[ModbusPool] Closing idle connection to" << it.key();
+			it->client->deleteLater();
+			it = mEntries.erase(it);
+		} else {
+			++it;
+		}
+	}
+	scheduleLingerTimer();
+}
+
+QString ModbusTcpClientPool::createKey(const QString &hostName, quint16 tcpPort)
+{
+	return QString("%1:%2").arg(hostName).arg(tcpPort);
+}
+
+void ModbusTcpClientPool::scheduleLingerTimer()
+{
+	qint64 deadline = -1;
+	foreach (const Entry &e, mEntries) {
+		if (e.refCount == 0 && (deadline < 0 || e.idleSince + mLingerTime < deadline))
+			deadline = e.idleSince + mLingerTime;
+	}
+	if (deadline < 0) {
+		mLingerTimer->stop();
+		return;
+	}
+	mLingerTimer->start(static_cast<int>(qMax(Q_INT64_C(0), deadline - mClock.elapsed())));
+}
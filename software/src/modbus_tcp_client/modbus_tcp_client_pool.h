@@ -0,0 +1,79 @@
+#ifndef MODBUS_TCP_CLIENT_POOL_H
+#define MODBUS_TCP_CLIENT_POOL_H
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QObject>
+#include "modbus_tcp_client.h"
+
+class QTimer;
+
+/*!
+ * Hands out shared Modbus TCP connections, one for each (host, port) combination.
+ *
+ * Inverter data managers only accept a limited number of concurrent Modbus TCP connections, so
+ * all detectors and updaters talking to the same host should use the same client. Clients are
+ * reference counted: each `acquire` must be matched by a `release`. When the last reference is
+ * released, the connection is kept open for a while (the linger time), so an updater created
+ * right after detection can adopt the connection used by the detector.
+ *
+ * The client is shared by all unit ids on the host, so all PV inverters behind a Fronius
+ * datamanager are detected and polled over a single connection. The client sends queued requests
+ * for different unit ids in turns.
+ *
+ * Settings like the timeout and the maximum number of pending requests are shared by all users
+ * of a client, so users should not change them. Instead, they pass their timeout with each
+ * request (see `ModbusRequest::timeout`), and raise the window for themselves only (see
+ * `ModbusTcpClient::setMaxPendingRequests(const QObject *, int)`).
+ */
+class ModbusTcpClientPool : public QObject
+{
+	Q_OBJECT
+public:
+	static const int DefaultLingerTime = 10000;
+
+	static ModbusTcpClientPool *instance();
+
+	/*!
+	 * Returns the client for the given host. The client may already be connected, in which case
+	 * the `connected` signal will not be emitted again. Calling `connectToServer` on the client is
+	 * always safe, because it does nothing if a connection is present or in progress.
+	 */
+	ModbusTcpClient *acquire(const QString &hostName,
+							 quint16 tcpPort = ModbusTcpClient::DefaultTcpPort);
+
+	/*!
+	 * Releases a client retrieved by `acquire`. The caller should disconnect all signals from the
+	 * client first, because the client will outlive the caller.
+	 */
+	void release(ModbusTcpClient *client);
+
+	/// Returns the time (in milliseconds) an unused connection is kept open.
+	int lingerTime() const;
+
+	void setLingerTime(int t);
+
+private slots:
+	void onLingerTimer();
+
+private:
+	explicit ModbusTcpClientPool(QObject *parent = 0);
+
+	struct Entry {
+		ModbusTcpClient *client;
+		int refCount;
+		/// Time (`mClock`) at which the reference count dropped to 0.
+		qint64 idleSince;
+	};
+
+	static QString createKey(const QString &hostName, quint16 tcpPort);
+
+	void scheduleLingerTimer();
+
+	QHash<QString, Entry> mEntries;
+	QTimer *mLingerTimer;
+	QElapsedTimer mClock;
+	int mLingerTime;
+};
+
+#endif // MODBUS_TCP_CLIENT_POOL_H
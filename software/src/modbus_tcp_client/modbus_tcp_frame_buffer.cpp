@@ -0,0 +1,69 @@
+#include <string.h>
+#include "modbus_tcp_frame_buffer.h"
+
+// Transaction id (2), protocol id (2), length (2)
+static const int MbapPrefixSize = 6;
+
+ModbusTcpFrameBuffer::ModbusTcpFrameBuffer(int capacity):
+	mData(qMax(capacity, 2 * MaxFrameSize), 0),
+	mReadPos(0),
+	mWritePos(0),
+	mError(false)
+{
+}
+
+char *ModbusTcpFrameBuffer::writePointer()
+{
+	if (mReadPos == mWritePos) {
+		mReadPos = 0;
+		mWritePos = 0;
+	} else if (writeCapacity() < MaxFrameSize) {
+		// There is at most a single incomplete frame left, so this copies less than MaxFrameSize
+		// bytes.
+		int size = mWritePos - mReadPos;
+		char *data = mData.data();
+		memmove(data, data + mReadPos, static_cast<size_t>(size));
+		mReadPos = 0;
+		mWritePos = size;
+	}
+	return mData.data() + mWritePos;
+}
+
+void ModbusTcpFrameBuffer::commit(int count)
+{
+	Q_ASSERT(count >= 0 && count <= writeCapacity());
+	mWritePos += count;
+}
+
+bool ModbusTcpFrameBuffer::nextFrame(ModbusTcpFrame &frame)
+{
+	if (mError)
+		return false;
+	int available = mWritePos - mReadPos;
+	if (available < MbapPrefixSize)
+		return false;
+	const quint8 *p = reinterpret_cast<const quint8 *>(mData.constData()) + mReadPos;
+	// The length field counts the unit id, function code and the remainder of the PDU.
+	int length = (p[4] << 8) | p[5];
+	if (length < 2 || length + MbapPrefixSize > MaxFrameSize) {
+		mError = true;
+		return false;
+	}
+	if (available < length + MbapPrefixSize)
+		return false;
+	frame.transactionId = static_cast<quint16>((p[0] << 8) | p[1]);
+	frame.protocolId = static_cast<quint16>((p[2] << 8) | p[3]);
+	frame.unitId = p[6];
+	frame.functionCode = p[7];
+	frame.data = p + 8;
+	frame.size = length - 2;
+	mReadPos += length + MbapPrefixSize;
+	return true;
+}
+
+void ModbusTcpFrameBuffer::clear()
+{
+	mReadPos = 0;
+	mWritePos = 0;
+	mError = false;
+}
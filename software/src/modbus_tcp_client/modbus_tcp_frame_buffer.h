@@ -0,0 +1,95 @@
+#ifndef MODBUS_TCP_FRAME_BUFFER_H
+#define MODBUS_TCP_FRAME_BUFFER_H
+
+#include <QByteArray>
+#include <QtGlobal>
+
+/*!
+ * A decoded Modbus TCP frame. The frame does not own its data: it points into the
+ * `ModbusTcpFrameBuffer` it was taken from, and is valid until the next call to
+ * `ModbusTcpFrameBuffer::writePointer` or `ModbusTcpFrameBuffer::clear`.
+ */
+struct ModbusTcpFrame
+{
+	quint16 transactionId;
+	quint16 protocolId;
+	quint8 unitId;
+	quint8 functionCode;
+	/// The PDU bytes following the function code.
+	const quint8 *data;
+	int size;
+
+	quint8 byteAt(int offset) const
+	{
+		return data[offset];
+	}
+
+	quint16 uint16At(int offset) const
+	{
+		return static_cast<quint16>((data[offset] << 8) | data[offset + 1]);
+	}
+};
+
+/*!
+ * Fixed capacity receive buffer used to reassemble Modbus TCP frames.
+ *
+ * Data is read from the socket straight into the buffer (see `writePointer`). Complete frames are
+ * decoded in place by advancing a read offset, so handling a burst of pipelined replies costs no
+ * copying and no heap allocations. Remaining bytes are only moved to the front of the buffer when
+ * there is not enough room left at the end to hold a complete frame.
+ */
+class ModbusTcpFrameBuffer
+{
+public:
+	/// MBAP header (7 bytes) + largest PDU allowed by the standard (253 bytes).
+	static const int MaxFrameSize = 260;
+
+	explicit ModbusTcpFrameBuffer(int capacity = 8 * MaxFrameSize);
+
+	/*!
+	 * Returns a pointer to the free space at the end of the buffer. At least `MaxFrameSize` bytes
+	 * are available, unless the buffer contains more unprocessed data than its capacity allows,
+	 * which cannot happen if all complete frames are taken with `nextFrame`.
+	 */
+	char *writePointer();
+
+	/// The number of bytes available at `writePointer`.
+	int writeCapacity() const
+	{
+		return mData.size() - mWritePos;
+	}
+
+	/// Marks `count` bytes written at `writePointer` as received.
+	void commit(int count);
+
+	/*!
+	 * Takes the next complete frame from the buffer.
+	 * @return false if there is no complete frame available.
+	 */
+	bool nextFrame(ModbusTcpFrame &frame);
+
+	/*!
+	 * Returns true if the stream is corrupt: the length in the MBAP header cannot be right. The
+	 * buffer should be cleared (or the connection be closed) in this case, because there is no
+	 * way to find the start of the next frame.
+	 */
+	bool hasError() const
+	{
+		return mError;
+	}
+
+	int bytesAvailable() const
+	{
+		return mWritePos - mReadPos;
+	}
+
+	void clear();
+
+private:
+	QByteArray mData;
+	int mReadPos;
+	int mWritePos;
+	bool mError;
+};
+
+#endif // MODBUS_TCP_FRAME_BUFFER_H
@@ -0,0 +1,232 @@
+#include <QCoreApplication>
+#include <QMetaType>
+#include <QTcpSocket>
+#include <QThread>
+#include <string.h>
+#include <QsLog.h>
+#include "modbus_tcp_transport.h"
+#include "tcp_socket_options.h"
+
+namespace {
+
+class ModbusIoThread : public QThread
+{
+public:
+	explicit ModbusIoThread(QObject *parent):
+		QThread(parent)
+	{
+	}
+
+	~ModbusIoThread()
+	{
+		quit();
+		wait();
+	}
+};
+
+bool ioThreadEnabled = false;
+
+QThread *ioThread()
+{
+	// Parented to the application, so the thread is stopped before the application is gone.
+	static QThread *thread = 0;
+	if (thread == 0) {
+		thread = new ModbusIoThread(QCoreApplication::instance());
+		thread->start();
+		QLOG_INFO() << "Modbus TCP I/O thread started";
+	}
+	return thread;
+}
+
+}
+
+ModbusTcpTransport::ModbusTcpTransport():
+	QObject(0),
+	mSocket(new QTcpSocket(this)),
+	mFirstByteTime(-1),
+	mSession(0),
+	mNotified(0),
+	mStalled(0)
+{
+	connect(mSocket, SIGNAL(readyRead()), this, SLOT(onReadyRead()));
+	connect(mSocket, SIGNAL(connected()), this, SLOT(onConnected()));
+	connect(mSocket, SIGNAL(disconnected()), this, SLOT(onDisconnected()));
+	connect(mSocket, SIGNAL(error(QAbstractSocket::SocketError)),
+			this, SLOT(onError(QAbstractSocket::SocketError)));
+}
+
+ModbusTcpTransport *ModbusTcpTransport::create()
+{
+	qRegisterMetaType<QAbstractSocket::SocketError>("QAbstractSocket::SocketError");
+	ModbusTcpTransport *transport = new ModbusTcpTransport();
+	if (ioThreadEnabled)
+		transport->moveToThread(ioThread());
+	return transport;
+}
+
+void ModbusTcpTransport::destroy()
+{
+	if (thread() == QThread::currentThread())
+		delete this;
+	else
+		deleteLater();
+}
+
+void ModbusTcpTransport::setIoThreadEnabled(bool enabled)
+{
+	ioThreadEnabled = enabled;
+}
+
+bool ModbusTcpTransport::isIoThreadEnabled()
+{
+	return ioThreadEnabled;
+}
+
+qint64 ModbusTcpTransport::currentTime()
+{
+	QElapsedTimer timer;
+	timer.start();
+	return timer.msecsSinceReference();
+}
+
+void ModbusTcpTransport::connectToHost(const QString &hostName, quint16 port, int session)
+{
+	QMetaObject::invokeMethod(this, "onConnectToHost", Qt::AutoConnection,
+							  Q_ARG(QString, hostName), Q_ARG(int, port),
+							  Q_ARG(int, session));
+}
+
+void ModbusTcpTransport::disconnectFromHost()
+{
+	QMetaObject::invokeMethod(this, "onDisconnectFromHost", Qt::AutoConnection);
+}
+
+void ModbusTcpTransport::write(const QByteArray &frame, int session)
+{
+	QMetaObject::invokeMethod(this, "onWrite", Qt::AutoConnection, Q_ARG(QByteArray, frame),
+							  Q_ARG(int, session));
+}
+
+const ModbusTcpTransport::Frame *ModbusTcpTransport::nextFrame()
+{
+	const Frame *frame = mFrames.front();
+	if (frame != 0)
+		return frame;
+	// Frames pushed after this point will trigger a new notification.
+	mNotified.fetchAndStoreOrdered(0);
+	return mFrames.front();
+}
+
+void ModbusTcpTransport::popFrame()
+{
+	mFrames.pop();
+	// Not a direct call, because the client is probably still handling frames.
+	if (mStalled.testAndSetOrdered(1, 0))
+		QMetaObject::invokeMethod(this, "onReadyRead", Qt::QueuedConnection);
+}
+
+void ModbusTcpTransport::onConnectToHost(const QString &hostName, int port, int session)
+{
+	if (mSocket->state() != QAbstractSocket::UnconnectedState)
+		mSocket->abort();
+	mSession = session;
+	mBuffer.clear();
+	mSocket->connectToHost(hostName, static_cast<quint16>(port));
+}
+
+void ModbusTcpTransport::onDisconnectFromHost()
+{
+	mSocket->disconnectFromHost();
+}
+
+void ModbusTcpTransport::onWrite(const QByteArray &frame, int session)
+{
+	if (session != mSession)
+		return;
+	mSocket->write(frame);
+}
+
+void ModbusTcpTransport::onConnected()
+{
+	TcpSocketOptions::global().apply(mSocket);
+	emit connected(mSession);
+}
+
+void ModbusTcpTransport::onDisconnected()
+{
+	emit disconnected(mSession);
+}
+
+void ModbusTcpTransport::onError(QAbstractSocket::SocketError error)
+{
+	emit error(mSession, error);
+}
+
+void ModbusTcpTransport::onReadyRead()
+{
+	mStalled.fetchAndStoreOrdered(0);
+	qint64 now = currentTime();
+	// Frames left in the buffer after a stall.
+	if (!queueFrames(now))
+		return;
+	for (;;) {
+		bool wasEmpty = mBuffer.bytesAvailable() == 0;
+		qint64 count = mSocket->read(mBuffer.writePointer(), mBuffer.writeCapacity());
+		if (count <= 0)
+			return;
+		now = currentTime();
+		if (wasEmpty)
+			mFirstByteTime = now;
+		mBuffer.commit(static_cast<int>(count));
+		if (!queueFrames(now))
+			return;
+		if (mBuffer.hasError()) {
+			// We cannot find the start of the next frame, so all we can do is start over.
+			QLOG_WARN() << "Corrupt Modbus TCP stream from" << mSocket->peerName();
+			mBuffer.clear();
+			mSocket->abort();
+			emit streamError(mSession);
+			return;
+		}
+	}
+}
+
+bool ModbusTcpTransport::queueFrames(qint64 now)
+{
+	bool queued = false;
+	bool full = false;
+	for (;;) {
+		Frame *slot = mFrames.back();
+		if (slot == 0) {
+			full = true;
+			break;
+		}
+		ModbusTcpFrame frame;
+		if (!mBuffer.nextFrame(frame))
+			break;
+		Q_ASSERT(frame.protocolId == 0);
+		slot->session = mSession;
+		slot->transactionId = frame.transactionId;
+		slot->unitId = frame.unitId;
+		slot->functionCode = frame.functionCode;
+		slot->size = frame.size;
+		slot->firstByteTime = mFirstByteTime;
+		slot->receivedTime = now;
+		memcpy(slot->data, frame.data, static_cast<size_t>(frame.size));
+		mFrames.push();
+		queued = true;
+		// We do not know exactly when the remaining bytes arrived, so we take the latest possible
+		// time. This is only inaccurate for pipelined replies.
+		mFirstByteTime = now;
+	}
+	if (queued && mNotified.testAndSetOrdered(0, 1))
+		emit framesAvailable();
+	if (full) {
+		// Reading resumes when the client pops a frame.
+		mStalled.fetchAndStoreOrdered(1);
+		if (mFrames.back() != 0 && mStalled.testAndSetOrdered(1, 0))
+			QMetaObject::invokeMethod(this, "onReadyRead", Qt::QueuedConnection);
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,152 @@
+#ifndef MODBUS_TCP_TRANSPORT_H
+#define MODBUS_TCP_TRANSPORT_H
+
+#include <QAbstractSocket>
+#include <QElapsedTimer>
+#include <QObject>
+#include "modbus_spsc_queue.h"
+#include "modbus_tcp_frame_buffer.h"
+
+class QThread;
+
+/*!
+ * Owns the socket of a `ModbusTcpClient` and splits the incoming stream into frames.
+ *
+ * By default the transport lives in the thread of the client, and all calls are direct. If the
+ * I/O thread is enabled (see `setIoThreadEnabled`), transports are moved to a dedicated thread
+ * shared by all clients. In that case socket access and frame decoding are not delayed when the
+ * main event loop is busy (eg. with D-Bus traffic), and vice versa.
+ *
+ * Decoded frames are handed to the client through a bounded single producer/single consumer queue.
+ * `framesAvailable` is emitted when the queue becomes non-empty. If the client does not keep up
+ * and the queue fills up, the transport stops reading from the socket until the client has taken
+ * frames from the queue.
+ *
+ * Each connection attempt gets a session number, which is passed with all connection related
+ * signals. This allows the client to ignore signals that were already underway when it started a
+ * new connection attempt. Frames are tagged with the session as well, in both directions: the
+ * client drops decoded frames from an earlier connection which are still in the queue, and the
+ * transport drops writes meant for an earlier connection.
+ */
+class ModbusTcpTransport : public QObject
+{
+	Q_OBJECT
+public:
+	/// Number of decoded frames that can be waiting for the client.
+	static const int QueueCapacity = 32;
+
+	struct Frame
+	{
+		/// Session of the connection the frame was received on.
+		int session;
+		quint16 transactionId;
+		quint8 unitId;
+		quint8 functionCode;
+		/// Number of bytes in `data`
+		int size;
+		/// Time the first byte of the frame was received (see `currentTime`).
+		qint64 firstByteTime;
+		/// Time the frame was complete (see `currentTime`).
+		qint64 receivedTime;
+		/// The PDU bytes following the function code.
+		quint8 data[ModbusTcpFrameBuffer::MaxFrameSize];
+	};
+
+	/*!
+	 * Creates a transport for a client living in the current thread. The transport has no parent,
+	 * because it may be moved to the I/O thread. Use `destroy` instead of deleting it.
+	 */
+	static ModbusTcpTransport *create();
+
+	/// Deletes the transport in its own thread.
+	void destroy();
+
+	/*!
+	 * Enables the I/O thread for transports created after this call. Should be called before any
+	 * Modbus client is created.
+	 */
+	static void setIoThreadEnabled(bool enabled);
+
+	static bool isIoThreadEnabled();
+
+	/*!
+	 * Returns the value of a monotonic clock in milliseconds. The reference point is the same
+	 * for all `QElapsedTimer` objects, so the result can be compared with
+	 * `QElapsedTimer::msecsSinceReference` in any thread.
+	 */
+	static qint64 currentTime();
+
+	/// Starts a new connection. Closes the current connection, if any. Thread safe.
+	void connectToHost(const QString &hostName, quint16 port, int session);
+
+	/// Closes the connection. Thread safe.
+	void disconnectFromHost();
+
+	/*!
+	 * Writes a frame to the socket. The frame is dropped if the connection of `session` has been
+	 * replaced by then. Thread safe.
+	 */
+	void write(const QByteArray &frame, int session);
+
+	/// Returns the oldest decoded frame, or 0 if there is none. Only for the client thread.
+	const Frame *nextFrame();
+
+	/*!
+	 * Releases the frame returned by `nextFrame`, which should not be used afterwards. Only for
+	 * the client thread.
+	 */
+	void popFrame();
+
+signals:
+	void connected(int session);
+
+	void disconnected(int session);
+
+	void error(int session, QAbstractSocket::SocketError error);
+
+	/// Emitted when frames were added to an empty queue.
+	void framesAvailable();
+
+	/*!
+	 * Emitted when the incoming stream could not be parsed. The connection has been aborted when
+	 * this signal is emitted.
+	 */
+	void streamError(int session);
+
+private slots:
+	void onConnectToHost(const QString &hostName, int port, int session);
+
+	void onDisconnectFromHost();
+
+	void onWrite(const QByteArray &frame, int session);
+
+	void onConnected();
+
+	void onDisconnected();
+
+	void onError(QAbstractSocket::SocketError error);
+
+	void onReadyRead();
+
+private:
+	ModbusTcpTransport();
+
+	/*!
+	 * Moves complete frames from the frame buffer to the queue.
+	 * @return false if the queue is full
+	 */
+	bool queueFrames(qint64 now);
+
+	QAbstractSocket *mSocket;
+	ModbusTcpFrameBuffer mBuffer;
+	ModbusSpscQueue<Frame, QueueCapacity> mFrames;
+	/// Time at which the first byte of the next frame in `mBuffer` was received.
+	qint64 mFirstByteTime;
+	int mSession;
+	/// Set when `framesAvailable` has been emitted, reset by the client before taking frames.
+	QAtomicInt mNotified;
+	/// Set when reading was stopped because the queue was full.
+	QAtomicInt mStalled;
+};
+
+#endif // MODBUS_TCP_TRANSPORT_H
@@ -12,7 +12,9 @@ Settings::Settings(VeQItem *root, QObject *parent) :
 	mIpAddresses(connectItem("IPAddresses", "", SIGNAL(ipAddressesChanged()), false)),
 	mKnownIpAddresses(connectItem("KnownIPAddresses", "", 0, false)),
 	mInverterIds(connectItem("InverterIds", "", SLOT(onInverterdIdsChanged()), false)),
-	mAutoScan(connectItem("AutoScan", 1, 0))
+	mAutoScan(connectItem("AutoScan", 1, 0)),
+	mPowerFlowInterval(connectItem("PowerFlowInterval", 0.0, 0.0, 60000.0,
+								   SIGNAL(powerFlowIntervalChanged())))
 {
 }
 
@@ -57,6 +59,11 @@ bool Settings::autoScan() const
 	return mAutoScan->getValue().toBool();
 }
 
+int Settings::powerFlowInterval() const
+{
+	return mPowerFlowInterval->getValue().toInt();
+}
+
 QStringList Settings::inverterIds() const
 {
 	return mInverterIdCache;
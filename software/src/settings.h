@@ -32,6 +32,12 @@ public:
 
 	bool autoScan() const;
 
+	/*!
+	 * Interval (ms) of the fast power polling of Solar API inverters, which
+	 * uses the power flow data. 0 disables fast polling.
+	 */
+	int powerFlowInterval() const;
+
 	/*!
 	 * Returns the list with D-Bus object names for each registered inverter.
 	 * The names in the list are based on the device type and the serial
@@ -63,6 +69,8 @@ signals:
 
 	void ipAddressesChanged();
 
+	void powerFlowIntervalChanged();
+
 private slots:
 	void onInverterdIdsChanged();
 
@@ -78,6 +86,7 @@ private:
 	VeQItem *mKnownIpAddresses;
 	VeQItem *mInverterIds;
 	VeQItem *mAutoScan;
+	VeQItem *mPowerFlowInterval;
 	QStringList mInverterIdCache;
 };
 
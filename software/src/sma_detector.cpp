@@ -1,6 +1,7 @@
 #include <QsLog.h>
 #include <velib/vecan/products.h>
 #include "modbus_tcp_client.h"
+#include "modbus_tcp_client_pool.h"
 #include "modbus_reply.h"
 #include "settings.h"
 #include "sma_detector.h"
@@ -18,16 +19,21 @@ SMADetector::SMADetector(const Settings *settings, QObject *parent):
 
 DetectorReply *SMADetector::start(const QString &hostName, int timeout)
 {
-    ModbusTcpClient *client = new ModbusTcpClient(this);
-    connect(client, SIGNAL(connected()), this, SLOT(onConnected()));
-    connect(client, SIGNAL(disconnected()), this, SLOT(onDisconnected()));
-    client->setTimeout(timeout);
-    client->connectToServer(hostName);
+    ModbusTcpClient *client = ModbusTcpClientPool::instance()->acquire(hostName);
+    if (!mClientToReply.contains(client)) {
+        connect(client, SIGNAL(connected()), this, SLOT(onConnected()));
+        connect(client, SIGNAL(disconnected()), this, SLOT(onDisconnected()));
+    }
     Reply *reply = new Reply(this);
     reply->client = client;
+    reply->timeout = timeout;
     reply->di.networkId = mSettings->unitId();
     reply->di.hostName = hostName;
-    mClientToReply[client] = reply;
+    mClientToReply.insert(client, reply);
+    if (client->isConnected())
+        startDetection(reply);
+    else
+        client->connectToServer(hostName, ModbusTcpClient::DefaultTcpPort, timeout);
 
     QLOG_DEBUG() << "SMADetector start";
     return reply;
@@ -36,34 +42,38 @@ DetectorReply *SMADetector::start(const QString &hostName, int timeout)
 void SMADetector::onConnected()
 {
     ModbusTcpClient *client = static_cast<ModbusTcpClient *>(sender());
-    Reply *di = mClientToReply.value(client);
-    Q_ASSERT(di != 0);
+    Q_ASSERT(mClientToReply.contains(client));
 
     QLOG_DEBUG() << "SMADetector connected to " << client->hostName() << " @" << client->portName();
 
-    di->state = Reply::ReadDeviceClass;
-    di->currentRegister = 30051;
-    startNextReadRequest(di, 2);
+    foreach (Reply *di, mClientToReply.values(client))
+        startDetection(di);
 }
 
 void SMADetector::onDisconnected()
 {
     ModbusTcpClient *client = static_cast<ModbusTcpClient *>(sender());
-    Reply *di = mClientToReply.value(client);
 
     QLOG_DEBUG() << "SMADetector disconnected";
 
-    if (di != 0)
+    foreach (Reply *di, mClientToReply.values(client))
         setDone(di);
 }
 
+void SMADetector::startDetection(Reply *di)
+{
+    di->state = Reply::ReadDeviceClass;
+    di->currentRegister = 30051;
+    startNextReadRequest(di, 2);
+}
+
 void SMADetector::onFinished()
 {
     ModbusReply *reply = static_cast<ModbusReply *>(sender());
     Reply *di = mModbusReplyToReply.take(reply);
     reply->deleteLater();
 
-    QVector<quint16> values = reply->registers();
+    ModbusRegisterView values = reply->registerView();
 
     switch (di->state) {
         case Reply::ReadDeviceClass:
@@ -216,25 +226,30 @@ void SMADetector::onFinished()
 
 void SMADetector::startNextReadRequest(Reply *di, quint16 regCount)
 {
-    ModbusReply *reply = di->client->readHoldingRegisters(di->di.networkId, di->currentRegister,
-                                                          regCount);
+    ModbusRequest request = ModbusRequest::readHoldingRegisters(di->di.networkId,
+                                                                di->currentRegister, regCount);
+    request.timeout = di->timeout;
+    ModbusReply *reply = di->client->sendRequest(request);
     mModbusReplyToReply[reply] = di;
     connect(reply, SIGNAL(finished()), this, SLOT(onFinished()));
 }
 
 void SMADetector::setDone(Reply *di)
 {
-    if (!mClientToReply.contains(di->client))
+    ModbusTcpClient *client = di->client;
+    if (!mClientToReply.remove(client, di))
         return;
+    if (!mClientToReply.contains(client))
+        disconnect(client, 0, this, 0);
+    // The pool keeps the connection open for a while, so the updater can take it over.
+    ModbusTcpClientPool::instance()->release(client);
     di->setFinished();
-    disconnect(di->client);
-    mClientToReply.remove(di->client);
-    di->client->deleteLater();
 }
 
 SMADetector::Reply::Reply(QObject *parent):
     DetectorReply(parent),
     client(0),
+    timeout(0),
     state(ReadDeviceClass),
     currentRegister(0)
 {
@@ -61,15 +61,18 @@ private:
 
         DeviceInfo di;
         ModbusTcpClient *client;
+        /// Timeout (ms) of each request, passed to `start`.
+        int timeout;
         State state;
         quint16 currentRegister;
     };
 
+    void startDetection(Reply *di);
     void startNextReadRequest(Reply *di, quint16 regCount);
     void setDone(Reply *di);
     quint8 BCDtoByte(quint8 bcd);
 
-    QHash<ModbusTcpClient *, Reply *> mClientToReply;
+    QMultiHash<ModbusTcpClient *, Reply *> mClientToReply;
     QHash<ModbusReply *, Reply *> mModbusReplyToReply;
     const Settings *mSettings;
 };
@@ -7,6 +7,8 @@
 #include "sma_updater.h"
 #include "inverter_settings.h"
 #include "modbus_tcp_client.h"
+#include "modbus_tcp_client_pool.h"
+#include "modbus_read_plan.h"
 #include "modbus_reply.h"
 #include "power_info.h"
 
@@ -15,20 +17,43 @@
 // timeout is pretty safe.
 static const int PowerLimitTimeout = 120;
 
+// Time (ms) the operating mode and power limit registers we wrote are trusted without reading them
+// back.
+static const int ShadowRegisterAge = PowerLimitTimeout * 1000 / 2;
+
+// Operating mode (40210) and power limit (40212) registers
+static const quint16 OpModeReg = 40210;
+static const quint16 PowerLimitReg = 40212;
+
+// Registers up to this distance apart are read in a single request. SMA inverters reject requests
+// which include unsupported registers, so only adjacent blocks are merged.
+static const int MeasurementGapTolerance = 0;
+
+// Timeout (ms) of connection attempts and requests. Passed with each request, because the modbus
+// client is shared with other users (see ModbusTcpClientPool).
+static const int RequestTimeout = 5000;
+
 SMAUpdater::SMAUpdater(SMAInverter *inverter, InverterSettings *settings, QObject *parent) :
     QObject(parent),
       mInverter(inverter),
       mSettings(settings),
-      mModbusClient(new ModbusTcpClient(this)),
+      mModbusClient(ModbusTcpClientPool::instance()->acquire(inverter->hostName())),
       mTimer(new QTimer(this)),
       mDataProcessor(new DataProcessor(inverter, settings, this)),
       mCurrentState(Idle),
-      mRetryCount(0)
+      mRetryCount(0),
+      mWriteStartReg(0),
+      mPowerLimitFromShadow(false)
 {
     Q_ASSERT(inverter != 0);
     connectModbusClient();
-    mModbusClient->setTimeout(5000);
-    mModbusClient->connectToServer(inverter->hostName());
+    if (mModbusClient->isConnected()) {
+        // Connection taken over from the detector
+        QMetaObject::invokeMethod(this, "onConnected", Qt::QueuedConnection);
+    } else {
+        mModbusClient->connectToServer(inverter->hostName(), ModbusTcpClient::DefaultTcpPort,
+                                       RequestTimeout);
+    }
     connect(mInverter, SIGNAL(powerLimitRequested(double)), this, SLOT(onPowerLimitRequested(double)));
     mTimer->setSingleShot(true);
     connect(mTimer, SIGNAL(timeout()), this, SLOT(onTimer()));
@@ -36,6 +61,15 @@ SMAUpdater::SMAUpdater(SMAInverter *inverter, InverterSettings *settings, QObjec
     mPowerLimitWatt = (quint16)(mInverter->deviceInfo().powerLimitScale);
 }
 
+SMAUpdater::~SMAUpdater()
+{
+    disconnect(mModbusClient, 0, this, 0);
+    // The client is shared, so only our own requests are cancelled.
+    mModbusClient->cancelAll(this);
+    mModbusClient->setMaxPendingRequests(this, 0);
+    ModbusTcpClientPool::instance()->release(mModbusClient);
+}
+
 void SMAUpdater::startNextAction(ModbusState state)
 {
     ModbusState prvstate = mCurrentState;
@@ -70,7 +104,12 @@ void SMAUpdater::startNextAction(ModbusState state)
     }
 
     case CheckOpMode:
-        readHoldingRegisters(40210, 2);
+        if (mShadowRegisters.isFresh(OpModeReg, 2, ShadowRegisterAge)) {
+            // The operating mode has been written recently.
+            startNextAction(processOperatingMode(mShadowRegisters.values(OpModeReg, 2)));
+            return;
+        }
+        readHoldingRegisters(OpModeReg, 2);
         break;
 
     case SetOpMode:
@@ -78,21 +117,17 @@ void SMAUpdater::startNextAction(ModbusState state)
         QVector<quint16> values;
         values.append(0);
         values.append(SMAInverter::SMA_OM_WATT);
-        writeMultipleHoldingRegisters(40210, values);
+        writeMultipleHoldingRegisters(OpModeReg, values);
         break;
     }
 
-    case ReadPowerLimit:
-        readHoldingRegisters(40212, 2);
-        break;
-
     case WritePowerLimit:
     {
         quint16 w = (quint16)mPowerLimitWatt;
         QVector<quint16> values;
         values.append(0);
         values.append(w);
-        writeMultipleHoldingRegisters(40212, values);
+        writeMultipleHoldingRegisters(PowerLimitReg, values);
         break;
     }
 
@@ -100,28 +135,8 @@ void SMAUpdater::startNextAction(ModbusState state)
         readHoldingRegisters(30513, 8);
         break;
 
-    case ReadACFrequency:
-        readHoldingRegisters(40135, 2);
-        break;
-
-    case ReadACCurrent:
-        readHoldingRegisters(30795, 2);
-        break;
-
-    case ReadACPowerAndVoltage:
-        readHoldingRegisters(30775, 10);
-        break;
-
-    case ReadTemperature:
-        readHoldingRegisters(34113, 2);
-        break;
-
-    case ReadPVData1:
-        readHoldingRegisters(30769, 6);
-        break;
-
-    case ReadPVData2:
-        readHoldingRegisters(30957, 6);
+    case ReadMeasurements:
+        readMeasurements();
         break;
 
     case Idle:
@@ -144,21 +159,58 @@ void SMAUpdater::startNextAction(ModbusState state)
 
 void SMAUpdater::startIdleTimer()
 {
-    mTimer->setInterval(mCurrentState == Idle ? 1000 : 5000);
+    int interval = mCurrentState == Idle ? 1000 : 5000;
+    // Do not try to reconnect before the modbus client allows it (see ModbusTcpClient).
+    if (!mModbusClient->isConnected())
+        interval = qMax(interval, mModbusClient->reconnectDelay());
+    mTimer->setInterval(interval);
     mTimer->start();
 }
 
 void SMAUpdater::readHoldingRegisters(quint16 startRegister, quint16 count)
 {
     const DeviceInfo &deviceInfo = mInverter->deviceInfo();
-    ModbusReply *reply = mModbusClient->readHoldingRegisters(deviceInfo.networkId, startRegister, count);
+    ModbusRequest request = ModbusRequest::readHoldingRegisters(deviceInfo.networkId,
+                                                                startRegister, count);
+    request.timeout = RequestTimeout;
+    ModbusReply *reply = mModbusClient->sendRequest(request);
+    reply->setOwner(this);
     connect(reply, SIGNAL(finished()), this, SLOT(onReadCompleted()));
 }
 
+void SMAUpdater::readMeasurements()
+{
+    const DeviceInfo &deviceInfo = mInverter->deviceInfo();
+    ModbusReadPlan *plan = new ModbusReadPlan(mModbusClient, deviceInfo.networkId, this);
+    plan->setGapTolerance(MeasurementGapTolerance);
+    plan->setTimeout(RequestTimeout);
+    plan->addRange(40135, 2);  // AC frequency
+    plan->addRange(30795, 2);  // AC current
+    plan->addRange(30775, 10); // AC power and voltage
+    plan->addRange(34113, 2);  // Temperature
+    plan->addRange(30769, 6);  // PV data 1
+    plan->addRange(30957, 6);  // PV data 2
+    // The power limit is only read when we did not write it recently.
+    mPowerLimitFromShadow = mShadowRegisters.isFresh(PowerLimitReg, 2, ShadowRegisterAge);
+    if (!mPowerLimitFromShadow)
+        plan->addRange(PowerLimitReg, 2);
+    connect(plan, SIGNAL(finished()), this, SLOT(onMeasurementsCompleted()));
+    // Send all requests of the plan without waiting for a reply, so all measurements are retrieved
+    // in a single round trip.
+    mModbusClient->setMaxPendingRequests(this, plan->blockCount());
+    plan->start();
+}
+
 void SMAUpdater::writeMultipleHoldingRegisters(quint16 startReg, const QVector<quint16> &values)
 {
+    mWriteStartReg = startReg;
+    mWriteValues = values;
     const DeviceInfo &deviceInfo = mInverter->deviceInfo();
-    ModbusReply *reply = mModbusClient->writeMultipleHoldingRegisters(deviceInfo.networkId, startReg, values);
+    ModbusRequest request = ModbusRequest::writeMultipleHoldingRegisters(deviceInfo.networkId,
+                                                                         startReg, values);
+    request.timeout = RequestTimeout;
+    ModbusReply *reply = mModbusClient->sendRequest(request);
+    reply->setOwner(this);
     connect(reply, SIGNAL(finished()), this, SLOT(onWriteCompleted()));
 }
 
@@ -190,7 +242,7 @@ void SMAUpdater::onReadCompleted()
     if (!handleModbusError(reply))
         return;
 
-    QVector<quint16> values = reply->registers();
+    ModbusRegisterView values = reply->registerView();
 
     mRetryCount = 0;
 
@@ -299,36 +351,8 @@ void SMAUpdater::onReadCompleted()
     }
 
     case CheckOpMode:
-    {
-        if (values.size() != 2) {
-            nextState = Error;
-            break;
-        }
-
-        // default next state
-        nextState = ReadPowerYield;
-
-        mInverter->setOperatingMode((SMAInverter::OperatingMode_t)values[1]);
-        QLOG_DEBUG() << "SMAUpdater Operating Mode: " << mInverter->opMode();
-
-        if((mInverter->opMode() != SMAInverter::SMA_OM_WATT) && (mWriteCount < 3)) {
-            QLOG_INFO() << "SMAUpdater update operating mode (retry=" << mWriteCount << ")";
-            mWriteCount++;
-            nextState = SetOpMode;
-        }
-
-        // all is good to go for full power control
-        if(nextState == ReadPowerYield) {
-            if(mPowerLimitWatt == mInverter->deviceInfo().maxPower) {
-                mInverter->setStatus(SMAInverter::SMA_SC_MPPT);
-            }
-            else {
-                mInverter->setStatus(SMAInverter::SMA_SC_THROTTLED);
-            }
-        }
-
+        nextState = processOperatingMode(values);
         break;
-    }
 
     case ReadPowerYield:
     {
@@ -343,7 +367,7 @@ void SMAUpdater::onReadCompleted()
         mInverterData.dayEnergy = (double)uul;
 
         // set default next state
-        nextState = ReadACFrequency;
+        nextState = ReadMeasurements;
 
         QLOG_DEBUG() << "SMAUpdater Power Yield: " << mInverterData.totalEnergy << " WH / " << mInverterData.dayEnergy << " WH";
 
@@ -357,156 +381,44 @@ void SMAUpdater::onReadCompleted()
         break;
     }
 
-    case ReadACFrequency:
-    {
-        if (values.size() != 2) {
-            nextState = Error;
-            break;
-        }
-
-        uint32_t ul = getULong(values, 0);
-        mInverterData.acFrequency = ((double)ul) / 100.0;
-        mInverter->setFrequency(mInverterData.acFrequency);
-
-        QLOG_DEBUG() << "SMAUpdater AC Frequency: " << mInverterData.acFrequency;
-
-        nextState = ReadACCurrent;
-        break;
-    }
-
-    case ReadACCurrent:
-    {
-        if (values.size() != 2) {
-            nextState = Error;
-            break;
-        }
-
-        uint32_t ul = getULong(values, 0);
-        mInverterData.acCurrent = ((double)ul) / 1000.0;
-
-        QLOG_DEBUG() << "SMAUpdater AC Current: " << mInverterData.acCurrent;
-
-        nextState = ReadACPowerAndVoltage;
-        break;
-    }
-
-    case ReadACPowerAndVoltage:
-    {
-        if (values.size() != 10) {
-            nextState = Error;
-            break;
-        }
-
-        uint32_t ul = getULong(values, 0);
-        mInverterData.acPower = (double)ul;
-        ul = getULong(values, 8);
-        mInverterData.acVoltage = ((double)ul) / 100.0;
-
-        QLOG_DEBUG() << "SMAUpdater AC Power And Voltage: " << mInverterData.acPower << " W / " << mInverterData.acVoltage << " V";
-
-        nextState = ReadTemperature;
+    default:
+        QLOG_ERROR() << "SMAUpdater::onReadCompleted ERROR";
+        Q_ASSERT(false);
+        nextState = CheckCondition;
         break;
     }
 
-    case ReadTemperature:
-    {
-        if (values.size() != 2) {
-            nextState = Error;
-            break;
-        }
+    startNextAction(nextState);
+}
 
-        uint32_t ul = getULong(values, 0);
-        double t = ((double)ul) / 10.0;
-        mInverter->setTemperature(t);
+SMAUpdater::ModbusState SMAUpdater::processOperatingMode(const ModbusRegisterView &values)
+{
+    if (values.size() != 2)
+        return Error;
 
-        QLOG_DEBUG() << "SMAUpdater Temperature" <<  t << " deg C";
+    // default next state
+    ModbusState nextState = ReadPowerYield;
 
-        nextState = ReadPVData1;
-        break;
-    }
+    mInverter->setOperatingMode((SMAInverter::OperatingMode_t)values[1]);
+    QLOG_DEBUG() << "SMAUpdater Operating Mode: " << mInverter->opMode();
 
-    case ReadPVData1:
-    {
-        if (values.size() != 6) {
-            nextState = Error;
-            break;
-        }
-
-        PvInfo *pvi = mInverter->pvInfo1();
-        uint32_t ul = getULong(values, 0);
-        double pvc = ((double)ul) / 1000.0;
-        pvi->setCurrent(pvc);
-        mInverterData.dcCurrent = pvc;
-        ul = getULong(values, 2);
-        double pvv = ((double)ul) / 100.0;
-        pvi->setVoltage(pvv);
-        mInverterData.dcVoltage = pvv;
-        ul = getULong(values, 4);
-        double pvp = ((double)ul);
-        pvi->setPower(pvp);
-
-        QLOG_DEBUG() << "SMAUpdater PV Data 1: " << pvp << " W / " << pvv << " V / " << pvc << " A";
-
-        nextState = ReadPVData2;
-        break;
+    if((mInverter->opMode() != SMAInverter::SMA_OM_WATT) && (mWriteCount < 3)) {
+        QLOG_INFO() << "SMAUpdater update operating mode (retry=" << mWriteCount << ")";
+        mWriteCount++;
+        nextState = SetOpMode;
     }
 
-    case ReadPVData2:
-    {
-        if (values.size() != 6) {
-            nextState = Error;
-            break;
+    // all is good to go for full power control
+    if(nextState == ReadPowerYield) {
+        if(mPowerLimitWatt == mInverter->deviceInfo().maxPower) {
+            mInverter->setStatus(SMAInverter::SMA_SC_MPPT);
         }
-
-        PvInfo *pvi = mInverter->pvInfo2();
-        uint32_t ul = getULong(values, 0);
-        double pvc = ((double)ul) / 1000.0;
-        pvi->setCurrent(pvc);
-        mInverterData.dcCurrent += pvc;
-        ul = getULong(values, 2);
-        double pvv = ((double)ul) / 100.0;
-        pvi->setVoltage(pvv);
-        mInverterData.dcVoltage += pvv;
-        mInverterData.dcVoltage /= 2.0; // average
-        ul = getULong(values, 4);
-        double pvp = ((double)ul);
-        pvi->setPower(pvp);
-
-        QLOG_DEBUG() << "SMAUpdater PV Data 2: " << pvp << " W / " << pvv << " V / " << pvc << " A";
-
-        nextState = ReadPowerLimit;
-        break;
-    }
-
-    case ReadPowerLimit:
-    {
-       if (values.size() != 2) {
-           nextState = Error;
-           break;
-        }
-        double powerLimit = values[1];
-        mInverter->setPowerLimit(powerLimit);
-
-        QLOG_DEBUG() << "SMAUpdater Power Limit: " << powerLimit << " W";
-        mDataProcessor->process(mInverterData);
-        nextState = Idle;
-
-        // if we are logged in and mode correct, we can control the inverter output
-        if((mInverter->isLoggedIn()) && (mInverter->opMode() == SMAInverter::SMA_OM_WATT)) {
-            nextState = WritePowerLimit;
+        else {
+            mInverter->setStatus(SMAInverter::SMA_SC_THROTTLED);
         }
-
-        break;
-    }
-
-    default:
-        QLOG_ERROR() << "SMAUpdater::onReadCompleted ERROR";
-        Q_ASSERT(false);
-        nextState = CheckCondition;
-        break;
     }
 
-    startNextAction(nextState);
+    return nextState;
 }
 
 void SMAUpdater::onWriteCompleted()
@@ -515,6 +427,14 @@ void SMAUpdater::onWriteCompleted()
     reply->deleteLater();
     mWritePowerLimitRequested = false;
 
+    // Keep track of the control registers, so we do not have to read them back.
+    if (mCurrentState == SetOpMode || mCurrentState == WritePowerLimit) {
+        if (reply->error() == ModbusReply::NoException)
+            mShadowRegisters.write(mWriteStartReg, mWriteValues);
+        else
+            mShadowRegisters.invalidate(mWriteStartReg, mWriteValues.size());
+    }
+
     ModbusState nextState = mCurrentState;
     switch (mCurrentState) {
     case DoLogin:
@@ -546,6 +466,111 @@ void SMAUpdater::onWriteCompleted()
     startNextAction(nextState);
 }
 
+void SMAUpdater::onMeasurementsCompleted()
+{
+    ModbusReadPlan *plan = static_cast<ModbusReadPlan *>(sender());
+    plan->deleteLater();
+    if (plan->error() != ModbusReply::NoException) {
+        handleError();
+        return;
+    }
+    mRetryCount = 0;
+    startNextAction(processMeasurements(plan));
+}
+
+SMAUpdater::ModbusState SMAUpdater::processMeasurements(const ModbusReadPlan *plan)
+{
+    ModbusRegisterView values = plan->registers(40135, 2);
+    if (values.size() != 2)
+        return Error;
+    uint32_t ul = getULong(values, 0);
+    mInverterData.acFrequency = ((double)ul) / 100.0;
+    mInverter->setFrequency(mInverterData.acFrequency);
+
+    QLOG_DEBUG() << "SMAUpdater AC Frequency: " << mInverterData.acFrequency;
+
+    values = plan->registers(30795, 2);
+    if (values.size() != 2)
+        return Error;
+    ul = getULong(values, 0);
+    mInverterData.acCurrent = ((double)ul) / 1000.0;
+
+    QLOG_DEBUG() << "SMAUpdater AC Current: " << mInverterData.acCurrent;
+
+    values = plan->registers(30775, 10);
+    if (values.size() != 10)
+        return Error;
+    ul = getULong(values, 0);
+    mInverterData.acPower = (double)ul;
+    ul = getULong(values, 8);
+    mInverterData.acVoltage = ((double)ul) / 100.0;
+
+    QLOG_DEBUG() << "SMAUpdater AC Power And Voltage: " << mInverterData.acPower << " W / " << mInverterData.acVoltage << " V";
+
+    values = plan->registers(34113, 2);
+    if (values.size() != 2)
+        return Error;
+    ul = getULong(values, 0);
+    double t = ((double)ul) / 10.0;
+    mInverter->setTemperature(t);
+
+    QLOG_DEBUG() << "SMAUpdater Temperature" <<  t << " deg C";
+
+    values = plan->registers(30769, 6);
+    if (values.size() != 6)
+        return Error;
+    PvInfo *pvi = mInverter->pvInfo1();
+    ul = getULong(values, 0);
+    double pvc = ((double)ul) / 1000.0;
+    pvi->setCurrent(pvc);
+    mInverterData.dcCurrent = pvc;
+    ul = getULong(values, 2);
+    double pvv = ((double)ul) / 100.0;
+    pvi->setVoltage(pvv);
+    mInverterData.dcVoltage = pvv;
+    ul = getULong(values, 4);
+    double pvp = ((double)ul);
+    pvi->setPower(pvp);
+
+    QLOG_DEBUG() << "SMAUpdater PV Data 1: " << pvp << " W / " << pvv << " V / " << pvc << " A";
+
+    values = plan->registers(30957, 6);
+    if (values.size() != 6)
+        return Error;
+    pvi = mInverter->pvInfo2();
+    ul = getULong(values, 0);
+    pvc = ((double)ul) / 1000.0;
+    pvi->setCurrent(pvc);
+    mInverterData.dcCurrent += pvc;
+    ul = getULong(values, 2);
+    pvv = ((double)ul) / 100.0;
+    pvi->setVoltage(pvv);
+    mInverterData.dcVoltage += pvv;
+    mInverterData.dcVoltage /= 2.0; // average
+    ul = getULong(values, 4);
+    pvp = ((double)ul);
+    pvi->setPower(pvp);
+
+    QLOG_DEBUG() << "SMAUpdater PV Data 2: " << pvp << " W / " << pvv << " V / " << pvc << " A";
+
+    if (mPowerLimitFromShadow)
+        values = mShadowRegisters.values(PowerLimitReg, 2);
+    else
+        values = plan->registers(PowerLimitReg, 2);
+    if (values.size() != 2)
+        return Error;
+    double powerLimit = values[1];
+    mInverter->setPowerLimit(powerLimit);
+
+    QLOG_DEBUG() << "SMAUpdater Power Limit: " << powerLimit << " W";
+    mDataProcessor->process(mInverterData);
+
+    // if we are logged in and mode correct, we can control the inverter output
+    if((mInverter->isLoggedIn()) && (mInverter->opMode() == SMAInverter::SMA_OM_WATT))
+        return WritePowerLimit;
+    return Idle;
+}
+
 void SMAUpdater::onPowerLimitRequested(double value)
 {
     const DeviceInfo &deviceInfo = mInverter->deviceInfo();
@@ -569,6 +594,8 @@ void SMAUpdater::onConnected()
 void SMAUpdater::onDisconnected()
 {
     QLOG_DEBUG() << "SMAUpdater Disconnected";
+    // The inverter may have been restarted.
+    mShadowRegisters.invalidate();
     mCurrentState = CheckCondition;
     handleError();
 }
@@ -579,7 +606,8 @@ void SMAUpdater::onTimer()
     if (mModbusClient->isConnected())
         startNextAction(mCurrentState == Idle ? CheckCondition : mCurrentState);
     else
-        mModbusClient->connectToServer(mInverter->hostName());
+        mModbusClient->connectToServer(mInverter->hostName(), ModbusTcpClient::DefaultTcpPort,
+                                       RequestTimeout);
 }
 
 void SMAUpdater::onPhaseChanged()
@@ -596,7 +624,7 @@ void SMAUpdater::connectModbusClient()
 }
 
 /* Utilities */
-uint64_t SMAUpdater::getDoubleULong(const QVector<quint16> &values, int offset)
+uint64_t SMAUpdater::getDoubleULong(const ModbusRegisterView &values, int offset)
 {
     uint32_t v0 = static_cast<quint32>((values[offset] << 16) | values[offset + 1]);
     uint32_t v1 = static_cast<quint32>((values[offset + 2] << 16) | values[offset + 3]);
@@ -606,7 +634,7 @@ uint64_t SMAUpdater::getDoubleULong(const QVector<quint16> &values, int offset)
     return u64;
 }
 
-uint32_t SMAUpdater::getULong(const QVector<quint16> &values, int offset)
+uint32_t SMAUpdater::getULong(const ModbusRegisterView &values, int offset)
 {
     uint32_t v = static_cast<quint32>((values[offset] << 16) | values[offset + 1]);
     return v;
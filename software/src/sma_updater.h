@@ -4,11 +4,14 @@
 #include <QObject>
 #include <QAbstractSocket>
 #include "froniussolar_api.h"
+#include "modbus_shadow_registers.h"
 #include "sma_inverter.h"
 
 class DataProcessor;
 class Inverter;
 class InverterSettings;
+class ModbusReadPlan;
+class ModbusRegisterView;
 class ModbusReply;
 class ModbusTcpClient;
 class QTimer;
@@ -19,6 +22,8 @@ class SMAUpdater : public QObject
 public:
     explicit SMAUpdater(SMAInverter *inverter, InverterSettings *settings, QObject *parent = 0);
 
+    virtual ~SMAUpdater();
+
 signals:
     void connectionLost();
 
@@ -29,6 +34,8 @@ public slots:
 
     void onWriteCompleted();
 
+    void onMeasurementsCompleted();
+
     void onPowerLimitRequested(double value);
 
     void onConnected();
@@ -48,13 +55,7 @@ private:
         CheckOpMode,
         SetOpMode,
         ReadPowerYield,
-        ReadACFrequency,
-        ReadACCurrent,
-        ReadACPowerAndVoltage,
-        ReadTemperature,
-        ReadPVData1,
-        ReadPVData2,
-        ReadPowerLimit,
+        ReadMeasurements,
         WritePowerLimit,
         Error,
         Idle
@@ -70,14 +71,21 @@ private:
 
     void readHoldingRegisters(quint16 startRegister, quint16 count);
 
+    void readMeasurements();
+
+    ModbusState processMeasurements(const ModbusReadPlan *plan);
+
+    /// Processes the operating mode registers, either read from the inverter or from the shadow.
+    ModbusState processOperatingMode(const ModbusRegisterView &values);
+
     void writeMultipleHoldingRegisters(quint16 startReg, const QVector<quint16> &values);
 
     bool handleModbusError(ModbusReply *reply);
 
     void handleError();
 
-    uint64_t getDoubleULong(const QVector<quint16> &values, int offset);
-    uint32_t getULong(const QVector<quint16> &values, int offset);
+    uint64_t getDoubleULong(const ModbusRegisterView &values, int offset);
+    uint32_t getULong(const ModbusRegisterView &values, int offset);
 
     SMAInverter *mInverter;
     InverterSettings *mSettings;
@@ -91,6 +99,13 @@ private:
     bool mWritePowerLimitRequested;
     bool mWritePowerBootMax;
     CommonInverterData mInverterData;
+    /// Registers written by the last write action.
+    quint16 mWriteStartReg;
+    QVector<quint16> mWriteValues;
+    /// Operating mode and power limit registers as last written or read.
+    ModbusShadowRegisters mShadowRegisters;
+    /// True if the power limit was left out of the last measurement read plan.
+    bool mPowerLimitFromShadow;
 
 };
 
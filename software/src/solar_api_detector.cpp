@@ -24,7 +24,9 @@ DetectorReply *SolarApiDetector::start(const QString &hostName, int timeout)
 		this, SLOT(onDeviceInfoFound(DeviceInfoData)));
 	connect(reply->api, SIGNAL(converterInfoFound(InverterListData)),
 		this, SLOT(onConverterInfoFound(InverterListData)));
+	// The requests are independent, so they are sent in parallel.
 	reply->api->getDeviceInfoAsync();
+	reply->api->getConverterInfoAsync();
 	return reply;
 }
 
@@ -33,13 +35,24 @@ void SolarApiDetector::onDeviceInfoFound(const DeviceInfoData &data)
 	Api *api = static_cast<Api *>(sender());
 	Reply *reply = static_cast<Reply *>(api->parent());
 	reply->serialInfo = data.serialInfo; // Store for later use
-	reply->api->getConverterInfoAsync();
+	reply->deviceInfoReceived = true;
+	if (reply->converterInfoReceived)
+		processInverters(reply);
 }
 
 void SolarApiDetector::onConverterInfoFound(const InverterListData &data)
 {
 	Api *api = static_cast<Api *>(sender());
 	Reply *reply = static_cast<Reply *>(api->parent());
+	reply->converterInfo = data;
+	reply->converterInfoReceived = true;
+	if (reply->deviceInfoReceived)
+		processInverters(reply);
+}
+
+void SolarApiDetector::processInverters(Reply *reply)
+{
+	const InverterListData &data = reply->converterInfo;
 	bool setFinished = true;
 	for (QList<InverterInfo>::const_iterator it = data.inverters.begin();
 		 it != data.inverters.end();
@@ -63,7 +76,7 @@ void SolarApiDetector::onConverterInfoFound(const InverterListData &data)
 			// Allowing a longer timeout for sunspec only slows us down where
 			// we already know there is a Fronius PV-inverter, and this caters
 			// for very slow DataManagers with several PV-inverters connected.
-			DetectorReply *dr = mSunspecDetector->start(api->hostName(), 25000);
+			DetectorReply *dr = mSunspecDetector->start(reply->api->hostName(), 25000);
 			connect(dr, SIGNAL(deviceFound(DeviceInfo)),
 					this, SLOT(onSunspecDeviceFound(DeviceInfo)));
 			connect(dr, SIGNAL(finished()), this, SLOT(onSunspecDone()));
@@ -169,7 +182,9 @@ void SolarApiDetector::checkFinished(Reply *reply)
 
 SolarApiDetector::Reply::Reply(QObject *parent):
 	DetectorReply(parent),
-	api(0)
+	api(0),
+	deviceInfoReceived(false),
+	converterInfoReceived(false)
 {
 }
 
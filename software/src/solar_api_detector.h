@@ -51,6 +51,9 @@ private:
 
 		FroniusSolarApi *api;
 		QMap<int, QString> serialInfo; // A place to store serial info for later use
+		InverterListData converterInfo;
+		bool deviceInfoReceived;
+		bool converterInfoReceived;
 	};
 
 	class Api: public FroniusSolarApi
@@ -71,6 +74,9 @@ private:
 
 	static QString fixUniqueId(const InverterInfo &inverterInfo);
 
+	/// Starts detection of the inverters, once both device info and converter info are in.
+	void processInverters(Reply *reply);
+
 	void checkFinished(Reply *reply);
 
 	static QList<QString> mInvalidDevices;
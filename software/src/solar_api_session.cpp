@@ -0,0 +1,245 @@
+#include <QCoreApplication>
+#include <QHash>
+#include <QsLog.h>
+#include <QTimer>
+#include "http_client.h"
+#include "solar_api_session.h"
+
+static QHash<QString, SolarApiSession *> sessions;
+
+SolarApiSession::SolarApiSession(const QString &hostName, int port, QObject *parent):
+	QObject(parent),
+	mHostName(hostName),
+	mPort(port),
+	mLingerTimer(new QTimer(this)),
+	mLastId(0),
+	mRefCount(0),
+	mKeepAliveFailures(0),
+	mKeepAlive(true),
+	mConnected(false)
+{
+	mLingerTimer->setSingleShot(true);
+	mLingerTimer->setInterval(LingerTime);
+	connect(mLingerTimer, SIGNAL(timeout()), this, SLOT(onLingerTimer()));
+}
+
+SolarApiSession::~SolarApiSession()
+{
+	// The HTTP clients are children of this object.
+	qDeleteAll(mConnections);
+}
+
+SolarApiSession *SolarApiSession::acquire(const QString &hostName, int port)
+{
+	QString key = createKey(hostName, port);
+	SolarApiSession *session = sessions.value(key);
+	if (session == 0) {
+		// Parented to the application, so the connection is closed before the event loop is gone.
+		session = new SolarApiSession(hostName, port, QCoreApplication::instance());
+		sessions.insert(key, session);
+	}
+	session->mLingerTimer->stop();
+	++session->mRefCount;
+	return session;
+}
+
+void SolarApiSession::release(SolarApiSession *session)
+{
+	Q_ASSERT(session != 0 && session->mRefCount > 0);
+	if (--session->mRefCount > 0)
+		return;
+	// No need to keep a connection to a host which is not a data manager (eg. during a scan).
+	if (session->mConnected)
+		session->mLingerTimer->start();
+	else
+		session->destroy();
+}
+
+QString SolarApiSession::hostName() const
+{
+	return mHostName;
+}
+
+int SolarApiSession::port() const
+{
+	return mPort;
+}
+
+bool SolarApiSession::keepAlive() const
+{
+	return mKeepAlive;
+}
+
+int SolarApiSession::get(const QString &path, int timeout)
+{
+	++mLastId;
+	if (mLastId <= 0)
+		mLastId = 1;
+	Request r;
+	r.id = mLastId;
+	r.path = path;
+	r.timeout = timeout;
+	r.retried = false;
+	mQueue.append(r);
+	startNext();
+	return r.id;
+}
+
+void SolarApiSession::cancel(int id)
+{
+	foreach (Connection *c, mConnections) {
+		if (c->current.id == id) {
+			c->current.id = 0;
+			// Closes the connection, so the reply of the cancelled request cannot be taken for
+			// the reply of the next one.
+			c->client->abort();
+			startNext();
+			return;
+		}
+	}
+	for (int i=0; i<mQueue.size(); ++i) {
+		if (mQueue[i].id == id) {
+			mQueue.removeAt(i);
+			return;
+		}
+	}
+}
+
+void SolarApiSession::onConnected()
+{
+	mConnected = true;
+}
+
+void SolarApiSession::onRequestSent()
+{
+	Connection *c = findConnection(sender());
+	if (c != 0 && c->current.id != 0)
+		emit requestStarted(c->current.id);
+}
+
+void SolarApiSession::onFirstByteReceived()
+{
+	Connection *c = findConnection(sender());
+	if (c != 0 && c->current.id != 0)
+		emit firstByteReceived(c->current.id);
+}
+
+void SolarApiSession::onRequestFinished(const QString &error, const QByteArray &body)
+{
+	Connection *c = findConnection(sender());
+	if (c == 0 || c->current.id == 0)
+		return;
+	if (!error.isEmpty()) {
+		handleFailure(c, error);
+		return;
+	}
+	if (c->reused) {
+		mKeepAliveFailures = 0;
+	} else if (c->current.retried && mKeepAlive &&
+			   ++mKeepAliveFailures >= MaxKeepAliveFailures) {
+		QLOG_WARN() << "[Solar API] Requests to" << createKey(mHostName, mPort)
+					<< "only succeed on a new connection. Disabling keep-alive.";
+		mKeepAlive = false;
+		foreach (Connection *other, mConnections)
+			other->client->setKeepAlive(false);
+	}
+	finish(c, QString(), body);
+}
+
+void SolarApiSession::onLingerTimer()
+{
+	destroy();
+}
+
+QString SolarApiSession::createKey(const QString &hostName, int port)
+{
+	return QString("%1:%2").arg(hostName).arg(port);
+}
+
+void SolarApiSession::startNext()
+{
+	while (!mQueue.isEmpty()) {
+		Connection *c = idleConnection();
+		if (c == 0)
+			return;
+		c->current = mQueue.takeFirst();
+		send(c);
+	}
+}
+
+SolarApiSession::Connection *SolarApiSession::idleConnection()
+{
+	Connection *idle = 0;
+	foreach (Connection *c, mConnections) {
+		if (c->current.id != 0)
+			continue;
+		if (c->client->isConnected())
+			return c;
+		if (idle == 0)
+			idle = c;
+	}
+	if (idle != 0 || mConnections.size() >= MaxConnections)
+		return idle;
+	Connection *c = new Connection;
+	c->client = new HttpClient(mHostName, static_cast<quint16>(mPort), this);
+	c->client->setKeepAlive(mKeepAlive);
+	c->current.id = 0;
+	c->reused = false;
+	connect(c->client, SIGNAL(connected()), this, SLOT(onConnected()));
+	connect(c->client, SIGNAL(requestSent()), this, SLOT(onRequestSent()));
+	connect(c->client, SIGNAL(firstByteReceived()),
+			this, SLOT(onFirstByteReceived()));
+	connect(c->client, SIGNAL(finished(QString, QByteArray)),
+			this, SLOT(onRequestFinished(QString, QByteArray)));
+	mConnections.append(c);
+	return c;
+}
+
+SolarApiSession::Connection *SolarApiSession::findConnection(const QObject *client) const
+{
+	foreach (Connection *c, mConnections) {
+		if (c->client == client)
+			return c;
+	}
+	return 0;
+}
+
+void SolarApiSession::send(Connection *c)
+{
+	c->reused = c->client->isConnected();
+	c->client->get(c->current.path, c->current.timeout);
+}
+
+void SolarApiSession::handleFailure(Connection *c, const QString &error)
+{
+	// The client has closed the connection, so a retry is sent over a new one.
+	if (c->reused && !c->current.retried) {
+		// The connection may have been closed by the data manager, or the firmware does not
+		// support keep-alive. Try again with a new connection.
+		QLOG_DEBUG() << "[Solar API] Request to" << createKey(mHostName, mPort)
+					 << "failed on existing connection, reconnecting:" << error;
+		c->current.retried = true;
+		send(c);
+		return;
+	}
+	finish(c, error, QByteArray());
+}
+
+void SolarApiSession::finish(Connection *c, const QString &error, const QByteArray &body)
+{
+	int id = c->current.id;
+	c->current.id = 0;
+	emit requestFinished(id, error, body);
+	startNext();
+}
+
+void SolarApiSession::destroy()
+{
+	sessions.remove(createKey(mHostName, mPort));
+	mLingerTimer->stop();
+	foreach (Connection *c, mConnections) {
+		disconnect(c->client, 0, this, 0);
+		c->client->abort();
+	}
+	deleteLater();
+}
@@ -0,0 +1,162 @@
+#ifndef SOLAR_API_SESSION_H
+#define SOLAR_API_SESSION_H
+
+#include <QByteArray>
+#include <QList>
+#include <QObject>
+#include <QString>
+
+class HttpClient;
+class QTimer;
+
+/*!
+ * @brief Persistent HTTP connection to a Fronius data manager, shared by all
+ * FroniusSolarApi objects talking to the same host.
+ *
+ * Requests are sent over up to `MaxConnections` keep-alive connections, so
+ * polling does not require a TCP handshake for each request, and independent
+ * requests (eg. common and 3 phase data of an inverter) are handled in
+ * parallel. Each connection handles one request at a time.
+ * If a request fails or times out on a connection which has been used
+ * before, it is sent once more over a new connection. Some firmware does not
+ * handle keep-alive properly (the CCGX used to miss replies to subsequent
+ * requests). If requests keep succeeding only after a reconnect, keep-alive
+ * is disabled for the session and the connection is closed after each
+ * request.
+ *
+ * Sessions are reference counted: each `acquire` must be matched by a
+ * `release`. A session which has connected successfully is kept for a while
+ * after the last reference is released, so an updater created right after
+ * detection can adopt the connection used by the detector.
+ */
+class SolarApiSession : public QObject
+{
+	Q_OBJECT
+public:
+	static const int LingerTime = 10000;
+
+	/*!
+	 * Maximum number of connections to a data manager. The web server of the
+	 * data manager handles a few connections only, and it is shared with the
+	 * web interface and other clients.
+	 */
+	static const int MaxConnections = 2;
+
+	/*!
+	 * Number of subsequent requests which succeeded only after a reconnect,
+	 * before keep-alive is disabled.
+	 */
+	static const int MaxKeepAliveFailures = 2;
+
+	virtual ~SolarApiSession();
+
+	static SolarApiSession *acquire(const QString &hostName, int port);
+
+	/*!
+	 * @brief Releases a session retrieved by `acquire`. The caller should
+	 * cancel its requests and disconnect all signals first.
+	 */
+	static void release(SolarApiSession *session);
+
+	QString hostName() const;
+
+	int port() const;
+
+	/// Returns false if keep-alive has been disabled for this session.
+	bool keepAlive() const;
+
+	/*!
+	 * @brief Queues a GET request.
+	 * @param path The path and query of the request.
+	 * @param timeout Timeout in milliseconds, starting when the request is
+	 * sent.
+	 * @return An id which identifies the request in the signals below.
+	 */
+	int get(const QString &path, int timeout);
+
+	/*!
+	 * @brief Cancels a request. No signals will be emitted for it. If the
+	 * request is in progress, the connection is closed.
+	 */
+	void cancel(int id);
+
+signals:
+	void requestStarted(int id);
+
+	void firstByteReceived(int id);
+
+	/*!
+	 * @brief Emitted when a request has been completed.
+	 * @param error Description of the network error, or an empty string on
+	 * success.
+	 */
+	void requestFinished(int id, const QString &error, const QByteArray &body);
+
+private slots:
+	void onConnected();
+
+	void onRequestSent();
+
+	void onFirstByteReceived();
+
+	void onRequestFinished(const QString &error, const QByteArray &body);
+
+	void onLingerTimer();
+
+private:
+	SolarApiSession(const QString &hostName, int port, QObject *parent = 0);
+
+	struct Request
+	{
+		int id;
+		QString path;
+		int timeout;
+		/// True if the request has been sent again over a new connection
+		bool retried;
+	};
+
+	struct Connection
+	{
+		HttpClient *client;
+		/// The request in progress. `current.id` is 0 if the connection is idle.
+		Request current;
+		/// True if the current request is sent over a connection used before.
+		bool reused;
+	};
+
+	static QString createKey(const QString &hostName, int port);
+
+	/// Sends queued requests over idle connections (creating them if needed).
+	void startNext();
+
+	/*!
+	 * @brief Returns the connection which should handle the next request, or
+	 * 0 if all connections are busy. Idle connections which are still open are
+	 * preferred.
+	 */
+	Connection *idleConnection();
+
+	/// Returns the connection using `client`.
+	Connection *findConnection(const QObject *client) const;
+
+	void send(Connection *c);
+
+	void handleFailure(Connection *c, const QString &error);
+
+	void finish(Connection *c, const QString &error, const QByteArray &body);
+
+	void destroy();
+
+	QString mHostName;
+	int mPort;
+	QTimer *mLingerTimer;
+	QList<Request> mQueue;
+	QList<Connection *> mConnections;
+	int mLastId;
+	int mRefCount;
+	int mKeepAliveFailures;
+	bool mKeepAlive;
+	bool mConnected;
+};
+
+#endif // SOLAR_API_SESSION_H
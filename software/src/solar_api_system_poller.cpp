@@ -0,0 +1,149 @@
+#include <QCoreApplication>
+#include <QHash>
+#include <QsLog.h>
+#include <QTimer>
+#include "froniussolar_api.h"
+#include "solar_api_system_poller.h"
+
+static QHash<QString, SolarApiSystemPoller *> pollers;
+
+SolarApiSystemPoller::SolarApiSystemPoller(const QString &hostName, int port, QObject *parent):
+	QObject(parent),
+	mSolarApi(new FroniusSolarApi(hostName, port, 15000, this)),
+	mTimer(new QTimer(this)),
+	mPowerFlowTimer(new QTimer(this)),
+	mInterval(DefaultInterval),
+	mPowerFlowInterval(0),
+	mPowerFlowValid(false),
+	mRefCount(0)
+{
+	mTimer->setSingleShot(true);
+	connect(mTimer, SIGNAL(timeout()), this, SLOT(onStartRetrieval()));
+	mPowerFlowTimer->setSingleShot(true);
+	connect(mPowerFlowTimer, SIGNAL(timeout()), this, SLOT(onStartPowerFlowRetrieval()));
+	connect(mSolarApi, SIGNAL(systemDataFound(SystemInverterData)),
+			this, SLOT(onSystemDataFound(SystemInverterData)));
+	connect(mSolarApi, SIGNAL(powerFlowDataFound(PowerFlowData)),
+			this, SLOT(onPowerFlowDataFound(PowerFlowData)));
+	// Give the caller of `acquire` a chance to connect to our signals before the first request.
+	QTimer::singleShot(0, this, SLOT(onStartRetrieval()));
+}
+
+SolarApiSystemPoller *SolarApiSystemPoller::acquire(const QString &hostName, int port)
+{
+	QString key = createKey(hostName, port);
+	SolarApiSystemPoller *poller = pollers.value(key);
+	if (poller == 0) {
+		// Parented to the application, so the connection is closed before the event loop is gone.
+		poller = new SolarApiSystemPoller(hostName, port, QCoreApplication::instance());
+		pollers.insert(key, poller);
+		QLOG_DEBUG() << "[Solar API] Start system polling of" << key;
+	}
+	++poller->mRefCount;
+	return poller;
+}
+
+void SolarApiSystemPoller::release(SolarApiSystemPoller *poller)
+{
+	Q_ASSERT(poller != 0 && poller->mRefCount > 0);
+	if (--poller->mRefCount > 0)
+		return;
+	QString key = createKey(poller->hostName(), poller->port());
+	QLOG_DEBUG() << "[Solar API] Stop system polling of" << key;
+	pollers.remove(key);
+	poller->mTimer->stop();
+	poller->mPowerFlowTimer->stop();
+	poller->mSolarApi->cancel();
+	// We may be called while the poller is emitting systemDataFound.
+	poller->deleteLater();
+}
+
+QString SolarApiSystemPoller::hostName() const
+{
+	return mSolarApi->hostName();
+}
+
+int SolarApiSystemPoller::port() const
+{
+	return mSolarApi->port();
+}
+
+int SolarApiSystemPoller::interval() const
+{
+	return mInterval;
+}
+
+void SolarApiSystemPoller::setInterval(int t)
+{
+	mInterval = t;
+}
+
+int SolarApiSystemPoller::powerFlowInterval() const
+{
+	return mPowerFlowInterval;
+}
+
+void SolarApiSystemPoller::setPowerFlowInterval(int t)
+{
+	if (t > 0)
+		t = qMax(t, MinPowerFlowInterval);
+	if (mPowerFlowInterval == t)
+		return;
+	bool wasEnabled = mPowerFlowInterval > 0;
+	mPowerFlowInterval = t;
+	if (t == 0) {
+		QLOG_DEBUG() << "[Solar API] Stop power flow polling of" << createKey(hostName(), port());
+		mPowerFlowTimer->stop();
+		mSolarApi->cancel(mPowerFlowRequest);
+		mPowerFlowRequest = SolarApiRequest();
+		if (mPowerFlowValid && mTimer->isActive())
+			mTimer->start(mInterval);
+		mPowerFlowValid = false;
+	} else if (!wasEnabled) {
+		QLOG_DEBUG() << "[Solar API] Start power flow polling of" << createKey(hostName(), port())
+					 << "every" << t << "ms";
+		mPowerFlowTimer->start(0);
+	}
+}
+
+void SolarApiSystemPoller::onStartRetrieval()
+{
+	if (mRefCount == 0)
+		return;
+	mSolarApi->getSystemDataAsync();
+}
+
+void SolarApiSystemPoller::onSystemDataFound(const SystemInverterData &data)
+{
+	emit systemDataFound(data);
+	if (mRefCount > 0)
+		mTimer->start(mPowerFlowValid ? SlowInterval : mInterval);
+}
+
+void SolarApiSystemPoller::onStartPowerFlowRetrieval()
+{
+	if (mRefCount == 0 || mPowerFlowInterval == 0 || mPowerFlowRequest.isValid())
+		return;
+	mPowerFlowRequest = mSolarApi->getPowerFlowDataAsync(PowerFlowTimeout);
+}
+
+void SolarApiSystemPoller::onPowerFlowDataFound(const PowerFlowData &data)
+{
+	mPowerFlowRequest = SolarApiRequest();
+	bool wasValid = mPowerFlowValid;
+	mPowerFlowValid = data.error == SolarApiReply::NoError;
+	if (wasValid && !mPowerFlowValid) {
+		QLOG_DEBUG() << "[Solar API] Power flow data retrieval error:" << data.errorMessage;
+		// The power is taken from the system data again. Do not wait for the slow interval.
+		if (mTimer->isActive())
+			mTimer->start(mInterval);
+	}
+	emit powerFlowDataFound(data);
+	if (mRefCount > 0 && mPowerFlowInterval > 0)
+		mPowerFlowTimer->start(mPowerFlowInterval);
+}
+
+QString SolarApiSystemPoller::createKey(const QString &hostName, int port)
+{
+	return QString("%1:%2").arg(hostName).arg(port);
+}
@@ -0,0 +1,100 @@
+#ifndef SOLAR_API_SYSTEM_POLLER_H
+#define SOLAR_API_SYSTEM_POLLER_H
+
+#include <QObject>
+#include <QString>
+#include "froniussolar_api.h"
+
+class QTimer;
+
+/*!
+ * @brief Polls power and energy of all inverters on a Fronius data manager.
+ * Uses a single `Scope=System` request per interval, instead of a request
+ * for each inverter. The results are emitted to all SolarApiUpdater objects
+ * on the host, which pick their own values using the device id.
+ *
+ * Optionally, the power of all inverters is polled at a higher rate using
+ * the power flow data (see `setPowerFlowInterval`). This request is much
+ * lighter than the full data collections, so power limiting control loops
+ * get fresh power values without a matching increase of the load on the
+ * data manager. While the power flow data is available, the system data
+ * (which supplies the energy counters) is retrieved at `SlowInterval`.
+ *
+ * There is one poller for each (host, port) combination. Pollers are
+ * reference counted: each `acquire` must be matched by a `release`. Polling
+ * starts when the poller is created, and the poller is deleted when the last
+ * reference is released.
+ */
+class SolarApiSystemPoller : public QObject
+{
+	Q_OBJECT
+public:
+	static const int DefaultInterval = 5000;
+
+	/// Interval of the system data retrieval while the power flow data is used for power.
+	static const int SlowInterval = 30000;
+
+	/// Lower limit of the power flow interval.
+	static const int MinPowerFlowInterval = 200;
+
+	/// Timeout of power flow requests. A lost reply should not stall the fast path for long.
+	static const int PowerFlowTimeout = 5000;
+
+	static SolarApiSystemPoller *acquire(const QString &hostName, int port);
+
+	/*!
+	 * @brief Releases a poller retrieved by `acquire`. The caller should
+	 * disconnect all signals from the poller first.
+	 */
+	static void release(SolarApiSystemPoller *poller);
+
+	QString hostName() const;
+
+	int port() const;
+
+	/// Returns the time (in milliseconds) between a reply and the next request.
+	int interval() const;
+
+	void setInterval(int t);
+
+	/// Returns the time (in milliseconds) between power flow requests, 0 if disabled.
+	int powerFlowInterval() const;
+
+	/*!
+	 * @brief Sets the time between a power flow reply and the next request.
+	 * 0 (the default) disables power flow polling.
+	 */
+	void setPowerFlowInterval(int t);
+
+signals:
+	void systemDataFound(const SystemInverterData &data);
+
+	void powerFlowDataFound(const PowerFlowData &data);
+
+private slots:
+	void onStartRetrieval();
+
+	void onSystemDataFound(const SystemInverterData &data);
+
+	void onStartPowerFlowRetrieval();
+
+	void onPowerFlowDataFound(const PowerFlowData &data);
+
+private:
+	SolarApiSystemPoller(const QString &hostName, int port, QObject *parent = 0);
+
+	static QString createKey(const QString &hostName, int port);
+
+	FroniusSolarApi *mSolarApi;
+	QTimer *mTimer;
+	QTimer *mPowerFlowTimer;
+	/// Interval of the system data retrieval
+	int mInterval;
+	SolarApiRequest mPowerFlowRequest;
+	int mPowerFlowInterval;
+	/// True if the last power flow request succeeded.
+	bool mPowerFlowValid;
+	int mRefCount;
+};
+
+#endif // SOLAR_API_SYSTEM_POLLER_H
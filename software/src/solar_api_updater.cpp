@@ -3,24 +3,36 @@
 #include "froniussolar_api.h"
 #include "inverter.h"
 #include "inverter_settings.h"
+#include "solar_api_system_poller.h"
 #include "solar_api_updater.h"
 #include "power_info.h"
+#include "settings.h"
 
 static const int UpdateInterval = 5000;
+/// Interval of device data retrieval, when power and energy are taken from the system data.
+static const int DeviceUpdateInterval = 30000;
 static const int UpdateSettingsInterval = 10 * 60 * 1000;
 
-SolarApiUpdater::SolarApiUpdater(Inverter *inverter, InverterSettings *settings, QObject *parent):
+SolarApiUpdater::SolarApiUpdater(Inverter *inverter, InverterSettings *settings,
+								 Settings *globalSettings, QObject *parent):
 	QObject(parent),
 	mInverter(inverter),
 	mSettings(settings),
+	mGlobalSettings(globalSettings),
 	mSolarApi(new FroniusSolarApi(inverter->hostName(), inverter->port(), 15000, this)),
+	mSystemPoller(0),
+	mRetrievalTimer(new QTimer(this)),
 	mSettingsTimer(new QTimer(this)),
 	mProcessor(inverter, settings),
+	mPendingReplies(0),
+	mThreePhasesRequested(false),
 	mInitialized(false),
+	mSystemDataValid(false),
 	mRetryCount(0)
 {
 	Q_ASSERT(inverter != 0);
 	Q_ASSERT(settings != 0);
+	Q_ASSERT(globalSettings != 0);
 	connect(
 		mSolarApi, SIGNAL(commonDataFound(const CommonInverterData &)),
 		this, SLOT(onCommonDataFound(const CommonInverterData &)));
@@ -30,6 +42,12 @@ SolarApiUpdater::SolarApiUpdater(Inverter *inverter, InverterSettings *settings,
 	connect(
 		mSettings, SIGNAL(phaseChanged()),
 		this, SLOT(onPhaseChanged()));
+	connect(
+		mGlobalSettings, SIGNAL(powerFlowIntervalChanged()),
+		this, SLOT(onPowerFlowIntervalChanged()));
+	connect(
+		mRetrievalTimer, SIGNAL(timeout()),
+		this, SLOT(onStartRetrieval()));
 	connect(
 		mSettingsTimer, SIGNAL(timeout()),
 		this, SLOT(onSettingsTimer()));
@@ -39,11 +57,18 @@ SolarApiUpdater::SolarApiUpdater(Inverter *inverter, InverterSettings *settings,
 	connect(
 		mInverter, SIGNAL(portChanged()),
 		this, SLOT(onConnectionDataChanged()));
+	mRetrievalTimer->setSingleShot(true);
 	mSettingsTimer->setInterval(UpdateSettingsInterval);
 	mSettingsTimer->start();
+	acquireSystemPoller();
 	onStartRetrieval();
 }
 
+SolarApiUpdater::~SolarApiUpdater()
+{
+	releaseSystemPoller();
+}
+
 Inverter *SolarApiUpdater::inverter()
 {
 	return mInverter;
@@ -56,53 +81,74 @@ InverterSettings *SolarApiUpdater::settings()
 
 void SolarApiUpdater::onStartRetrieval()
 {
-	mSolarApi->getCommonDataAsync(mInverter->deviceInfo().networkId);
+	const DeviceInfo &deviceInfo = mInverter->deviceInfo();
+	mPendingReplies = 1;
+	mSolarApi->getCommonDataAsync(deviceInfo.networkId);
+	mThreePhasesRequested = deviceInfo.phaseCount > 1;
+	if (mThreePhasesRequested) {
+		++mPendingReplies;
+		mSolarApi->getThreePhasesInverterDataAsync(deviceInfo.networkId);
+	}
 }
 
 void SolarApiUpdater::onCommonDataFound(const CommonInverterData &data)
+{
+	mCommonData = data;
+	onDeviceDataReceived();
+}
+
+void SolarApiUpdater::onThreePhasesDataFound(const ThreePhasesInverterData &data)
+{
+	mThreePhasesData = data;
+	onDeviceDataReceived();
+}
+
+void SolarApiUpdater::onDeviceDataReceived()
+{
+	if (--mPendingReplies > 0)
+		return;
+	// The 3 phase data is only used along with valid common data, as it was when the requests
+	// were sent one after the other.
+	if (processCommonData(mCommonData) &&
+		(!mThreePhasesRequested || processThreePhasesData(mThreePhasesData))) {
+		setInitialized();
+	}
+	scheduleRetrieval();
+}
+
+bool SolarApiUpdater::processCommonData(const CommonInverterData &data)
 {
 	switch (data.error)
 	{
 	case SolarApiReply::NoError:
-	{
 		mProcessor.process(data);
 		mRetryCount = 0;
-		const DeviceInfo &deviceInfo = mInverter->deviceInfo();
-		if (deviceInfo.phaseCount > 1) {
-			mSolarApi->getThreePhasesInverterDataAsync(deviceInfo.networkId);
-		} else {
-			setInitialized();
-			scheduleRetrieval();
-		}
 		mInverter->setStatusCode(data.statusCode);
 		mInverter->setErrorCode(data.errorCode);
-		break;
-	}
+		return true;
 	case SolarApiReply::NetworkError:
 		QLOG_DEBUG() << "[Solar API] Network error: " << data.errorMessage;
 		handleError();
-		scheduleRetrieval();
 		break;
 	case SolarApiReply::ApiError:
 		QLOG_DEBUG() << "[Solar API] CommonInverterData retrieval error:" << data.errorMessage;
 		handleError();
-		scheduleRetrieval();
 		break;
 	default:
 		QLOG_DEBUG() << "[Solar API] Unknown error" << data.error << data.errorMessage;
 		break;
 	}
+	return false;
 }
 
-void SolarApiUpdater::onThreePhasesDataFound(const ThreePhasesInverterData &data)
+bool SolarApiUpdater::processThreePhasesData(const ThreePhasesInverterData &data)
 {
 	switch (data.error)
 	{
 	case SolarApiReply::NoError:
 		mProcessor.process(data);
 		mRetryCount = 0;
-		setInitialized();
-		break;
+		return true;
 	case SolarApiReply::NetworkError:
 		QLOG_DEBUG() << "[Solar API] Network error: " << data.errorMessage;
 		handleError();
@@ -116,7 +162,54 @@ void SolarApiUpdater::onThreePhasesDataFound(const ThreePhasesInverterData &data
 		QLOG_DEBUG() << "[Solar API] Unknown error" << data.error << data.errorMessage;
 		break;
 	}
-	scheduleRetrieval();
+	return false;
+}
+
+void SolarApiUpdater::onSystemDataFound(const SystemInverterData &data)
+{
+	bool wasValid = mSystemDataValid;
+	mSystemDataValid = false;
+	switch (data.error)
+	{
+	case SolarApiReply::NoError:
+	{
+		QMap<int, InverterSystemValues>::ConstIterator it =
+			data.inverters.find(mInverter->deviceInfo().networkId);
+		if (it != data.inverters.end()) {
+			mSystemDataValid = true;
+			mProcessor.process(it.value());
+		}
+		break;
+	}
+	case SolarApiReply::NetworkError:
+		// Connection loss is detected by the device data retrieval.
+		QLOG_DEBUG() << "[Solar API] Network error: " << data.errorMessage;
+		break;
+	default:
+		QLOG_DEBUG() << "[Solar API] System data retrieval error:" << data.errorMessage;
+		break;
+	}
+	// Without system data we need the device data at the normal rate. Reschedule a pending slow
+	// retrieval.
+	if (wasValid && !mSystemDataValid && mRetrievalTimer->isActive())
+		mRetrievalTimer->start(UpdateInterval);
+}
+
+void SolarApiUpdater::onPowerFlowDataFound(const PowerFlowData &data)
+{
+	// Errors are handled by the system poller, which falls back to the system data for power.
+	if (data.error != SolarApiReply::NoError)
+		return;
+	QMap<int, double>::ConstIterator it =
+		data.inverterPower.find(mInverter->deviceInfo().networkId);
+	if (it != data.inverterPower.end())
+		mProcessor.processPower(it.value());
+}
+
+void SolarApiUpdater::onPowerFlowIntervalChanged()
+{
+	if (mSystemPoller != 0)
+		mSystemPoller->setPowerFlowInterval(mGlobalSettings->powerFlowInterval());
 }
 
 void SolarApiUpdater::onPhaseChanged()
@@ -137,11 +230,18 @@ void SolarApiUpdater::onConnectionDataChanged()
 {
 	mSolarApi->setHostName(mInverter->hostName());
 	mSolarApi->setPort(mInverter->port());
+	releaseSystemPoller();
+	acquireSystemPoller();
+	// Changing the host cancels the requests in progress.
+	if (mPendingReplies > 0 && mSolarApi->pendingRequestCount() == 0) {
+		mPendingReplies = 0;
+		scheduleRetrieval();
+	}
 }
 
 void SolarApiUpdater::scheduleRetrieval()
 {
-	QTimer::singleShot(UpdateInterval, this, SLOT(onStartRetrieval()));
+	mRetrievalTimer->start(mSystemDataValid ? DeviceUpdateInterval : UpdateInterval);
 }
 
 void SolarApiUpdater::setInitialized()
@@ -160,3 +260,26 @@ void SolarApiUpdater::handleError()
 		mRetryCount = 0;
 	}
 }
+
+void SolarApiUpdater::acquireSystemPoller()
+{
+	Q_ASSERT(mSystemPoller == 0);
+	mSystemPoller = SolarApiSystemPoller::acquire(mInverter->hostName(), mInverter->port());
+	connect(
+		mSystemPoller, SIGNAL(systemDataFound(SystemInverterData)),
+		this, SLOT(onSystemDataFound(SystemInverterData)));
+	connect(
+		mSystemPoller, SIGNAL(powerFlowDataFound(PowerFlowData)),
+		this, SLOT(onPowerFlowDataFound(PowerFlowData)));
+	mSystemPoller->setPowerFlowInterval(mGlobalSettings->powerFlowInterval());
+}
+
+void SolarApiUpdater::releaseSystemPoller()
+{
+	if (mSystemPoller == 0)
+		return;
+	disconnect(mSystemPoller, 0, this, 0);
+	SolarApiSystemPoller::release(mSystemPoller);
+	mSystemPoller = 0;
+	mSystemDataValid = false;
+}
@@ -3,20 +3,35 @@
 
 #include <QObject>
 #include "data_processor.h"
+#include "froniussolar_api.h"
 
-class FroniusSolarApi;
 class Inverter;
 class InverterSettings;
 class PowerInfo;
 class QTimer;
-struct CommonInverterData;
-struct ThreePhasesInverterData;
-
+class Settings;
+class SolarApiSystemPoller;
+
+/*!
+ * @brief Retrieves data from an inverter using the Fronius Solar API.
+ * Power and energy are taken from the SolarApiSystemPoller shared by all
+ * inverters on the data manager. Voltages, currents and status, which are
+ * only available per device, are retrieved at a lower rate. If the system
+ * data does not contain the inverter, all data is retrieved per device at
+ * the normal rate.
+ * On 3 phase inverters, common and 3 phase data are requested at the same
+ * time, and processed once both replies are in.
+ * If enabled in the settings, the power is also taken from the power flow
+ * data, which the system poller retrieves at a higher rate.
+ */
 class SolarApiUpdater : public QObject
 {
 	Q_OBJECT
 public:
-	SolarApiUpdater(Inverter *inverter, InverterSettings *settings, QObject *parent = 0);
+	SolarApiUpdater(Inverter *inverter, InverterSettings *settings, Settings *globalSettings,
+					QObject *parent = 0);
+
+	virtual ~SolarApiUpdater();
 
 	Inverter *inverter();
 
@@ -34,6 +49,12 @@ private slots:
 
 	void onThreePhasesDataFound(const ThreePhasesInverterData &data);
 
+	void onSystemDataFound(const SystemInverterData &data);
+
+	void onPowerFlowDataFound(const PowerFlowData &data);
+
+	void onPowerFlowIntervalChanged();
+
 	void onPhaseChanged();
 
 	void onSettingsTimer();
@@ -41,18 +62,40 @@ private slots:
 	void onConnectionDataChanged();
 
 private:
+	/// Called when a reply to the device data requests has been received.
+	void onDeviceDataReceived();
+
+	/// Returns true if the data has been processed.
+	bool processCommonData(const CommonInverterData &data);
+
+	bool processThreePhasesData(const ThreePhasesInverterData &data);
+
 	void scheduleRetrieval();
 
 	void setInitialized();
 
 	void handleError();
 
+	void acquireSystemPoller();
+
+	void releaseSystemPoller();
+
 	Inverter *mInverter;
 	InverterSettings *mSettings;
+	Settings *mGlobalSettings;
 	FroniusSolarApi *mSolarApi;
+	SolarApiSystemPoller *mSystemPoller;
+	QTimer *mRetrievalTimer;
 	QTimer *mSettingsTimer;
 	DataProcessor mProcessor;
+	CommonInverterData mCommonData;
+	ThreePhasesInverterData mThreePhasesData;
+	/// Number of device data replies we are waiting for.
+	int mPendingReplies;
+	bool mThreePhasesRequested;
 	bool mInitialized;
+	/// True if the last system data contained values for our inverter
+	bool mSystemDataValid;
 	int mRetryCount;
 };
 
@@ -1,6 +1,9 @@
 #include <QsLog.h>
 #include <velib/vecan/products.h>
+#include "modbus_register_cache.h"
 #include "modbus_tcp_client.h"
+#include "modbus_tcp_client_pool.h"
+#include "modbus_read_plan.h"
 #include "modbus_reply.h"
 #include "sunspec_detector.h"
 #include "sunspec_tools.h"
@@ -20,34 +23,36 @@ SunspecDetector::SunspecDetector(quint8 unitId, QObject *parent):
 DetectorReply *SunspecDetector::start(const QString &hostName, int timeout)
 {
 	Q_ASSERT(mUnitId != 0);
-	ModbusTcpClient *client = new ModbusTcpClient(this);
-	connect(client, SIGNAL(connected()), this, SLOT(onConnected()));
-	connect(client, SIGNAL(disconnected()), this, SLOT(onDisconnected()));
-	client->setTimeout(timeout);
-	client->connectToServer(hostName);
+	ModbusTcpClient *client = ModbusTcpClientPool::instance()->acquire(hostName);
+	if (!mClientToReply.contains(client)) {
+		connect(client, SIGNAL(connected()), this, SLOT(onConnected()));
+		connect(client, SIGNAL(disconnected()), this, SLOT(onDisconnected()));
+	}
 	Reply *reply = new Reply(this);
 	reply->client = client;
+	reply->timeout = timeout;
 	reply->di.networkId = mUnitId;
 	reply->di.hostName = hostName;
-	mClientToReply[client] = reply;
+	mClientToReply.insert(client, reply);
+	if (client->isConnected())
+		startDetection(reply);
+	else
+		client->connectToServer(hostName, ModbusTcpClient::DefaultTcpPort, timeout);
 	return reply;
 }
 
 void SunspecDetector::onConnected()
 {
 	ModbusTcpClient *client = static_cast<ModbusTcpClient *>(sender());
-	Reply *di = mClientToReply.value(client);
-	Q_ASSERT(di != 0);
-	di->state = Reply::SunSpecHeader;
-	di->currentRegister = 40000;
-	startNextRequest(di, 2);
+	Q_ASSERT(mClientToReply.contains(client));
+	foreach (Reply *di, mClientToReply.values(client))
+		startDetection(di);
 }
 
 void SunspecDetector::onDisconnected()
 {
 	ModbusTcpClient *client = static_cast<ModbusTcpClient *>(sender());
-	Reply *di = mClientToReply.value(client);
-	if (di != 0)
+	foreach (Reply *di, mClientToReply.values(client))
 		setDone(di);
 }
 
@@ -57,7 +62,7 @@ void SunspecDetector::onFinished()
 	Reply *di = mModbusReplyToReply.take(reply);
 	reply->deleteLater();
 
-	QVector<quint16> values = reply->registers();
+	ModbusRegisterView values = reply->registerView();
 
 	switch (di->state) {
 	case Reply::SunSpecHeader:
@@ -66,58 +71,28 @@ void SunspecDetector::onFinished()
 		if (values.size() == 2)
 			sunspecId = getString(values, 0, 2);
 		if (sunspecId != "SunS") {
+			ModbusRegisterCache::instance()->invalidate(di->di.hostName, di->di.networkId);
 			setDone(di);
 			return;
 		}
 		di->currentRegister += 2;
 		di->state = Reply::ModuleContent;
-		startNextRequest(di, 66);
+		// Model header, the content of model 1, and the header of the next model, so we do not
+		// need a separate request for it. Model 1 has 65 or 66 registers. We assume 65, because
+		// reading beyond the end of the last model fails. With 66 registers, the next header is
+		// read separately.
+		startNextRequest(di, 2 + 65 + 2);
 		break;
 	}
 	case Reply::ModuleHeader:
-	{
 		if (values.size() < 2) {
 			setDone(di);
 			return;
 		}
-		quint16 modelId = values[0];
-		quint16 modelSize = values[1];
-		di->state = Reply::ModuleHeader;
-		switch (modelId) {
-		case 101:
-		case 102:
-		case 103:
-		case 111:
-		case 112:
-		case 113:
-			di->di.retrievalMode = modelId > 103 ? ProtocolSunSpecFloat : ProtocolSunSpecIntSf;
-			di->di.phaseCount = modelId % 10;
-			di->di.inverterModelOffset = di->currentRegister;
-			break;
-		case 120: // Nameplate ratings
-			di->di.namePlateModelOffset = di->currentRegister;
-			di->state = Reply::ModuleContent;
-			break;
-		case 123: // Immediate controls
-			di->di.immediateControlOffset = di->currentRegister;
-			di->state = Reply::ModuleContent;
-			break;
-		case 0xFFFF:
-			if (!di->di.productName.isEmpty() && di->di.phaseCount > 0 && di->di.networkId > 0)
-				di->setResult();
-			setDone(di);
-			return;
-		}
-		if (di->state == Reply::ModuleHeader) {
-			di->currentRegister += 2 + modelSize;
-			startNextRequest(di, 2);
-		} else {
-			startNextRequest(di, modelSize + 2);
-		}
+		handleModelHeader(di, values[0], values[1]);
 		break;
-	}
 	case Reply::ModuleContent:
-		if (values.size() < 1) {
+		if (values.size() < 2) {
 			setDone(di);
 			return;
 		}
@@ -125,7 +100,7 @@ void SunspecDetector::onFinished()
 		quint16 modelId = values[0];
 		switch(modelId) {
 		case 1:
-			if (values.size() == 66) {
+			if (values.size() >= 66) {
 				QString manufacturer = getString(values, 2, 16);
 				if (manufacturer == "Fronius")
 					di->di.productId = VE_PROD_ID_PV_INVERTER_FRONIUS;
@@ -163,33 +138,99 @@ void SunspecDetector::onFinished()
             }
 			break;
 		}
-		di->currentRegister += 2 + values[1];
-		startNextRequest(di, 2);
+		int nextHeader = 2 + values[1];
+		di->currentRegister += nextHeader;
+		if (values.size() >= nextHeader + 2) {
+			// The header of the next model was included in the request
+			handleModelHeader(di, values[nextHeader], values[nextHeader + 1]);
+		} else {
+			startNextRequest(di, 2);
+		}
+		break;
+	}
+}
+
+void SunspecDetector::handleModelHeader(Reply *di, quint16 modelId, quint16 modelSize)
+{
+	di->state = Reply::ModuleHeader;
+	switch (modelId) {
+	case 101:
+	case 102:
+	case 103:
+	case 111:
+	case 112:
+	case 113:
+		di->di.retrievalMode = modelId > 103 ? ProtocolSunSpecFloat : ProtocolSunSpecIntSf;
+		di->di.phaseCount = modelId % 10;
+		di->di.inverterModelOffset = di->currentRegister;
+		break;
+	case 120: // Nameplate ratings
+		di->di.namePlateModelOffset = di->currentRegister;
+		di->state = Reply::ModuleContent;
+		break;
+	case 123: // Immediate controls
+		di->di.immediateControlOffset = di->currentRegister;
+		di->state = Reply::ModuleContent;
 		break;
+	case 0xFFFF:
+		if (!di->di.productName.isEmpty() && di->di.phaseCount > 0 && di->di.networkId > 0)
+			di->setResult();
+		setDone(di);
+		return;
+	}
+	if (di->state == Reply::ModuleHeader) {
+		di->currentRegister += 2 + modelSize;
+		startNextRequest(di, 2);
+	} else {
+		// Include the header of the next model if the request does not get too large.
+		int count = modelSize + 2;
+		if (count + 2 <= ModbusReadPlan::MaxRegistersPerRead)
+			count += 2;
+		startNextRequest(di, static_cast<quint16>(count));
 	}
 }
 
+void SunspecDetector::startDetection(Reply *di)
+{
+	di->state = Reply::SunSpecHeader;
+	di->currentRegister = 40000;
+	startNextRequest(di, 2);
+}
+
 void SunspecDetector::startNextRequest(Reply *di, quint16 regCount)
 {
-	ModbusReply *reply = di->client->readHoldingRegisters(di->di.networkId, di->currentRegister,
-														  regCount);
+	ModbusReply *reply = 0;
+	if (di->state == Reply::SunSpecHeader) {
+		// Always ask the device, so we know it is still there.
+		ModbusRequest request = ModbusRequest::readHoldingRegisters(
+			di->di.networkId, di->currentRegister, regCount);
+		request.timeout = di->timeout;
+		reply = di->client->sendRequest(request);
+	} else {
+		reply = ModbusRegisterCache::instance()->readHoldingRegisters(
+			di->client, di->di.hostName, di->di.networkId, di->currentRegister, regCount,
+			ModelCacheTtl, di->timeout);
+	}
 	mModbusReplyToReply[reply] = di;
 	connect(reply, SIGNAL(finished()), this, SLOT(onFinished()));
 }
 
 void SunspecDetector::setDone(Reply *di)
 {
-	if (!mClientToReply.contains(di->client))
+	ModbusTcpClient *client = di->client;
+	if (!mClientToReply.remove(client, di))
 		return;
+	if (!mClientToReply.contains(client))
+		disconnect(client, 0, this, 0);
+	// The pool keeps the connection open for a while, so the updater can take it over.
+	ModbusTcpClientPool::instance()->release(client);
 	di->setFinished();
-	disconnect(di->client);
-	mClientToReply.remove(di->client);
-	di->client->deleteLater();
 }
 
 SunspecDetector::Reply::Reply(QObject *parent):
 	DetectorReply(parent),
 	client(0),
+	timeout(0),
 	state(SunSpecHeader),
 	currentRegister(0)
 {
@@ -12,6 +12,12 @@ class SunspecDetector : public AbstractDetector
 {
 	Q_OBJECT
 public:
+	/*!
+	 * Time (ms) the content and layout of the SunSpec models are cached. Only the SunSpec marker
+	 * at the start of the register map is read on each detection pass.
+	 */
+	static const int ModelCacheTtl = 600000;
+
 	SunspecDetector(QObject *parent = 0);
 
 	SunspecDetector(quint8 unitId, QObject *parent = 0);
@@ -66,15 +72,21 @@ private:
 
 		DeviceInfo di;
 		ModbusTcpClient *client;
+		/// Timeout (ms) of each request, passed to `start`.
+		int timeout;
 		State state;
 		quint16 currentRegister;
 	};
 
+	void startDetection(Reply *di);
+
+	void handleModelHeader(Reply *di, quint16 modelId, quint16 modelSize);
+
 	void startNextRequest(Reply *di, quint16 regCount);
 
 	void setDone(Reply *di);
 
-	QHash<ModbusTcpClient *, Reply *> mClientToReply;
+	QMultiHash<ModbusTcpClient *, Reply *> mClientToReply;
 	QHash<ModbusReply *, Reply *> mModbusReplyToReply;
 	quint8 mUnitId;
 };
@@ -2,7 +2,7 @@
 #include <qnumeric.h>
 #include "sunspec_tools.h"
 
-double getScaledValue(const QVector<quint16> &values, int offset, int size, int scaleOffset,
+double getScaledValue(const ModbusRegisterView &values, int offset, int size, int scaleOffset,
 					  bool isSigned)
 {
 	Q_ASSERT(size > 0 && size < 3);
@@ -32,7 +32,7 @@ double getScaledValue(const QVector<quint16> &values, int offset, int size, int
 	return value * scale;
 }
 
-double getFloat(const QVector<quint16> &values, int offset)
+double getFloat(const ModbusRegisterView &values, int offset)
 {
 	// gcc 5.4 generates warning about strict aliasing when we compute a quint32 and cast its
 	// address to a float pointer. If we use a union instead we do the same thing, but there is
@@ -45,7 +45,7 @@ double getFloat(const QVector<quint16> &values, int offset)
 	return static_cast<double>(vf.f);
 }
 
-QString getString(const QVector<quint16> &values, int offset, int size)
+QString getString(const ModbusRegisterView &values, int offset, int size)
 {
 	QString result;
 	for (int i=0; i<size; ++i) {
@@ -56,7 +56,7 @@ QString getString(const QVector<quint16> &values, int offset, int size)
 	return result;
 }
 
-double getScale(const QVector<quint16> &values, int offset)
+double getScale(const ModbusRegisterView &values, int offset)
 {
 	quint16 v = values[offset];
 	if (v == 0x8000)
@@ -2,15 +2,15 @@
 #define SUNSPEC_TOOLS_H
 
 #include <QString>
-#include <QVector>
+#include "modbus_register_view.h"
 
-double getScaledValue(const QVector<quint16> &values, int offset, int size,
+double getScaledValue(const ModbusRegisterView &values, int offset, int size,
 					  int scaleOffset, bool isSigned);
 
-double getScale(const QVector<quint16> &values, int offset);
+double getScale(const ModbusRegisterView &values, int offset);
 
-double getFloat(const QVector<quint16> &values, int offset);
+double getFloat(const ModbusRegisterView &values, int offset);
 
-QString getString(const QVector<quint16> &values, int offset, int size);
+QString getString(const ModbusRegisterView &values, int offset, int size);
 
 #endif // SUNSPEC_TOOLS_H
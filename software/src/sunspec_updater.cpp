@@ -8,6 +8,7 @@
 #include "sunspec_updater.h"
 #include "inverter_settings.h"
 #include "modbus_tcp_client.h"
+#include "modbus_tcp_client_pool.h"
 #include "modbus_reply.h"
 #include "power_info.h"
 #include "sunspec_tools.h"
@@ -16,27 +17,42 @@
 // the power of the inverter to increase (or stay at its current value), so a large value for the
 // timeout is pretty safe.
 static const int PowerLimitTimeout = 120;
+// Time (ms) the power limit registers we wrote are trusted without reading them back. The inverter
+// may revert the limit after PowerLimitTimeout, so we check well before that.
+static const int PowerLimitShadowAge = PowerLimitTimeout * 1000 / 2;
+// Number of power limit registers, starting at WMaxLimPct (immediate controls + 5).
+static const int PowerLimitRegCount = 5;
 // This value used to be bigger to prevent old Fronius firmware from running (the resolution of
 // the power limiter was 1%. New Versions support precision of 0.01%. However, since a change in
 // the algorithm in hub4control, 1% should only work.
 static const int PowerLimitScale = 100;
+// Timeout (ms) of connection attempts and requests. Passed with each request, because the modbus
+// client is shared with other users (see ModbusTcpClientPool).
+static const int RequestTimeout = 5000;
 
-SunspecUpdater::SunspecUpdater(Inverter *inverter, InverterSettings *settings, QObject *parent):
+SunspecUpdater::SunspecUpdater(Inverter *inverter, InverterSettings *settings, QObject *parent,
+							   quint16 tcpPort):
 	QObject(parent),
 	mInverter(inverter),
 	mSettings(settings),
-	mModbusClient(new ModbusTcpClient(this)),
+	mModbusClient(ModbusTcpClientPool::instance()->acquire(inverter->hostName(), tcpPort)),
+	mTcpPort(tcpPort),
 	mTimer(new QTimer(this)),
 	mDataProcessor(new DataProcessor(inverter, settings, this)),
 	mCurrentState(Idle),
 	mPowerLimitPct(100),
 	mRetryCount(0),
+	mWriteStartReg(0),
 	mWritePowerLimitRequested(false)
 {
 	Q_ASSERT(inverter != 0);
 	connectModbusClient();
-	mModbusClient->setTimeout(5000);
-	mModbusClient->connectToServer(inverter->hostName());
+	if (mModbusClient->isConnected()) {
+		// Connection taken over from the detector
+		QMetaObject::invokeMethod(this, "onConnected", Qt::QueuedConnection);
+	} else {
+		mModbusClient->connectToServer(inverter->hostName(), mTcpPort, RequestTimeout);
+	}
 	connect(
 		mInverter, SIGNAL(powerLimitRequested(double)),
 		this, SLOT(onPowerLimitRequested(double)));
@@ -45,23 +61,38 @@ SunspecUpdater::SunspecUpdater(Inverter *inverter, InverterSettings *settings, Q
 	connect(mSettings, SIGNAL(phaseChanged()), this, SLOT(onPhaseChanged()));
 }
 
+SunspecUpdater::~SunspecUpdater()
+{
+	disconnect(mModbusClient, 0, this, 0);
+	// The client is shared, so only our own requests are cancelled.
+	mModbusClient->cancelAll(this);
+	ModbusTcpClientPool::instance()->release(mModbusClient);
+}
+
 void SunspecUpdater::startNextAction(ModbusState state)
 {
 	mCurrentState = state;
 	const DeviceInfo &deviceInfo = mInverter->deviceInfo();
 	switch (mCurrentState) {
 	case ReadPowerLimit:
-		readHoldingRegisters(deviceInfo.immediateControlOffset + 5, 5);
+	{
+		quint16 startReg = deviceInfo.immediateControlOffset + 5;
+		if (mShadowRegisters.isFresh(startReg, PowerLimitRegCount, PowerLimitShadowAge)) {
+			// We wrote the limit recently, so we can skip the round trip.
+			startNextAction(processPowerLimit(
+				mShadowRegisters.values(startReg, PowerLimitRegCount)));
+			return;
+		}
+		readHoldingRegisters(startReg, PowerLimitRegCount);
 		break;
+	}
 	case ReadPowerAndVoltage:
-		if (deviceInfo.retrievalMode == ProtocolSunSpecFloat)
-			readHoldingRegisters(deviceInfo.inverterModelOffset, 62);
-		else
-			readHoldingRegisters(deviceInfo.inverterModelOffset, 52);
+		readHoldingRegisters(deviceInfo.inverterModelOffset, getInverterModelSize());
 		break;
 	case WritePowerLimit:
 	{
 		QVector<quint16> values;
+		quint16 startReg = 0;
 		if (mPowerLimitPct < 100) {
 			quint16 pct = static_cast<quint16>(qRound(mPowerLimitPct * deviceInfo.powerLimitScale));
 			values.append(pct);
@@ -69,10 +100,29 @@ void SunspecUpdater::startNextAction(ModbusState state)
 			values.append(PowerLimitTimeout);
 			values.append(0); // unused
 			values.append(1); // enabled power throttle mode
-			writeMultipleHoldingRegisters(deviceInfo.immediateControlOffset + 5, values);
+			startReg = deviceInfo.immediateControlOffset + 5;
 		} else {
 			values.append(0);
-			writeMultipleHoldingRegisters(deviceInfo.immediateControlOffset + 9, values);
+			startReg = deviceInfo.immediateControlOffset + 9;
+		}
+		mWriteStartReg = startReg;
+		mWriteValues = values;
+		// A limit requested from now on is written in the next cycle.
+		mWritePowerLimitRequested = false;
+		// Whether the inverter supports function 23 is kept by the client, so it is only probed
+		// once per connection.
+		if (mModbusClient->isFunctionSupported(deviceInfo.networkId,
+											   ModbusRequest::ReadWriteMultipleRegisters)) {
+			// Write the limit and read the measurements in a single round trip.
+			ModbusRequest request = ModbusRequest::readWriteMultipleRegisters(
+				deviceInfo.networkId, deviceInfo.inverterModelOffset, getInverterModelSize(),
+				startReg, values);
+			request.timeout = RequestTimeout;
+			ModbusReply *reply = mModbusClient->sendRequest(request);
+			reply->setOwner(this);
+			connect(reply, SIGNAL(finished()), this, SLOT(onReadWriteCompleted()));
+		} else {
+			writeMultipleHoldingRegisters(startReg, values);
 		}
 		break;
 	}
@@ -87,7 +137,11 @@ void SunspecUpdater::startNextAction(ModbusState state)
 
 void SunspecUpdater::startIdleTimer()
 {
-	mTimer->setInterval(mCurrentState == Idle ? 1000 : 5000);
+	int interval = mCurrentState == Idle ? 1000 : 5000;
+	// Do not try to reconnect before the modbus client allows it (see ModbusTcpClient).
+	if (!mModbusClient->isConnected())
+		interval = qMax(interval, mModbusClient->reconnectDelay());
+	mTimer->setInterval(interval);
 	mTimer->start();
 }
 
@@ -125,20 +179,28 @@ void SunspecUpdater::setInverterState(int sunSpecState)
 void SunspecUpdater::readHoldingRegisters(quint16 startRegister, quint16 count)
 {
 	const DeviceInfo &deviceInfo = mInverter->deviceInfo();
-	ModbusReply *reply = mModbusClient->readHoldingRegisters(deviceInfo.networkId, startRegister, count);
-	connect(reply, SIGNAL(finished()), this, SLOT(onReadCompleted()));
+	// Sent every poll cycle, so we use the callback API which does not create a reply object.
+	ModbusRequest request = ModbusRequest::readHoldingRegisters(deviceInfo.networkId,
+																startRegister, count);
+	request.timeout = RequestTimeout;
+	mModbusClient->submit(
+		request, ModbusCallback::create<SunspecUpdater, &SunspecUpdater::onReadCompleted>(this));
 }
 
 void SunspecUpdater::writeMultipleHoldingRegisters(quint16 startReg, const QVector<quint16> &values)
 {
 	const DeviceInfo &deviceInfo = mInverter->deviceInfo();
-	ModbusReply *reply = mModbusClient->writeMultipleHoldingRegisters(deviceInfo.networkId, startReg, values);
+	ModbusRequest request = ModbusRequest::writeMultipleHoldingRegisters(deviceInfo.networkId,
+																		 startReg, values);
+	request.timeout = RequestTimeout;
+	ModbusReply *reply = mModbusClient->sendRequest(request);
+	reply->setOwner(this);
 	connect(reply, SIGNAL(finished()), this, SLOT(onWriteCompleted()));
 }
 
-bool SunspecUpdater::handleModbusError(ModbusReply *reply)
+bool SunspecUpdater::handleModbusError(ModbusReply::ExceptionCode error)
 {
-	if (reply->error() == ModbusReply::NoException) {
+	if (error == ModbusReply::NoException) {
 		mRetryCount = 0;
 		return true;
 	}
@@ -156,6 +218,11 @@ void SunspecUpdater::handleError()
 	startIdleTimer();
 }
 
+quint16 SunspecUpdater::getInverterModelSize() const
+{
+	return mInverter->deviceInfo().retrievalMode == ProtocolSunSpecFloat ? 62 : 52;
+}
+
 SunspecUpdater::ModbusState SunspecUpdater::getInitState() const
 {
 	// This is a workaround. SMA power limiting is not fully compatible with the standard: the
@@ -173,130 +240,23 @@ SunspecUpdater::ModbusState SunspecUpdater::getInitState() const
 		ReadPowerLimit : ReadPowerAndVoltage;
 }
 
-void SunspecUpdater::onReadCompleted()
+void SunspecUpdater::onReadCompleted(const ModbusResult &result)
 {
-	ModbusReply *reply = static_cast<ModbusReply *>(sender());
-	reply->deleteLater();
-	if (!handleModbusError(reply))
+	if (!handleModbusError(result.error))
 		return;
 
-	QVector<quint16> values = reply->registers();
+	ModbusRegisterView values = result.registers;
 
 	mRetryCount = 0;
 
 	ModbusState nextState = mCurrentState;
 	switch (mCurrentState) {
 	case ReadPowerAndVoltage:
-	{
-		if (values.isEmpty())
-			break;
-
-		// Allow the inverter object to decide if this frame is useable. This
-		// allows filtering bad frames on a per-inverter level. We use this
-		// for Fronius inverters that send a frame consisting of all zeros,
-		// with Status=7, Vendor State=10. By breaking out of the switch,
-		// the register will be fetched again immediately. See fronius_inverter.cpp
-		// for the implementation.
-		if (!mInverter->validateSunspecMonitorFrame(values))
-			break;
-
-		int modelId = values[0];
-		const DeviceInfo &deviceInfo = mInverter->deviceInfo();
-		ProtocolType retrievalMode = modelId > 103 ? ProtocolSunSpecFloat : ProtocolSunSpecIntSf;
-		int phaseCount = modelId % 10;
-		if (retrievalMode != deviceInfo.retrievalMode || phaseCount != deviceInfo.phaseCount) {
-			emit inverterModelChanged();
-			nextState = Idle;
-			break;
-		}
-		if (deviceInfo.retrievalMode == ProtocolSunSpecFloat) {
-			if (values.size() != 62)
-				break;
-			double power = getFloat(values, 22);
-			if (qIsFinite(power)) {
-				CommonInverterData cid;
-				cid.acCurrent = getFloat(values, 2);
-				cid.acPower = power;
-				// sunspec does not provide a voltage for the system as a whole. This does not
-				// make a lot of sense. Since previous versions of dbus-fronius published this
-				// value (retrieved via the Solar API) we use the value from phase 1.
-				cid.acVoltage = getFloat(values, 16);
-				cid.totalEnergy = getFloat(values, 32);
-				mDataProcessor->process(cid);
-
-				if (deviceInfo.phaseCount > 1) {
-					ThreePhasesInverterData tpid;
-					tpid.acCurrentPhase1 = getFloat(values, 4);
-					tpid.acCurrentPhase2 = getFloat(values, 6);
-					tpid.acCurrentPhase3 = getFloat(values, 8);
-					tpid.acVoltagePhase1 = getFloat(values, 16);
-					tpid.acVoltagePhase2 = getFloat(values, 18);
-					tpid.acVoltagePhase3 = getFloat(values, 20);
-					mDataProcessor->process(tpid);
-				} else if (mSettings->phase() == MultiPhase) {
-					// A single phase inverter used as a Multiphase
-					// generator. This only makes sense in a split-phase
-					// system. Typical in North America, and fully
-					// supported by Fronius.
-					updateSplitPhase(cid.acPower/2, cid.totalEnergy/2);
-				}
-			}
-			setInverterState(values[48]);
-		} else {
-			if (values.size() != 52)
-				break;
-			// In older versions of the Fronius firmware, power value and its scaling were sometimes
-			// 0 even when it was obvious that the value should have been different. It seemed to
-			// be indicating some kind of error situation.
-			double power = getScaledValue(values, 14, 1, 15, true);
-			if (qIsFinite(power)) {
-				CommonInverterData cid;
-				cid.acCurrent = getScaledValue(values, 2, 1, 6, false);
-				cid.acPower = power;
-				// sunspec does not provide a voltage for the system as a whole. This does not
-				// make a lot of sense. Since previous versions of dbus-fronius published this
-				// value (retrieved via the Solar API) we use the value from phase 1.
-				cid.acVoltage = getScaledValue(values, 10, 1, 13, false);
-				cid.totalEnergy = getScaledValue(values, 24, 2, 26, false);
-				mDataProcessor->process(cid);
-
-				if (deviceInfo.phaseCount > 1) {
-					ThreePhasesInverterData tpid;
-					tpid.acCurrentPhase1 = getScaledValue(values, 3, 1, 6, false);
-					tpid.acCurrentPhase2 = getScaledValue(values, 4, 1, 6, false);
-					tpid.acCurrentPhase3 = getScaledValue(values, 5, 1, 6, false);
-					tpid.acVoltagePhase1 = getScaledValue(values, 10, 1, 13, false);
-					tpid.acVoltagePhase2 = getScaledValue(values, 11, 1, 13, false);
-					tpid.acVoltagePhase3 = getScaledValue(values, 12, 1, 13, false);
-					mDataProcessor->process(tpid);
-				} else if (mSettings->phase() == MultiPhase) {
-					// A single phase inverter used as a Multiphase
-					// generator. This only makes sense in a split-phase
-					// system. Typical in North America, and fully
-					// supported by Fronius.
-					updateSplitPhase(cid.acPower/2, cid.totalEnergy/2);
-				}
-			}
-			setInverterState(values[38]);
-		}
-		nextState = mWritePowerLimitRequested ? WritePowerLimit : Idle;
+		nextState = processInverterModel(values);
 		break;
-	}
 	case ReadPowerLimit:
-		if (values.size() == 5) {
-			double powerLimit = qQNaN();
-			const DeviceInfo &deviceInfo = mInverter->deviceInfo();
-			if (deviceInfo.powerLimitScale >= PowerLimitScale) {
-				if (values[4] == 1) {
-					if (values[0] != 0xFFFF)
-						powerLimit = values[0] * deviceInfo.maxPower / deviceInfo.powerLimitScale;
-				} else {
-					powerLimit = deviceInfo.maxPower;
-				}
-			}
-			mInverter->setPowerLimit(powerLimit);
-			nextState = ReadPowerAndVoltage;
-		}
+		if (values.size() == PowerLimitRegCount)
+			nextState = processPowerLimit(values);
 		break;
 	default:
 		Q_ASSERT(false);
@@ -306,14 +266,151 @@ void SunspecUpdater::onReadCompleted()
 	startNextAction(nextState);
 }
 
+SunspecUpdater::ModbusState SunspecUpdater::processPowerLimit(const ModbusRegisterView &values)
+{
+	if (values.size() != PowerLimitRegCount)
+		return ReadPowerLimit;
+	double powerLimit = qQNaN();
+	const DeviceInfo &deviceInfo = mInverter->deviceInfo();
+	if (deviceInfo.powerLimitScale >= PowerLimitScale) {
+		if (values[4] == 1) {
+			if (values[0] != 0xFFFF)
+				powerLimit = values[0] * deviceInfo.maxPower / deviceInfo.powerLimitScale;
+		} else {
+			powerLimit = deviceInfo.maxPower;
+		}
+	}
+	mInverter->setPowerLimit(powerLimit);
+	return ReadPowerAndVoltage;
+}
+
+SunspecUpdater::ModbusState SunspecUpdater::processInverterModel(const ModbusRegisterView &values)
+{
+	if (values.isEmpty())
+		return ReadPowerAndVoltage;
+
+	// Allow the inverter object to decide if this frame is useable. This
+	// allows filtering bad frames on a per-inverter level. We use this
+	// for Fronius inverters that send a frame consisting of all zeros,
+	// with Status=7, Vendor State=10. By returning ReadPowerAndVoltage,
+	// the register will be fetched again immediately. See fronius_inverter.cpp
+	// for the implementation.
+	if (!mInverter->validateSunspecMonitorFrame(values))
+		return ReadPowerAndVoltage;
+
+	int modelId = values[0];
+	const DeviceInfo &deviceInfo = mInverter->deviceInfo();
+	ProtocolType retrievalMode = modelId > 103 ? ProtocolSunSpecFloat : ProtocolSunSpecIntSf;
+	int phaseCount = modelId % 10;
+	if (retrievalMode != deviceInfo.retrievalMode || phaseCount != deviceInfo.phaseCount) {
+		emit inverterModelChanged();
+		return Idle;
+	}
+	if (deviceInfo.retrievalMode == ProtocolSunSpecFloat) {
+		if (values.size() != 62)
+			return ReadPowerAndVoltage;
+		double power = getFloat(values, 22);
+		if (qIsFinite(power)) {
+			CommonInverterData cid;
+			cid.acCurrent = getFloat(values, 2);
+			cid.acPower = power;
+			// sunspec does not provide a voltage for the system as a whole. This does not
+			// make a lot of sense. Since previous versions of dbus-fronius published this
+			// value (retrieved via the Solar API) we use the value from phase 1.
+			cid.acVoltage = getFloat(values, 16);
+			cid.totalEnergy = getFloat(values, 32);
+			mDataProcessor->process(cid);
+
+			if (deviceInfo.phaseCount > 1) {
+				ThreePhasesInverterData tpid;
+				tpid.acCurrentPhase1 = getFloat(values, 4);
+				tpid.acCurrentPhase2 = getFloat(values, 6);
+				tpid.acCurrentPhase3 = getFloat(values, 8);
+				tpid.acVoltagePhase1 = getFloat(values, 16);
+				tpid.acVoltagePhase2 = getFloat(values, 18);
+				tpid.acVoltagePhase3 = getFloat(values, 20);
+				mDataProcessor->process(tpid);
+			} else if (mSettings->phase() == MultiPhase) {
+				// A single phase inverter used as a Multiphase
+				// generator. This only makes sense in a split-phase
+				// system. Typical in North America, and fully
+				// supported by Fronius.
+				updateSplitPhase(cid.acPower/2, cid.totalEnergy/2);
+			}
+		}
+		setInverterState(values[48]);
+	} else {
+		if (values.size() != 52)
+			return ReadPowerAndVoltage;
+		// In older versions of the Fronius firmware, power value and its scaling were sometimes
+		// 0 even when it was obvious that the value should have been different. It seemed to
+		// be indicating some kind of error situation.
+		double power = getScaledValue(values, 14, 1, 15, true);
+		if (qIsFinite(power)) {
+			CommonInverterData cid;
+			cid.acCurrent = getScaledValue(values, 2, 1, 6, false);
+			cid.acPower = power;
+			// sunspec does not provide a voltage for the system as a whole. This does not
+			// make a lot of sense. Since previous versions of dbus-fronius published this
+			// value (retrieved via the Solar API) we use the value from phase 1.
+			cid.acVoltage = getScaledValue(values, 10, 1, 13, false);
+			cid.totalEnergy = getScaledValue(values, 24, 2, 26, false);
+			mDataProcessor->process(cid);
+
+			if (deviceInfo.phaseCount > 1) {
+				ThreePhasesInverterData tpid;
+				tpid.acCurrentPhase1 = getScaledValue(values, 3, 1, 6, false);
+				tpid.acCurrentPhase2 = getScaledValue(values, 4, 1, 6, false);
+				tpid.acCurrentPhase3 = getScaledValue(values, 5, 1, 6, false);
+				tpid.acVoltagePhase1 = getScaledValue(values, 10, 1, 13, false);
+				tpid.acVoltagePhase2 = getScaledValue(values, 11, 1, 13, false);
+				tpid.acVoltagePhase3 = getScaledValue(values, 12, 1, 13, false);
+				mDataProcessor->process(tpid);
+			} else if (mSettings->phase() == MultiPhase) {
+				// A single phase inverter used as a Multiphase
+				// generator. This only makes sense in a split-phase
+				// system. Typical in North America, and fully
+				// supported by Fronius.
+				updateSplitPhase(cid.acPower/2, cid.totalEnergy/2);
+			}
+		}
+		setInverterState(values[38]);
+	}
+	return mWritePowerLimitRequested ? WritePowerLimit : Idle;
+}
+
 void SunspecUpdater::onWriteCompleted()
 {
 	ModbusReply *reply = static_cast<ModbusReply *>(sender());
 	reply->deleteLater();
-	mWritePowerLimitRequested = false;
+	updateShadowRegisters(reply);
+	// Try again in the next cycle.
+	if (reply->error() != ModbusReply::NoException)
+		mWritePowerLimitRequested = true;
 	startNextAction(getInitState());
 }
 
+void SunspecUpdater::onReadWriteCompleted()
+{
+	ModbusReply *reply = static_cast<ModbusReply *>(sender());
+	reply->deleteLater();
+	if (reply->error() == ModbusReply::IllegalFunction) {
+		QLOG_INFO() << "Read/write multiple registers not supported, using separate requests @"
+					<< mInverter->location();
+		// Uses the latest requested limit, which may have changed while we were waiting.
+		startNextAction(WritePowerLimit);
+		return;
+	}
+	updateShadowRegisters(reply);
+	if (reply->error() != ModbusReply::NoException)
+		mWritePowerLimitRequested = true;
+	if (!handleModbusError(reply->error()))
+		return;
+	// The power limit itself will be taken from the shadow registers at the start of the next
+	// cycle.
+	startNextAction(processInverterModel(reply->registerView()));
+}
+
 void SunspecUpdater::onPowerLimitRequested(double value)
 {
 	const DeviceInfo &deviceInfo = mInverter->deviceInfo();
@@ -343,6 +440,8 @@ void SunspecUpdater::onConnected()
 
 void SunspecUpdater::onDisconnected()
 {
+	// The inverter may have been restarted.
+	mShadowRegisters.invalidate();
 	mCurrentState = getInitState();
 	handleError();
 }
@@ -353,7 +452,7 @@ void SunspecUpdater::onTimer()
 	if (mModbusClient->isConnected())
 		startNextAction(mCurrentState == Idle ? getInitState() : mCurrentState);
 	else
-		mModbusClient->connectToServer(mInverter->hostName());
+		mModbusClient->connectToServer(mInverter->hostName(), mTcpPort, RequestTimeout);
 }
 
 void SunspecUpdater::onPhaseChanged()
@@ -365,6 +464,17 @@ void SunspecUpdater::onPhaseChanged()
 	mInverter->l3PowerInfo()->resetValues();
 }
 
+void SunspecUpdater::updateShadowRegisters(ModbusReply *reply)
+{
+	if (reply->error() == ModbusReply::NoException) {
+		mShadowRegisters.write(mWriteStartReg, mWriteValues);
+	} else {
+		// We do not know whether the write has been executed.
+		mShadowRegisters.invalidate(mInverter->deviceInfo().immediateControlOffset + 5,
+									PowerLimitRegCount);
+	}
+}
+
 void SunspecUpdater::connectModbusClient()
 {
 	connect(mModbusClient, SIGNAL(connected()), this, SLOT(onConnected()));
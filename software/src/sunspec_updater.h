@@ -3,19 +3,29 @@
 
 #include <QObject>
 #include <QAbstractSocket>
+#include <QVector>
+#include "modbus_reply.h"
+#include "modbus_shadow_registers.h"
+#include "modbus_tcp_client.h"
 
 class DataProcessor;
 class Inverter;
 class InverterSettings;
-class ModbusReply;
-class ModbusTcpClient;
+class ModbusRegisterView;
+struct ModbusResult;
 class QTimer;
 
 class SunspecUpdater: public QObject
 {
 	Q_OBJECT
 public:
-	explicit SunspecUpdater(Inverter *inverter, InverterSettings *settings, QObject *parent = 0);
+	/*!
+	 * @param tcpPort The Modbus TCP port of the inverter. Only differs from the default in tests.
+	 */
+	explicit SunspecUpdater(Inverter *inverter, InverterSettings *settings, QObject *parent = 0,
+							quint16 tcpPort = ModbusTcpClient::DefaultTcpPort);
+
+	virtual ~SunspecUpdater();
 
 signals:
 	void connectionLost();
@@ -23,10 +33,10 @@ signals:
 	void inverterModelChanged();
 
 private slots:
-	void onReadCompleted();
-
 	void onWriteCompleted();
 
+	void onReadWriteCompleted();
+
 	void onPowerLimitRequested(double value);
 
 	void onConnected();
@@ -68,22 +78,53 @@ private:
 
 	void writeMultipleHoldingRegisters(quint16 startReg, const QVector<quint16> &values);
 
-	bool handleModbusError(ModbusReply *reply);
+	void onReadCompleted(const ModbusResult &result);
+
+	bool handleModbusError(ModbusReply::ExceptionCode error);
 
 	void handleError();
 
+	/*!
+	 * Processes the power limit registers (WMaxLimPct up to WMaxLim_Ena of the immediate controls
+	 * model), either read from the inverter or taken from the shadow registers.
+	 * @return The next state.
+	 */
+	ModbusState processPowerLimit(const ModbusRegisterView &values);
+
+	/*!
+	 * Processes the content of the inverter model (101-103 or 111-113).
+	 * @return The next state. ReadPowerAndVoltage if the data was not usable and should be read
+	 * again.
+	 */
+	ModbusState processInverterModel(const ModbusRegisterView &values);
+
+	quint16 getInverterModelSize() const;
+
 	ModbusState getInitState() const;
 
 	void updateSplitPhase(double power, double energy);
 
+	/// Stores the power limit written by `reply` in the shadow registers if the write succeeded.
+	void updateShadowRegisters(ModbusReply *reply);
+
 	Inverter *mInverter;
 	InverterSettings *mSettings;
 	ModbusTcpClient *mModbusClient;
+	quint16 mTcpPort;
 	QTimer *mTimer;
 	DataProcessor *mDataProcessor;
 	ModbusState mCurrentState;
 	double mPowerLimitPct;
 	int mRetryCount;
+	/// Power limit registers written by the last WritePowerLimit action.
+	quint16 mWriteStartReg;
+	QVector<quint16> mWriteValues;
+	/// Power limit registers as last written or read.
+	ModbusShadowRegisters mShadowRegisters;
+	/*!
+	 * Set when a new power limit should be written. Cleared when the write is sent, so a limit
+	 * requested while the write is in flight will be written in the next cycle.
+	 */
 	bool mWritePowerLimitRequested;
 };
 
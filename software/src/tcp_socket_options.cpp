@@ -0,0 +1,71 @@
+#include <QAbstractSocket>
+#include <QsLog.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include "tcp_socket_options.h"
+
+namespace {
+
+TcpSocketOptions globalOptions;
+
+bool setTcpOption(int fd, int option, int value)
+{
+	return setsockopt(fd, IPPROTO_TCP, option, &value, sizeof(value)) == 0;
+}
+
+bool setSocketOption(int fd, int option, int value)
+{
+	return setsockopt(fd, SOL_SOCKET, option, &value, sizeof(value)) == 0;
+}
+
+}
+
+TcpSocketOptions::TcpSocketOptions():
+	noDelay(true),
+	keepAliveIdle(4),
+	keepAliveInterval(2),
+	keepAliveCount(3),
+	userTimeout(10000),
+	receiveBufferSize(0),
+	sendBufferSize(0)
+{
+}
+
+bool TcpSocketOptions::apply(QAbstractSocket *socket) const
+{
+	int fd = static_cast<int>(socket->socketDescriptor());
+	if (fd < 0)
+		return false;
+	bool ok = true;
+	socket->setSocketOption(QAbstractSocket::LowDelayOption, noDelay ? 1 : 0);
+	socket->setSocketOption(QAbstractSocket::KeepAliveOption, keepAliveIdle > 0 ? 1 : 0);
+	if (keepAliveIdle > 0) {
+#ifdef TCP_KEEPIDLE
+		ok = setTcpOption(fd, TCP_KEEPIDLE, keepAliveIdle) && ok;
+		ok = setTcpOption(fd, TCP_KEEPINTVL, keepAliveInterval) && ok;
+		ok = setTcpOption(fd, TCP_KEEPCNT, keepAliveCount) && ok;
+#endif
+	}
+#ifdef TCP_USER_TIMEOUT
+	if (userTimeout > 0)
+		ok = setTcpOption(fd, TCP_USER_TIMEOUT, userTimeout) && ok;
+#endif
+	if (receiveBufferSize > 0)
+		ok = setSocketOption(fd, SO_RCVBUF, receiveBufferSize) && ok;
+	if (sendBufferSize > 0)
+		ok = setSocketOption(fd, SO_SNDBUF, sendBufferSize) && ok;
+	if (!ok)
+		QLOG_WARN() << "Could not set TCP options for" << socket->peerName();
+	return ok;
+}
+
+const TcpSocketOptions &TcpSocketOptions::global()
+{
+	return globalOptions;
+}
+
+void TcpSocketOptions::setGlobal(const TcpSocketOptions &options)
+{
+	globalOptions = options;
+}
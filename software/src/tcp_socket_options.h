@@ -0,0 +1,68 @@
+#ifndef TCP_SOCKET_OPTIONS_H
+#define TCP_SOCKET_OPTIONS_H
+
+class QAbstractSocket;
+
+/*!
+ * Options for the TCP connections to inverters (Modbus TCP and the Fronius Solar API).
+ *
+ * Requests and responses are small, so Nagle's algorithm is disabled: it would hold back a
+ * request until the previous segment is acknowledged.
+ *
+ * Without further measures, a connection to an inverter which is switched off (or disconnected
+ * from the network) is only noticed after a number of requests have timed out. Keepalive probes
+ * detect a dead peer on an idle connection. The user timeout (Linux only) limits the time
+ * transmitted data may remain unacknowledged, which covers connections carrying a request to a
+ * dead peer. In both cases the kernel closes the connection, and the client will see a socket
+ * error. With the default options a dead peer is detected within about 10 seconds: an idle
+ * connection is closed after 4 s without traffic plus 3 unanswered probes 2 s apart, a connection
+ * with unacknowledged data after the 10 s user timeout.
+ *
+ * The socket buffer sizes are left to the system by default. Replies are at most a few kB, so
+ * smaller buffers may be used to save memory when there are many connections.
+ *
+ * The options are applied when a connection has been established, because the socket descriptor
+ * does not exist before. As a consequence, a receive buffer larger than the system default does
+ * not raise the TCP window beyond the window scale negotiated during the handshake.
+ */
+class TcpSocketOptions
+{
+public:
+	/// Creates the default options.
+	TcpSocketOptions();
+
+	/// Disables Nagle's algorithm (TCP_NODELAY).
+	bool noDelay;
+	/// Idle time (s) before the first keepalive probe is sent. 0 disables keepalive.
+	int keepAliveIdle;
+	/// Time (s) between keepalive probes.
+	int keepAliveInterval;
+	/// Number of unanswered probes after which the connection is closed.
+	int keepAliveCount;
+	/*!
+	 * Maximum time (ms) transmitted data may remain unacknowledged before the connection is
+	 * closed (TCP_USER_TIMEOUT). 0 leaves the system default. Ignored where not supported.
+	 */
+	int userTimeout;
+	/// Size (bytes) of the receive buffer (SO_RCVBUF). 0 leaves the system default.
+	int receiveBufferSize;
+	/// Size (bytes) of the send buffer (SO_SNDBUF). 0 leaves the system default.
+	int sendBufferSize;
+
+	/*!
+	 * Applies the options to a connected socket.
+	 * @return false if one or more options could not be set.
+	 */
+	bool apply(QAbstractSocket *socket) const;
+
+	/// Returns the options used for all connections to inverters.
+	static const TcpSocketOptions &global();
+
+	/*!
+	 * Sets the options used for all connections to inverters. Should be called before any
+	 * connection is created, because the options may be read from the Modbus I/O thread.
+	 */
+	static void setGlobal(const TcpSocketOptions &options);
+};
+
+#endif // TCP_SOCKET_OPTIONS_H
@@ -11,7 +11,7 @@ QMAKE_CXXFLAGS += -Wno-unused-local-typedefs
 target.path = /opt/dbus_fronius_test
 INSTALLS += target
 
-QT += core network script
+QT += core network
 QT -= gui
 
 TARGET = dbus_fronius_test
@@ -30,17 +30,18 @@ include($$EXTDIR/qslog/QsLog.pri)
 include($$SRCDIR/json/json.pri)
 include($$EXTDIR/velib/src/qt/ve_qitems.pri)
 
-equals(QT_MAJOR_VERSION, 5): include($$SRCDIR/qhttp/qhttp.pri)
-
 INCLUDEPATH += \
     $$EXTDIR/velib/inc \
     $$EXTDIR/googletest/include \
     $$EXTDIR/googletest \
-    $$EXTDIR/qthttp/src/qhttp \
-    $$SRCDIR
+    $$SRCDIR \
+    $$SRCDIR/modbus_tcp_client
 
 HEADERS += \
     $$SRCDIR/froniussolar_api.h \
+    $$SRCDIR/solar_api_session.h \
+    $$SRCDIR/http_client.h \
+    $$SRCDIR/http_response_parser.h \
     $$SRCDIR/inverter.h \
     $$SRCDIR/power_info.h \
     $$SRCDIR/inverter_settings.h \
@@ -48,13 +49,43 @@ HEADERS += \
     $$SRCDIR/fronius_device_info.h \
     $$SRCDIR/ve_qitem_consumer.h \
     $$SRCDIR/ve_service.h \
+    $$SRCDIR/latency_statistics.h \
+    $$SRCDIR/tcp_socket_options.h \
+    $$SRCDIR/sunspec_updater.h \
+    $$SRCDIR/sunspec_tools.h \
+    $$SRCDIR/modbus_tcp_client/crc16.h \
+    $$SRCDIR/modbus_tcp_client/modbus_batch.h \
+    $$SRCDIR/modbus_tcp_client/modbus_client.h \
+    $$SRCDIR/modbus_tcp_client/modbus_request.h \
+    $$SRCDIR/modbus_tcp_client/modbus_object_pool.h \
+    $$SRCDIR/modbus_tcp_client/modbus_read_plan.h \
+    $$SRCDIR/modbus_tcp_client/modbus_register_cache.h \
+    $$SRCDIR/modbus_tcp_client/modbus_shadow_registers.h \
+    $$SRCDIR/modbus_tcp_client/modbus_reply.h \
+    $$SRCDIR/modbus_tcp_client/modbus_rtu_client.h \
+    $$SRCDIR/modbus_tcp_client/modbus_rtu_frame.h \
+    $$SRCDIR/modbus_tcp_client/modbus_rtu_tcp_client.h \
+    $$SRCDIR/modbus_tcp_client/modbus_register_view.h \
+    $$SRCDIR/modbus_tcp_client/modbus_spsc_queue.h \
+    $$SRCDIR/modbus_tcp_client/modbus_tcp_client.h \
+    $$SRCDIR/modbus_tcp_client/modbus_tcp_client_pool.h \
+    $$SRCDIR/modbus_tcp_client/modbus_tcp_frame_buffer.h \
+    $$SRCDIR/modbus_tcp_client/modbus_tcp_transport.h \
+    $$SRCDIR/modbus_tcp_client/modbus_deadline_queue.h \
     src/fronius_solar_api_test.h \
     src/test_helper.h \
     src/dbus_inverter_bridge_test.h \
-    src/data_processor_test.h
+    src/data_processor_test.h \
+    src/modbus_rtu_tcp_client_test.h \
+    src/modbus_stand_in_server.h \
+    src/modbus_tcp_client_test.h \
+    src/sunspec_updater_test.h
 
 SOURCES += \
     $$SRCDIR/froniussolar_api.cpp \
+    $$SRCDIR/solar_api_session.cpp \
+    $$SRCDIR/http_client.cpp \
+    $$SRCDIR/http_response_parser.cpp \
     $$SRCDIR/inverter.cpp \
     $$SRCDIR/power_info.cpp \
     $$SRCDIR/inverter_settings.cpp \
@@ -62,12 +93,55 @@ SOURCES += \
     $$SRCDIR/fronius_device_info.cpp \
     $$SRCDIR/ve_qitem_consumer.cpp \
     $$SRCDIR/ve_service.cpp \
+    $$SRCDIR/latency_statistics.cpp \
+    $$SRCDIR/tcp_socket_options.cpp \
+    $$SRCDIR/sunspec_updater.cpp \
+    $$SRCDIR/sunspec_tools.cpp \
+    $$SRCDIR/modbus_tcp_client/crc16.cpp \
+    $$SRCDIR/modbus_tcp_client/modbus_batch.cpp \
+    $$SRCDIR/modbus_tcp_client/modbus_client.cpp \
+    $$SRCDIR/modbus_tcp_client/modbus_request.cpp \
+    $$SRCDIR/modbus_tcp_client/modbus_read_plan.cpp \
+    $$SRCDIR/modbus_tcp_client/modbus_register_cache.cpp \
+    $$SRCDIR/modbus_tcp_client/modbus_shadow_registers.cpp \
+    $$SRCDIR/modbus_tcp_client/modbus_reply.cpp \
+    $$SRCDIR/modbus_tcp_client/modbus_rtu_client.cpp \
+    $$SRCDIR/modbus_tcp_client/modbus_rtu_frame.cpp \
+    $$SRCDIR/modbus_tcp_client/modbus_rtu_tcp_client.cpp \
+    $$SRCDIR/modbus_tcp_client/modbus_tcp_client.cpp \
+    $$SRCDIR/modbus_tcp_client/modbus_tcp_client_pool.cpp \
+    $$SRCDIR/modbus_tcp_client/modbus_tcp_frame_buffer.cpp \
+    $$SRCDIR/modbus_tcp_client/modbus_tcp_transport.cpp \
+    $$SRCDIR/modbus_tcp_client/modbus_deadline_queue.cpp \
+    $$EXTDIR/velib/src/plt/serial.c \
+    $$EXTDIR/velib/src/plt/posix_serial.c \
+    $$EXTDIR/velib/src/plt/posix_ctx.c \
+    $$EXTDIR/velib/src/types/ve_variant.c \
     $$EXTDIR/googletest/src/gtest-all.cc \
     src/main.cpp \
     src/dbus_inverter_bridge_test.cpp \
     src/fronius_solar_api_test.cpp \
     src/test_helper.cpp \
-    src/data_processor_test.cpp
+    src/data_processor_test.cpp \
+    src/modbus_deadline_queue_test.cpp \
+    src/modbus_read_plan_test.cpp \
+    src/latency_statistics_test.cpp \
+    src/tcp_socket_options_test.cpp \
+    src/modbus_request_test.cpp \
+    src/json_reader_test.cpp \
+    src/http_response_parser_test.cpp \
+    src/modbus_spsc_queue_test.cpp \
+    src/modbus_rtu_frame_test.cpp \
+    src/modbus_rtu_client_test.cpp \
+    src/modbus_rtu_tcp_client_test.cpp \
+    src/modbus_register_cache_test.cpp \
+    src/modbus_shadow_registers_test.cpp \
+    src/modbus_stand_in_server.cpp \
+    src/modbus_tcp_client_test.cpp \
+    src/sunspec_updater_test.cpp
+
+# openpty, used to simulate a serial bus
+LIBS += -lutil
 
 OTHER_FILES += \
     src/fronius_sim/app.py \
@@ -0,0 +1,47 @@
+# Application version and revision
+VERSION = 0.1.0
+
+# suppress the mangling of va_arg has changed for gcc 4.4
+QMAKE_CXXFLAGS += -Wno-psabi
+
+# gcc 4.8 and newer don't like the QOMPILE_ASSERT in qt
+QMAKE_CXXFLAGS += -Wno-unused-local-typedefs
+
+MOC_DIR=.moc
+OBJECTS_DIR=.obj
+
+QT += core network
+QT -= gui
+
+TARGET = http_benchmark
+CONFIG += console
+CONFIG -= app_bundle
+DEFINES += VERSION=\\\"$${VERSION}\\\" PRJ_DIR=\\\"$$PWD\\\"
+
+TEMPLATE = app
+
+SRCDIR = ../software/src
+EXTDIR = ../software/ext
+APPDIR = ./http_benchmark
+
+include($$EXTDIR/qslog/QsLog.pri)
+
+# QHttp, which HttpClient replaced, is the reference this benchmark compares
+# with. It is part of Qt4, and was ported to Qt5 in qhttp.
+equals(QT_MAJOR_VERSION, 5): include($$APPDIR/qhttp/qhttp.pri)
+
+INCLUDEPATH += \
+    $$SRCDIR \
+    $$APPDIR
+
+HEADERS += \
+    $$SRCDIR/http_client.h \
+    $$SRCDIR/http_response_parser.h \
+    $$SRCDIR/tcp_socket_options.h \
+    $$APPDIR/benchmark.h
+
+SOURCES += \
+    $$SRCDIR/http_client.cpp \
+    $$SRCDIR/http_response_parser.cpp \
+    $$SRCDIR/tcp_socket_options.cpp \
+    $$APPDIR/main.cpp
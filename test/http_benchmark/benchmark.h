@@ -0,0 +1,112 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QObject>
+#include <QString>
+
+class HttpClient;
+class QHttp;
+class QTcpServer;
+class QTcpSocket;
+
+/*!
+ * Stand-in for the web server of a data manager. Replies to every GET request with the same
+ * CommonInverterData document. Every other reply uses chunked transfer encoding, so both ways of
+ * delimiting the body are exercised.
+ */
+class StandInServer : public QObject
+{
+	Q_OBJECT
+public:
+	explicit StandInServer(QObject *parent = 0);
+
+	/// Listens on the loopback interface. Returns the port, or 0 on failure.
+	quint16 listen();
+
+private slots:
+	void onNewConnection();
+
+	void onReadyRead();
+
+	void onDisconnected();
+
+private:
+	QTcpServer *mServer;
+	QHash<QTcpSocket *, QByteArray> mBuffers;
+	QByteArray mBody;
+	int mReplyCount;
+};
+
+/// Sends a number of requests one after the other, and counts the results.
+class Driver : public QObject
+{
+	Q_OBJECT
+public:
+	Driver(int requestCount, QObject *parent = 0);
+
+	/// Sends all requests and returns when the last one has been completed.
+	void run();
+
+	int errorCount() const
+	{
+		return mErrorCount;
+	}
+
+	qint64 bodyBytes() const
+	{
+		return mBodyBytes;
+	}
+
+signals:
+	void done();
+
+protected:
+	virtual void sendRequest() = 0;
+
+	void onReply(bool error, int bodySize);
+
+private:
+	int mRemaining;
+	int mErrorCount;
+	qint64 mBodyBytes;
+};
+
+class HttpClientDriver : public Driver
+{
+	Q_OBJECT
+public:
+	HttpClientDriver(quint16 port, int requestCount, QObject *parent = 0);
+
+protected:
+	virtual void sendRequest();
+
+private slots:
+	void onFinished(const QString &error, const QByteArray &body);
+
+private:
+	HttpClient *mClient;
+};
+
+class QHttpDriver : public Driver
+{
+	Q_OBJECT
+public:
+	QHttpDriver(quint16 port, int requestCount, QObject *parent = 0);
+
+protected:
+	virtual void sendRequest();
+
+private slots:
+	void onConnected();
+
+	void onRequestFinished(int id, bool error);
+
+private:
+	QHttp *mHttp;
+	QTcpSocket *mSocket;
+	int mRequestId;
+};
+
+#endif // BENCHMARK_H
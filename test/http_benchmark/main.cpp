@@ -0,0 +1,287 @@
+#include <QtGlobal>
+#if QT_VERSION >= QT_VERSION_CHECK(5, 0, 0)
+#include "qhttp.h"
+#else
+#include <QHttp>
+#endif
+
+#include <sys/resource.h>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFile>
+#include <QProcess>
+#include <QStringList>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTextStream>
+#include "benchmark.h"
+#include "http_client.h"
+#include "tcp_socket_options.h"
+
+// Compares HttpClient with the QHttp port it replaced, by sending Solar API requests one after the
+// other over a keep-alive connection. The server is a stand-in running in a child process (this
+// program started with --server), so only the client side is measured. Memory usage is taken from
+// /proc/self/status, so this benchmark only works on linux.
+
+static const int RequestCount = 5000;
+static const char *const RequestPath =
+	"/solar_api/v1/GetInverterRealtimeData.cgi?Scope=Device&DeviceId=1&"
+	"DataCollection=CommonInverterData";
+
+/// Returns the CommonInverterData document from documents/solar_api_samples.txt.
+static QByteArray loadCommonData()
+{
+	QFile file(PRJ_DIR "/../documents/solar_api_samples.txt");
+	if (!file.open(QIODevice::ReadOnly))
+		return QByteArray();
+	QByteArray document;
+	bool found = false;
+	while (!file.atEnd()) {
+		QByteArray line = file.readLine();
+		if (!found) {
+			found = line.contains("DataCollection=CommonInverterData");
+			continue;
+		}
+		document.append(line);
+		if (line.startsWith('}'))
+			break;
+	}
+	return document;
+}
+
+static long residentSetKb()
+{
+	QFile file("/proc/self/status");
+	if (!file.open(QIODevice::ReadOnly))
+		return -1;
+	while (!file.atEnd()) {
+		QByteArray line = file.readLine();
+		if (line.startsWith("VmRSS:"))
+			return line.mid(6).trimmed().split(' ').first().toLong();
+	}
+	return -1;
+}
+
+/// User and system CPU time used by this process in microseconds.
+static qint64 cpuTimeUs()
+{
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return -1;
+	return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * Q_INT64_C(1000000) +
+		usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+StandInServer::StandInServer(QObject *parent):
+	QObject(parent),
+	mServer(new QTcpServer(this)),
+	mBody(loadCommonData()),
+	mReplyCount(0)
+{
+	connect(mServer, SIGNAL(newConnection()), this, SLOT(onNewConnection()));
+}
+
+quint16 StandInServer::listen()
+{
+	if (mBody.isEmpty() || !mServer->listen(QHostAddress::LocalHost, 0))
+		return 0;
+	return mServer->serverPort();
+}
+
+void StandInServer::onNewConnection()
+{
+	while (mServer->hasPendingConnections()) {
+		QTcpSocket *socket = mServer->nextPendingConnection();
+		TcpSocketOptions::global().apply(socket);
+		mBuffers.insert(socket, QByteArray());
+		connect(socket, SIGNAL(readyRead()), this, SLOT(onReadyRead()));
+		connect(socket, SIGNAL(disconnected()), this, SLOT(onDisconnected()));
+	}
+}
+
+void StandInServer::onReadyRead()
+{
+	QTcpSocket *socket = static_cast<QTcpSocket *>(sender());
+	QByteArray &buffer = mBuffers[socket];
+	buffer.append(socket->readAll());
+	for (;;) {
+		int end = buffer.indexOf("\r\n\r\n");
+		if (end < 0)
+			return;
+		bool close = buffer.left(end).toLower().contains("connection: close");
+		buffer.remove(0, end + 4);
+		QByteArray reply =
+			"HTTP/1.1 200 OK\r\n"
+			"Content-Type: application/json\r\n"
+			"Cache-Control: no-cache\r\n";
+		if (close)
+			reply.append("Connection: close\r\n");
+		if (++mReplyCount % 2 == 0) {
+			int half = mBody.size() / 2;
+			reply.append("Transfer-Encoding: chunked\r\n\r\n");
+			reply.append(QByteArray::number(half, 16) + "\r\n");
+			reply.append(mBody.left(half) + "\r\n");
+			reply.append(QByteArray::number(mBody.size() - half, 16) + "\r\n");
+			reply.append(mBody.mid(half) + "\r\n");
+			reply.append("0\r\n\r\n");
+		} else {
+			reply.append("Content-Length: " + QByteArray::number(mBody.size()) + "\r\n\r\n");
+			reply.append(mBody);
+		}
+		socket->write(reply);
+		if (close) {
+			socket->disconnectFromHost();
+			return;
+		}
+	}
+}
+
+void StandInServer::onDisconnected()
+{
+	QTcpSocket *socket = static_cast<QTcpSocket *>(sender());
+	mBuffers.remove(socket);
+	socket->deleteLater();
+}
+
+Driver::Driver(int requestCount, QObject *parent):
+	QObject(parent),
+	mRemaining(requestCount),
+	mErrorCount(0),
+	mBodyBytes(0)
+{
+}
+
+void Driver::run()
+{
+	QEventLoop loop;
+	connect(this, SIGNAL(done()), &loop, SLOT(quit()));
+	sendRequest();
+	loop.exec();
+}
+
+void Driver::onReply(bool error, int bodySize)
+{
+	if (error)
+		++mErrorCount;
+	mBodyBytes += bodySize;
+	if (--mRemaining > 0)
+		sendRequest();
+	else
+		emit done();
+}
+
+HttpClientDriver::HttpClientDriver(quint16 port, int requestCount, QObject *parent):
+	Driver(requestCount, parent),
+	mClient(new HttpClient("localhost", port, this))
+{
+	connect(mClient, SIGNAL(finished(QString, QByteArray)),
+			this, SLOT(onFinished(QString, QByteArray)));
+}
+
+void HttpClientDriver::sendRequest()
+{
+	mClient->get(RequestPath, 5000);
+}
+
+void HttpClientDriver::onFinished(const QString &error, const QByteArray &body)
+{
+	onReply(!error.isEmpty(), body.size());
+}
+
+QHttpDriver::QHttpDriver(quint16 port, int requestCount, QObject *parent):
+	Driver(requestCount, parent),
+	mHttp(new QHttp("localhost", QHttp::ConnectionModeHttp, port, this)),
+	mSocket(new QTcpSocket(mHttp)),
+	mRequestId(-1)
+{
+	// Same socket options as used with HttpClient.
+	connect(mSocket, SIGNAL(connected()), this, SLOT(onConnected()));
+	mHttp->setSocket(mSocket);
+	connect(mHttp, SIGNAL(requestFinished(int, bool)), this, SLOT(onRequestFinished(int, bool)));
+}
+
+void QHttpDriver::sendRequest()
+{
+	mRequestId = mHttp->get(RequestPath);
+}
+
+void QHttpDriver::onConnected()
+{
+	TcpSocketOptions::global().apply(mSocket);
+}
+
+void QHttpDriver::onRequestFinished(int id, bool error)
+{
+	if (id != mRequestId)
+		return;
+	onReply(error, mHttp->readAll().size());
+}
+
+static int runServer()
+{
+	StandInServer server;
+	quint16 port = server.listen();
+	QTextStream out(stdout);
+	out << port << endl;
+	if (port == 0)
+		return 1;
+	return QCoreApplication::exec();
+}
+
+static bool report(QTextStream &out, const char *name, Driver &driver)
+{
+	long rssStart = residentSetKb();
+	qint64 cpuStart = cpuTimeUs();
+	QElapsedTimer timer;
+	timer.start();
+	driver.run();
+	qint64 elapsed = timer.nsecsElapsed();
+	qint64 cpu = cpuTimeUs() - cpuStart;
+	long rss = residentSetKb();
+	out << name << elapsed / 1000 / RequestCount << " us/request, CPU "
+		<< cpu / RequestCount << " us/request, RSS +" << rss - rssStart << " kB";
+	if (driver.errorCount() > 0)
+		out << ", " << driver.errorCount() << " errors";
+	out << endl;
+	return driver.errorCount() == 0;
+}
+
+int main(int argc, char *argv[])
+{
+	QCoreApplication app(argc, argv);
+	QStringList arguments = QCoreApplication::arguments();
+	if (arguments.contains("--server"))
+		return runServer();
+
+	QTextStream out(stdout);
+	QProcess server;
+	server.start(QCoreApplication::applicationFilePath(), QStringList() << "--server");
+	if (!server.waitForStarted() || !server.waitForReadyRead()) {
+		out << "Could not start the stand-in server" << endl;
+		return 1;
+	}
+	quint16 port = static_cast<quint16>(server.readLine().trimmed().toUInt());
+	if (port == 0) {
+		out << "Stand-in server failed (samples file missing?)" << endl;
+		return 1;
+	}
+	out << RequestCount << " requests over a keep-alive connection" << endl;
+
+	HttpClientDriver clientDriver(port, RequestCount);
+	// Warm up
+	HttpClientDriver(port, 100).run();
+	bool ok = report(out, "HttpClient: ", clientDriver);
+
+	QHttpDriver httpDriver(port, RequestCount);
+	QHttpDriver(port, 100).run();
+	ok = report(out, "QHttp:      ", httpDriver) && ok;
+
+	if (clientDriver.bodyBytes() != httpDriver.bodyBytes()) {
+		out << "Bodies received by HttpClient and QHttp differ in size" << endl;
+		ok = false;
+	}
+	server.kill();
+	server.waitForFinished();
+	return ok ? 0 : 1;
+}
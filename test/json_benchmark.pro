@@ -0,0 +1,38 @@
+# Application version and revision
+VERSION = 0.1.0
+
+# suppress the mangling of va_arg has changed for gcc 4.4
+QMAKE_CXXFLAGS += -Wno-psabi
+
+# gcc 4.8 and newer don't like the QOMPILE_ASSERT in qt
+QMAKE_CXXFLAGS += -Wno-unused-local-typedefs
+
+MOC_DIR=.moc
+OBJECTS_DIR=.obj
+
+# The script module is only used for the QScriptEngine based parser, which is
+# the reference this benchmark compares with.
+QT += core script
+QT -= gui
+
+TARGET = json_benchmark
+CONFIG += console
+CONFIG -= app_bundle
+DEFINES += VERSION=\\\"$${VERSION}\\\" PRJ_DIR=\\\"$$PWD\\\"
+
+TEMPLATE = app
+
+SRCDIR = ../software/src
+APPDIR = ./json_benchmark
+
+include($$SRCDIR/json/json.pri)
+
+INCLUDEPATH += \
+    $$APPDIR
+
+HEADERS += \
+    $$APPDIR/json.h
+
+SOURCES += \
+    $$APPDIR/json.cpp \
+    $$APPDIR/main.cpp
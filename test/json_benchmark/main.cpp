@@ -0,0 +1,181 @@
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QList>
+#include <QStringList>
+#include <QTextStream>
+#include <QVariantMap>
+#include <QVector>
+#include "json.h"
+#include "json_reader.h"
+
+// Compares the extraction of Solar API values using JsonReader with the QScriptEngine based
+// parser it replaced (JSON::parse followed by a lookup of each path in the resulting map). The
+// payloads are taken from documents/solar_api_samples.txt. Memory usage is taken from
+// /proc/self/status, so this benchmark only works on linux.
+
+static const int Iterations = 2000;
+
+static const char *const Paths[] = {
+	"Head/Status/Code",
+	"Head/Status/Reason",
+	"Head/RequestArguments/DeviceId",
+	"Body/Data/PAC/Value",
+	"Body/Data/IAC/Value",
+	"Body/Data/UAC/Value",
+	"Body/Data/FAC/Value",
+	"Body/Data/IDC/Value",
+	"Body/Data/UDC/Value",
+	"Body/Data/DAY_ENERGY/Value",
+	"Body/Data/YEAR_ENERGY/Value",
+	"Body/Data/TOTAL_ENERGY/Value",
+	"Body/Data/DeviceStatus/StatusCode",
+	"Body/Data/DeviceStatus/ErrorCode",
+	"Body/Data/IAC_L1/Value",
+	"Body/Data/UAC_L1/Value",
+	"Body/Data/IAC_L2/Value",
+	"Body/Data/UAC_L2/Value",
+	"Body/Data/IAC_L3/Value",
+	"Body/Data/UAC_L3/Value"
+};
+
+static const int PathCount = static_cast<int>(sizeof(Paths) / sizeof(Paths[0]));
+
+/// Returns the JSON documents in the samples file. Each starts with a line containing '{' and ends
+/// with a line containing '}'.
+static QList<QByteArray> loadDocuments(const QString &fileName)
+{
+	QList<QByteArray> documents;
+	QFile file(fileName);
+	if (!file.open(QIODevice::ReadOnly))
+		return documents;
+	QByteArray document;
+	bool inDocument = false;
+	while (!file.atEnd()) {
+		QByteArray line = file.readLine();
+		QByteArray trimmed = line.trimmed();
+		if (!inDocument && trimmed == "{") {
+			inDocument = true;
+			document.clear();
+		}
+		if (inDocument) {
+			document.append(line);
+			if (trimmed == "}" && line.startsWith('}')) {
+				documents.append(document);
+				inDocument = false;
+			}
+		}
+	}
+	return documents;
+}
+
+static long residentSetKb()
+{
+	QFile file("/proc/self/status");
+	if (!file.open(QIODevice::ReadOnly))
+		return -1;
+	while (!file.atEnd()) {
+		QByteArray line = file.readLine();
+		if (line.startsWith("VmRSS:"))
+			return line.mid(6).trimmed().split(' ').first().toLong();
+	}
+	return -1;
+}
+
+/// The lookup as done by FroniusSolarApi before JsonReader was introduced.
+static QVariant getByPath(const QVariant &variant, const QString &path)
+{
+	QVariant m = variant;
+	QStringList spl = path.split('/');
+	for (QStringList::Iterator it = spl.begin(); it != spl.end(); ++it)
+		m = m.toMap()[*it];
+	return m;
+}
+
+static void runScript(const QList<QByteArray> &documents, QVector<double> &sums)
+{
+	foreach (const QByteArray &document, documents) {
+		QVariantMap map = JSON::instance().parse(QString::fromUtf8(document)).toMap();
+		for (int i=0; i<PathCount; ++i)
+			sums[i] += getByPath(map, Paths[i]).toDouble();
+	}
+}
+
+class SumHandler : public JsonHandler
+{
+public:
+	SumHandler(QVector<double> &sums):
+		mSums(sums)
+	{
+	}
+
+	virtual void onValue(int path, const QByteArray &key, const JsonValue &value)
+	{
+		Q_UNUSED(key)
+		mSums[path] += value.toDouble();
+	}
+
+private:
+	QVector<double> &mSums;
+};
+
+static bool runReader(JsonReader &reader, const QList<QByteArray> &documents,
+					  QVector<double> &sums)
+{
+	SumHandler handler(sums);
+	bool ok = true;
+	foreach (const QByteArray &document, documents)
+		ok = reader.read(document, handler) && ok;
+	return ok;
+}
+
+int main(int argc, char *argv[])
+{
+	QTextStream out(stdout);
+	QString fileName = argc > 1 ?
+		QString::fromLocal8Bit(argv[1]) :
+		QString(PRJ_DIR "/../documents/solar_api_samples.txt");
+	QList<QByteArray> documents = loadDocuments(fileName);
+	if (documents.isEmpty()) {
+		out << "No JSON documents found in " << fileName << endl;
+		return 1;
+	}
+	int parsed = Iterations * documents.size();
+	out << documents.size() << " documents, " << Iterations << " iterations" << endl;
+
+	long rssStart = residentSetKb();
+	JsonPaths paths(Paths, PathCount);
+	JsonReader reader(paths);
+	QVector<double> readerSums(PathCount, 0);
+	QVector<double> dummy(PathCount, 0);
+	// Warm up
+	if (!runReader(reader, documents, dummy)) {
+		out << "JsonReader: " << reader.errorString() << " at offset " << reader.errorOffset()
+			<< endl;
+		return 1;
+	}
+	QElapsedTimer timer;
+	timer.start();
+	for (int i=0; i<Iterations; ++i)
+		runReader(reader, documents, readerSums);
+	qint64 elapsed = timer.nsecsElapsed();
+	long rssReader = residentSetKb();
+	out << "JsonReader:    " << elapsed / parsed << " ns/document, RSS +"
+		<< rssReader - rssStart << " kB" << endl;
+
+	QVector<double> scriptSums(PathCount, 0);
+	runScript(documents, dummy);
+	timer.restart();
+	for (int i=0; i<Iterations; ++i)
+		runScript(documents, scriptSums);
+	elapsed = timer.nsecsElapsed();
+	long rssScript = residentSetKb();
+	out << "QScriptEngine: " << elapsed / parsed << " ns/document, RSS +"
+		<< rssScript - rssReader << " kB" << endl;
+
+	if (readerSums != scriptSums) {
+		out << "Values extracted by JsonReader and QScriptEngine differ" << endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,35 @@
+# Application version and revision
+VERSION = 0.1.0
+
+# suppress the mangling of va_arg has changed for gcc 4.4
+QMAKE_CXXFLAGS += -Wno-psabi
+
+# gcc 4.8 and newer don't like the QOMPILE_ASSERT in qt
+QMAKE_CXXFLAGS += -Wno-unused-local-typedefs
+
+MOC_DIR=.moc
+OBJECTS_DIR=.obj
+
+QT += core
+QT -= gui
+
+TARGET = modbus_frame_benchmark
+CONFIG += console
+CONFIG -= app_bundle
+DEFINES += VERSION=\\\"$${VERSION}\\\"
+
+TEMPLATE = app
+
+SRCDIR = ../software/src
+CLIENTDIR = $$SRCDIR/modbus_tcp_client
+APPDIR = ./modbus_frame_benchmark
+
+INCLUDEPATH += \
+    $$CLIENTDIR
+
+HEADERS += \
+    $$CLIENTDIR/modbus_tcp_frame_buffer.h
+
+SOURCES += \
+    $$CLIENTDIR/modbus_tcp_frame_buffer.cpp \
+    $$APPDIR/main.cpp
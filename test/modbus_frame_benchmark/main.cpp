@@ -0,0 +1,158 @@
+#include <stdlib.h>
+#include <string.h>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QTextStream>
+#include <QVector>
+#include "modbus_tcp_frame_buffer.h"
+
+// Compares the reassembly of Modbus TCP replies using the frame buffer used by ModbusTcpClient with
+// the append/remove approach it replaced. Heap allocations are counted by wrapping the glibc
+// allocator, so this benchmark only works on linux.
+
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t n, size_t size);
+void *__libc_realloc(void *p, size_t size);
+void __libc_free(void *p);
+
+static long allocationCount = 0;
+
+void *malloc(size_t size)
+{
+	++allocationCount;
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size)
+{
+	++allocationCount;
+	return __libc_calloc(n, size);
+}
+
+void *realloc(void *p, size_t size)
+{
+	++allocationCount;
+	return __libc_realloc(p, size);
+}
+
+void free(void *p)
+{
+	__libc_free(p);
+}
+}
+
+static const int RegisterCount = 125;
+static const int FrameCount = 64; // Number of pipelined replies in a single burst
+static const int ChunkSize = 1460; // Typical TCP segment payload
+static const int Iterations = 2000;
+
+static QByteArray createStream()
+{
+	QByteArray stream;
+	for (int t=0; t<FrameCount; ++t) {
+		stream.append(static_cast<char>(t >> 8));
+		stream.append(static_cast<char>(t & 0xFF));
+		stream.append(static_cast<char>(0));
+		stream.append(static_cast<char>(0));
+		int length = 3 + 2 * RegisterCount;
+		stream.append(static_cast<char>(length >> 8));
+		stream.append(static_cast<char>(length & 0xFF));
+		stream.append(static_cast<char>(1)); // unit id
+		stream.append(static_cast<char>(3)); // read holding registers
+		stream.append(static_cast<char>(2 * RegisterCount));
+		for (int r=0; r<RegisterCount; ++r) {
+			stream.append(static_cast<char>(r >> 8));
+			stream.append(static_cast<char>(r & 0xFF));
+		}
+	}
+	return stream;
+}
+
+static quint16 toUInt16(const QByteArray &a, int offset)
+{
+	return static_cast<quint16>((static_cast<quint8>(a[offset]) << 8) |
+		static_cast<quint8>(a[offset + 1]));
+}
+
+/// The reassembly algorithm as used by ModbusTcpClient before the frame buffer was introduced.
+static void runAppendRemove(const QByteArray &stream, int &checksum)
+{
+	QByteArray buffer;
+	int offset = 0;
+	while (offset < stream.size()) {
+		int n = qMin(ChunkSize, stream.size() - offset);
+		buffer.append(stream.mid(offset, n));
+		offset += n;
+		for (;;) {
+			if (buffer.size() < 6)
+				break;
+			int length = toUInt16(buffer, 4) + 6;
+			if (buffer.size() < length)
+				break;
+			int payloadSize = static_cast<quint8>(buffer[8]);
+			QVector<quint16> values;
+			for (int i0 = 9; i0 < 9 + payloadSize; i0 += 2)
+				values.append(toUInt16(buffer, i0));
+			checksum += values.last();
+			buffer.remove(0, length);
+		}
+	}
+}
+
+static void runFrameBuffer(ModbusTcpFrameBuffer &buffer, const QByteArray &stream,
+							 quint16 *registers, int &checksum)
+{
+	int offset = 0;
+	while (offset < stream.size()) {
+		char *dest = buffer.writePointer();
+		int n = qMin(qMin(ChunkSize, buffer.writeCapacity()), stream.size() - offset);
+		memcpy(dest, stream.constData() + offset, static_cast<size_t>(n));
+		buffer.commit(n);
+		offset += n;
+		ModbusTcpFrame frame;
+		while (buffer.nextFrame(frame)) {
+			int count = frame.byteAt(0) / 2;
+			for (int i=0; i<count; ++i)
+				registers[i] = frame.uint16At(1 + 2 * i);
+			checksum += registers[count - 1];
+		}
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	Q_UNUSED(argc)
+	Q_UNUSED(argv)
+	QTextStream out(stdout);
+	QByteArray stream = createStream();
+	int checksum = 0;
+	int replies = Iterations * FrameCount;
+
+	// Warm up, so one time allocations do not show up in the figures
+	runAppendRemove(stream, checksum);
+	QElapsedTimer timer;
+	long allocations = allocationCount;
+	timer.start();
+	for (int i=0; i<Iterations; ++i)
+		runAppendRemove(stream, checksum);
+	qint64 elapsed = timer.nsecsElapsed();
+	allocations = allocationCount - allocations;
+	out << "append/remove: " << elapsed / replies << " ns/reply, "
+		<< static_cast<double>(allocations) / replies << " allocations/reply" << endl;
+
+	ModbusTcpFrameBuffer buffer;
+	quint16 registers[RegisterCount];
+	runFrameBuffer(buffer, stream, registers, checksum);
+	allocations = allocationCount;
+	timer.restart();
+	for (int i=0; i<Iterations; ++i)
+		runFrameBuffer(buffer, stream, registers, checksum);
+	elapsed = timer.nsecsElapsed();
+	allocations = allocationCount - allocations;
+	out << "frame buffer:  " << elapsed / replies << " ns/reply, "
+		<< static_cast<double>(allocations) / replies << " allocations/reply" << endl;
+	out << "(checksum " << checksum << ")" << endl;
+
+	return allocations == 0 ? 0 : 1;
+}
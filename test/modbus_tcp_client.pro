@@ -38,11 +38,22 @@ INCLUDEPATH += \
     ../software/ext/velib/inc
 
 HEADERS += \
+    $$SRCDIR/latency_statistics.h \
+    $$SRCDIR/tcp_socket_options.h \
     $$CLIENTDIR/crc16.h \
     $$CLIENTDIR/modbus_client.h \
+    $$CLIENTDIR/modbus_request.h \
+    $$CLIENTDIR/modbus_object_pool.h \
     $$CLIENTDIR/modbus_tcp_client.h \
+    $$CLIENTDIR/modbus_tcp_frame_buffer.h \
+    $$CLIENTDIR/modbus_tcp_transport.h \
+    $$CLIENTDIR/modbus_spsc_queue.h \
+    $$CLIENTDIR/modbus_deadline_queue.h \
     $$CLIENTDIR/modbus_reply.h \
+    $$CLIENTDIR/modbus_register_view.h \
     $$CLIENTDIR/modbus_rtu_client.h \
+    $$CLIENTDIR/modbus_rtu_frame.h \
+    $$CLIENTDIR/modbus_rtu_tcp_client.h \
     $$APPDIR/app.h \
     $$APPDIR/arguments.h
 
@@ -51,11 +62,19 @@ SOURCES += \
     $$EXTDIR/velib/src/plt/posix_serial.c \
     $$EXTDIR/velib/src/plt/posix_ctx.c \
     $$EXTDIR/velib/src/types/ve_variant.c \
+    $$SRCDIR/latency_statistics.cpp \
+    $$SRCDIR/tcp_socket_options.cpp \
     $$CLIENTDIR/crc16.cpp \
     $$CLIENTDIR/modbus_client.cpp \
+    $$CLIENTDIR/modbus_request.cpp \
     $$CLIENTDIR/modbus_tcp_client.cpp \
+    $$CLIENTDIR/modbus_tcp_frame_buffer.cpp \
+    $$CLIENTDIR/modbus_tcp_transport.cpp \
+    $$CLIENTDIR/modbus_deadline_queue.cpp \
     $$CLIENTDIR/modbus_reply.cpp \
     $$CLIENTDIR/modbus_rtu_client.cpp \
+    $$CLIENTDIR/modbus_rtu_frame.cpp \
+    $$CLIENTDIR/modbus_rtu_tcp_client.cpp \
     $$APPDIR/app.cpp \
     $$APPDIR/arguments.cpp \
     $$APPDIR/main.cpp
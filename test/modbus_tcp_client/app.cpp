@@ -1,5 +1,6 @@
 #include <QTextStream>
 #include "modbus_tcp_client/modbus_rtu_client.h"
+#include "modbus_tcp_client/modbus_rtu_tcp_client.h"
 #include "modbus_tcp_client/modbus_tcp_client.h"
 #include "app.h"
 #include "arguments.h"
@@ -15,6 +16,7 @@ int App::parseOptions()
 	args.addArg("-s", "Server name");
 	args.addArg("-p", "TCP port");
 	args.addArg("-d", "Serial port");
+	args.addArg("-t", "Use RTU framing over TCP");
 	args.addArg("-r", "Register");
 	args.addArg("-c", "Register count");
 	args.addArg("-u", "Unit ID");
@@ -57,7 +59,12 @@ int App::parseOptions()
 	if (args.contains("d"))
 		serialPort = args.value("d");
 
-	if (serialPort.isEmpty()) {
+	if (args.contains("t")) {
+		ModbusRtuTcpClient *client = new ModbusRtuTcpClient(this);
+		connect(client, SIGNAL(connected()), this, SLOT(onConnected()));
+		client->connectToServer(server, port);
+		mClient = client;
+	} else if (serialPort.isEmpty()) {
 		ModbusTcpClient *client = new ModbusTcpClient(this);
 		connect(client, SIGNAL(connected()), this, SLOT(onConnected()));
 		client->connectToServer(server, port);
@@ -227,6 +227,81 @@ TEST_F(DataProcessorTest, ThreePhaseMultiple)
 	}
 }
 
+TEST_F(DataProcessorTest, L1PhaseSystemUpdate)
+{
+	setUpProcessor(PhaseL1);
+
+	InverterSystemValues values;
+	values.acPower = 512;
+	values.dayEnergy = 300;
+	values.yearEnergy = 20000;
+	values.totalEnergy = 34596.9;
+	mProcessor->process(values);
+
+	EXPECT_FLOAT_EQ(512, mInverter->meanPowerInfo()->power());
+	EXPECT_FLOAT_EQ(34.5969, mInverter->meanPowerInfo()->totalEnergy());
+	EXPECT_FLOAT_EQ(512, mInverter->l1PowerInfo()->power());
+	EXPECT_FLOAT_EQ(34.5969, mInverter->l1PowerInfo()->totalEnergy());
+	EXPECT_NAN(mInverter->l1PowerInfo()->current());
+	EXPECT_NAN(mInverter->l1PowerInfo()->voltage());
+}
+
+TEST_F(DataProcessorTest, ThreePhaseSystemUpdate)
+{
+	setUpProcessor(MultiPhase);
+
+	InverterSystemValues values;
+	values.acPower = 600;
+	values.dayEnergy = 300;
+	values.yearEnergy = 20000;
+	values.totalEnergy = 4321.9;
+	mProcessor->process(values);
+
+	// No phase weights yet
+	EXPECT_FLOAT_EQ(600, mInverter->meanPowerInfo()->power());
+	EXPECT_NAN(mInverter->l1PowerInfo()->power());
+
+	ThreePhasesInverterData tpd;
+	tpd.acCurrentPhase1 = 1;
+	tpd.acVoltagePhase1 = 200;
+	tpd.acCurrentPhase2 = 1;
+	tpd.acVoltagePhase2 = 200;
+	tpd.acCurrentPhase3 = 2;
+	tpd.acVoltagePhase3 = 200;
+	mProcessor->process(tpd);
+
+	values.acPower = 800;
+	mProcessor->process(values);
+
+	EXPECT_FLOAT_EQ(800, mInverter->meanPowerInfo()->power());
+	EXPECT_FLOAT_EQ(200, mInverter->l1PowerInfo()->power());
+	EXPECT_FLOAT_EQ(200, mInverter->l2PowerInfo()->power());
+	EXPECT_FLOAT_EQ(400, mInverter->l3PowerInfo()->power());
+	EXPECT_FLOAT_EQ(1, mInverter->l1PowerInfo()->current());
+}
+
+TEST_F(DataProcessorTest, ThreePhasePowerUpdate)
+{
+	setUpProcessor(MultiPhase);
+
+	ThreePhasesInverterData tpd;
+	tpd.acCurrentPhase1 = 1;
+	tpd.acVoltagePhase1 = 200;
+	tpd.acCurrentPhase2 = 3;
+	tpd.acVoltagePhase2 = 200;
+	tpd.acCurrentPhase3 = 0;
+	tpd.acVoltagePhase3 = 200;
+	mProcessor->process(tpd);
+
+	mProcessor->processPower(1000);
+
+	EXPECT_FLOAT_EQ(1000, mInverter->meanPowerInfo()->power());
+	EXPECT_FLOAT_EQ(250, mInverter->l1PowerInfo()->power());
+	EXPECT_FLOAT_EQ(750, mInverter->l2PowerInfo()->power());
+	EXPECT_FLOAT_EQ(0, mInverter->l3PowerInfo()->power());
+	EXPECT_NAN(mInverter->meanPowerInfo()->totalEnergy());
+}
+
 void DataProcessorTest::SetUp()
 {
 }
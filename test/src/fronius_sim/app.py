@@ -139,14 +139,34 @@ def get_inverter_realtime_data():
 			'Head': create_head({'Scope': scope}),
 			'Body': {
 				'Data': {
-					'PAC': {'Value': 3373, 'Unit': 'W'},
-					'DAY_ENERGY': {'Value': 8000, 'Unit': 'Wh'},
-					'YEAR_ENERGY': {'Value': 44000, 'Unit': 'Wh'},
-					'TOTAL_ENERGY': {'Value': 45000, 'Unit': 'Wh'}}}}
+					'PAC': {'Unit': 'W', 'Values': dict((x.id, x.main.power) for x in inverters)},
+					'DAY_ENERGY': {'Unit': 'Wh', 'Values': dict((x.id, 8000) for x in inverters)},
+					'YEAR_ENERGY': {'Unit': 'Wh', 'Values': dict((x.id, 44000) for x in inverters)},
+					'TOTAL_ENERGY': {'Unit': 'Wh', 'Values': dict((x.id, x.main.energy) for x in inverters)}}}}
 	else:
 		raise Exception('Unknown scope')
 
 
+@bottle.route('/solar_api/v1/GetPowerFlowRealtimeData.fcgi')
+def get_power_flow_realtime_data():
+	return {
+		'Head': create_head({}),
+		'Body': {
+			'Data': {
+				'Inverters': dict((x.id, {
+					'DT': x.device_type,
+					'P': x.main.power,
+					'E_Day': 8000,
+					'E_Year': 44000,
+					'E_Total': x.main.energy})
+					for x in inverters),
+				'Site': {
+					'Mode': 'produce-only',
+					'P_Grid': None,
+					'P_Load': None,
+					'P_PV': sum(x.main.power for x in inverters)}}}}
+
+
 def create_head(args, error_code=0, error_message=''):
 	return {
 		'RequestArguments': args,
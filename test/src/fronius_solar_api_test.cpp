@@ -20,6 +20,10 @@ FroniusSolarApiTest::FroniusSolarApiTest(QObject *parent) :
 			this, SLOT(onCommonDataFound(CommonInverterData)));
 	connect(&mApi, SIGNAL(threePhasesDataFound(ThreePhasesInverterData)),
 			this, SLOT(onThreePhasesDataFound(ThreePhasesInverterData)));
+	connect(&mApi, SIGNAL(systemDataFound(SystemInverterData)),
+			this, SLOT(onSystemDataFound(SystemInverterData)));
+	connect(&mApi, SIGNAL(powerFlowDataFound(PowerFlowData)),
+			this, SLOT(onPowerFlowDataFound(PowerFlowData)));
 }
 
 void FroniusSolarApiTest::onConverterInfoFound(const InverterListData &data)
@@ -37,6 +41,16 @@ void FroniusSolarApiTest::onThreePhasesDataFound(const ThreePhasesInverterData &
 	m3PData.reset(new ThreePhasesInverterData(data));
 }
 
+void FroniusSolarApiTest::onSystemDataFound(const SystemInverterData &data)
+{
+	mSystemData.reset(new SystemInverterData(data));
+}
+
+void FroniusSolarApiTest::onPowerFlowDataFound(const PowerFlowData &data)
+{
+	mPowerFlowData.reset(new PowerFlowData(data));
+}
+
 void FroniusSolarApiTest::SetUpTestCase()
 {
 	mProcess = new QProcess();
@@ -111,3 +125,74 @@ TEST_F(FroniusSolarApiTest, getThreePhasesInverterDataSinglePhase)
 	EXPECT_EQ(SolarApiReply::ApiError, m3PData->error);
 	EXPECT_FALSE(m3PData->errorMessage.isEmpty());
 }
+
+TEST_F(FroniusSolarApiTest, getSystemData)
+{
+	mApi.getSystemDataAsync();
+	waitForCompletion(mSystemData);
+
+	EXPECT_EQ(SolarApiReply::NoError, mSystemData->error);
+	EXPECT_TRUE(mSystemData->errorMessage.isEmpty());
+	ASSERT_EQ(3, mSystemData->inverters.size());
+	EXPECT_TRUE(mSystemData->inverters.contains(1));
+	const InverterSystemValues &v = mSystemData->inverters[2];
+	EXPECT_EQ(8000.0, v.dayEnergy);
+	EXPECT_EQ(44000.0, v.yearEnergy);
+	EXPECT_GE(v.acPower, 0);
+	EXPECT_GE(v.totalEnergy, 0);
+}
+
+TEST_F(FroniusSolarApiTest, getPowerFlowData)
+{
+	mApi.getPowerFlowDataAsync();
+	waitForCompletion(mPowerFlowData);
+
+	EXPECT_EQ(SolarApiReply::NoError, mPowerFlowData->error);
+	EXPECT_TRUE(mPowerFlowData->errorMessage.isEmpty());
+	ASSERT_EQ(3, mPowerFlowData->inverterPower.size());
+	EXPECT_TRUE(mPowerFlowData->inverterPower.contains(1));
+	EXPECT_GE(mPowerFlowData->inverterPower[2], 0);
+}
+
+TEST_F(FroniusSolarApiTest, sharedSession)
+{
+	FroniusSolarApi api2("localhost", 8080, 15000);
+	connect(&api2, SIGNAL(converterInfoFound(InverterListData)),
+			this, SLOT(onConverterInfoFound(InverterListData)));
+	mCommonData.reset();
+	mInverterListData.reset();
+	// Both requests are handled by the same session.
+	mApi.getCommonDataAsync(2);
+	api2.getConverterInfoAsync();
+	while (mCommonData.isNull() || mInverterListData.isNull())
+		qWait(10);
+
+	EXPECT_EQ(SolarApiReply::NoError, mCommonData->error);
+	EXPECT_EQ(SolarApiReply::NoError, mInverterListData->error);
+	EXPECT_EQ(3, mInverterListData->inverters.size());
+}
+
+TEST_F(FroniusSolarApiTest, concurrentRequests)
+{
+	mCommonData.reset();
+	m3PData.reset();
+	mSystemData.reset();
+	SolarApiRequest common = mApi.getCommonDataAsync(2);
+	SolarApiRequest threePhases = mApi.getThreePhasesInverterDataAsync(2, 5000);
+	SolarApiRequest system = mApi.getSystemDataAsync();
+	EXPECT_EQ(SolarApiRequest::CommonData, common.type());
+	EXPECT_EQ(SolarApiRequest::ThreePhasesData, threePhases.type());
+	EXPECT_EQ(3, mApi.pendingRequestCount());
+	mApi.cancel(system);
+	EXPECT_EQ(2, mApi.pendingRequestCount());
+	while (mCommonData.isNull() || m3PData.isNull())
+		qWait(10);
+	qWait(100);
+
+	EXPECT_EQ(SolarApiReply::NoError, mCommonData->error);
+	EXPECT_EQ(common.id(), mCommonData->requestId);
+	EXPECT_EQ(SolarApiReply::NoError, m3PData->error);
+	EXPECT_EQ(threePhases.id(), m3PData->requestId);
+	EXPECT_TRUE(mSystemData.isNull());
+	EXPECT_EQ(0, mApi.pendingRequestCount());
+}
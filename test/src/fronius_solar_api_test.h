@@ -29,6 +29,10 @@ public slots:
 
 	void onThreePhasesDataFound(const ThreePhasesInverterData &data);
 
+	void onSystemDataFound(const SystemInverterData &data);
+
+	void onPowerFlowDataFound(const PowerFlowData &data);
+
 protected:
 	/*! Per-test-case set-up.
 	 * Called before the first test in this test case.
@@ -60,6 +64,8 @@ protected:
 	QScopedPointer<InverterListData> mInverterListData;
 	QScopedPointer<CommonInverterData> mCommonData;
 	QScopedPointer<ThreePhasesInverterData> m3PData;
+	QScopedPointer<SystemInverterData> mSystemData;
+	QScopedPointer<PowerFlowData> mPowerFlowData;
 
 private:
 	static QProcess *mProcess;
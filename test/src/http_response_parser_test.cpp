@@ -0,0 +1,123 @@
+#include <gtest/gtest.h>
+#include "http_response_parser.h"
+
+/// Feeds `data` to the parser in pieces of `pieceSize` bytes. Returns the number of bytes consumed.
+static int parseInPieces(HttpResponseParser &parser, const QByteArray &data, int pieceSize)
+{
+	int consumed = 0;
+	while (consumed < data.size()) {
+		int size = qMin(pieceSize, data.size() - consumed);
+		int count = parser.parse(data.constData() + consumed, size);
+		consumed += count;
+		if (count < size)
+			break;
+	}
+	return consumed;
+}
+
+TEST(HttpResponseParserTest, ContentLength)
+{
+	QByteArray reply =
+		"HTTP/1.1 200 OK\r\n"
+		"Content-Type: application/json\r\n"
+		"content-length: 11\r\n"
+		"\r\n"
+		"{\"a\": true}";
+	// Byte by byte, and at once.
+	for (int pieceSize=1; pieceSize<=reply.size(); pieceSize+=reply.size() - 1) {
+		HttpResponseParser parser;
+		EXPECT_EQ(reply.size(), parseInPieces(parser, reply, pieceSize));
+		EXPECT_TRUE(parser.headerComplete());
+		ASSERT_TRUE(parser.isComplete());
+		EXPECT_EQ(200, parser.statusCode());
+		EXPECT_TRUE(parser.keepAlive());
+		EXPECT_EQ(QByteArray("{\"a\": true}"), parser.body());
+	}
+}
+
+TEST(HttpResponseParserTest, Chunked)
+{
+	QByteArray reply =
+		"HTTP/1.1 200 OK\r\n"
+		"Transfer-Encoding: chunked\r\n"
+		"\r\n"
+		"5;name=value\r\n"
+		"{\"a\":\r\n"
+		"6\r\n"
+		" true}\r\n"
+		"0\r\n"
+		"Trailer: x\r\n"
+		"\r\n"
+		"HTTP/1.1";
+	for (int pieceSize=1; pieceSize<=reply.size(); pieceSize+=reply.size() - 1) {
+		HttpResponseParser parser;
+		// The start of the next reply is not consumed.
+		EXPECT_EQ(reply.size() - 8, parseInPieces(parser, reply, pieceSize));
+		ASSERT_TRUE(parser.isComplete());
+		EXPECT_EQ(QByteArray("{\"a\": true}"), parser.takeBody());
+		EXPECT_TRUE(parser.body().isEmpty());
+	}
+}
+
+TEST(HttpResponseParserTest, ConnectionHandling)
+{
+	HttpResponseParser parser;
+	QByteArray reply = "HTTP/1.1 404 Not Found\r\nConnection: close\r\nContent-Length: 0\r\n\r\n";
+	parser.parse(reply.constData(), reply.size());
+	ASSERT_TRUE(parser.isComplete());
+	EXPECT_EQ(404, parser.statusCode());
+	EXPECT_FALSE(parser.keepAlive());
+
+	parser.reset();
+	reply = "HTTP/1.0 200 OK\r\nConnection: Keep-Alive\r\nContent-Length: 0\r\n\r\n";
+	parser.parse(reply.constData(), reply.size());
+	ASSERT_TRUE(parser.isComplete());
+	EXPECT_TRUE(parser.keepAlive());
+
+	// Without length, the body ends with the connection.
+	parser.reset();
+	reply = "HTTP/1.0 200 OK\r\n\r\n{}";
+	EXPECT_EQ(reply.size(), parser.parse(reply.constData(), reply.size()));
+	EXPECT_FALSE(parser.isComplete());
+	EXPECT_TRUE(parser.setEndOfStream());
+	EXPECT_FALSE(parser.keepAlive());
+	EXPECT_EQ(QByteArray("{}"), parser.body());
+
+	// Interim replies are skipped.
+	parser.reset();
+	reply = "HTTP/1.1 100 Continue\r\n\r\nHTTP/1.1 204 No Content\r\n\r\n";
+	parser.parse(reply.constData(), reply.size());
+	ASSERT_TRUE(parser.isComplete());
+	EXPECT_EQ(204, parser.statusCode());
+}
+
+TEST(HttpResponseParserTest, Errors)
+{
+	const char *const replies[] = {
+		"SSH-2.0-OpenSSH_7.4\r\n",
+		"HTTP/1.1 abc OK\r\n",
+		"HTTP/1.1 200 OK\r\nNo colon\r\n",
+		"HTTP/1.1 200 OK\r\nContent-Length: -1\r\n",
+		"HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\nxyz\r\n",
+		"HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n1\r\nab\r\n",
+		"HTTP/1.1 200 OK\r\nContent-Length: 100000000\r\n\r\n"
+	};
+	for (size_t i=0; i<sizeof(replies) / sizeof(replies[0]); ++i) {
+		HttpResponseParser parser;
+		parser.parse(replies[i], static_cast<int>(strlen(replies[i])));
+		EXPECT_TRUE(parser.hasError()) << replies[i];
+		EXPECT_FALSE(parser.errorString().isEmpty());
+	}
+
+	HttpResponseParser parser;
+	QByteArray line(HttpResponseParser::MaxLineLength + 1, 'x');
+	parser.parse(line.constData(), line.size());
+	EXPECT_TRUE(parser.hasError());
+
+	// Connection closed halfway the body.
+	parser.reset();
+	QByteArray reply = "HTTP/1.1 200 OK\r\nContent-Length: 10\r\n\r\n{}";
+	parser.parse(reply.constData(), reply.size());
+	EXPECT_FALSE(parser.setEndOfStream());
+	EXPECT_TRUE(parser.hasError());
+}
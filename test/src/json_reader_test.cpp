@@ -0,0 +1,99 @@
+#include <gtest/gtest.h>
+#include <QMap>
+#include "json/json_reader.h"
+
+class ValueRecorder : public JsonHandler
+{
+public:
+	virtual void onValue(int path, const QByteArray &key, const JsonValue &value)
+	{
+		paths.append(path);
+		keys.append(key);
+		values.append(value.toString());
+		numbers.append(value.toDouble());
+	}
+
+	QList<int> paths;
+	QList<QByteArray> keys;
+	QList<QString> values;
+	QList<double> numbers;
+};
+
+TEST(JsonReaderTest, ExtractPaths)
+{
+	const char *const p[] = { "Head/Status/Code", "Body/Data/PAC/Value", "Body/Data/PAC/Unit" };
+	JsonPaths paths(p, 3);
+	JsonReader reader(paths);
+	ValueRecorder recorder;
+	QByteArray json =
+		"{ \"Head\": { \"Status\": { \"Code\": 0, \"Reason\": \"\" } },\n"
+		"  \"Body\": { \"Data\": {\n"
+		"    \"IAC\": { \"Value\": 0.98, \"Unit\": \"A\" },\n"
+		"    \"PAC\": { \"Unit\": \"W\", \"Value\": 225.5 },\n"
+		"    \"List\": [ 1, { \"PAC\": 3 }, [] ] } } }";
+	EXPECT_TRUE(reader.read(json, recorder));
+	EXPECT_TRUE(reader.errorString().isEmpty());
+	ASSERT_EQ(3, recorder.paths.size());
+	EXPECT_EQ(0, recorder.paths[0]);
+	EXPECT_EQ(0.0, recorder.numbers[0]);
+	EXPECT_EQ(2, recorder.paths[1]);
+	EXPECT_EQ(QString("W"), recorder.values[1]);
+	EXPECT_EQ(1, recorder.paths[2]);
+	EXPECT_EQ(225.5, recorder.numbers[2]);
+}
+
+TEST(JsonReaderTest, Wildcard)
+{
+	const char *const p[] = { "Body/Data/*/Serial" };
+	JsonPaths paths(p, 1);
+	JsonReader reader(paths);
+	ValueRecorder recorder;
+	QByteArray json =
+		"{\"Body\":{\"Data\":{\"1\":{\"Serial\":\"S1\"},\"2\":{\"Other\":1},\"55\":{\"Serial\":476}}}}";
+	EXPECT_TRUE(reader.read(json, recorder));
+	ASSERT_EQ(2, recorder.paths.size());
+	EXPECT_EQ(QByteArray("1"), recorder.keys[0]);
+	EXPECT_EQ(QString("S1"), recorder.values[0]);
+	EXPECT_EQ(QByteArray("55"), recorder.keys[1]);
+	EXPECT_EQ(QString("476"), recorder.values[1]);
+}
+
+TEST(JsonReaderTest, Values)
+{
+	const char *const p[] = { "a", "b", "c", "d", "e", "f", "g" };
+	JsonPaths paths(p, 7);
+	JsonReader reader(paths);
+	ValueRecorder recorder;
+	QByteArray json =
+		"{\"a\":-12.5e2,\"b\":true,\"c\":null,\"d\":\"x\\\"\\n\\u00e9\\ud83d\\ude00\","
+		"\"e\":0.1,\"f\":12345678901234567890,\"g\":1E-3}";
+	EXPECT_TRUE(reader.read(json, recorder));
+	ASSERT_EQ(7, recorder.paths.size());
+	EXPECT_EQ(-1250.0, recorder.numbers[0]);
+	EXPECT_EQ(QString("true"), recorder.values[1]);
+	EXPECT_TRUE(recorder.values[2].isNull());
+	EXPECT_EQ(QString::fromUtf8("x\"\n\xc3\xa9\xf0\x9f\x98\x80"), recorder.values[3]);
+	EXPECT_EQ(0.1, recorder.numbers[4]);
+	EXPECT_EQ(12345678901234567890.0, recorder.numbers[5]);
+	EXPECT_EQ(0.001, recorder.numbers[6]);
+}
+
+TEST(JsonReaderTest, InvalidDocuments)
+{
+	const char *const p[] = { "a" };
+	JsonPaths paths(p, 1);
+	JsonReader reader(paths);
+	ValueRecorder recorder;
+	EXPECT_FALSE(reader.read(QByteArray(), recorder));
+	EXPECT_FALSE(reader.read("{\"a\":1", recorder));
+	EXPECT_FALSE(reader.read("{\"a\":1,}", recorder));
+	EXPECT_FALSE(reader.read("{\"b\":[1 2]}", recorder));
+	EXPECT_FALSE(reader.read("{\"b\":\"\\x\"}", recorder));
+	EXPECT_FALSE(reader.read("{\"a\":tru}", recorder));
+	EXPECT_FALSE(reader.read("{\"a\":1} x", recorder));
+	EXPECT_EQ(8, reader.errorOffset());
+	EXPECT_FALSE(reader.errorString().isEmpty());
+	EXPECT_FALSE(reader.read("<html></html>", recorder));
+	QByteArray deep(100, '[');
+	EXPECT_FALSE(reader.read("{\"b\":" + deep + "}", recorder));
+}
@@ -0,0 +1,77 @@
+#include <gtest/gtest.h>
+#include "latency_statistics.h"
+
+TEST(LatencyHistogramTest, BucketIndex)
+{
+	EXPECT_EQ(0, LatencyHistogram::bucketIndex(0));
+	EXPECT_EQ(1, LatencyHistogram::bucketIndex(1));
+	EXPECT_EQ(2, LatencyHistogram::bucketIndex(2));
+	EXPECT_EQ(2, LatencyHistogram::bucketIndex(3));
+	EXPECT_EQ(3, LatencyHistogram::bucketIndex(4));
+	EXPECT_EQ(10, LatencyHistogram::bucketIndex(1000));
+	EXPECT_EQ(LatencyHistogram::BucketCount - 1, LatencyHistogram::bucketIndex(10000000));
+}
+
+TEST(LatencyHistogramTest, Percentiles)
+{
+	LatencyHistogram h;
+	EXPECT_EQ(-1, h.percentile(50));
+	for (int i=0; i<90; ++i)
+		h.add(10);
+	for (int i=0; i<10; ++i)
+		h.add(300);
+	EXPECT_EQ(100, h.count());
+	EXPECT_EQ(16, h.percentile(50));
+	EXPECT_EQ(16, h.percentile(90));
+	EXPECT_EQ(512, h.percentile(91));
+	EXPECT_EQ(512, h.percentile(99));
+}
+
+TEST(LatencyStatisticsTest, RecordStages)
+{
+	LatencyStatistics::Timestamps t;
+	t.enqueued = 100;
+	t.written = 120;
+	t.firstByte = 170;
+	t.completed = 171;
+	LatencyStatistics::Entry *entry = LatencyStatistics::instance().entry("Test/RecordStages");
+	entry->record(t);
+	EXPECT_EQ(32, entry->histogram(LatencyStatistics::QueueStage).percentile(50));
+	EXPECT_EQ(64, entry->histogram(LatencyStatistics::WaitStage).percentile(50));
+	EXPECT_EQ(2, entry->histogram(LatencyStatistics::ReceiveStage).percentile(50));
+	EXPECT_EQ(128, entry->histogram(LatencyStatistics::TotalStage).percentile(50));
+	EXPECT_EQ(entry, LatencyStatistics::instance().entry("Test/RecordStages"));
+}
+
+TEST(LatencyStatisticsTest, MissingTimestamps)
+{
+	LatencyStatistics::Timestamps t;
+	t.enqueued = 100;
+	t.completed = 1100;
+	LatencyStatistics::Entry *entry = LatencyStatistics::instance().entry("Test/Missing");
+	entry->record(t);
+	EXPECT_EQ(0, entry->histogram(LatencyStatistics::WaitStage).count());
+	EXPECT_EQ(1, entry->histogram(LatencyStatistics::TotalStage).count());
+}
+
+TEST(LatencyStatisticsTest, PathElement)
+{
+	EXPECT_EQ(QString("192_168_1_10"), LatencyStatistics::toPathElement("192.168.1.10"));
+	EXPECT_EQ(QString("fronius_lan"), LatencyStatistics::toPathElement("fronius-lan"));
+}
+
+TEST(LatencyHistogramTest, SnapshotDifference)
+{
+	LatencyHistogram h;
+	for (int i=0; i<100; ++i)
+		h.add(300);
+	LatencyHistogram::Snapshot before = h.snapshot();
+	EXPECT_EQ(100, before.count());
+	h.add(10);
+	h.add(10);
+	LatencyHistogram::Snapshot interval = h.snapshot() - before;
+	// Only the values added after the first snapshot are left.
+	EXPECT_EQ(2, interval.count());
+	EXPECT_EQ(16, interval.percentile(99));
+	EXPECT_EQ(-1, (h.snapshot() - h.snapshot()).percentile(50));
+}
@@ -0,0 +1,59 @@
+#include <gtest/gtest.h>
+#include "modbus_tcp_client/modbus_deadline_queue.h"
+
+static const int Tags[8] = { 0 };
+
+TEST(ModbusDeadlineQueueTest, PopInOrder)
+{
+	ModbusDeadlineQueue queue;
+	queue.push(300, 3, &Tags[3]);
+	queue.push(100, 1, &Tags[1]);
+	queue.push(200, 2, &Tags[2]);
+	EXPECT_EQ(100, queue.nextDeadline());
+	ModbusDeadlineQueue::Entry entry;
+	EXPECT_FALSE(queue.popExpired(99, entry));
+	ASSERT_TRUE(queue.popExpired(250, entry));
+	EXPECT_EQ(1, entry.transactionId);
+	EXPECT_EQ(&Tags[1], entry.tag);
+	ASSERT_TRUE(queue.popExpired(250, entry));
+	EXPECT_EQ(2, entry.transactionId);
+	EXPECT_FALSE(queue.popExpired(250, entry));
+	EXPECT_EQ(1, queue.size());
+}
+
+TEST(ModbusDeadlineQueueTest, Remove)
+{
+	ModbusDeadlineQueue queue;
+	for (int i=0; i<8; ++i)
+		queue.push(100 * (8 - i), static_cast<quint16>(i), &Tags[i]);
+	// Completed transactions no longer hold the earliest deadline.
+	EXPECT_TRUE(queue.remove(&Tags[7]));
+	EXPECT_FALSE(queue.remove(&Tags[7]));
+	EXPECT_TRUE(queue.remove(&Tags[3]));
+	EXPECT_EQ(6, queue.size());
+	EXPECT_EQ(200, queue.nextDeadline());
+	ModbusDeadlineQueue::Entry entry;
+	qint64 previous = 0;
+	while (queue.popExpired(1000, entry)) {
+		EXPECT_NE(&Tags[3], entry.tag);
+		EXPECT_LE(previous, entry.deadline);
+		previous = entry.deadline;
+	}
+	EXPECT_TRUE(queue.isEmpty());
+}
+
+TEST(ModbusDeadlineQueueTest, PushReplaces)
+{
+	ModbusDeadlineQueue queue;
+	queue.push(100, 1, &Tags[1]);
+	queue.push(200, 2, &Tags[2]);
+	// Same tag, used for a new transaction.
+	queue.push(300, 5, &Tags[1]);
+	EXPECT_EQ(2, queue.size());
+	ModbusDeadlineQueue::Entry entry;
+	ASSERT_TRUE(queue.popExpired(1000, entry));
+	EXPECT_EQ(2, entry.transactionId);
+	ASSERT_TRUE(queue.popExpired(1000, entry));
+	EXPECT_EQ(5, entry.transactionId);
+	EXPECT_TRUE(queue.isEmpty());
+}
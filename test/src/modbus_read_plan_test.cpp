@@ -0,0 +1,102 @@
+#include <QElapsedTimer>
+#include <gtest/gtest.h>
+#include "modbus_stand_in_server.h"
+#include "modbus_tcp_client/modbus_read_plan.h"
+#include "modbus_tcp_client/modbus_tcp_client.h"
+#include "test_helper.h"
+
+typedef QList<ModbusRegisterRange> RangeList;
+
+static RangeList plan(const RangeList &ranges, int gapTolerance, int maxCount = 125)
+{
+	return ModbusReadPlan::plan(ranges, gapTolerance, maxCount);
+}
+
+TEST(ModbusReadPlanTest, MergeAdjacent)
+{
+	RangeList ranges;
+	ranges << ModbusRegisterRange(30775, 10) << ModbusRegisterRange(30769, 6)
+		   << ModbusRegisterRange(30795, 2);
+	RangeList requests = plan(ranges, 0);
+	ASSERT_EQ(2, requests.size());
+	EXPECT_EQ(ModbusRegisterRange(30769, 16), requests[0]);
+	EXPECT_EQ(ModbusRegisterRange(30795, 2), requests[1]);
+}
+
+TEST(ModbusReadPlanTest, MergeWithinGapTolerance)
+{
+	RangeList ranges;
+	ranges << ModbusRegisterRange(30769, 16) << ModbusRegisterRange(30795, 2)
+		   << ModbusRegisterRange(30957, 6);
+	RangeList requests = plan(ranges, 10);
+	ASSERT_EQ(2, requests.size());
+	EXPECT_EQ(ModbusRegisterRange(30769, 28), requests[0]);
+	EXPECT_EQ(ModbusRegisterRange(30957, 6), requests[1]);
+}
+
+TEST(ModbusReadPlanTest, MergeOverlapping)
+{
+	RangeList ranges;
+	ranges << ModbusRegisterRange(100, 10) << ModbusRegisterRange(102, 3)
+		   << ModbusRegisterRange(105, 10);
+	RangeList requests = plan(ranges, 0);
+	ASSERT_EQ(1, requests.size());
+	EXPECT_EQ(ModbusRegisterRange(100, 15), requests[0]);
+}
+
+TEST(ModbusReadPlanTest, RespectMaxCount)
+{
+	RangeList ranges;
+	ranges << ModbusRegisterRange(0, 100) << ModbusRegisterRange(100, 30);
+	RangeList requests = plan(ranges, 0);
+	// The second range should not be split over two requests
+	ASSERT_EQ(2, requests.size());
+	EXPECT_EQ(ModbusRegisterRange(0, 100), requests[0]);
+	EXPECT_EQ(ModbusRegisterRange(100, 30), requests[1]);
+}
+
+TEST(ModbusReadPlanTest, SplitLargeRange)
+{
+	RangeList ranges;
+	ranges << ModbusRegisterRange(1000, 300);
+	RangeList requests = plan(ranges, 0);
+	ASSERT_EQ(3, requests.size());
+	EXPECT_EQ(ModbusRegisterRange(1000, 125), requests[0]);
+	EXPECT_EQ(ModbusRegisterRange(1125, 125), requests[1]);
+	EXPECT_EQ(ModbusRegisterRange(1250, 50), requests[2]);
+}
+
+TEST(ModbusReadPlanTest, RegistersOfSplitRange)
+{
+	ModbusStandInServer server;
+	quint16 port = server.listen();
+	ASSERT_NE(0, port);
+	// The value of each register is its address.
+	for (quint16 i=0; i<300; ++i)
+		server.registers.insert(static_cast<quint16>(1000 + i), static_cast<quint16>(1000 + i));
+	ModbusTcpClient client;
+	client.connectToServer("127.0.0.1", port);
+	QElapsedTimer timer;
+	timer.start();
+	while (!client.isConnected() && timer.elapsed() < 5000)
+		qWait(10);
+	ASSERT_TRUE(client.isConnected());
+	ModbusReadPlan plan(&client, 1);
+	plan.addRange(1000, 300);
+	plan.start();
+	while (!plan.isFinished() && timer.elapsed() < 5000)
+		qWait(10);
+	ASSERT_TRUE(plan.isFinished());
+	ASSERT_EQ(3, server.requests.size());
+	// The range is retrieved as a whole, although it was read in 3 requests.
+	ModbusRegisterView values = plan.registers(1000, 300);
+	ASSERT_EQ(300, values.size());
+	for (int i=0; i<300; ++i)
+		EXPECT_EQ(1000 + i, values[i]);
+	ModbusRegisterView part = plan.registers(1120, 10);
+	ASSERT_EQ(10, part.size());
+	EXPECT_EQ(1120, part[0]);
+	EXPECT_EQ(1129, part[9]);
+	EXPECT_TRUE(plan.contains(1000, 300));
+	EXPECT_FALSE(plan.contains(1290, 20));
+}
@@ -0,0 +1,173 @@
+#include <QList>
+#include <gtest/gtest.h>
+#include "modbus_tcp_client/modbus_client.h"
+#include "modbus_tcp_client/modbus_register_cache.h"
+#include "test_helper.h"
+
+class FakeReply : public ModbusReply
+{
+public:
+	FakeReply(QObject *parent = 0):
+		ModbusReply(parent),
+		mFinished(false)
+	{}
+
+	using ModbusReply::setResult;
+
+	virtual bool isFinished() const
+	{
+		return mFinished;
+	}
+
+private:
+	virtual void onFinished()
+	{
+		mFinished = true;
+	}
+
+	bool mFinished;
+};
+
+/// Records all reads. The replies are finished by the test.
+class FakeModbusClient : public ModbusClient
+{
+public:
+	virtual ModbusReply *readHoldingRegisters(quint8, quint16, quint16)
+	{
+		FakeReply *reply = new FakeReply(this);
+		reads.append(reply);
+		return reply;
+	}
+
+	virtual ModbusReply *readInputRegisters(quint8, quint16, quint16)
+	{
+		return 0;
+	}
+
+	virtual ModbusReply *writeSingleHoldingRegister(quint8, quint16, quint16)
+	{
+		return 0;
+	}
+
+	virtual ModbusReply *writeMultipleHoldingRegisters(quint8, quint16, const QVector<quint16> &)
+	{
+		return 0;
+	}
+
+	virtual ModbusReply *readWriteMultipleRegisters(quint8, quint16, quint16, quint16,
+													const QVector<quint16> &)
+	{
+		return 0;
+	}
+
+	virtual int timeout() const
+	{
+		return 1000;
+	}
+
+	virtual void setTimeout(int)
+	{
+	}
+
+	QList<FakeReply *> reads;
+
+protected:
+	virtual void cancelTransaction(ModbusReply *)
+	{
+	}
+};
+
+static QVector<quint16> createValues(quint16 first, int count)
+{
+	QVector<quint16> values;
+	for (int i=0; i<count; ++i)
+		values.append(static_cast<quint16>(first + i));
+	return values;
+}
+
+TEST(ModbusRegisterCacheTest, CacheHit)
+{
+	FakeModbusClient client;
+	ModbusRegisterCache cache;
+	ModbusReply *reply = cache.readHoldingRegisters(&client, "host", 1, 40002, 4, 10000);
+	ASSERT_EQ(1, client.reads.size());
+	client.reads[0]->setResult(createValues(7, 4));
+	EXPECT_EQ(1, cache.count());
+	delete reply;
+
+	reply = cache.readHoldingRegisters(&client, "host", 1, 40002, 4, 10000);
+	EXPECT_EQ(1, client.reads.size());
+	// Cached replies are finished from the event loop.
+	EXPECT_FALSE(reply->isFinished());
+	qWait(10);
+	ASSERT_TRUE(reply->isFinished());
+	EXPECT_EQ(ModbusReply::NoException, reply->error());
+	EXPECT_EQ(createValues(7, 4), reply->registers());
+	delete reply;
+
+	// Different range, unit or host
+	cache.readHoldingRegisters(&client, "host", 1, 40002, 5, 10000);
+	cache.readHoldingRegisters(&client, "host", 2, 40002, 4, 10000);
+	cache.readHoldingRegisters(&client, "other", 1, 40002, 4, 10000);
+	EXPECT_EQ(4, client.reads.size());
+}
+
+TEST(ModbusRegisterCacheTest, Expire)
+{
+	FakeModbusClient client;
+	ModbusRegisterCache cache;
+	cache.readHoldingRegisters(&client, "host", 1, 40002, 4, 20);
+	client.reads[0]->setResult(createValues(7, 4));
+	qWait(40);
+	cache.readHoldingRegisters(&client, "host", 1, 40002, 4, 20);
+	EXPECT_EQ(2, client.reads.size());
+}
+
+TEST(ModbusRegisterCacheTest, RemoveExpiredOnInsert)
+{
+	FakeModbusClient client;
+	ModbusRegisterCache cache;
+	cache.readHoldingRegisters(&client, "host", 1, 40002, 4, 20);
+	cache.readHoldingRegisters(&client, "other", 1, 40002, 4, 20);
+	cache.readHoldingRegisters(&client, "host", 1, 40070, 2, 10000);
+	client.reads[0]->setResult(createValues(7, 4));
+	client.reads[1]->setResult(createValues(7, 4));
+	EXPECT_EQ(2, cache.count());
+	qWait(40);
+	// The expired entries are never read again, but are removed when a new entry is added.
+	client.reads[2]->setResult(createValues(7, 2));
+	EXPECT_EQ(1, cache.count());
+}
+
+TEST(ModbusRegisterCacheTest, ErrorsAreNotCached)
+{
+	FakeModbusClient client;
+	ModbusRegisterCache cache;
+	cache.readHoldingRegisters(&client, "host", 1, 40002, 4, 10000);
+	client.reads[0]->setResult(ModbusReply::Timeout);
+	EXPECT_EQ(0, cache.count());
+	cache.readHoldingRegisters(&client, "host", 1, 40002, 4, 10000);
+	EXPECT_EQ(2, client.reads.size());
+}
+
+TEST(ModbusRegisterCacheTest, Invalidate)
+{
+	FakeModbusClient client;
+	ModbusRegisterCache cache;
+	cache.readHoldingRegisters(&client, "host", 1, 40002, 4, 10000);
+	cache.readHoldingRegisters(&client, "host", 2, 40002, 4, 10000);
+	client.reads[0]->setResult(createValues(7, 4));
+	client.reads[1]->setResult(createValues(7, 4));
+	EXPECT_EQ(2, cache.count());
+	cache.invalidate("host", 1);
+	EXPECT_EQ(1, cache.count());
+
+	// Reads in flight during invalidation may return stale data.
+	cache.readHoldingRegisters(&client, "host", 1, 40002, 4, 10000);
+	cache.invalidate("host", 1);
+	client.reads[2]->setResult(createValues(7, 4));
+	EXPECT_EQ(1, cache.count());
+
+	cache.invalidate("host");
+	EXPECT_EQ(0, cache.count());
+}
@@ -0,0 +1,92 @@
+#include <gtest/gtest.h>
+#include "modbus_tcp_client/modbus_object_pool.h"
+#include "modbus_tcp_client/modbus_request.h"
+
+class ResultRecorder
+{
+public:
+	ResultRecorder():
+		count(0),
+		lastRequestId(0),
+		lastError(ModbusReply::NoException)
+	{}
+
+	void onResult(const ModbusResult &result)
+	{
+		++count;
+		lastRequestId = result.requestId;
+		lastError = result.error;
+		lastRegisters = result.registers.toVector();
+	}
+
+	int count;
+	quint32 lastRequestId;
+	ModbusReply::ExceptionCode lastError;
+	QVector<quint16> lastRegisters;
+};
+
+TEST(ModbusRequestTest, Callback)
+{
+	ResultRecorder recorder;
+	ModbusCallback callback;
+	EXPECT_TRUE(callback.isNull());
+	callback = ModbusCallback::create<ResultRecorder, &ResultRecorder::onResult>(&recorder);
+	EXPECT_FALSE(callback.isNull());
+	EXPECT_EQ(&recorder, callback.object());
+
+	quint16 values[] = { 3, 4 };
+	ModbusResult result;
+	result.requestId = 7;
+	result.error = ModbusReply::NoException;
+	result.registers = ModbusRegisterView(values, 2);
+	callback(result);
+	EXPECT_EQ(1, recorder.count);
+	EXPECT_EQ(7u, recorder.lastRequestId);
+	ASSERT_EQ(2, recorder.lastRegisters.size());
+	EXPECT_EQ(4, recorder.lastRegisters[1]);
+
+	result.error = ModbusReply::Timeout;
+	result.registers = ModbusRegisterView();
+	callback(result);
+	EXPECT_EQ(2, recorder.count);
+	EXPECT_EQ(ModbusReply::Timeout, recorder.lastError);
+}
+
+TEST(ModbusRequestTest, Create)
+{
+	QVector<quint16> values;
+	values << 1 << 2;
+	ModbusRequest request = ModbusRequest::readWriteMultipleRegisters(2, 40000, 10, 40100, values);
+	EXPECT_EQ(ModbusRequest::ReadWriteMultipleRegisters, request.function);
+	EXPECT_EQ(2, request.unitId);
+	EXPECT_EQ(40000, request.startReg);
+	EXPECT_EQ(10, request.count);
+	EXPECT_EQ(40100, request.writeStartReg);
+	EXPECT_EQ(values, request.values);
+	// The timeout of the client is used, unless the user sets one.
+	EXPECT_EQ(0, request.timeout);
+
+	request = ModbusRequest::writeSingleHoldingRegister(3, 40200, 5);
+	EXPECT_EQ(ModbusRequest::WriteSingleRegister, request.function);
+	EXPECT_EQ(40200, request.startReg);
+	ASSERT_EQ(1, request.values.size());
+	EXPECT_EQ(5, request.values[0]);
+}
+
+TEST(ModbusRequestTest, ObjectPool)
+{
+	ModbusObjectPool<int> pool;
+	int *a = pool.take();
+	int *b = pool.take();
+	EXPECT_NE(a, b);
+	EXPECT_EQ(2, pool.size());
+	EXPECT_EQ(0, pool.available());
+	pool.release(a);
+	EXPECT_EQ(1, pool.available());
+	// Released objects are reused.
+	EXPECT_EQ(a, pool.take());
+	EXPECT_EQ(2, pool.size());
+	pool.release(a);
+	pool.release(b);
+	EXPECT_EQ(2, pool.available());
+}
@@ -0,0 +1,250 @@
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QList>
+#include <QPointer>
+#include <fcntl.h>
+#include <gtest/gtest.h>
+#include <pty.h>
+#include <termios.h>
+#include <unistd.h>
+#include "modbus_tcp_client/modbus_rtu_client.h"
+
+/*!
+ * Simulates the slaves on a serial bus. Uses the master side of a pty pair, while the client under
+ * test opens the slave side. Only ReadHoldingRegisters is supported: the value of each register
+ * is its address.
+ */
+class RtuBusSimulator
+{
+public:
+	RtuBusSimulator():
+		mMaster(-1),
+		mSlave(-1)
+	{
+		char name[64];
+		if (openpty(&mMaster, &mSlave, name, 0, 0) != 0)
+			return;
+		mPortName = name;
+		termios tio;
+		tcgetattr(mSlave, &tio);
+		cfmakeraw(&tio);
+		tcsetattr(mSlave, TCSANOW, &tio);
+		fcntl(mMaster, F_SETFL, fcntl(mMaster, F_GETFL) | O_NONBLOCK);
+	}
+
+	~RtuBusSimulator()
+	{
+		if (mMaster >= 0)
+			close(mMaster);
+		if (mSlave >= 0)
+			close(mSlave);
+	}
+
+	bool isOpen() const
+	{
+		return mMaster >= 0;
+	}
+
+	QString portName() const
+	{
+		return mPortName;
+	}
+
+	/// Handles all requests received so far.
+	void poll()
+	{
+		char buffer[256];
+		for (;;) {
+			ssize_t count = read(mMaster, buffer, sizeof(buffer));
+			if (count <= 0)
+				break;
+			mBuffer.append(buffer, static_cast<int>(count));
+		}
+		// All read requests are 8 bytes long.
+		while (mBuffer.size() >= 8) {
+			QByteArray request = mBuffer.left(8);
+			mBuffer.remove(0, 8);
+			quint8 unitId = static_cast<quint8>(request[0]);
+			requests.append(unitId);
+			if (!units.contains(unitId))
+				continue;
+			quint16 reg = toUInt16(request, 2);
+			quint16 count = toUInt16(request, 4);
+			QByteArray response;
+			response.append(static_cast<char>(unitId));
+			response.append(request[1]);
+			response.append(static_cast<char>(2 * count));
+			for (quint16 i=0; i<count; ++i) {
+				quint16 value = static_cast<quint16>(reg + i);
+				response.append(static_cast<char>(msb(value)));
+				response.append(static_cast<char>(lsb(value)));
+			}
+			quint16 crc = Crc16::getValue(response);
+			response.append(static_cast<char>(msb(crc)));
+			response.append(static_cast<char>(lsb(crc)));
+			ssize_t written = write(mMaster, response.constData(),
+									static_cast<size_t>(response.size()));
+			Q_UNUSED(written)
+		}
+	}
+
+	/// Unit ids of the slaves present on the bus.
+	QList<quint8> units;
+	/// Unit ids of all requests, in the order in which they were received.
+	QList<quint8> requests;
+
+private:
+	int mMaster;
+	int mSlave;
+	QString mPortName;
+	QByteArray mBuffer;
+};
+
+static bool waitForReplies(RtuBusSimulator &bus, const QList<ModbusReply *> &replies, int ms)
+{
+	QElapsedTimer timer;
+	timer.start();
+	while (timer.elapsed() < ms) {
+		QCoreApplication::processEvents(QEventLoop::AllEvents);
+		bus.poll();
+		bool done = true;
+		foreach (ModbusReply *reply, replies)
+			done = done && reply->isFinished();
+		if (done)
+			return true;
+		usleep(1000);
+	}
+	return false;
+}
+
+TEST(ModbusRtuClientTest, SilentInterval)
+{
+	EXPECT_EQ(4010, ModbusRtuClient::silentInterval(9600));
+	EXPECT_EQ(2005, ModbusRtuClient::silentInterval(19200));
+	EXPECT_EQ(1750, ModbusRtuClient::silentInterval(38400));
+	EXPECT_EQ(1750, ModbusRtuClient::silentInterval(115200));
+	EXPECT_EQ(9166, ModbusRtuClient::transmitTime(9600, 8));
+}
+
+TEST(ModbusRtuClientTest, RoundRobin)
+{
+	RtuBusSimulator bus;
+	ASSERT_TRUE(bus.isOpen());
+	bus.units << 1 << 2;
+	ModbusRtuClient client(bus.portName(), 38400);
+	QList<ModbusReply *> replies;
+	for (int i=0; i<4; ++i)
+		replies.append(client.readHoldingRegisters(1, 100 * i, 2));
+	replies.append(client.readHoldingRegisters(2, 40000, 3));
+	ASSERT_TRUE(waitForReplies(bus, replies, 5000));
+
+	// The first request is sent immediately, the request for slave 2 is handled before the
+	// remaining requests for slave 1.
+	QList<quint8> expected;
+	expected << 1 << 1 << 2 << 1 << 1;
+	EXPECT_EQ(expected, bus.requests);
+	foreach (ModbusReply *reply, replies)
+		EXPECT_EQ(ModbusReply::NoException, reply->error());
+	ASSERT_EQ(2, replies[3]->registerView().size());
+	EXPECT_EQ(301, replies[3]->registerView()[1]);
+	ASSERT_EQ(3, replies[4]->registerView().size());
+	EXPECT_EQ(40002, replies[4]->registerView()[2]);
+}
+
+TEST(ModbusRtuClientTest, AdaptiveTimeout)
+{
+	RtuBusSimulator bus;
+	ASSERT_TRUE(bus.isOpen());
+	bus.units << 1;
+	ModbusRtuClient client(bus.portName(), 38400);
+	client.setTimeout(1000);
+	EXPECT_EQ(1000, client.responseTimeout(1, 8, 9));
+
+	QList<ModbusReply *> replies;
+	replies.append(client.readHoldingRegisters(1, 0, 2));
+	ASSERT_TRUE(waitForReplies(bus, replies, 5000));
+	EXPECT_EQ(ModbusReply::NoException, replies.first()->error());
+	EXPECT_LT(client.responseTimeout(1, 8, 9), 500);
+	// Other slaves are not affected
+	EXPECT_EQ(1000, client.responseTimeout(2, 8, 9));
+
+	// Slave 1 leaves the bus. The timeout should be based on the measured response time.
+	bus.units.clear();
+	int measured = client.responseTimeout(1, 8, 9);
+	QElapsedTimer timer;
+	timer.start();
+	replies.clear();
+	replies.append(client.readHoldingRegisters(1, 0, 2));
+	ASSERT_TRUE(waitForReplies(bus, replies, 5000));
+	EXPECT_EQ(ModbusReply::Timeout, replies.first()->error());
+	EXPECT_LT(timer.elapsed(), 500);
+	// The estimate is kept, and the timeout doubles with each missed response.
+	EXPECT_EQ(qMin(2 * measured, 1000), client.responseTimeout(1, 8, 9));
+	replies.clear();
+	replies.append(client.readHoldingRegisters(1, 0, 2));
+	ASSERT_TRUE(waitForReplies(bus, replies, 5000));
+	EXPECT_EQ(qMin(4 * measured, 1000), client.responseTimeout(1, 8, 9));
+
+	// Back to the estimate once the slave responds again.
+	bus.units << 1;
+	replies.clear();
+	replies.append(client.readHoldingRegisters(1, 0, 2));
+	ASSERT_TRUE(waitForReplies(bus, replies, 5000));
+	EXPECT_EQ(ModbusReply::NoException, replies.first()->error());
+	EXPECT_LT(client.responseTimeout(1, 8, 9), 500);
+}
+
+TEST(ModbusRtuClientTest, AbsentSlave)
+{
+	RtuBusSimulator bus;
+	ASSERT_TRUE(bus.isOpen());
+	// Slave 2 is configured, but not present on the bus.
+	bus.units << 1;
+	ModbusRtuClient client(bus.portName(), 38400);
+	client.setTimeout(1000);
+	QList<ModbusReply *> present;
+	QList<ModbusReply *> absent;
+	for (int i=0; i<5; ++i) {
+		present.append(client.readHoldingRegisters(1, 100 * i, 2));
+		absent.append(client.readHoldingRegisters(2, 100 * i, 2));
+	}
+	QElapsedTimer timer;
+	timer.start();
+	ASSERT_TRUE(waitForReplies(bus, present + absent, 10000));
+	// Only the first miss costs the full timeout. Before, each request for slave 2 did, and
+	// slave 1 got one request per second.
+	EXPECT_LT(timer.elapsed(), 1000 + 4 * ModbusRtuClient::MissedSlaveTimeout + 500);
+	EXPECT_EQ(ModbusRtuClient::MissedSlaveTimeout, client.responseTimeout(2, 8, 9));
+	foreach (ModbusReply *reply, present)
+		EXPECT_EQ(ModbusReply::NoException, reply->error());
+	foreach (ModbusReply *reply, absent)
+		EXPECT_EQ(ModbusReply::Timeout, reply->error());
+}
+
+TEST(ModbusRtuClientTest, Cancel)
+{
+	RtuBusSimulator bus;
+	ASSERT_TRUE(bus.isOpen());
+	bus.units << 1 << 2;
+	ModbusRtuClient client(bus.portName(), 38400);
+	QObject owner;
+	QList<ModbusReply *> replies;
+	// The first request is sent immediately, the others are queued.
+	replies.append(client.readHoldingRegisters(1, 0, 2));
+	QPointer<ModbusReply> cancelled = client.readHoldingRegisters(1, 100, 2);
+	QPointer<ModbusReply> owned = client.readHoldingRegisters(2, 200, 2);
+	owned->setOwner(&owner);
+	replies.append(client.readHoldingRegisters(2, 300, 2));
+	client.cancel(cancelled);
+	client.cancelAll(&owner);
+	ASSERT_TRUE(waitForReplies(bus, replies, 5000));
+
+	QList<quint8> expected;
+	expected << 1 << 2;
+	EXPECT_EQ(expected, bus.requests);
+	foreach (ModbusReply *reply, replies)
+		EXPECT_EQ(ModbusReply::NoException, reply->error());
+	// Cancelled replies are never finished (and deleted later).
+	EXPECT_TRUE(cancelled.isNull() || !cancelled->isFinished());
+	EXPECT_TRUE(owned.isNull() || !owned->isFinished());
+}
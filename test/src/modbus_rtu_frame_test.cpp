@@ -0,0 +1,161 @@
+#include <gtest/gtest.h>
+#include "modbus_tcp_client/modbus_rtu_frame.h"
+
+static QByteArray appendCrc(const QByteArray &frame)
+{
+	quint16 crc = Crc16::getValue(frame);
+	QByteArray result = frame;
+	result.append(static_cast<char>(msb(crc)));
+	result.append(static_cast<char>(lsb(crc)));
+	return result;
+}
+
+static ModbusRtuDecoder::Result decode(ModbusRtuDecoder &decoder, const QByteArray &bytes)
+{
+	ModbusRtuDecoder::Result result = ModbusRtuDecoder::Incomplete;
+	for (int i=0; i<bytes.size() && result == ModbusRtuDecoder::Incomplete; ++i)
+		result = decoder.add(static_cast<quint8>(bytes[i]));
+	return result;
+}
+
+TEST(ModbusRtuFrameTest, CreateReadFrame)
+{
+	ModbusRtuReply reply;
+	reply.function = ModbusRtuReply::ReadHoldingRegisters;
+	reply.slaveAddress = 1;
+	reply.reg = 0;
+	reply.count = 10;
+	EXPECT_EQ(QByteArray::fromHex("01030000000ac5cd"), reply.createFrame());
+}
+
+TEST(ModbusRtuFrameTest, DecodeRead)
+{
+	ModbusRtuReply reply;
+	reply.function = ModbusRtuReply::ReadHoldingRegisters;
+	reply.slaveAddress = 3;
+	reply.count = 2;
+	ModbusRtuDecoder decoder;
+	EXPECT_EQ(ModbusRtuDecoder::Complete,
+			  decode(decoder, appendCrc(QByteArray::fromHex("030304123489ab"))));
+	ASSERT_TRUE(decoder.setResult(&reply));
+	ASSERT_TRUE(reply.isFinished());
+	EXPECT_EQ(ModbusReply::NoException, reply.error());
+	ASSERT_EQ(2, reply.registerView().size());
+	EXPECT_EQ(0x1234, reply.registerView()[0]);
+	EXPECT_EQ(0x89ab, reply.registerView()[1]);
+}
+
+TEST(ModbusRtuFrameTest, DecodeException)
+{
+	ModbusRtuReply reply;
+	reply.function = ModbusRtuReply::WriteSingleRegister;
+	reply.slaveAddress = 3;
+	ModbusRtuDecoder decoder;
+	EXPECT_EQ(ModbusRtuDecoder::Complete,
+			  decode(decoder, appendCrc(QByteArray::fromHex("038602"))));
+	ASSERT_TRUE(decoder.setResult(&reply));
+	EXPECT_EQ(ModbusReply::IllegalDataAddress, reply.error());
+}
+
+TEST(ModbusRtuFrameTest, WrongUnitId)
+{
+	ModbusRtuReply reply;
+	reply.function = ModbusRtuReply::ReadHoldingRegisters;
+	reply.slaveAddress = 4;
+	ModbusRtuDecoder decoder;
+	EXPECT_EQ(ModbusRtuDecoder::Complete,
+			  decode(decoder, appendCrc(QByteArray::fromHex("0303021234"))));
+	EXPECT_FALSE(decoder.setResult(&reply));
+	EXPECT_FALSE(reply.isFinished());
+}
+
+TEST(ModbusRtuFrameTest, MismatchedResponse)
+{
+	ModbusRtuDecoder decoder;
+	// Byte count does not match the number of registers requested.
+	ModbusRtuReply read;
+	read.function = ModbusRtuReply::ReadHoldingRegisters;
+	read.slaveAddress = 3;
+	read.count = 1;
+	EXPECT_EQ(ModbusRtuDecoder::Complete,
+			  decode(decoder, appendCrc(QByteArray::fromHex("030304123489ab"))));
+	EXPECT_FALSE(decoder.setResult(&read));
+	EXPECT_FALSE(read.isFinished());
+
+	ModbusRtuReply write;
+	write.function = ModbusRtuReply::WriteSingleRegister;
+	write.slaveAddress = 3;
+	write.reg = 1;
+	write.values.append(0xabcd);
+	// Echo of another register
+	decoder.reset();
+	EXPECT_EQ(ModbusRtuDecoder::Complete,
+			  decode(decoder, appendCrc(QByteArray::fromHex("03060002abcd"))));
+	EXPECT_FALSE(decoder.setResult(&write));
+	// Echo of another value
+	decoder.reset();
+	EXPECT_EQ(ModbusRtuDecoder::Complete,
+			  decode(decoder, appendCrc(QByteArray::fromHex("03060001abce"))));
+	EXPECT_FALSE(decoder.setResult(&write));
+	decoder.reset();
+	EXPECT_EQ(ModbusRtuDecoder::Complete,
+			  decode(decoder, appendCrc(QByteArray::fromHex("03060001abcd"))));
+	ASSERT_TRUE(decoder.setResult(&write));
+	EXPECT_EQ(ModbusReply::NoException, write.error());
+
+	ModbusRtuReply writeMultiple;
+	writeMultiple.function = ModbusRtuReply::WriteMultipleRegisters;
+	writeMultiple.slaveAddress = 3;
+	writeMultiple.reg = 40000;
+	writeMultiple.values << 1 << 2;
+	// Register count does not match.
+	decoder.reset();
+	EXPECT_EQ(ModbusRtuDecoder::Complete,
+			  decode(decoder, appendCrc(QByteArray::fromHex("03109c400003"))));
+	EXPECT_FALSE(decoder.setResult(&writeMultiple));
+	decoder.reset();
+	EXPECT_EQ(ModbusRtuDecoder::Complete,
+			  decode(decoder, appendCrc(QByteArray::fromHex("03109c400002"))));
+	EXPECT_TRUE(decoder.setResult(&writeMultiple));
+}
+
+TEST(ModbusRtuFrameTest, CrcError)
+{
+	ModbusRtuDecoder decoder;
+	QByteArray frame = appendCrc(QByteArray::fromHex("0303021234"));
+	frame[3] = 0x13;
+	EXPECT_EQ(ModbusRtuDecoder::Invalid, decode(decoder, frame));
+}
+
+TEST(ModbusRtuFrameTest, DecodeBulk)
+{
+	QByteArray first = appendCrc(QByteArray::fromHex("030304123489ab"));
+	QByteArray data = first + appendCrc(QByteArray::fromHex("03060001abcd"));
+	const quint8 *bytes = reinterpret_cast<const quint8 *>(data.constData());
+	ModbusRtuDecoder decoder;
+	int consumed = 0;
+	EXPECT_EQ(ModbusRtuDecoder::Complete, decoder.add(bytes, data.size(), consumed));
+	EXPECT_EQ(first.size(), consumed);
+	EXPECT_EQ(4, decoder.dataSize());
+
+	decoder.reset();
+	int offset = consumed;
+	EXPECT_EQ(ModbusRtuDecoder::Incomplete, decoder.add(bytes + offset, 3, consumed));
+	EXPECT_EQ(3, consumed);
+	offset += consumed;
+	EXPECT_EQ(ModbusRtuDecoder::Complete,
+			  decoder.add(bytes + offset, data.size() - offset, consumed));
+	EXPECT_EQ(data.size() - offset, consumed);
+	EXPECT_EQ(ModbusRtuReply::WriteSingleRegister, decoder.functionCode());
+	EXPECT_EQ(0xab, decoder.data()[0]);
+}
+
+TEST(ModbusRtuFrameTest, ResponseSize)
+{
+	ModbusRtuReply reply;
+	reply.function = ModbusRtuReply::ReadInputRegisters;
+	reply.count = 10;
+	EXPECT_EQ(25, ModbusRtuDecoder::responseSize(&reply));
+	reply.function = ModbusRtuReply::WriteMultipleRegisters;
+	EXPECT_EQ(8, ModbusRtuDecoder::responseSize(&reply));
+}
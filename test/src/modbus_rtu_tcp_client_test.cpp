@@ -0,0 +1,211 @@
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QHostAddress>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include "modbus_tcp_client/crc16.h"
+#include "modbus_tcp_client/modbus_rtu_tcp_client.h"
+#include "modbus_rtu_tcp_client_test.h"
+#include "test_helper.h"
+
+/*!
+ * Simulates an RS485-to-Ethernet bridge in transparent mode, with a single slave behind it. Only
+ * ReadHoldingRegisters is supported: the value of each register is its address.
+ */
+class RtuTcpBridgeSimulator
+{
+public:
+	RtuTcpBridgeSimulator():
+		connectionCount(0),
+		requestCount(0),
+		mSocket(0)
+	{
+		mServer.listen(QHostAddress::LocalHost, 0);
+	}
+
+	quint16 port() const
+	{
+		return mServer.serverPort();
+	}
+
+	/// Accepts new connections, and handles all requests received so far.
+	void poll()
+	{
+		while (mServer.hasPendingConnections()) {
+			delete mSocket;
+			mSocket = mServer.nextPendingConnection();
+			mBuffer.clear();
+			++connectionCount;
+		}
+		if (mSocket == 0)
+			return;
+		mBuffer.append(mSocket->readAll());
+		// All read requests are 8 bytes long.
+		while (mBuffer.size() >= 8) {
+			QByteArray request = mBuffer.left(8);
+			mBuffer.remove(0, 8);
+			++requestCount;
+			quint16 reg = toUInt16(request, 2);
+			quint16 count = toUInt16(request, 4);
+			QByteArray response;
+			response.append(request[0]);
+			response.append(request[1]);
+			response.append(static_cast<char>(2 * count));
+			for (quint16 i=0; i<count; ++i) {
+				quint16 value = static_cast<quint16>(reg + i);
+				response.append(static_cast<char>(msb(value)));
+				response.append(static_cast<char>(lsb(value)));
+			}
+			quint16 crc = Crc16::getValue(response);
+			response.append(static_cast<char>(msb(crc)));
+			response.append(static_cast<char>(lsb(crc)));
+			mSocket->write(response);
+		}
+	}
+
+	/// Closes the connection from the bridge side.
+	void dropConnection()
+	{
+		if (mSocket == 0)
+			return;
+		mSocket->disconnectFromHost();
+		delete mSocket;
+		mSocket = 0;
+	}
+
+	/// Closes the connection, and refuses new ones.
+	void shutDown()
+	{
+		dropConnection();
+		mServer.close();
+	}
+
+	int connectionCount;
+	int requestCount;
+
+private:
+	QTcpServer mServer;
+	QTcpSocket *mSocket;
+	QByteArray mBuffer;
+};
+
+static QString localHost()
+{
+	return QHostAddress(QHostAddress::LocalHost).toString();
+}
+
+TEST_F(ModbusRtuTcpClientTest, ReadRegisters)
+{
+	RtuTcpBridgeSimulator bridge;
+	ModbusRtuTcpClient client;
+	client.connectToServer(localHost(), bridge.port());
+	QList<ModbusReply *> replies;
+	replies << client.readHoldingRegisters(1, 100, 2);
+	replies << client.readHoldingRegisters(1, 200, 3);
+	ASSERT_TRUE(waitForReplies(bridge, replies, 5000));
+	EXPECT_EQ(ModbusReply::NoException, replies[0]->error());
+	ASSERT_EQ(3, replies[1]->registerView().size());
+	EXPECT_EQ(202, replies[1]->registerView()[2]);
+	EXPECT_EQ(2, bridge.requestCount);
+}
+
+TEST_F(ModbusRtuTcpClientTest, Reconnect)
+{
+	RtuTcpBridgeSimulator bridge;
+	ModbusRtuTcpClient client;
+	connect(&client, SIGNAL(disconnected()), this, SLOT(onDisconnected()));
+	client.connectToServer(localHost(), bridge.port());
+	QList<ModbusReply *> replies;
+	replies << client.readHoldingRegisters(1, 100, 2);
+	ASSERT_TRUE(waitForReplies(bridge, replies, 5000));
+
+	bridge.dropConnection();
+	ASSERT_TRUE(waitForDisconnects(bridge, 1, 5000));
+	// The socket reports both an error and the disconnect.
+	qWait(100);
+	EXPECT_EQ(1, mDisconnectCount);
+	EXPECT_FALSE(client.isConnected());
+
+	// The next request restores the connection, instead of waiting for it forever.
+	replies.clear();
+	replies << client.readHoldingRegisters(1, 300, 2);
+	ASSERT_TRUE(waitForReplies(bridge, replies, 5000));
+	EXPECT_EQ(ModbusReply::NoException, replies[0]->error());
+	EXPECT_EQ(2, bridge.connectionCount);
+}
+
+TEST_F(ModbusRtuTcpClientTest, ConnectionRefused)
+{
+	RtuTcpBridgeSimulator bridge;
+	ModbusRtuTcpClient client;
+	connect(&client, SIGNAL(disconnected()), this, SLOT(onDisconnected()));
+	client.connectToServer(localHost(), bridge.port());
+	QList<ModbusReply *> replies;
+	replies << client.readHoldingRegisters(1, 100, 2);
+	ASSERT_TRUE(waitForReplies(bridge, replies, 5000));
+
+	bridge.shutDown();
+	ASSERT_TRUE(waitForDisconnects(bridge, 1, 5000));
+	replies.clear();
+	replies << client.readHoldingRegisters(1, 100, 2);
+	ASSERT_TRUE(waitForReplies(bridge, replies, 5000));
+	EXPECT_EQ(ModbusReply::TcpError, replies[0]->error());
+	EXPECT_EQ(2, mDisconnectCount);
+}
+
+TEST_F(ModbusRtuTcpClientTest, ReplyDestroyedWhileQueued)
+{
+	RtuTcpBridgeSimulator bridge;
+	ModbusRtuTcpClient client;
+	client.connectToServer(localHost(), bridge.port());
+	QList<ModbusReply *> replies;
+	replies << client.readHoldingRegisters(1, 100, 2);
+	ModbusReply *destroyed = client.readHoldingRegisters(1, 200, 2);
+	replies << client.readHoldingRegisters(1, 300, 2);
+	delete destroyed;
+	ASSERT_TRUE(waitForReplies(bridge, replies, 5000));
+	foreach (ModbusReply *reply, replies)
+		EXPECT_EQ(ModbusReply::NoException, reply->error());
+	EXPECT_EQ(301, replies[1]->registerView()[1]);
+	EXPECT_EQ(2, bridge.requestCount);
+}
+
+void ModbusRtuTcpClientTest::onDisconnected()
+{
+	++mDisconnectCount;
+}
+
+void ModbusRtuTcpClientTest::SetUp()
+{
+	mDisconnectCount = 0;
+}
+
+bool ModbusRtuTcpClientTest::waitForReplies(RtuTcpBridgeSimulator &bridge,
+											const QList<ModbusReply *> &replies, int timeout)
+{
+	QElapsedTimer timer;
+	timer.start();
+	for (;;) {
+		bridge.poll();
+		bool finished = true;
+		foreach (ModbusReply *reply, replies)
+			finished = finished && reply->isFinished();
+		if (finished)
+			return true;
+		if (timer.elapsed() >= timeout)
+			return false;
+		qWait(5);
+	}
+}
+
+bool ModbusRtuTcpClientTest::waitForDisconnects(RtuTcpBridgeSimulator &bridge, int count,
+												int timeout)
+{
+	QElapsedTimer timer;
+	timer.start();
+	while (mDisconnectCount < count && timer.elapsed() < timeout) {
+		bridge.poll();
+		qWait(5);
+	}
+	return mDisconnectCount >= count;
+}
@@ -0,0 +1,33 @@
+#ifndef MODBUSRTUTCPCLIENTTEST_H
+#define MODBUSRTUTCPCLIENTTEST_H
+
+#include <QList>
+#include <QObject>
+#include <gtest/gtest.h>
+
+class ModbusReply;
+class RtuTcpBridgeSimulator;
+
+class ModbusRtuTcpClientTest : public QObject, public testing::Test
+{
+	Q_OBJECT
+public slots:
+	void onDisconnected();
+
+protected:
+	virtual void SetUp();
+
+	/*!
+	 * Processes events and lets the bridge handle requests until all replies have finished, or
+	 * `timeout` ms have passed.
+	 */
+	static bool waitForReplies(RtuTcpBridgeSimulator &bridge, const QList<ModbusReply *> &replies,
+							   int timeout);
+
+	/// Processes events until `count` disconnects have been seen, or `timeout` ms have passed.
+	bool waitForDisconnects(RtuTcpBridgeSimulator &bridge, int count, int timeout);
+
+	int mDisconnectCount;
+};
+
+#endif // MODBUSRTUTCPCLIENTTEST_H
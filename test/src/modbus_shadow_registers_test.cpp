@@ -0,0 +1,73 @@
+#include <gtest/gtest.h>
+#include "modbus_tcp_client/modbus_shadow_registers.h"
+#include "test_helper.h"
+
+static QVector<quint16> createValues(quint16 a, quint16 b)
+{
+	QVector<quint16> values;
+	values.append(a);
+	values.append(b);
+	return values;
+}
+
+TEST(ModbusShadowRegistersTest, Write)
+{
+	ModbusShadowRegisters shadow;
+	EXPECT_FALSE(shadow.isFresh(40210, 2, 1000));
+	EXPECT_TRUE(shadow.values(40210, 2).isEmpty());
+	shadow.write(40210, createValues(0, 1077));
+	EXPECT_TRUE(shadow.isFresh(40210, 2, 1000));
+	EXPECT_EQ(ModbusRegisterView(createValues(0, 1077)), shadow.values(40210, 2));
+	// Partially known ranges are not fresh.
+	EXPECT_FALSE(shadow.isFresh(40210, 3, 1000));
+	EXPECT_TRUE(shadow.values(40209, 2).isEmpty());
+}
+
+TEST(ModbusShadowRegistersTest, Age)
+{
+	ModbusShadowRegisters shadow;
+	shadow.write(40210, createValues(0, 1077));
+	qWait(30);
+	shadow.write(40212, createValues(0, 3000));
+	EXPECT_FALSE(shadow.isFresh(40210, 4, 20));
+	EXPECT_TRUE(shadow.isFresh(40212, 2, 20));
+	EXPECT_TRUE(shadow.isFresh(40210, 4, 1000));
+	// Adjacent writes can be retrieved as a single range.
+	ModbusRegisterView values = shadow.values(40210, 4);
+	ASSERT_EQ(4, values.size());
+	EXPECT_EQ(1077, values[1]);
+	EXPECT_EQ(3000, values[3]);
+}
+
+TEST(ModbusShadowRegistersTest, Overwrite)
+{
+	ModbusShadowRegisters shadow;
+	shadow.write(40210, createValues(0, 1077));
+	shadow.write(40214, createValues(5, 6));
+	shadow.write(40211, createValues(1, 2));
+	EXPECT_FALSE(shadow.isFresh(40210, 6, 1000));
+	shadow.write(40213, createValues(3, 4));
+	ModbusRegisterView values = shadow.values(40210, 6);
+	ASSERT_EQ(6, values.size());
+	for (int i=0; i<6; ++i)
+		EXPECT_EQ(i, values[i]);
+}
+
+TEST(ModbusShadowRegistersTest, Invalidate)
+{
+	ModbusShadowRegisters shadow;
+	shadow.write(40210, createValues(0, 1077));
+	shadow.write(40212, createValues(0, 3000));
+	shadow.invalidate(40212, 2);
+	EXPECT_TRUE(shadow.isFresh(40210, 2, 1000));
+	EXPECT_FALSE(shadow.isFresh(40212, 1, 1000));
+	shadow.write(40212, createValues(0, 3000));
+	// Registers around the range are kept.
+	shadow.invalidate(40211, 2);
+	EXPECT_TRUE(shadow.isFresh(40210, 1, 1000));
+	EXPECT_FALSE(shadow.isFresh(40211, 1, 1000));
+	ASSERT_EQ(1, shadow.values(40213, 1).size());
+	EXPECT_EQ(3000, shadow.values(40213, 1)[0]);
+	shadow.invalidate();
+	EXPECT_FALSE(shadow.isFresh(40210, 1, 1000));
+}
@@ -0,0 +1,52 @@
+#include <gtest/gtest.h>
+#include "modbus_tcp_client/modbus_spsc_queue.h"
+
+TEST(ModbusSpscQueueTest, PushPop)
+{
+	ModbusSpscQueue<int, 4> queue;
+	EXPECT_TRUE(queue.front() == 0);
+	*queue.back() = 1;
+	queue.push();
+	*queue.back() = 2;
+	queue.push();
+	ASSERT_TRUE(queue.front() != 0);
+	EXPECT_EQ(1, *queue.front());
+	queue.pop();
+	EXPECT_EQ(2, *queue.front());
+	queue.pop();
+	EXPECT_TRUE(queue.front() == 0);
+}
+
+TEST(ModbusSpscQueueTest, Full)
+{
+	ModbusSpscQueue<int, 4> queue;
+	for (int i=0; i<4; ++i) {
+		ASSERT_TRUE(queue.back() != 0);
+		*queue.back() = i;
+		queue.push();
+	}
+	EXPECT_TRUE(queue.back() == 0);
+	queue.pop();
+	EXPECT_TRUE(queue.back() != 0);
+}
+
+TEST(ModbusSpscQueueTest, WrapAround)
+{
+	ModbusSpscQueue<int, 4> queue;
+	for (int i=0; i<100; ++i) {
+		*queue.back() = i;
+		queue.push();
+		if (i % 3 == 2) {
+			*queue.back() = -i;
+			queue.push();
+			EXPECT_EQ(i, *queue.front());
+			queue.pop();
+			EXPECT_EQ(-i, *queue.front());
+			queue.pop();
+		} else {
+			EXPECT_EQ(i, *queue.front());
+			queue.pop();
+		}
+		EXPECT_TRUE(queue.front() == 0);
+	}
+}
@@ -0,0 +1,216 @@
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTimer>
+#include "modbus_stand_in_server.h"
+
+static quint16 getU16(const QByteArray &data, int offset)
+{
+	return static_cast<quint16>((static_cast<quint8>(data[offset]) << 8) |
+		static_cast<quint8>(data[offset + 1]));
+}
+
+static void appendU16(QByteArray &data, quint16 value)
+{
+	data.append(static_cast<char>(value >> 8));
+	data.append(static_cast<char>(value & 0xFF));
+}
+
+ModbusStandInServer::ModbusStandInServer(QObject *parent):
+	QObject(parent),
+	readWriteCount(0),
+	readDelay(0),
+	writeDelay(0),
+	holdReplies(false),
+	splitReplies(false),
+	maxOutstanding(0),
+	mServer(new QTcpServer(this)),
+	mOutstanding(0)
+{
+	connect(mServer, SIGNAL(newConnection()), this, SLOT(onNewConnection()));
+	mClock.start();
+}
+
+quint16 ModbusStandInServer::listen()
+{
+	if (!mServer->listen(QHostAddress::LocalHost, 0))
+		return 0;
+	return mServer->serverPort();
+}
+
+void ModbusStandInServer::releaseHeldReplies(bool reverse)
+{
+	QList<DelayedReply> held = mHeldReplies;
+	mHeldReplies.clear();
+	for (int i=0; i<held.size(); ++i) {
+		const DelayedReply &r = held[reverse ? held.size() - 1 - i : i];
+		if (!r.socket.isNull())
+			sendReply(r.socket, r.adu);
+	}
+}
+
+void ModbusStandInServer::onNewConnection()
+{
+	while (mServer->hasPendingConnections()) {
+		QTcpSocket *socket = mServer->nextPendingConnection();
+		mBuffers.insert(socket, QByteArray());
+		connect(socket, SIGNAL(readyRead()), this, SLOT(onReadyRead()));
+		connect(socket, SIGNAL(disconnected()), this, SLOT(onDisconnected()));
+	}
+}
+
+void ModbusStandInServer::onReadyRead()
+{
+	QTcpSocket *socket = static_cast<QTcpSocket *>(sender());
+	QByteArray &buffer = mBuffers[socket];
+	buffer.append(socket->readAll());
+	// MBAP header: transaction id, protocol id, length (including the unit id), unit id.
+	while (buffer.size() >= 8) {
+		int size = 6 + getU16(buffer, 4);
+		if (buffer.size() < size)
+			return;
+		QByteArray pdu = buffer.mid(7, size - 7);
+		Request request;
+		request.transactionId = getU16(buffer, 0);
+		request.unitId = static_cast<quint8>(buffer[6]);
+		request.function = static_cast<quint8>(pdu[0]);
+		request.startReg = pdu.size() >= 5 ? getU16(pdu, 1) : 0;
+		request.count = pdu.size() >= 5 ? getU16(pdu, 3) : 0;
+		requests.append(request);
+		QByteArray reply = handlePdu(pdu);
+		QByteArray adu = buffer.left(4);
+		appendU16(adu, static_cast<quint16>(reply.size() + 1));
+		adu.append(buffer[6]);
+		adu.append(reply);
+		buffer.remove(0, size);
+		++mOutstanding;
+		maxOutstanding = qMax(maxOutstanding, mOutstanding);
+		if (holdReplies) {
+			DelayedReply held;
+			held.socket = socket;
+			held.adu = adu;
+			held.due = 0;
+			held.remainder = false;
+			mHeldReplies.append(held);
+			continue;
+		}
+		int delay = 0;
+		if (request.function == 3)
+			delay = readDelay;
+		else if (request.function == 6 || request.function == 16)
+			delay = writeDelay;
+		if (delay > 0) {
+			DelayedReply delayed;
+			delayed.socket = socket;
+			delayed.adu = adu;
+			delayed.due = mClock.elapsed() + delay;
+			delayed.remainder = false;
+			mDelayedReplies.append(delayed);
+			QTimer::singleShot(delay, this, SLOT(onDelayedReply()));
+		} else {
+			sendReply(socket, adu);
+		}
+	}
+}
+
+void ModbusStandInServer::onDisconnected()
+{
+	QTcpSocket *socket = static_cast<QTcpSocket *>(sender());
+	mBuffers.remove(socket);
+	socket->deleteLater();
+}
+
+void ModbusStandInServer::onDelayedReply()
+{
+	// Read and write delays may differ, so the replies are not due in the order of the list.
+	qint64 now = mClock.elapsed();
+	for (int i=0; i<mDelayedReplies.size();) {
+		if (mDelayedReplies[i].due > now) {
+			++i;
+			continue;
+		}
+		DelayedReply delayed = mDelayedReplies.takeAt(i);
+		if (delayed.socket.isNull())
+			continue;
+		if (delayed.remainder)
+			delayed.socket->write(delayed.adu);
+		else
+			sendReply(delayed.socket, delayed.adu);
+	}
+}
+
+void ModbusStandInServer::sendReply(QTcpSocket *socket, const QByteArray &adu)
+{
+	--mOutstanding;
+	if (!splitReplies) {
+		socket->write(adu);
+		return;
+	}
+	// Replies sent while the rest of a split reply is pending follow that rest.
+	for (int i=0; i<mDelayedReplies.size(); ++i) {
+		DelayedReply &delayed = mDelayedReplies[i];
+		if (delayed.remainder && delayed.socket == socket) {
+			delayed.adu.append(adu);
+			return;
+		}
+	}
+	// Split within the MBAP header, so the client has to wait for the rest of the header.
+	socket->write(adu.left(5));
+	socket->flush();
+	DelayedReply delayed;
+	delayed.socket = socket;
+	delayed.adu = adu.mid(5);
+	delayed.due = mClock.elapsed() + 20;
+	delayed.remainder = true;
+	mDelayedReplies.append(delayed);
+	QTimer::singleShot(20, this, SLOT(onDelayedReply()));
+}
+
+QByteArray ModbusStandInServer::handlePdu(const QByteArray &pdu)
+{
+	QByteArray reply;
+	quint8 function = static_cast<quint8>(pdu[0]);
+	switch (function) {
+	case 3:
+	{
+		quint16 startReg = getU16(pdu, 1);
+		quint16 count = getU16(pdu, 3);
+		reply.append(static_cast<char>(function));
+		reply.append(static_cast<char>(2 * count));
+		for (quint16 i=0; i<count; ++i)
+			appendU16(reply, registers.value(static_cast<quint16>(startReg + i)));
+		break;
+	}
+	case 6:
+	{
+		Write write;
+		write.startReg = getU16(pdu, 1);
+		write.values.append(getU16(pdu, 3));
+		registers.insert(write.startReg, write.values[0]);
+		writes.append(write);
+		reply = pdu.left(5);
+		break;
+	}
+	case 16:
+	{
+		Write write;
+		write.startReg = getU16(pdu, 1);
+		quint16 count = getU16(pdu, 3);
+		for (quint16 i=0; i<count; ++i) {
+			quint16 value = getU16(pdu, 6 + 2 * i);
+			write.values.append(value);
+			registers.insert(static_cast<quint16>(write.startReg + i), value);
+		}
+		writes.append(write);
+		reply = pdu.left(5);
+		break;
+	}
+	case 23:
+		++readWriteCount;
+		// Fall through
+	default:
+		reply.append(static_cast<char>(function | 0x80));
+		reply.append(static_cast<char>(1)); // Illegal function
+		break;
+	}
+	return reply;
+}
@@ -0,0 +1,97 @@
+#ifndef MODBUS_STAND_IN_SERVER_H
+#define MODBUS_STAND_IN_SERVER_H
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QPointer>
+#include <QVector>
+
+class QTcpServer;
+class QTcpSocket;
+
+/*!
+ * Stand-in for the Modbus TCP server of an inverter, which does not support read/write multiple
+ * registers (function 23). Holding registers are taken from `registers`, and writes are stored
+ * there as well. All requests received are logged in `requests`.
+ */
+class ModbusStandInServer : public QObject
+{
+	Q_OBJECT
+public:
+	struct Request
+	{
+		quint16 transactionId;
+		quint8 unitId;
+		quint8 function;
+		quint16 startReg;
+		quint16 count;
+	};
+
+	struct Write
+	{
+		quint16 startReg;
+		QVector<quint16> values;
+	};
+
+	explicit ModbusStandInServer(QObject *parent = 0);
+
+	/// Listens on the loopback interface. Returns the port, or 0 on failure.
+	quint16 listen();
+
+	/// Sends the replies kept because of `holdReplies`, in reverse order if `reverse` is set.
+	void releaseHeldReplies(bool reverse);
+
+	QHash<quint16, quint16> registers;
+	/// All requests received, in order.
+	QList<Request> requests;
+	/// Write single and multiple registers requests received, in order.
+	QList<Write> writes;
+	/// Number of read/write multiple registers requests received.
+	int readWriteCount;
+	/// Time (ms) before read holding registers requests are answered.
+	int readDelay;
+	/// Time (ms) before write requests are answered.
+	int writeDelay;
+	/// If set, replies are kept until `releaseHeldReplies` is called.
+	bool holdReplies;
+	/// If set, each reply is sent in two parts, the second one 20ms after the first.
+	bool splitReplies;
+	/// Largest number of requests received, but not answered yet.
+	int maxOutstanding;
+
+private slots:
+	void onNewConnection();
+
+	void onReadyRead();
+
+	void onDisconnected();
+
+	void onDelayedReply();
+
+private:
+	/// Returns the reply PDU for the request PDU `pdu`.
+	QByteArray handlePdu(const QByteArray &pdu);
+
+	void sendReply(QTcpSocket *socket, const QByteArray &adu);
+
+	struct DelayedReply
+	{
+		QPointer<QTcpSocket> socket;
+		QByteArray adu;
+		qint64 due;
+		/// Set if `adu` is the second part of a split reply.
+		bool remainder;
+	};
+
+	QTcpServer *mServer;
+	QElapsedTimer mClock;
+	QHash<QTcpSocket *, QByteArray> mBuffers;
+	QList<DelayedReply> mDelayedReplies;
+	QList<DelayedReply> mHeldReplies;
+	int mOutstanding;
+};
+
+#endif // MODBUS_STAND_IN_SERVER_H
@@ -0,0 +1,262 @@
+#include <QElapsedTimer>
+#include <QHostAddress>
+#include <QTcpServer>
+#include "modbus_stand_in_server.h"
+#include "modbus_tcp_client/modbus_reply.h"
+#include "modbus_tcp_client/modbus_tcp_client.h"
+#include "modbus_tcp_client_test.h"
+#include "test_helper.h"
+
+static const quint8 UnitId = 1;
+static const quint16 ModelOffset = 40070;
+static const quint16 ModelSize = 52;
+
+static QString localHost()
+{
+	return QHostAddress(QHostAddress::LocalHost).toString();
+}
+
+TEST_F(ModbusTcpClientTest, SharedReadContained)
+{
+	// Keep the first transaction in flight while the other reads are made.
+	mServer->readDelay = 200;
+	QList<ModbusReply *> replies;
+	ModbusReply *block = mClient->readHoldingRegisters(UnitId, ModelOffset, ModelSize);
+	ModbusReply *header = mClient->readHoldingRegisters(UnitId, ModelOffset, 2);
+	ModbusReply *middle = mClient->readHoldingRegisters(UnitId, ModelOffset + 30, 4);
+	// Not contained in the first read, or for another unit: sent separately.
+	ModbusReply *overlap = mClient->readHoldingRegisters(UnitId, ModelOffset + ModelSize - 2, 4);
+	ModbusReply *otherUnit = mClient->readHoldingRegisters(UnitId + 1, ModelOffset, 2);
+	replies << block << header << middle << overlap << otherUnit;
+	ASSERT_TRUE(waitForReplies(replies, 5000));
+
+	ASSERT_EQ(3, mServer->requests.size());
+	EXPECT_EQ(ModelOffset + ModelSize - 2, mServer->requests[1].startReg);
+	EXPECT_EQ(UnitId + 1, mServer->requests[2].unitId);
+	expectRegisters(block, ModelOffset, ModelSize);
+	expectRegisters(header, ModelOffset, 2);
+	expectRegisters(middle, ModelOffset + 30, 4);
+	foreach (ModbusReply *reply, replies)
+		delete reply;
+}
+
+TEST_F(ModbusTcpClientTest, SharedReadOwnerDestroyed)
+{
+	mServer->readDelay = 200;
+	ModbusReply *block = mClient->readHoldingRegisters(UnitId, ModelOffset, ModelSize);
+	ModbusReply *part = mClient->readHoldingRegisters(UnitId, ModelOffset + 10, 3);
+	// The transaction is kept for the remaining reply.
+	delete block;
+	QList<ModbusReply *> replies;
+	replies << part;
+	ASSERT_TRUE(waitForReplies(replies, 5000));
+	EXPECT_EQ(1, mServer->requests.size());
+	expectRegisters(part, ModelOffset + 10, 3);
+	delete part;
+}
+
+TEST_F(ModbusTcpClientTest, SharedReadClosedByWrite)
+{
+	mServer->readDelay = 200;
+	ModbusReply *block = mClient->readHoldingRegisters(UnitId, ModelOffset, ModelSize);
+	ModbusReply *write = mClient->writeSingleHoldingRegister(UnitId, ModelOffset + 5, 7);
+	// The block read may not contain the written value, so this read is sent.
+	ModbusReply *part = mClient->readHoldingRegisters(UnitId, ModelOffset + 5, 1);
+	QList<ModbusReply *> replies;
+	replies << block << write << part;
+	ASSERT_TRUE(waitForReplies(replies, 5000));
+	EXPECT_EQ(3, mServer->requests.size());
+	EXPECT_EQ(ModbusReply::NoException, part->error());
+	ASSERT_EQ(1, part->values().size());
+	EXPECT_EQ(7, part->values()[0]);
+	foreach (ModbusReply *reply, replies)
+		delete reply;
+}
+
+TEST_F(ModbusTcpClientTest, PipeliningWindow)
+{
+	mServer->readDelay = 100;
+	QList<ModbusReply *> replies;
+	for (quint16 i=0; i<4; ++i)
+		replies << mClient->readHoldingRegisters(UnitId, ModelOffset + 2 * i, 2);
+	ASSERT_TRUE(waitForReplies(replies, 5000));
+	// By default, a request is sent when the previous one has been answered.
+	EXPECT_EQ(1, mServer->maxOutstanding);
+
+	mClient->setMaxPendingRequests(3);
+	for (quint16 i=0; i<8; ++i)
+		replies << mClient->readHoldingRegisters(UnitId, ModelOffset + 2 * i, 2);
+	ASSERT_TRUE(waitForReplies(replies, 5000));
+	EXPECT_EQ(3, mServer->maxOutstanding);
+	EXPECT_EQ(12, mServer->requests.size());
+	for (int i=0; i<replies.size(); ++i)
+		expectRegisters(replies[i], ModelOffset + 2 * (i < 4 ? i : i - 4), 2);
+	qDeleteAll(replies);
+}
+
+TEST_F(ModbusTcpClientTest, OutOfOrderResponses)
+{
+	mClient->setMaxPendingRequests(3);
+	mServer->holdReplies = true;
+	QList<ModbusReply *> replies;
+	for (quint16 i=0; i<3; ++i) {
+		ModbusReply *reply = mClient->readHoldingRegisters(UnitId, ModelOffset + 10 * i, 3);
+		connect(reply, SIGNAL(finished()), this, SLOT(onReplyFinished()));
+		replies << reply;
+	}
+	QElapsedTimer timer;
+	timer.start();
+	while (mServer->requests.size() < 3 && timer.elapsed() < 5000)
+		qWait(10);
+	ASSERT_EQ(3, mServer->requests.size());
+	mServer->releaseHeldReplies(true);
+	ASSERT_TRUE(waitForReplies(replies, 5000));
+	// Responses are matched by transaction id, not by the order of the requests.
+	ASSERT_EQ(3, mFinished.size());
+	EXPECT_EQ(replies[2], mFinished[0]);
+	EXPECT_EQ(replies[0], mFinished[2]);
+	for (int i=0; i<3; ++i)
+		expectRegisters(replies[i], ModelOffset + 10 * i, 3);
+	qDeleteAll(replies);
+}
+
+TEST_F(ModbusTcpClientTest, PartialFrames)
+{
+	mClient->setMaxPendingRequests(2);
+	mServer->splitReplies = true;
+	QList<ModbusReply *> replies;
+	replies << mClient->readHoldingRegisters(UnitId, ModelOffset, ModelSize);
+	replies << mClient->readHoldingRegisters(UnitId + 1, ModelOffset + 4, 1);
+	ASSERT_TRUE(waitForReplies(replies, 5000));
+	expectRegisters(replies[0], ModelOffset, ModelSize);
+	expectRegisters(replies[1], ModelOffset + 4, 1);
+	qDeleteAll(replies);
+}
+
+TEST_F(ModbusTcpClientTest, RoundRobinPerUnit)
+{
+	mServer->readDelay = 50;
+	QList<ModbusReply *> replies;
+	// The first request is sent right away, the others are queued.
+	for (quint16 i=0; i<4; ++i)
+		replies << mClient->readHoldingRegisters(UnitId, ModelOffset + 2 * i, 2);
+	replies << mClient->readHoldingRegisters(UnitId + 1, ModelOffset, 2);
+	ASSERT_TRUE(waitForReplies(replies, 5000));
+	// The request for the other unit does not wait for all requests of the first one.
+	ASSERT_EQ(5, mServer->requests.size());
+	quint8 expected[] = { UnitId, UnitId, UnitId + 1, UnitId, UnitId };
+	for (int i=0; i<5; ++i)
+		EXPECT_EQ(expected[i], mServer->requests[i].unitId);
+	EXPECT_EQ(ModelOffset + 4, mServer->requests[3].startReg);
+	qDeleteAll(replies);
+}
+
+TEST_F(ModbusTcpClientTest, ReconnectBackoff)
+{
+	// Nobody listens on this port, so connections are refused right away.
+	QTcpServer server;
+	ASSERT_TRUE(server.listen(QHostAddress::LocalHost, 0));
+	quint16 port = server.serverPort();
+	server.close();
+
+	ModbusTcpClient client;
+	connect(&client, SIGNAL(disconnected()), this, SLOT(onDisconnected()));
+	QElapsedTimer timer;
+	timer.start();
+	QList<qint64> failures;
+	for (int i=0; i<ModbusTcpClient::CircuitFailureThreshold; ++i) {
+		EXPECT_EQ(ModbusTcpClient::CircuitClosed, client.circuitState());
+		// Postponed until the reconnect delay has elapsed.
+		client.connectToServer(localHost(), port);
+		ASSERT_TRUE(waitForDisconnects(i + 1, 10000));
+		failures.append(timer.elapsed());
+	}
+	// The delay doubles after each failure, and the actual delay lies between half and the full
+	// delay.
+	int delay = ModbusTcpClient::InitialReconnectDelay;
+	for (int i=1; i<failures.size(); ++i) {
+		qint64 interval = failures[i] - failures[i - 1];
+		EXPECT_GE(interval, delay / 2 - 50);
+		EXPECT_LE(interval, delay + 500);
+		delay *= 2;
+	}
+
+	EXPECT_EQ(ModbusTcpClient::CircuitOpen, client.circuitState());
+	EXPECT_GT(client.reconnectDelay(), 0);
+	EXPECT_LE(client.reconnectDelay(), delay);
+	// No connection attempt while the circuit is open.
+	client.connectToServer(localHost(), port);
+	qWait(100);
+	EXPECT_EQ(ModbusTcpClient::CircuitOpen, client.circuitState());
+	EXPECT_EQ(ModbusTcpClient::CircuitFailureThreshold, mDisconnectCount);
+}
+
+void ModbusTcpClientTest::onReplyFinished()
+{
+	mFinished.append(static_cast<ModbusReply *>(sender()));
+}
+
+void ModbusTcpClientTest::onDisconnected()
+{
+	++mDisconnectCount;
+}
+
+void ModbusTcpClientTest::SetUp()
+{
+	mDisconnectCount = 0;
+	mServer.reset(new ModbusStandInServer());
+	mPort = mServer->listen();
+	ASSERT_NE(0, mPort);
+	// The value of each register is its address.
+	for (quint16 i=0; i<ModelSize; ++i) {
+		quint16 reg = static_cast<quint16>(ModelOffset + i);
+		mServer->registers.insert(reg, reg);
+	}
+	mClient.reset(new ModbusTcpClient());
+	mClient->connectToServer(localHost(), mPort);
+	QElapsedTimer timer;
+	timer.start();
+	while (!mClient->isConnected() && timer.elapsed() < 5000)
+		qWait(10);
+	ASSERT_TRUE(mClient->isConnected());
+}
+
+void ModbusTcpClientTest::TearDown()
+{
+	mClient.reset();
+	mServer.reset();
+}
+
+bool ModbusTcpClientTest::waitForReplies(const QList<ModbusReply *> &replies, int timeout)
+{
+	QElapsedTimer timer;
+	timer.start();
+	for (;;) {
+		bool finished = true;
+		foreach (ModbusReply *reply, replies)
+			finished = finished && reply->isFinished();
+		if (finished)
+			return true;
+		if (timer.elapsed() >= timeout)
+			return false;
+		qWait(10);
+	}
+}
+
+bool ModbusTcpClientTest::waitForDisconnects(int count, int timeout)
+{
+	QElapsedTimer timer;
+	timer.start();
+	while (mDisconnectCount < count && timer.elapsed() < timeout)
+		qWait(10);
+	return mDisconnectCount >= count;
+}
+
+void ModbusTcpClientTest::expectRegisters(const ModbusReply *reply, quint16 startReg, int count)
+{
+	EXPECT_EQ(ModbusReply::NoException, reply->error());
+	QVector<quint16> values = reply->values();
+	ASSERT_EQ(count, values.size());
+	for (int i=0; i<count; ++i)
+		EXPECT_EQ(startReg + i, values[i]);
+}
@@ -0,0 +1,43 @@
+#ifndef MODBUSTCPCLIENTTEST_H
+#define MODBUSTCPCLIENTTEST_H
+
+#include <QList>
+#include <QObject>
+#include <QScopedPointer>
+#include <gtest/gtest.h>
+
+class ModbusReply;
+class ModbusStandInServer;
+class ModbusTcpClient;
+
+class ModbusTcpClientTest : public QObject, public testing::Test
+{
+	Q_OBJECT
+public slots:
+	void onReplyFinished();
+
+	void onDisconnected();
+
+protected:
+	virtual void SetUp();
+
+	virtual void TearDown();
+
+	/// Processes events until all replies have finished, or `timeout` ms have passed.
+	static bool waitForReplies(const QList<ModbusReply *> &replies, int timeout);
+
+	/// Processes events until `count` disconnects have been seen, or `timeout` ms have passed.
+	bool waitForDisconnects(int count, int timeout);
+
+	/// Checks that the reply holds `count` registers starting at `startReg`.
+	static void expectRegisters(const ModbusReply *reply, quint16 startReg, int count);
+
+	QScopedPointer<ModbusStandInServer> mServer;
+	QScopedPointer<ModbusTcpClient> mClient;
+	quint16 mPort;
+	/// Replies connected to `onReplyFinished`, in the order in which they finished.
+	QList<ModbusReply *> mFinished;
+	int mDisconnectCount;
+};
+
+#endif // MODBUSTCPCLIENTTEST_H
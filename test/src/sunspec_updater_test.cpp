@@ -0,0 +1,105 @@
+#include <qnumeric.h>
+#include <QElapsedTimer>
+#include <velib/vecan/products.h>
+#include "defines.h"
+#include "inverter.h"
+#include "inverter_settings.h"
+#include "modbus_stand_in_server.h"
+#include "sunspec_updater.h"
+#include "sunspec_updater_test.h"
+#include "test_helper.h"
+#include "ve_service.h"
+
+static const quint8 UnitId = 1;
+static const quint16 InverterModelOffset = 40070;
+static const quint16 ImmediateControlOffset = 40230;
+static const quint16 PowerLimitReg = ImmediateControlOffset + 5;
+static const quint16 PowerLimitRegCount = 5;
+
+TEST_F(SunspecUpdaterTest, ReadWriteNotSupported)
+{
+	mUpdater.reset(new SunspecUpdater(mInverter.data(), mSettings.data(), 0, mPort));
+	// The power limit is published after the limit registers have been read.
+	QElapsedTimer timer;
+	timer.start();
+	while (!qIsFinite(mInverter->powerLimit()) && timer.elapsed() < 5000)
+		qWait(10);
+	ASSERT_TRUE(qIsFinite(mInverter->powerLimit()));
+
+	setPowerLimit(2000);
+	ASSERT_TRUE(waitForWrites(1, 5000));
+	EXPECT_EQ(1, mServer->readWriteCount);
+	EXPECT_EQ(PowerLimitReg, mServer->writes[0].startReg);
+	EXPECT_EQ(40, mServer->writes[0].values[0]);
+
+	// The reply to the write has not been sent yet. This limit should not get lost.
+	setPowerLimit(3000);
+	ASSERT_TRUE(waitForWrites(2, 5000));
+	EXPECT_EQ(PowerLimitReg, mServer->writes[1].startReg);
+	EXPECT_EQ(60, mServer->writes[1].values[0]);
+
+	// A new updater uses the same connection, so function 23 is not tried again.
+	mUpdater.reset(new SunspecUpdater(mInverter.data(), mSettings.data(), 0, mPort));
+	setPowerLimit(1000);
+	ASSERT_TRUE(waitForWrites(3, 5000));
+	EXPECT_EQ(20, mServer->writes[2].values[0]);
+	EXPECT_EQ(1, mServer->readWriteCount);
+}
+
+void SunspecUpdaterTest::SetUp()
+{
+	mServer.reset(new ModbusStandInServer());
+	mPort = mServer->listen();
+	ASSERT_NE(0, mPort);
+	mServer->writeDelay = 300;
+	for (quint16 i=0; i<PowerLimitRegCount; ++i)
+		mServer->registers.insert(static_cast<quint16>(PowerLimitReg + i), 0);
+	mServer->registers.insert(InverterModelOffset, 101);
+	mServer->registers.insert(static_cast<quint16>(InverterModelOffset + 1), 50);
+
+	mItemProducer.reset(new VeProducer(VeQItems::getRoot(), "pub"));
+	mItemSubscriber.reset(new VeQItemProducer(VeQItems::getRoot(), "sub"));
+	DeviceInfo deviceInfo;
+	deviceInfo.productId = VE_PROD_ID_PV_INVERTER_FRONIUS;
+	deviceInfo.retrievalMode = ProtocolSunSpecIntSf;
+	deviceInfo.phaseCount = 1;
+	deviceInfo.hostName = "127.0.0.1";
+	deviceInfo.uniqueId = "757";
+	deviceInfo.networkId = UnitId;
+	deviceInfo.inverterModelOffset = InverterModelOffset;
+	deviceInfo.immediateControlOffset = ImmediateControlOffset;
+	deviceInfo.powerLimitScale = 100;
+	deviceInfo.maxPower = 5000;
+	VeQItem *root = mItemProducer->services()->itemGetOrCreate("com.victronenergy.pvinverter.test");
+	mInverter.reset(new Inverter(root, deviceInfo, 124));
+
+	VeQItem *settingsRoot = mItemSubscriber->services()->itemGetOrCreate("com.victronenergy.settings/Settings/Fronius/I124");
+	settingsRoot->itemGetOrCreate("Position")->setValue(static_cast<int>(Input2));
+	settingsRoot->itemGetOrCreate("Phase")->setValue(static_cast<int>(PhaseL1));
+	mSettings.reset(new InverterSettings(settingsRoot));
+}
+
+void SunspecUpdaterTest::TearDown()
+{
+	mUpdater.reset();
+	mSettings.reset();
+	mInverter.reset();
+	mItemProducer.reset();
+	mItemSubscriber.reset();
+	mServer.reset();
+}
+
+void SunspecUpdaterTest::setPowerLimit(double value)
+{
+	// Same path as a value set on the D-Bus.
+	mInverter->root()->itemGet("Ac/PowerLimit")->setValue(value);
+}
+
+bool SunspecUpdaterTest::waitForWrites(int count, int timeout)
+{
+	QElapsedTimer timer;
+	timer.start();
+	while (mServer->writes.size() < count && timer.elapsed() < timeout)
+		qWait(10);
+	return mServer->writes.size() >= count;
+}
@@ -0,0 +1,34 @@
+#ifndef SUNSPECUPDATERTEST_H
+#define SUNSPECUPDATERTEST_H
+
+#include <QScopedPointer>
+#include <gtest/gtest.h>
+
+class Inverter;
+class InverterSettings;
+class ModbusStandInServer;
+class SunspecUpdater;
+class VeQItemProducer;
+
+class SunspecUpdaterTest : public testing::Test
+{
+protected:
+	virtual void SetUp();
+
+	virtual void TearDown();
+
+	void setPowerLimit(double value);
+
+	/// Processes events until `count` writes have been received, or `timeout` ms have passed.
+	bool waitForWrites(int count, int timeout);
+
+	QScopedPointer<ModbusStandInServer> mServer;
+	QScopedPointer<VeQItemProducer> mItemProducer;
+	QScopedPointer<VeQItemProducer> mItemSubscriber;
+	QScopedPointer<Inverter> mInverter;
+	QScopedPointer<InverterSettings> mSettings;
+	QScopedPointer<SunspecUpdater> mUpdater;
+	quint16 mPort;
+};
+
+#endif // SUNSPECUPDATERTEST_H
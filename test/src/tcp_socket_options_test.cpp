@@ -0,0 +1,73 @@
+#include <QHostAddress>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <gtest/gtest.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include "tcp_socket_options.h"
+
+static int getTcpOption(QAbstractSocket &socket, int option)
+{
+	int value = -1;
+	socklen_t size = sizeof(value);
+	getsockopt(static_cast<int>(socket.socketDescriptor()), IPPROTO_TCP, option, &value, &size);
+	return value;
+}
+
+static int getSocketOption(QAbstractSocket &socket, int option)
+{
+	int value = -1;
+	socklen_t size = sizeof(value);
+	getsockopt(static_cast<int>(socket.socketDescriptor()), SOL_SOCKET, option, &value, &size);
+	return value;
+}
+
+TEST(TcpSocketOptionsTest, Apply)
+{
+	QTcpServer server;
+	ASSERT_TRUE(server.listen(QHostAddress::LocalHost));
+	QTcpSocket socket;
+	socket.connectToHost(QHostAddress::LocalHost, server.serverPort());
+	ASSERT_TRUE(socket.waitForConnected(1000));
+
+	TcpSocketOptions options;
+	options.keepAliveIdle = 7;
+	options.keepAliveInterval = 3;
+	options.keepAliveCount = 4;
+	options.userTimeout = 5000;
+	EXPECT_TRUE(options.apply(&socket));
+	EXPECT_EQ(1, socket.socketOption(QAbstractSocket::LowDelayOption).toInt());
+	EXPECT_EQ(1, socket.socketOption(QAbstractSocket::KeepAliveOption).toInt());
+	EXPECT_EQ(7, getTcpOption(socket, TCP_KEEPIDLE));
+	EXPECT_EQ(3, getTcpOption(socket, TCP_KEEPINTVL));
+	EXPECT_EQ(4, getTcpOption(socket, TCP_KEEPCNT));
+	EXPECT_EQ(5000, getTcpOption(socket, TCP_USER_TIMEOUT));
+}
+
+TEST(TcpSocketOptionsTest, BufferSizes)
+{
+	QTcpServer server;
+	ASSERT_TRUE(server.listen(QHostAddress::LocalHost));
+	QTcpSocket socket;
+	socket.connectToHost(QHostAddress::LocalHost, server.serverPort());
+	ASSERT_TRUE(socket.waitForConnected(1000));
+
+	TcpSocketOptions options;
+	options.receiveBufferSize = 8192;
+	options.sendBufferSize = 4096;
+	EXPECT_TRUE(options.apply(&socket));
+	// Linux doubles the value to allow for bookkeeping overhead.
+	int receiveBufferSize = getSocketOption(socket, SO_RCVBUF);
+	EXPECT_GE(receiveBufferSize, 8192);
+	EXPECT_LE(receiveBufferSize, 2 * 8192);
+	int sendBufferSize = getSocketOption(socket, SO_SNDBUF);
+	EXPECT_GE(sendBufferSize, 4096);
+	EXPECT_LE(sendBufferSize, 2 * 4096);
+}
+
+TEST(TcpSocketOptionsTest, NotConnected)
+{
+	QTcpSocket socket;
+	EXPECT_FALSE(TcpSocketOptions().apply(&socket));
+}